@@ -1,5 +1,5 @@
 @echo off
-set CompileFiles= ..\src\server.cpp ..\src\user.cpp ..\src\network.cpp ..\src\platform.cpp ..\src\logging.cpp
+set CompileFiles= ..\src\server.cpp ..\src\audio_level.cpp ..\src\user.cpp ..\src\network.cpp ..\src\platform.cpp ..\src\logging.cpp ..\src\timerwheel.cpp
 set CompileFlags= -nologo -Zi -Gm- -W4 -D_CRT_SECURE_NO_WARNINGS -DNOMINMAX -MTd -EHsc -Foobj/
 set IncludeDirs= -I..\thirdparty\include
 
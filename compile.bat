@@ -3,7 +3,7 @@
 For /f "tokens=1-4 delims=/ " %%a in ("%DATE%") do (set BuildDate=%%a-%%b-%%c)
 For /f "tokens=1-2 delims=/:/ " %%a in ("%TIME%") do (set BuildTime=%%a-%%b)
 FOR /f %%H IN ('git log -n 1 --oneline') DO set VersionHash=%%H
-set CompileFiles= ..\src\main.cpp ..\src\interface.cpp ..\src\render.cpp ..\src\audio.cpp ..\src\audio_resample.cpp ..\src\ringbuffer.cpp ..\src\platform.cpp ..\src\logging.cpp ..\src\user.cpp ..\src\user_client.cpp ..\src\network.cpp ..\src\network_client.cpp ..\src\video.cpp ..\src\videoinput.cpp ..\src\jitterbuffer.cpp
+set CompileFiles= ..\src\main.cpp ..\src\interface.cpp ..\src\render.cpp ..\src\audio.cpp ..\src\audio_buffer.cpp ..\src\audio_dtx.cpp ..\src\audio_level.cpp ..\src\audio_mix.cpp ..\src\audio_resample.cpp ..\src\audio_timestretch.cpp ..\src\ringbuffer.cpp ..\src\platform.cpp ..\src\logging.cpp ..\src\user.cpp ..\src\user_client.cpp ..\src\network.cpp ..\src\network_client.cpp ..\src\video.cpp ..\src\video_convert.cpp ..\src\video_fragment.cpp ..\src\threadpool.cpp ..\src\triplebuffer.cpp ..\src\bitrate_controller.cpp ..\src\videoinput.cpp ..\src\jitterbuffer.cpp
 set CompileFlags= -nologo -Zi -Gm- -W4 -wd4100 -D_CRT_SECURE_NO_WARNINGS -Od -DNOMINMAX -MTd -EHsc- -DBUILD_VERSION=\"%VersionHash%_%BuildDate%_%BuildTime%\" -DSOUNDIO_STATIC_LIBRARY -Foobj/
 set IncludeDirs= -I..\include -I..\thirdparty\include
 
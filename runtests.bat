@@ -2,7 +2,7 @@
 
 ctime -begin veek_test_time.ctm
 
-set CompileFiles= ..\test\main.cpp ..\test\audio_resample_test.cpp ..\test\ringbuffer_test.cpp ..\test\jitterbuffer_test.cpp ..\src\audio_resample.cpp ..\src\ringbuffer.cpp ..\src\jitterbuffer.cpp ..\src\platform.cpp ..\src\logging.cpp
+set CompileFiles= ..\test\main.cpp ..\test\audio_allocation_test.cpp ..\test\audio_dtx_test.cpp ..\test\audio_level_test.cpp ..\test\audio_mix_test.cpp ..\test\audio_resample_test.cpp ..\test\audio_timestretch_test.cpp ..\test\ringbuffer_test.cpp ..\test\spscringbuffer_test.cpp ..\test\spscqueue_test.cpp ..\test\jitterbuffer_test.cpp ..\test\video_convert_test.cpp ..\test\video_fragment_test.cpp ..\test\timerwheel_test.cpp ..\test\threadpool_test.cpp ..\test\triplebuffer_test.cpp ..\test\bitrate_controller_test.cpp ..\src\audio_buffer.cpp ..\src\audio_dtx.cpp ..\src\audio_level.cpp ..\src\audio_mix.cpp ..\src\audio_resample.cpp ..\src\audio_timestretch.cpp ..\src\video_convert.cpp ..\src\video_fragment.cpp ..\src\timerwheel.cpp ..\src\threadpool.cpp ..\src\triplebuffer.cpp ..\src\bitrate_controller.cpp ..\src\ringbuffer.cpp ..\src\jitterbuffer.cpp ..\src\platform.cpp ..\src\logging.cpp
 set CompileFlags= -nologo -Zi -Gm- -W4 -wd4100 -D_CRT_SECURE_NO_WARNINGS -Od -DNOMINMAX -MTd -EHsc- -Foobj/
 set IncludeDirs= -I..\include -I..\thirdparty\include -I..\src
 
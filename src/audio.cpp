@@ -2,13 +2,18 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <atomic>
 #include <unordered_map>
 
 #include "soundio/soundio.h"
 #include "opus/opus.h"
 
 #include "audio.h"
+#include "audio_dtx.h"
+#include "audio_level.h"
+#include "audio_mix.h"
 #include "audio_resample.h"
+#include "audio_timestretch.h"
 #include "common.h"
 #include "jitterbuffer.h"
 #include "logging.h"
@@ -17,6 +22,7 @@
 #include "network_client.h"
 #include "platform.h"
 #include "ringbuffer.h"
+#include "spscqueue.h"
 #include "unorderedlist.h"
 #include "user.h"
 #include "user_client.h"
@@ -30,6 +36,45 @@ static const int AUDIO_PACKET_FRAME_SIZE = (AUDIO_PACKET_DURATION_MS * Audio::NE
 //       to notice if we're somehow reliant on the size of the buffer.
 static int RING_BUFFER_SIZE = 1 << 18;
 
+// NOTE: The output callback mixes its sources together in blocks of (at most) this many frames,
+//       reading each block out of each source's ring buffer at once.
+static const int OUTPUT_MIX_BLOCK_SIZE = 256;
+
+// NOTE: Each 20ms frame is encoded separately, but several of them can be packed together into a
+//       single network packet (with the Opus repacketizer) to reduce the per-packet overhead.
+//       Opus never produces more than 1275 bytes for a single frame (plus its 1-byte header), and
+//       packing frames together adds at most a few bytes of header for the frame count and lengths.
+static const int AUDIO_MAX_ENCODED_FRAME_BYTES = 1276;
+static const int AUDIO_MAX_ENCODED_BYTES = Audio::AUDIO_MAX_FRAMES_PER_PACKET*AUDIO_MAX_ENCODED_FRAME_BYTES + 8;
+
+// NOTE: We send this many silence markers at the start of each silence, so that receivers still
+//       find out about it if some of them are lost.
+static const int AUDIO_SILENCE_MARKER_COUNT = 3;
+
+// NOTE: The audio thread wakes up whenever the input callback has captured a packet's worth of
+//       audio, but if there is no input (or the input is disabled) then it still needs to run
+//       regularly to produce silence/tone input and to keep the output buffers topped up.
+static const uint32 AUDIO_THREAD_MAX_WAIT_MS = AUDIO_PACKET_DURATION_MS/2;
+
+// NOTE: The number of packets that can be waiting to be passed between the network (main) thread
+//       and the audio thread. Packets that don't fit are dropped, which should only happen if
+//       one of the threads stalls for more than a second or so.
+static const int AUDIO_QUEUE_CAPACITY = 64;
+
+// NOTE: The most packets that we will buffer for each user. The number that we actually aim to
+//       keep buffered adapts to the delays that we see on the network, up to this limit.
+static const int AUDIO_JITTER_BUFFER_CAPACITY = 12;
+
+// NOTE: When a user's jitter buffer has more (or fewer) packets than it wants, we speed up (or
+//       slow down) their audio by this fraction for each packet of difference, up to the maximum.
+//       Time-stretching doesn't change the pitch, but larger changes are still more noticeable.
+static const float AUDIO_CATCH_UP_RATE_PER_PACKET = 0.05f;
+static const float AUDIO_MAX_CATCH_UP_RATE = 0.2f;
+
+// NOTE: The encoder settings that we use until the bitrate controller tells us otherwise
+static const int AUDIO_DEFAULT_BITRATE = 24000;
+static const int AUDIO_DEFAULT_PACKET_LOSS_PERCENT = 5;
+
 struct AudioData
 {
     int inputDeviceCount;
@@ -46,9 +91,6 @@ struct AudioData
     bool isListeningToInput;
     ResampleStreamContext inputListenResampler;
 
-    Audio::AudioBuffer encodingBuffer; // Used for resampling before encoding, when necessary
-    Audio::AudioBuffer decodingBuffer; // Used for resampling after decoding, when necessary
-
     bool inputEnabled;
 
     float  currentBufferVolume;
@@ -56,40 +98,152 @@ struct AudioData
     Audio::MicActivationMode inputActivationMode;
 };
 
+// Passed from the network thread to the audio thread.
+// NOTE: Users are added and removed through the same queue as their packets so that the audio
+//       thread always sees a user before any of their packets.
+enum class AudioInMessageType
+{
+    AddUser,
+    RemoveUser,
+    Packet
+};
+
+struct AudioInMessage
+{
+    AudioInMessageType type;
+    UserIdentifier srcUser;
+    uint16 index;
+    uint8 audioLevel;
+    double arrivalTime; // The time at which the main thread received the packet
+    uint16 encodedDataLength;
+    uint8 encodedData[AUDIO_MAX_ENCODED_BYTES];
+};
+
+// Passed from the audio thread to the network thread, to be sent to every other user
+struct AudioOutMessage
+{
+    uint16 skippedFrameCount; // The number of frames since the previous packet that we didn't send
+    uint8 frameCount;
+    uint8 audioLevel;
+    uint16 encodedDataLength;
+    uint8 encodedData[AUDIO_MAX_ENCODED_BYTES];
+};
+
 struct UserAudioData
 {
     int32 sampleRate;
     ResampleStreamContext receiveResampler;
+    TimeStretchStreamContext timeStretcher;
     OpusDecoder* decoder;
-    RingBuffer* buffer;
+    SPSCRingBuffer* buffer;
     JitterBuffer* jitter;
 
+    // NOTE: The user isn't sending anything during a silence, so we play comfort noise instead
+    SilenceReceiveContext silence;
+    ComfortNoiseContext comfortNoise;
+
+    // NOTE: We only decode the users that are speaking the loudest, see selectActiveSpeakers()
+    SpeakerActivity speakerActivity;
+    bool decoding;
+
     uint64_t totalExpectedPackets;
     uint64_t lostPackets;
 };
 
 static AudioData audioState = {};
 
+// NOTE: The quality of the filter used to convert between the device and network sample rates
+static const ResampleQuality AUDIO_RESAMPLE_QUALITY = ResampleQuality::Medium;
+
 static ResampleStreamContext sendResampler;
 static RingBuffer* presendBuffer;
 static Audio::AudioBuffer micBuffer;
 
+// NOTE: Only used by the audio thread while decoding, for one user at a time
+static Audio::AudioBuffer decodedBuffer;
+static Audio::AudioBuffer stretchedBuffer;
+
+// NOTE: Only used by the output callback
+static MixLimiterContext outputLimiter;
+
 static SoundIo* soundio = 0;
 static OpusEncoder* encoder = 0;
 
+// NOTE: Only used by the audio thread, to pack our encoded frames together before sending them
+//       and to split received packets back into their individual frames for the jitter buffers.
+//       The repacketizer only stores pointers to the frames, so they're kept in pendingFrameData.
+static OpusRepacketizer* sendRepacketizer = nullptr;
+static OpusRepacketizer* receiveRepacketizer = nullptr;
+static uint8 pendingFrameData[Audio::AUDIO_MAX_FRAMES_PER_PACKET][AUDIO_MAX_ENCODED_FRAME_BYTES];
+static int pendingFrameCount;
+
+// NOTE: Only used by the audio thread, to decide which of our frames don't need to be sent
+static VoiceActivityContext inputVoiceActivity;
+static uint16 skippedFrameCount;
+static int silenceMarkersSent; // Since we last sent a frame with audio in it
+static bool hasSentAudioFrame;
+static uint8 lastSentFrameHeader; // The Opus TOC byte of the last frame that we sent
+static float pendingPacketRms; // The loudest of the frames that we've packed so far
+static bool pendingPacketVoiceActive;
+
 static SoundIoDevice* inDevice = 0;
 static SoundIoInStream* inStream = 0;
-static RingBuffer* inBuffer = 0;
+static SPSCRingBuffer* inBuffer = 0; // Written by the input callback, read by the audio thread
 
 static SoundIoDevice* outDevice = 0;
 static SoundIoOutStream* outStream = 0;
 
 static UnorderedList<RingBuffer*> sourceList(10);
 
-static RingBuffer* listenBuffer;
+static SPSCRingBuffer* listenBuffer; // Written by the audio thread, read by the output callback
+
+// NOTE: Encoding, decoding and the jitter buffers all live on the audio thread, so that audio
+//       latency doesn't depend on how long the main thread spends on video or the network.
+//       Incoming packets and user changes are passed to it through networkToAudioQueue and our
+//       own encoded packets are passed back for sending through audioToNetworkQueue.
+static Platform::Thread* audioThread = nullptr;
+static Platform::Event* audioThreadWakeEvent = nullptr;
+static std::atomic<bool> audioThreadRunning;
+static SPSCQueue<AudioInMessage>* networkToAudioQueue = nullptr;
+static SPSCQueue<AudioOutMessage>* audioToNetworkQueue = nullptr;
+
+// NOTE: Set by the main thread, tells the audio thread whether there is anybody to send audio to
+static std::atomic<bool> audioSendEnabled;
+// NOTE: Computed by the audio thread, read by the interface
+static std::atomic<float> audioPacketLoss;
+static std::atomic<float> audioJitterMs;
+static std::atomic<float> audioPlayoutDelayMs;
+static std::atomic<int> outputSampleRate;
+// NOTE: Set by the main thread, applied to the encoder by the audio thread when they change
+static std::atomic<int> targetEncoderBitrate;
+static std::atomic<int> targetEncoderPacketLossPercent;
+static std::atomic<int> targetFramesPerPacket;
+static std::atomic<bool> framePackingEnabled;
+static int currentEncoderBitrate;
+static int currentEncoderPacketLossPercent;
 
 // TODO: We should probably just use std::map here? Which is a tree, so iteration would be significantly faster (probably?)
+// NOTE: This is only modified by the audio thread, which holds audioUsersLock while doing so.
+//       The main thread must hold the lock while reading it. The output callback doesn't read it
+//       at all, see outputSources.
 static std::unordered_map<UserIdentifier, UserAudioData> audioUsers;
+static Platform::Mutex* audioUsersLock = nullptr;
+
+// NOTE: The output callback mustn't wait for a lock, so the audio thread publishes the list of
+//       buffers that it should mix (one for each user) by swapping between two copies of it.
+//       After each swap, the audio thread waits for any callback that might still be reading the
+//       old copy to finish before it changes that copy again or destroys any of its buffers.
+struct OutputSourceList
+{
+    int count;
+    SPSCRingBuffer* buffers[MAX_USERS];
+};
+static OutputSourceList outputSourceLists[2];
+static std::atomic<OutputSourceList*> outputSources;
+static std::atomic<bool> outputCallbackActive;
+static std::atomic<uint32> outputCallbackCount; // The number of output callbacks that have finished
+
+static int audioThreadEntryPoint(void*);
 
 // NOTE: We assume all audio is mono.
 //       Input devices are opened as mono and output devices have the same sample copied to all
@@ -169,16 +323,69 @@ static void inReadCallback(SoundIoInStream* stream, int frameCountMin, int frame
         }
         framesRemaining -= frameCount;
     }
+
+    int samplesPerPacket = (AUDIO_PACKET_DURATION_MS*inBuffer->sampleRate)/1000;
+    if(inBuffer->count() >= samplesPerPacket)
+    {
+        Platform::SignalEvent(audioThreadWakeEvent);
+    }
+}
+
+// Write the same samples to every channel of the output
+static void writeOutputBlock(SoundIoChannelArea* areas, int channelCount, const float* block, int length)
+{
+    // NOTE: Most backends give us a single buffer of interleaved samples, which we can fill in one go
+    bool interleaved = true;
+    for(int channel=0; channel<channelCount; channel++)
+    {
+        if((areas[channel].ptr != areas[0].ptr + channel*sizeof(float)) ||
+           (areas[channel].step != channelCount*(int)sizeof(float)))
+        {
+            interleaved = false;
+            break;
+        }
+    }
+
+    if(interleaved)
+    {
+        mixInterleave(block, length, channelCount, (float*)areas[0].ptr);
+    }
+    else
+    {
+        for(int channel=0; channel<channelCount; channel++)
+        {
+            char* channelPtr = areas[channel].ptr;
+            for(int frame=0; frame<length; frame++)
+            {
+                *((float*)channelPtr) = block[frame];
+                channelPtr += areas[channel].step;
+            }
+        }
+    }
+
+    for(int channel=0; channel<channelCount; channel++)
+    {
+        areas[channel].ptr += areas[channel].step*length;
+    }
 }
 
 static void outWriteCallback(SoundIoOutStream* stream, int frameCountMin, int frameCountMax)
 {
+    // NOTE: These must be sequentially consistent, see publishOutputSources()
+    outputCallbackActive = true;
+    OutputSourceList* sources = outputSources;
+
     int samplesPerFrame = (AUDIO_PACKET_DURATION_MS*stream->sample_rate)/1000;
     int framesRemaining = clamp(samplesPerFrame, frameCountMin, frameCountMax);
     //logTerm("Write callback! %d - %d => %d\n", frameCountMin, frameCountMax, framesRemaining);
     int channelCount = stream->layout.channel_count;
     SoundIoChannelArea* outArea;
 
+    if(outputLimiter.SampleRate != stream->sample_rate)
+    {
+        mixLimiterInit(outputLimiter, stream->sample_rate);
+    }
+
     while(framesRemaining > 0)
     {
         int frameCount = framesRemaining;
@@ -189,43 +396,42 @@ static void outWriteCallback(SoundIoOutStream* stream, int frameCountMin, int fr
             break;
         }
 
-        for(int frame=0; frame<frameCount; ++frame)
+        for(int blockStart=0; blockStart<frameCount; blockStart+=OUTPUT_MIX_BLOCK_SIZE)
         {
-            // TODO: Proper audio mixing. Reading: http://www.voegler.eu/pub/audio/digital-audio-mixing-and-normalization.html
-            float val = 0.0f;
+            // NOTE: Sources are simply summed, and the limiter keeps the sum from clipping if
+            //       several of them are loud at once (rather than scaling every source down and
+            //       making the common case of a single speaker quieter).
+            //       Reading: http://www.voegler.eu/pub/audio/digital-audio-mixing-and-normalization.html
+            int blockLength = min(OUTPUT_MIX_BLOCK_SIZE, frameCount-blockStart);
+            float mixBlock[OUTPUT_MIX_BLOCK_SIZE] = {};
+            float sourceBlock[OUTPUT_MIX_BLOCK_SIZE];
             if(audioState.isListeningToInput)
             {
-                // NOTE: This will not modify val if there is no data available in listenBuffer.
-                listenBuffer->read(&val);
+                // NOTE: This will leave the rest of mixBlock as silence if listenBuffer runs out.
+                listenBuffer->read(mixBlock, blockLength);
             }
 
-            for(auto userKV : audioUsers)
+            for(int sourceIndex=0; sourceIndex<sources->count; sourceIndex++)
             {
-                UserAudioData& user = userKV.second;
-
-                float temp;
-                user.buffer->read(&temp);
-                val += temp;
+                int sourceLength = sources->buffers[sourceIndex]->read(sourceBlock, blockLength);
+                mixAddBlock(mixBlock, sourceBlock, sourceLength);
             }
             for(int sourceIndex=0; sourceIndex<sourceList.size(); sourceIndex++)
             {
-                // NOTE: This will not modify temp if there is no data available in listenBuffer.
-                float temp = 0.0f;
-                sourceList[sourceIndex]->read(&temp);
-                val += temp;
+                int sourceLength = sourceList[sourceIndex]->read(sourceBlock, blockLength);
+                mixAddBlock(mixBlock, sourceBlock, sourceLength);
             }
 
-            for(int channel=0; channel<channelCount; ++channel)
-            {
-                float* samplePtr = (float*)outArea[channel].ptr;
-                *samplePtr = val;
-                outArea[channel].ptr += outArea[channel].step;
-            }
+            mixLimiterApply(outputLimiter, mixBlock, blockLength);
+            writeOutputBlock(outArea, channelCount, mixBlock, blockLength);
         }
 
         soundio_outstream_end_write(stream);
         framesRemaining -= frameCount;
     }
+
+    outputCallbackCount++;
+    outputCallbackActive = false;
 }
 
 static void inOverflowCallback(SoundIoInStream* stream)
@@ -248,25 +454,35 @@ static void outErrorCallback(SoundIoOutStream* stream, int error)
     logWarn("Output error on stream from %s: %s\n", stream->device->name, soundio_strerror(error));
 }
 
+// Decode a single packet into targetAudioBuffer. A null source buffer produces packet loss
+// concealment instead. If decodeFEC is set then the source packet must be the one *after* the
+// packet that was lost, and the lost packet is recovered from the redundant (in-band FEC)
+// data that Opus included in it.
 static void decodeSingleFrame(OpusDecoder* decoder,
-                              int sourceLength, uint8_t* sourceBufferPtr,
+                              int sourceLength, uint8_t* sourceBufferPtr, bool decodeFEC,
                               Audio::AudioBuffer& targetAudioBuffer)
 {
     assert(targetAudioBuffer.Capacity >= AUDIO_PACKET_FRAME_SIZE);
     assert(targetAudioBuffer.SampleRate == Audio::NETWORK_SAMPLE_RATE);
+    assert(!decodeFEC || (sourceBufferPtr != nullptr));
 
+    // NOTE: When decoding FEC data, the frame size must be exactly the duration of the lost audio
     int packetLength = sourceLength;
-    int correctErrors = 0; // TODO: What value do we actually want here?
+    int targetFrameSize = decodeFEC ? AUDIO_PACKET_FRAME_SIZE : targetAudioBuffer.Capacity;
     int framesDecoded = opus_decode_float(decoder,
                                           sourceBufferPtr, packetLength,
-                                          targetAudioBuffer.Data, targetAudioBuffer.Capacity,
-                                          correctErrors);
+                                          targetAudioBuffer.Data, targetFrameSize,
+                                          decodeFEC ? 1 : 0);
     targetAudioBuffer.Length = framesDecoded;
 
     if(framesDecoded < 0)
     {
         logWarn("Error decoding audio data. Error %d\n", framesDecoded);
     }
+    else if(framesDecoded > 0 && decodeFEC)
+    {
+        logDbug("We got %d frames from FEC!\n", framesDecoded);
+    }
     else if(framesDecoded > 0 && sourceBufferPtr == nullptr)
     {
         logDbug("We got %d frames from PLC!\n", framesDecoded);
@@ -326,49 +542,215 @@ void Audio::PlayTestSound()
     sourceList.insert(sampleSource);
 }
 
-void Audio::AddAudioUser(UserIdentifier userId)
+// Give the output callback the current list of users' buffers to mix.
+// NOTE: When this returns, the output callback is no longer using any buffers that aren't in the list.
+static void publishOutputSources()
+{
+    OutputSourceList* oldSources = outputSources;
+    OutputSourceList* newSources = (oldSources == &outputSourceLists[0]) ? &outputSourceLists[1]
+                                                                         : &outputSourceLists[0];
+    newSources->count = 0;
+    for(auto& iter : audioUsers)
+    {
+        if(newSources->count < MAX_USERS)
+        {
+            newSources->buffers[newSources->count++] = iter.second.buffer;
+        }
+    }
+    outputSources = newSources;
+
+    // NOTE: A callback that starts after the swap sees the new list, because the callback marks
+    //       itself as active before reading the list and we check whether it is active after
+    //       swapping it (and all of these are sequentially consistent). Any callback that is
+    //       still using the old list must have started before the swap, so once the callback
+    //       count changes it has finished. Callbacks are short, so we won't wait for long.
+    uint32 callbackCount = outputCallbackCount;
+    while(outputCallbackActive && (outputCallbackCount == callbackCount))
+    {
+        Platform::SleepForMilliseconds(1);
+    }
+}
+
+static void addAudioUser(UserIdentifier userId)
 {
     logInfo("Added audio user with ID: %d\n", userId);
     int32 opusError;
     int32 channels = 1;
     UserAudioData newUser = {};
-    newUser.decoder = opus_decoder_create(NETWORK_SAMPLE_RATE, channels, &opusError);
+    newUser.decoder = opus_decoder_create(Audio::NETWORK_SAMPLE_RATE, channels, &opusError);
     logInfo("Opus decoder created: %d\n", opusError);
 
-    newUser.buffer = new RingBuffer(outStream->sample_rate, RING_BUFFER_SIZE);
-    newUser.jitter = new JitterBuffer();
-
+    newUser.buffer = new SPSCRingBuffer(outputSampleRate, RING_BUFFER_SIZE);
+    newUser.jitter = new JitterBuffer(AUDIO_JITTER_BUFFER_CAPACITY, AUDIO_MAX_ENCODED_FRAME_BYTES,
+                                     AUDIO_PACKET_DURATION_MS/1000.0);
+    newUser.receiveResampler.Quality = AUDIO_RESAMPLE_QUALITY;
+    timeStretchInit(newUser.timeStretcher, Audio::NETWORK_SAMPLE_RATE);
+    silenceReceiveInit(newUser.silence);
+    comfortNoiseInit(newUser.comfortNoise, Audio::NETWORK_SAMPLE_RATE);
+    speakerActivityInit(newUser.speakerActivity);
+    newUser.decoding = false;
+
+    Platform::LockMutex(audioUsersLock);
+    // NOTE: The output device may have changed since we created the buffer
+    newUser.buffer->sampleRate = outputSampleRate;
     audioUsers[userId] = newUser;
+    Platform::UnlockMutex(audioUsersLock);
+    publishOutputSources();
 }
 
-void Audio::RemoveAudioUser(UserIdentifier userId)
+static void removeAudioUser(UserIdentifier userId)
 {
     auto oldUserIter = audioUsers.find(userId);
     if(oldUserIter == audioUsers.end())
         return;
 
-    UserAudioData& oldUser = oldUserIter->second;
+    UserAudioData oldUser = oldUserIter->second;
+    Platform::LockMutex(audioUsersLock);
+    audioUsers.erase(oldUserIter);
+    Platform::UnlockMutex(audioUsersLock);
+    publishOutputSources();
+
+    // NOTE: Nothing else can be reading the user's buffers once they're out of the output sources
+    delete oldUser.buffer;
     delete oldUser.jitter;
     if(oldUser.decoder)
     {
         opus_decoder_destroy(oldUser.decoder);
     }
-    audioUsers.erase(userId);
+}
+
+static void pushNetworkToAudioMessage(AudioInMessageType type, UserIdentifier userId,
+                                      uint16 index, uint8 audioLevel,
+                                      uint16 encodedDataLength, uint8* encodedData)
+{
+    AudioInMessage* message = networkToAudioQueue->BeginPush();
+    if(type != AudioInMessageType::Packet)
+    {
+        // NOTE: Dropping user changes would leave the audio thread out of sync with the network,
+        //       so we wait for room instead. The queue only fills up if the audio thread stalls,
+        //       and users join or leave far too rarely for this to hold up the main thread.
+        while((message == nullptr) && audioThreadRunning)
+        {
+            Platform::SignalEvent(audioThreadWakeEvent);
+            Platform::SleepForMilliseconds(1);
+            message = networkToAudioQueue->BeginPush();
+        }
+    }
+    if(message == nullptr)
+    {
+        logWarn("Audio thread is not keeping up, dropping message for user %d\n", userId);
+        return;
+    }
+
+    message->type = type;
+    message->srcUser = userId;
+    message->index = index;
+    message->audioLevel = audioLevel;
+    message->arrivalTime = Platform::SecondsSinceStartup();
+    message->encodedDataLength = encodedDataLength;
+    if(encodedDataLength > 0)
+    {
+        memcpy(message->encodedData, encodedData, encodedDataLength);
+    }
+    networkToAudioQueue->CommitPush();
+}
+
+void Audio::AddAudioUser(UserIdentifier userId)
+{
+    pushNetworkToAudioMessage(AudioInMessageType::AddUser, userId, 0, AUDIO_LEVEL_SILENT, 0, nullptr);
+}
+
+void Audio::RemoveAudioUser(UserIdentifier userId)
+{
+    pushNetworkToAudioMessage(AudioInMessageType::RemoveUser, userId, 0, AUDIO_LEVEL_SILENT, 0, nullptr);
 }
 
 void Audio::ProcessIncomingPacket(NetworkAudioPacket& packet)
 {
-    auto srcUserIter = audioUsers.find(packet.srcUser);
-    if(srcUserIter == audioUsers.end())
+    if(packet.encodedDataLength > AUDIO_MAX_ENCODED_BYTES)
+    {
+        logWarn("Received an audio packet of %d bytes from user %d, which is too large\n",
+                packet.encodedDataLength, packet.srcUser);
+        return;
+    }
+
+    pushNetworkToAudioMessage(AudioInMessageType::Packet, packet.srcUser,
+                              packet.index, packet.audioLevel,
+                              packet.encodedDataLength, packet.encodedData);
+}
+
+// Split a received packet into its individual frames and add each of them to the jitter buffer.
+// NOTE: The packet's index is the index of its first frame, the frames after it have consecutive
+//       indices. This means that the jitter buffer only ever deals with single frames, regardless
+//       of how many frames the sender is packing together.
+static void addPacketToJitterBuffer(UserAudioData& srcUser, AudioInMessage& message)
+{
+    opus_repacketizer_init(receiveRepacketizer);
+    int error = opus_repacketizer_cat(receiveRepacketizer, message.encodedData, message.encodedDataLength);
+    if(error != OPUS_OK)
     {
-        logWarn("Received an audio packet from unknown user ID %d\n", packet.srcUser);
+        logWarn("Received an invalid audio packet %d from user %d. Error %d\n",
+                message.index, message.srcUser, error);
         return;
     }
 
-    UserAudioData& srcUser = srcUserIter->second;
-    logDbug("Received audio packet %d for user %d\n", packet.index, packet.srcUser);
+    int frameCount = opus_repacketizer_get_nb_frames(receiveRepacketizer);
+    if(frameCount == 1)
+    {
+        srcUser.jitter->Add(message.index, message.encodedDataLength, message.encodedData,
+                            message.arrivalTime);
+        return;
+    }
 
-    srcUser.jitter->Add(packet.index, packet.encodedDataLength, packet.encodedData);
+    for(int frameIndex=0; frameIndex<frameCount; frameIndex++)
+    {
+        uint8 frameData[AUDIO_MAX_ENCODED_FRAME_BYTES];
+        int frameLength = opus_repacketizer_out_range(receiveRepacketizer, frameIndex, frameIndex+1,
+                                                      frameData, AUDIO_MAX_ENCODED_FRAME_BYTES);
+        if(frameLength <= 0)
+        {
+            logWarn("Failed to unpack frame %d of audio packet %d. Error %d\n",
+                    frameIndex, message.index, frameLength);
+            continue;
+        }
+
+        uint16 frameIndexInStream = (uint16)(message.index + frameIndex);
+        srcUser.jitter->Add(frameIndexInStream, (uint16)frameLength, frameData, message.arrivalTime);
+    }
+}
+
+static void processNetworkToAudioMessages()
+{
+    AudioInMessage* message;
+    while((message = networkToAudioQueue->Peek()) != nullptr)
+    {
+        switch(message->type)
+        {
+            case AudioInMessageType::AddUser:
+                addAudioUser(message->srcUser);
+                break;
+
+            case AudioInMessageType::RemoveUser:
+                removeAudioUser(message->srcUser);
+                break;
+
+            case AudioInMessageType::Packet:
+            {
+                auto srcUserIter = audioUsers.find(message->srcUser);
+                if(srcUserIter == audioUsers.end())
+                {
+                    logWarn("Received an audio packet from unknown user ID %d\n", message->srcUser);
+                    break;
+                }
+
+                UserAudioData& srcUser = srcUserIter->second;
+                logDbug("Received audio packet %d for user %d\n", message->index, message->srcUser);
+                addPacketToJitterBuffer(srcUser, *message);
+                speakerActivityUpdate(srcUser.speakerActivity, message->audioLevel, message->arrivalTime);
+            } break;
+        }
+        networkToAudioQueue->Pop();
+    }
 }
 
 bool Audio::enableMicrophone(bool enabled)
@@ -547,11 +929,14 @@ bool Audio::SetAudioOutputDevice(int newOutputDevice)
     logInfo("  Format: %s\n", soundio_format_string(outStream->format));
 
     listenBuffer->sampleRate = outStream->sample_rate;
+    Platform::LockMutex(audioUsersLock);
+    outputSampleRate = outStream->sample_rate;
     for(auto& iter : audioUsers)
     {
         UserAudioData& user = iter.second;
         user.buffer->sampleRate = outStream->sample_rate;
     }
+    Platform::UnlockMutex(audioUsersLock);
 
     return true;
 }
@@ -818,8 +1203,26 @@ bool Audio::Setup()
     opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(6));
     opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
     opus_encoder_ctl(encoder, OPUS_SET_APPLICATION(OPUS_APPLICATION_VOIP));
-    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(24000));
-    opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(5));
+    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(AUDIO_DEFAULT_BITRATE));
+    opus_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(1));
+    opus_encoder_ctl(encoder, OPUS_SET_DTX(1));
+    opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(AUDIO_DEFAULT_PACKET_LOSS_PERCENT));
+    currentEncoderBitrate = AUDIO_DEFAULT_BITRATE;
+    currentEncoderPacketLossPercent = AUDIO_DEFAULT_PACKET_LOSS_PERCENT;
+    targetEncoderBitrate = AUDIO_DEFAULT_BITRATE;
+    targetEncoderPacketLossPercent = AUDIO_DEFAULT_PACKET_LOSS_PERCENT;
+    targetFramesPerPacket = 1;
+    framePackingEnabled = true;
+
+    sendRepacketizer = opus_repacketizer_create();
+    receiveRepacketizer = opus_repacketizer_create();
+    pendingFrameCount = 0;
+    vadInit(inputVoiceActivity, NETWORK_SAMPLE_RATE);
+    skippedFrameCount = 0;
+    silenceMarkersSent = 0;
+    hasSentAudioFrame = false;
+    pendingPacketRms = 0.0f;
+    pendingPacketVoiceActive = false;
 
     opus_int32 complexity;
     opus_int32 bitrate;
@@ -827,24 +1230,50 @@ bool Audio::Setup()
     opus_encoder_ctl(encoder, OPUS_GET_BITRATE(&bitrate));
     logInfo("Complexity=%d, Bitrate=%d\n", complexity, bitrate);
 
-    audioState.encodingBuffer = AudioBuffer(2880);
-    audioState.encodingBuffer.SampleRate = NETWORK_SAMPLE_RATE;
-
-    audioState.decodingBuffer = AudioBuffer(2880);
-    audioState.decodingBuffer.SampleRate = NETWORK_SAMPLE_RATE;
-
     // Initialize the current devices to null so that we will connect automatically when we 
     // get a list of connected devices
     audioState.currentInputDevice = -1;
     audioState.currentOutputDevice = -1;
 
-    inBuffer = new RingBuffer(NETWORK_SAMPLE_RATE, RING_BUFFER_SIZE);
-    listenBuffer = new RingBuffer(1, RING_BUFFER_SIZE);
+    inBuffer = new SPSCRingBuffer(NETWORK_SAMPLE_RATE, RING_BUFFER_SIZE);
+    listenBuffer = new SPSCRingBuffer(1, RING_BUFFER_SIZE);
+
+    audioUsersLock = Platform::CreateMutex();
+    outputSourceLists[0].count = 0;
+    outputSources = &outputSourceLists[0];
+    outputCallbackActive = false;
+    outputCallbackCount = 0;
+    audioThreadWakeEvent = Platform::CreateEvent();
+    networkToAudioQueue = new SPSCQueue<AudioInMessage>(AUDIO_QUEUE_CAPACITY);
+    audioToNetworkQueue = new SPSCQueue<AudioOutMessage>(AUDIO_QUEUE_CAPACITY);
+    audioSendEnabled = false;
+    audioPacketLoss = 0.0f;
+    audioJitterMs = 0.0f;
+    audioPlayoutDelayMs = 0.0f;
+    outputSampleRate = NETWORK_SAMPLE_RATE;
 
     micBuffer = Audio::AudioBuffer(AUDIO_PACKET_FRAME_SIZE);
     micBuffer.SampleRate = NETWORK_SAMPLE_RATE;
+
+    TimeStretchStreamContext timeStretchLimits;
+    timeStretchInit(timeStretchLimits, NETWORK_SAMPLE_RATE);
+    decodedBuffer = Audio::AudioBuffer(AUDIO_PACKET_FRAME_SIZE);
+    decodedBuffer.SampleRate = NETWORK_SAMPLE_RATE;
+    stretchedBuffer = Audio::AudioBuffer(timeStretchMaxOutputLength(timeStretchLimits, AUDIO_PACKET_FRAME_SIZE));
+    stretchedBuffer.SampleRate = NETWORK_SAMPLE_RATE;
     presendBuffer = new RingBuffer(NETWORK_SAMPLE_RATE, RING_BUFFER_SIZE);
 
+    sendResampler = {};
+    sendResampler.Quality = AUDIO_RESAMPLE_QUALITY;
+    audioState.inputListenResampler.Quality = AUDIO_RESAMPLE_QUALITY;
+
+    // NOTE: These are by far the most common device sample rates, so we compute their filters
+    //       now rather than stalling the audio update the first time that we need them.
+    resamplePrecomputeFilters(44100, NETWORK_SAMPLE_RATE, AUDIO_RESAMPLE_QUALITY);
+    resamplePrecomputeFilters(NETWORK_SAMPLE_RATE, 44100, AUDIO_RESAMPLE_QUALITY);
+    resamplePrecomputeFilters(16000, NETWORK_SAMPLE_RATE, AUDIO_RESAMPLE_QUALITY);
+    resamplePrecomputeFilters(NETWORK_SAMPLE_RATE, 16000, AUDIO_RESAMPLE_QUALITY);
+
     logInfo("Initializing libsoundio %s\n", soundio_version_string());
     soundio = soundio_create();
     if(!soundio)
@@ -874,45 +1303,177 @@ bool Audio::Setup()
     logInfo("SoundIO event queue flushed\n");
     // TODO: Check the supported input/output formats
 
+    audioThreadRunning = true;
+    audioThread = Platform::CreateThread(audioThreadEntryPoint, nullptr);
+    if(!audioThread)
+    {
+        logFail("Unable to create the audio thread\n");
+        audioThreadRunning = false;
+        soundio_destroy(soundio);
+        return false;
+    }
+
     return true;
 }
 
-static Audio::NetworkAudioPacket* CreateOutputPacket(Audio::AudioBuffer& sourceBuffer)
+void Audio::SendAudioToAllUsers(NetworkAudioPacket& audioPacket, int frameCount)
 {
-    assert(sourceBuffer.Length == AUDIO_PACKET_FRAME_SIZE);
-    assert(sourceBuffer.SampleRate == Audio::NETWORK_SAMPLE_RATE);
+    if(remoteUsers.size() == 0)
+    {
+        return;
+    }
+
+    // NOTE: Every user receives the same packet (with the same index), so we only need to
+    //       serialize it once and ENet can share the same data between all of the sends.
+    //       The index counts frames rather than packets, so that receivers can unpack each
+    //       frame into the right place in their jitter buffer.
+    audioPacket.index = localUser->lastSentAudioPacket;
+    localUser->lastSentAudioPacket += (uint16)frameCount;
+    logDbug("Send audio packet %d to %d users\n", audioPacket.index, (int)remoteUsers.size());
+
+    size_t payloadBytes = sizeof(audioPacket.srcUser) + sizeof(audioPacket.index) +
+                          sizeof(audioPacket.audioLevel) +
+                          sizeof(audioPacket.encodedDataLength) + audioPacket.encodedDataLength;
+    NetworkOutPacket outPacket = createNetworkOutPacket(NET_MSGTYPE_AUDIO, payloadBytes);
+    audioPacket.serialize(outPacket);
+
+    Network::SendToRoom(outPacket, 0, false);
+}
+
+// Send all of the frames that we've packed together so far as a single packet
+static void flushPendingAudioFrames()
+{
+    if(pendingFrameCount == 0)
+    {
+        return;
+    }
 
-    Audio::NetworkAudioPacket* audioPacket = new Audio::NetworkAudioPacket();
-    audioPacket->srcUser = localUser->ID;
+    AudioOutMessage* message = audioToNetworkQueue->BeginPush();
+    int packetLength = 0;
+    if(message != nullptr)
+    {
+        packetLength = opus_repacketizer_out(sendRepacketizer, message->encodedData, AUDIO_MAX_ENCODED_BYTES);
+        if(packetLength < 0)
+        {
+            logWarn("Error packing %d audio frames together. Error %d\n", pendingFrameCount, packetLength);
+        }
+    }
+    else
+    {
+        logWarn("Network thread is not keeping up, dropping outgoing audio packet\n");
+    }
 
-    int audioBytes = encodeSingleFrame(sourceBuffer, AUDIO_PACKET_FRAME_SIZE, audioPacket->encodedData);
-    audioPacket->encodedDataLength = audioBytes;
+    if(packetLength > 0)
+    {
+        message->skippedFrameCount = skippedFrameCount;
+        message->frameCount = (uint8)pendingFrameCount;
+        message->audioLevel = audioLevelEncode(pendingPacketRms, pendingPacketVoiceActive);
+        message->encodedDataLength = (uint16)packetLength;
+        audioToNetworkQueue->CommitPush();
+        skippedFrameCount = 0;
+    }
+    else
+    {
+        // NOTE: The receivers still need to know how many frames we didn't send, so that the
+        //       indices of the frames in our later packets are right.
+        skippedFrameCount += (uint16)pendingFrameCount;
+    }
 
-    return audioPacket;
+    opus_repacketizer_init(sendRepacketizer);
+    pendingFrameCount = 0;
+    pendingPacketRms = 0.0f;
+    pendingPacketVoiceActive = false;
 }
 
-void Audio::SendAudioToUser(ClientUserData* user, NetworkAudioPacket* audioPacket)
+// Add the encoded frame (stored in the next pending frame slot) to the packet that we're building,
+// and send the packet if it's full.
+static void packAudioFrame(int frameLength)
 {
-    audioPacket->index = user->lastSentAudioPacket++;
-    logDbug("Send audio packet %d to user %d\n", audioPacket->index, user->ID);
+    uint8* frameData = pendingFrameData[pendingFrameCount];
+    int error = opus_repacketizer_cat(sendRepacketizer, frameData, frameLength);
+    if(error != OPUS_OK)
+    {
+        // NOTE: Frames can only be packed together if they have the same mode and bandwidth, which
+        //       the encoder can change from one frame to the next (e.g when the bitrate changes).
+        //       In that case we send what we have and start a new packet with this frame.
+        flushPendingAudioFrames();
+        memmove(pendingFrameData[0], frameData, frameLength);
+        frameData = pendingFrameData[0];
+        error = opus_repacketizer_cat(sendRepacketizer, frameData, frameLength);
+        if(error != OPUS_OK)
+        {
+            logWarn("Unable to pack an encoded audio frame. Error %d\n", error);
+            skippedFrameCount++;
+            return;
+        }
+    }
+    pendingFrameCount++;
 
-    NetworkOutPacket outPacket = createNetworkOutPacket(NET_MSGTYPE_AUDIO);
-    audioPacket->serialize(outPacket);
+    int framesPerPacket = framePackingEnabled ? (int)targetFramesPerPacket : 1;
+    if(pendingFrameCount >= framesPerPacket)
+    {
+        flushPendingAudioFrames();
+    }
+}
 
-    outPacket.send(user->netPeer, 0, false);
+// Don't send the current frame, because there's nothing in it worth hearing.
+// NOTE: The first few frames of each silence are sent as markers (frames with a header but no
+//       audio data, which is what Opus itself produces in DTX mode), so that receivers know that
+//       the frames missing after them are silence rather than packet loss. We send the first
+//       marker along with any frames still waiting to be packed, so that the end of what was said
+//       isn't held back until the next time somebody speaks.
+static void skipAudioFrame()
+{
+    if(hasSentAudioFrame && (silenceMarkersSent < AUDIO_SILENCE_MARKER_COUNT))
+    {
+        silenceMarkersSent++;
+        pendingFrameData[pendingFrameCount][0] = lastSentFrameHeader;
+        packAudioFrame(1);
+        flushPendingAudioFrames();
+    }
+    else
+    {
+        flushPendingAudioFrames();
+        skippedFrameCount++;
+    }
 }
 
-static void ProduceASingleAudioOutputPacket()
+// Encode micBuffer and add it to the packet that we're building
+static void encodeAudioFrame(float rms, bool voiceActive)
 {
-    micBuffer.Length = 0;
-    for(int i=0; i<AUDIO_PACKET_FRAME_SIZE; i++)
+    uint8* frameData = pendingFrameData[pendingFrameCount];
+    int frameLength = encodeSingleFrame(micBuffer, AUDIO_MAX_ENCODED_FRAME_BYTES, frameData);
+    if(frameLength <= 0)
+    {
+        skippedFrameCount++;
+        return;
+    }
+
+    // NOTE: In DTX mode, the encoder tells us that the frame doesn't need to be sent by encoding
+    //       it in only one or two bytes (it still sends a full frame every so often to update the
+    //       receivers' comfort noise).
+    if(frameLength <= AUDIO_SILENCE_FRAME_BYTES)
     {
-        micBuffer.Length += presendBuffer->read(&micBuffer.Data[micBuffer.Length]);
+        skipAudioFrame();
+        return;
     }
+
+    silenceMarkersSent = 0;
+    hasSentAudioFrame = true;
+    lastSentFrameHeader = frameData[0];
+    pendingPacketRms = maxf(pendingPacketRms, rms);
+    pendingPacketVoiceActive = pendingPacketVoiceActive || voiceActive;
+    packAudioFrame(frameLength);
+}
+
+static void ProduceASingleAudioOutputPacket()
+{
+    micBuffer.Length = presendBuffer->read(micBuffer.Data, AUDIO_PACKET_FRAME_SIZE);
     assert(micBuffer.Length == AUDIO_PACKET_FRAME_SIZE);
 
     float rms = ComputeRMS(micBuffer);
     audioState.currentBufferVolume = rms;
+    bool voiceActive = vadProcess(inputVoiceActivity, micBuffer.Data, micBuffer.Length);
     switch(audioState.inputActivationMode)
     {
         case Audio::MicActivationMode::Always:
@@ -924,7 +1485,7 @@ static void ProduceASingleAudioOutputPacket()
             break;
 
         case Audio::MicActivationMode::Automatic:
-            audioState.inputActive = (rms >= 0.1f);
+            audioState.inputActive = voiceActive;
             break;
 
         default:
@@ -940,15 +1501,22 @@ static void ProduceASingleAudioOutputPacket()
             resampleBuffer2Ring(audioState.inputListenResampler, micBuffer, *listenBuffer);
         }
 
-        if(audioState.inputActive && Network::IsConnectedToMasterServer())
+        // NOTE: When we're not sending, we don't even encode, which saves a lot more CPU time
+        //       than the encoder's own DTX (that only works out what doesn't need to be sent).
+        if(audioSendEnabled)
         {
-            Audio::NetworkAudioPacket* audioPacket = CreateOutputPacket(micBuffer);
-            for(int i=0; i<remoteUsers.size(); i++)
+            if(audioState.inputActive)
+            {
+                encodeAudioFrame(rms, voiceActive);
+            }
+            else
             {
-                ClientUserData* destinationUser = remoteUsers[i];
-                Audio::SendAudioToUser(destinationUser, audioPacket);
+                skipAudioFrame();
             }
-            delete audioPacket;
+        }
+        else
+        {
+            flushPendingAudioFrames();
         }
 
         micBuffer.Length = 0;
@@ -960,126 +1528,292 @@ static void ProduceASingleAudioOutputPacket()
 }
 
 float Audio::GetPacketLoss()
+{
+    return audioPacketLoss;
+}
+
+void Audio::SetEncoderSettings(int bitrate, int expectedPacketLossPercent, int framesPerPacket)
+{
+    targetEncoderBitrate = bitrate;
+    targetEncoderPacketLossPercent = expectedPacketLossPercent;
+    targetFramesPerPacket = clamp(framesPerPacket, 1, AUDIO_MAX_FRAMES_PER_PACKET);
+}
+
+void Audio::EnableFramePacking(bool enabled)
+{
+    framePackingEnabled = enabled;
+}
+
+bool Audio::IsFramePackingEnabled()
+{
+    return framePackingEnabled;
+}
+
+static void applyEncoderSettings()
+{
+    int bitrate = targetEncoderBitrate;
+    if(bitrate != currentEncoderBitrate)
+    {
+        opus_encoder_ctl(encoder, OPUS_SET_BITRATE(bitrate));
+        currentEncoderBitrate = bitrate;
+        logDbug("Audio encoder bitrate set to %d\n", bitrate);
+    }
+
+    int packetLossPercent = targetEncoderPacketLossPercent;
+    if(packetLossPercent != currentEncoderPacketLossPercent)
+    {
+        opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(packetLossPercent));
+        currentEncoderPacketLossPercent = packetLossPercent;
+        logDbug("Audio encoder expected packet loss set to %d%%\n", packetLossPercent);
+    }
+}
+
+float Audio::GetJitterMs()
+{
+    return audioJitterMs;
+}
+
+float Audio::GetPlayoutDelayMs()
+{
+    return audioPlayoutDelayMs;
+}
+
+static void updatePacketLoss()
 {
     uint64_t total = 0;
     uint64_t lost = 0;
+    float maxJitterMs = 0.0f;
+    int maxTargetItemCount = 0;
     for(auto& iter : audioUsers)
     {
         UserAudioData& user = iter.second;
         total += user.totalExpectedPackets;
         lost += user.lostPackets;
+
+        JitterBufferStats jitterStats = user.jitter->Stats();
+        maxJitterMs = maxf(maxJitterMs, jitterStats.jitterMs);
+        maxTargetItemCount = max(maxTargetItemCount, jitterStats.targetItemCount);
     }
+    audioJitterMs = maxJitterMs;
+    audioPlayoutDelayMs = (float)(maxTargetItemCount*AUDIO_PACKET_DURATION_MS);
 
     if(total == 0)
     {
-        return 0.0f;
+        audioPacketLoss = 0.0f;
+    }
+    else
+    {
+        audioPacketLoss = lost * 1.0f/total;
     }
-    return lost * 1.0f/total;
 }
 
-void Audio::Update()
+// Fill presendBuffer with whatever input we're currently sending (be it from the microphone,
+// a generated tone or silence) and encode as many packets from it as we can.
+static void produceAudioOutput(double& nextGeneratedInputTime)
 {
-    soundio_flush_events(soundio);
-
-    if(audioState.generateToneInput)
+    double currentTime = Platform::SecondsSinceStartup();
+    if(audioState.generateToneInput || !audioState.inputEnabled)
     {
-        // NOTE: We need to clear the input buffer here because otherwise it will fill up and when
-        //       we disable tone input, we'll send a huge number of packets at once.
-        inBuffer->clear();
+        if(audioState.generateToneInput)
+        {
+            // NOTE: We need to clear the input buffer here because otherwise it will fill up and when
+            //       we disable tone input, we'll send a huge number of packets at once.
+            inBuffer->clear();
+        }
 
-        double twopi = 2.0*3.1415927;
-        double frequency = 261.6; // Middle C
-        double timestep = 1.0/presendBuffer->sampleRate;
-        static double sampleTime = 0.0;
-        for(int sampleIndex=0; sampleIndex<AUDIO_PACKET_FRAME_SIZE; sampleIndex++)
+        // NOTE: We get woken up at irregular intervals when there is no input to drive us, so we
+        //       generate input according to how much time has passed rather than per wake-up.
+        while(nextGeneratedInputTime <= currentTime)
         {
-            double sinVal = 0.05 * sin(frequency*twopi*sampleTime);
-            presendBuffer->write((float)sinVal);
-            sampleTime += timestep;
+            if(audioState.generateToneInput)
+            {
+                double twopi = 2.0*3.1415927;
+                double frequency = 261.6; // Middle C
+                double timestep = 1.0/presendBuffer->sampleRate;
+                static double sampleTime = 0.0;
+                for(int sampleIndex=0; sampleIndex<AUDIO_PACKET_FRAME_SIZE; sampleIndex++)
+                {
+                    double sinVal = 0.05 * sin(frequency*twopi*sampleTime);
+                    presendBuffer->write((float)sinVal);
+                    sampleTime += timestep;
+                }
+            }
+            else
+            {
+                float silence[AUDIO_PACKET_FRAME_SIZE] = {};
+                presendBuffer->write(silence, AUDIO_PACKET_FRAME_SIZE);
+            }
+            nextGeneratedInputTime += AUDIO_PACKET_DURATION_MS/1000.0;
         }
     }
-    else if(audioState.inputEnabled)
+    else
     {
         // TODO: Rename the resampler to something that makes more sense.
         resampleRing2Ring(sendResampler, *inBuffer, *presendBuffer);
-    }
-    else
-    {
-        for(int sampleIndex=0; sampleIndex<AUDIO_PACKET_FRAME_SIZE; sampleIndex++)
-        {
-            presendBuffer->write(0.0f);
-        }
+        nextGeneratedInputTime = currentTime;
     }
 
     while(presendBuffer->count() >= AUDIO_PACKET_FRAME_SIZE)
     {
         ProduceASingleAudioOutputPacket();
     }
+}
+
+// Decide which users we want to hear, based on the audio levels that they sent with their packets
+static void selectSpeakers()
+{
+    SpeakerActivity* speakers[MAX_USERS];
+    int speakerCount = 0;
+    for(auto& iter : audioUsers)
+    {
+        if(speakerCount < MAX_USERS)
+        {
+            speakers[speakerCount++] = &iter.second.speakerActivity;
+        }
+    }
+    selectActiveSpeakers(speakers, speakerCount, MAX_ACTIVE_SPEAKERS, Platform::SecondsSinceStartup());
+}
+
+// Decode enough audio from each user's jitter buffer to keep their output buffer topped up
+static void decodeAudioInput()
+{
+    selectSpeakers();
     for(auto& iter : audioUsers)
     {
         UserAudioData& srcUser = iter.second;
+        if(!srcUser.speakerActivity.Selected)
+        {
+            // NOTE: We don't decode users that we aren't going to hear, but we still keep their
+            //       jitter buffer at the right depth so that we can start again without a delay.
+            uint8_t* discardedData;
+            while(srcUser.jitter->ItemCount() > srcUser.jitter->DesiredItemCount())
+            {
+                srcUser.jitter->Get(&discardedData);
+            }
+            srcUser.decoding = false;
+            continue;
+        }
+        if(!srcUser.decoding)
+        {
+            // NOTE: The decoder's state is from whenever we last heard this user, which might be
+            //       a while ago, so we shouldn't use it to predict their audio now.
+            opus_decoder_ctl(srcUser.decoder, OPUS_RESET_STATE);
+            srcUser.decoding = true;
+        }
 
         while(srcUser.buffer->count() <= 2*AUDIO_PACKET_FRAME_SIZE)
         {
             uint8_t* dataToDecode = nullptr;
             uint16_t dataToDecodeLen = srcUser.jitter->Get(&dataToDecode);
-            AudioBuffer tempBuffer = {};
-            tempBuffer.Capacity = AUDIO_PACKET_FRAME_SIZE;
-            tempBuffer.Data = new float[tempBuffer.Capacity];
-            tempBuffer.SampleRate = NETWORK_SAMPLE_RATE;
-
-            if(srcUser.totalExpectedPackets >= 100)
-            {
-                srcUser.totalExpectedPackets /= 2;
-                srcUser.lostPackets /= 2;
-            }
-            srcUser.totalExpectedPackets++;
+            uint8_t* nextData = nullptr;
+            uint16_t nextDataLen = 0;
             if(dataToDecodeLen == 0)
             {
-                srcUser.lostPackets++;
+                nextDataLen = srcUser.jitter->Peek(&nextData);
             }
 
-            decodeSingleFrame(srcUser.decoder,
-                              dataToDecodeLen, dataToDecode,
-                              tempBuffer);
-
-            int bufferItemOffset = srcUser.jitter->ItemCount() - srcUser.jitter->DesiredItemCount();
-            if(bufferItemOffset > 1) // We have more items than we would like, speed up
+            if(silenceReceiveFrame(srcUser.silence, dataToDecodeLen, nextDataLen))
             {
-                ResampleStreamContext speedResampler = srcUser.receiveResampler;
-                double slowDown = -0.15;
-                AudioBuffer longBuffer = {};
-                longBuffer.Capacity = AUDIO_PACKET_FRAME_SIZE*5;
-                longBuffer.Data = new float[longBuffer.Capacity];
-                longBuffer.SampleRate = (int)(NETWORK_SAMPLE_RATE*(1+slowDown));
-                resampleBuffer2Buffer(speedResampler, tempBuffer, longBuffer);
-                longBuffer.SampleRate = NETWORK_SAMPLE_RATE;
-
-                resampleBuffer2Ring(srcUser.receiveResampler, longBuffer, *srcUser.buffer);
-                delete[] longBuffer.Data;
+                // NOTE: Packets that the user deliberately didn't send don't count as lost
+                comfortNoiseGenerate(srcUser.comfortNoise, decodedBuffer.Data, AUDIO_PACKET_FRAME_SIZE);
+                decodedBuffer.Length = AUDIO_PACKET_FRAME_SIZE;
             }
-            else if(bufferItemOffset < -1) // We have fewer items than we would like, slow down
+            else
             {
-                ResampleStreamContext speedResampler = srcUser.receiveResampler;
-                double slowDown = 0.15;
-                AudioBuffer longBuffer = {};
-                longBuffer.Capacity = AUDIO_PACKET_FRAME_SIZE*5;
-                longBuffer.Data = new float[longBuffer.Capacity];
-                longBuffer.SampleRate = (int)(NETWORK_SAMPLE_RATE*(1+slowDown));
-                resampleBuffer2Buffer(speedResampler, tempBuffer, longBuffer);
-                longBuffer.SampleRate = NETWORK_SAMPLE_RATE;
-
-                resampleBuffer2Ring(srcUser.receiveResampler, longBuffer, *srcUser.buffer);
-                delete[] longBuffer.Data;
-            }
-            else // Just play it as-is
-            {
-                resampleBuffer2Ring(srcUser.receiveResampler, tempBuffer, *srcUser.buffer);
+                if(srcUser.totalExpectedPackets >= 100)
+                {
+                    srcUser.totalExpectedPackets /= 2;
+                    srcUser.lostPackets /= 2;
+                }
+                srcUser.totalExpectedPackets++;
+                bool decodeFEC = false;
+                if(dataToDecodeLen == 0)
+                {
+                    srcUser.lostPackets++;
+
+                    // NOTE: Each packet carries a lower-quality copy of the previous one, so if the
+                    //       next packet has already arrived then we can recover most of this one.
+                    //       The next packet stays in the jitter buffer to be decoded normally.
+                    dataToDecode = nextData;
+                    dataToDecodeLen = nextDataLen;
+                    decodeFEC = (dataToDecodeLen > 0);
+                    if(!decodeFEC)
+                    {
+                        dataToDecode = nullptr;
+                    }
+                }
+
+                decodeSingleFrame(srcUser.decoder,
+                                  dataToDecodeLen, dataToDecode, decodeFEC,
+                                  decodedBuffer);
+
+                if(decodedBuffer.Length <= 0)
+                {
+                    // NOTE: We'd spin forever trying to fill the output buffer if decoding keeps failing
+                    break;
+                }
+
+                // NOTE: We only learn what the background noise sounds like from audio that we received
+                if((dataToDecode != nullptr) && !decodeFEC)
+                {
+                    comfortNoiseAnalyse(srcUser.comfortNoise, decodedBuffer.Data, decodedBuffer.Length);
+                }
             }
-            delete[] tempBuffer.Data;
+
+            int bufferItemOffset = srcUser.jitter->ItemCount() - srcUser.jitter->DesiredItemCount();
+            float speedChange = clampf(bufferItemOffset*AUDIO_CATCH_UP_RATE_PER_PACKET,
+                                       -AUDIO_MAX_CATCH_UP_RATE, AUDIO_MAX_CATCH_UP_RATE);
+            timeStretchBuffer2Buffer(srcUser.timeStretcher, decodedBuffer, stretchedBuffer, speedChange);
+            resampleBuffer2Ring(srcUser.receiveResampler, stretchedBuffer, *srcUser.buffer);
         }
     }
 
+    updatePacketLoss();
+}
+
+static int audioThreadEntryPoint(void*)
+{
+    logInfo("Audio thread started\n");
+    double nextGeneratedInputTime = Platform::SecondsSinceStartup();
+    while(audioThreadRunning)
+    {
+        // NOTE: The input callback signals us as soon as it has captured a packet's worth of audio
+        Platform::WaitForEvent(audioThreadWakeEvent, AUDIO_THREAD_MAX_WAIT_MS);
+
+        processNetworkToAudioMessages();
+        applyEncoderSettings();
+        produceAudioOutput(nextGeneratedInputTime);
+        decodeAudioInput();
+    }
+    logInfo("Audio thread stopped\n");
+    return 0;
+}
+
+void Audio::Update()
+{
+    soundio_flush_events(soundio);
+
+    audioSendEnabled = Network::IsConnectedToMasterServer() && (remoteUsers.size() > 0);
+
+    AudioOutMessage* message;
+    while((message = audioToNetworkQueue->Peek()) != nullptr)
+    {
+        // NOTE: We may have disconnected since the audio thread encoded this packet
+        if(audioSendEnabled && (message->encodedDataLength > 0))
+        {
+            NetworkAudioPacket audioPacket;
+            audioPacket.srcUser = localUser->ID;
+            audioPacket.audioLevel = message->audioLevel;
+            audioPacket.encodedDataLength = message->encodedDataLength;
+            audioPacket.encodedData = message->encodedData;
+            // NOTE: Frames that we didn't send still take up indices, so that receivers can tell
+            //       how much time has passed between the packets that we do send.
+            localUser->lastSentAudioPacket += message->skippedFrameCount;
+            SendAudioToAllUsers(audioPacket, message->frameCount);
+        }
+        audioToNetworkQueue->Pop();
+    }
+
     // NOTE: This technically could run while we're reading audio data from sourceList in the
     //       output callback, but that probably isn't a problem because it'd just mean that
     //       we skip one callback's worth of audio for a handful of sources.
@@ -1121,6 +1855,14 @@ void Audio::Shutdown()
     // TODO: Should we check that the mutexes are free at the moment? IE that any callbacks that
     //       may have been in progress when we stopped running, have finished
 
+    if(audioThread)
+    {
+        audioThreadRunning = false;
+        Platform::SignalEvent(audioThreadWakeEvent);
+        Platform::JoinThread(audioThread);
+        audioThread = nullptr;
+    }
+
     if(inStream)
     {
         soundio_instream_pause(inStream, true);
@@ -1144,8 +1886,20 @@ void Audio::Shutdown()
     }
     soundio_destroy(soundio);
     opus_encoder_destroy(encoder);
+    opus_repacketizer_destroy(sendRepacketizer);
+    opus_repacketizer_destroy(receiveRepacketizer);
 
     sourceList.pointerClear();
+
+    // NOTE: The streams (and therefore their callbacks) are gone, so nothing else can be using these
+    while(!audioUsers.empty())
+    {
+        removeAudioUser(audioUsers.begin()->first);
+    }
+    delete networkToAudioQueue;
+    delete audioToNetworkQueue;
+    Platform::DestroyEvent(audioThreadWakeEvent);
+    Platform::DestroyMutex(audioUsersLock);
 }
 
 float Audio::ComputeRMS(AudioBuffer& buffer)
@@ -1168,31 +1922,13 @@ float Audio::GetInputVolume()
     return audioState.currentBufferVolume;
 }
 
-Audio::AudioBuffer::AudioBuffer(int initialCapacity)
-{
-    Data = new float[initialCapacity];
-    Capacity = initialCapacity;
-    Length = 0;
-}
-
-Audio::AudioBuffer::~AudioBuffer()
-{
-    if(Data)
-    {
-        // TODO: We obviously can't do this if we're passing AudioBuffers arround by value
-        // delete[] Data;
-    }
-}
-
 template<typename Packet>
 bool Audio::NetworkAudioPacket::serialize(Packet& packet)
 {
     packet.serializeuint16(this->srcUser);
     packet.serializeuint16(this->index);
-    packet.serializeuint16(this->encodedDataLength);
-    packet.serializebytes(this->encodedData, this->encodedDataLength);
-
-    return true;
+    packet.serializeuint8(this->audioLevel);
+    return packet.serializebytesview(this->encodedData, this->encodedDataLength);
 }
 template bool Audio::NetworkAudioPacket::serialize(NetworkInPacket& packet);
 template bool Audio::NetworkAudioPacket::serialize(NetworkOutPacket& packet);
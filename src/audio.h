@@ -16,6 +16,12 @@ namespace Audio
     // NOTE: This should a sample rate that is supported by opus (e.g 48k, 24k)
     const int32 NETWORK_SAMPLE_RATE = 48000;
 
+    // NOTE: The most (20ms) frames that we will pack into a single network packet
+    const int AUDIO_MAX_FRAMES_PER_PACKET = 3;
+
+    // NOTE: AudioBuffers own their data, so they can be moved but not copied.
+    //       Buffers are allocated once up front and then reused, the audio thread and callbacks
+    //       should never need to create them.
     struct AudioBuffer
     {
         float* Data;
@@ -24,9 +30,14 @@ namespace Audio
 
         int SampleRate;
 
-        AudioBuffer() = default;
+        AudioBuffer();
         explicit AudioBuffer(int initialCapacity);
+        AudioBuffer(AudioBuffer&& other);
+        AudioBuffer& operator=(AudioBuffer&& other);
         ~AudioBuffer();
+
+        AudioBuffer(const AudioBuffer&) = delete;
+        AudioBuffer& operator=(const AudioBuffer&) = delete;
     };
 
     enum class MicActivationMode
@@ -39,9 +50,10 @@ namespace Audio
     struct NetworkAudioPacket
     {
         UserIdentifier srcUser;
-        uint16 index;
+        uint16 index; // The index of the first (20ms) frame in the packet
+        uint8 audioLevel; // How loud the packet is, see audio_level.h
         uint16 encodedDataLength;
-        uint8 encodedData[2400]; // TODO: Sizing (currently =2400=micBufferLen from main.cpp)
+        uint8* encodedData; // Points into the network packet when receiving, not owned by the packet
 
         template<typename Packet> bool serialize(Packet& packet);
     };
@@ -62,6 +74,22 @@ namespace Audio
 
     float GetPacketLoss();
 
+    // Return the largest jitter (variation in packet delay) and the largest target playout delay
+    // (the audio we keep buffered to cover that jitter) of any of the users that we're receiving from.
+    float GetJitterMs();
+    float GetPlayoutDelayMs();
+
+    // Change the bitrate of the audio that we send, the percentage of packets that we expect
+    // to be lost (which determines how much in-band FEC data Opus includes) and the number of
+    // 20ms frames that we pack into each network packet.
+    // NOTE: This can be called from any thread, the encoder picks up the change before its next packet.
+    void SetEncoderSettings(int bitrate, int expectedPacketLossPercent, int framesPerPacket);
+
+    // Packing frames together reduces the number of packets (and so the header overhead) that we
+    // send, at the cost of latency. When disabled, every frame is sent in its own packet.
+    void EnableFramePacking(bool enabled);
+    bool IsFramePackingEnabled();
+
     void GenerateToneInput(bool generateTone);
     void ListenToInput(bool listen);
     void PlayTestSound();
@@ -86,7 +114,7 @@ namespace Audio
 
     void ProcessIncomingPacket(NetworkAudioPacket& packet);
 
-    void SendAudioToUser(ClientUserData* user, NetworkAudioPacket* audioPacket);
+    void SendAudioToAllUsers(NetworkAudioPacket& audioPacket, int frameCount);
 
     // Returns the root-mean-square amplitude of the samples in buffer.
     float ComputeRMS(AudioBuffer& buffer);
@@ -0,0 +1,51 @@
+#include "audio.h"
+
+Audio::AudioBuffer::AudioBuffer()
+{
+    Data = nullptr;
+    Capacity = 0;
+    Length = 0;
+    SampleRate = 0;
+}
+
+Audio::AudioBuffer::AudioBuffer(int initialCapacity)
+{
+    Data = new float[initialCapacity];
+    Capacity = initialCapacity;
+    Length = 0;
+    SampleRate = 0;
+}
+
+Audio::AudioBuffer::AudioBuffer(AudioBuffer&& other)
+{
+    Data = other.Data;
+    Capacity = other.Capacity;
+    Length = other.Length;
+    SampleRate = other.SampleRate;
+
+    other.Data = nullptr;
+    other.Capacity = 0;
+    other.Length = 0;
+}
+
+Audio::AudioBuffer& Audio::AudioBuffer::operator=(AudioBuffer&& other)
+{
+    if(this != &other)
+    {
+        delete[] Data;
+        Data = other.Data;
+        Capacity = other.Capacity;
+        Length = other.Length;
+        SampleRate = other.SampleRate;
+
+        other.Data = nullptr;
+        other.Capacity = 0;
+        other.Length = 0;
+    }
+    return *this;
+}
+
+Audio::AudioBuffer::~AudioBuffer()
+{
+    delete[] Data;
+}
@@ -0,0 +1,243 @@
+#include <assert.h>
+#include <math.h>
+
+#include "audio_dtx.h"
+#include "math_utils.h"
+
+// NOTE: Anything quieter than this is silence, regardless of how quiet the background is
+static const float VAD_MIN_SPEECH_DB = -55.0f;
+// NOTE: Harmonic buffers this far above the noise floor are speech, as are any buffers that
+//       are loud enough above the noise floor (which catches unvoiced speech).
+static const float VAD_SPEECH_SNR_DB = 8.0f;
+static const float VAD_LOUD_SNR_DB = 20.0f;
+static const float VAD_MIN_HARMONICITY = 0.5f;
+static const int VAD_HANGOVER_MS = 300;
+
+// NOTE: The noise floor follows the energy down quickly but only rises slowly, so that it settles
+//       on the quiet gaps between words rather than on the words themselves. It still rises while
+//       we think that somebody is speaking, otherwise a lasting increase in the background noise
+//       would be treated as speech forever.
+static const float VAD_NOISE_FLOOR_FALL_RATE = 0.3f;
+static const float VAD_NOISE_FLOOR_RISE_DB_PER_SECOND = 2.0f;
+
+// NOTE: We search for the pitch period on a decimated copy of the input, which is plenty
+//       for the range of pitches that we're interested in and much cheaper to search.
+static const int VAD_DECIMATION = 4;
+static const int VAD_MIN_PITCH_HZ = 80;
+static const int VAD_MAX_PITCH_HZ = 400;
+static const int VAD_MAX_DECIMATED_LENGTH = 512;
+
+static const float COMFORT_NOISE_FALL_RATE = 0.5f;
+static const float COMFORT_NOISE_RISE_DB_PER_SECOND = 1.0f;
+static const float COMFORT_NOISE_CORRELATION_RATE = 0.3f;
+static const float COMFORT_NOISE_MAX_CORRELATION = 0.99f;
+// NOTE: Background noise is never this loud, so if we measure it as such then something has
+//       gone wrong and we would rather play quiet noise than loud noise.
+static const float COMFORT_NOISE_MAX_LEVEL = 0.03f;
+
+// NOTE: Missing this many consecutive frames (of 20ms each) is far more likely to be a silence
+//       whose markers were all lost than a network outage. Even if it is an outage, there's
+//       nothing left for packet loss concealment to do by this point.
+static const int SILENCE_MAX_MISSING_FRAMES = 10;
+
+static float decibels(float meanSquare)
+{
+    return 10.0f*log10f(meanSquare + 1e-12f);
+}
+
+// Returns the largest normalized autocorrelation of the signal over the range of pitch periods
+// of speech. This is close to 1 for a periodic (harmonic) signal and close to 0 for noise.
+static float harmonicity(int sampleRate, const float* samples, int length)
+{
+    float decimated[VAD_MAX_DECIMATED_LENGTH];
+    int decimatedLength = min(length/VAD_DECIMATION, VAD_MAX_DECIMATED_LENGTH);
+    for(int i=0; i<decimatedLength; i++)
+    {
+        const float* source = samples + i*VAD_DECIMATION;
+        float sum = 0.0f;
+        for(int j=0; j<VAD_DECIMATION; j++)
+        {
+            sum += source[j];
+        }
+        decimated[i] = sum;
+    }
+
+    int decimatedRate = sampleRate/VAD_DECIMATION;
+    int minLag = decimatedRate/VAD_MAX_PITCH_HZ;
+    int maxLag = min(decimatedRate/VAD_MIN_PITCH_HZ, decimatedLength/2);
+    float result = 0.0f;
+    for(int lag=minLag; lag<=maxLag; lag++)
+    {
+        float correlation = 0.0f;
+        float energyA = 0.0f;
+        float energyB = 0.0f;
+        for(int i=lag; i<decimatedLength; i++)
+        {
+            correlation += decimated[i]*decimated[i-lag];
+            energyA += decimated[i]*decimated[i];
+            energyB += decimated[i-lag]*decimated[i-lag];
+        }
+
+        float normalization = sqrtf(energyA*energyB);
+        if(normalization > 0.0f)
+        {
+            result = maxf(result, correlation/normalization);
+        }
+    }
+    return result;
+}
+
+void vadInit(VoiceActivityContext& ctx, int sampleRate)
+{
+    ctx.SampleRate = sampleRate;
+    ctx.HasNoiseFloor = false;
+    ctx.NoiseFloorDb = VAD_MIN_SPEECH_DB;
+    ctx.HangoverRemaining = 0;
+}
+
+bool vadProcess(VoiceActivityContext& ctx, const float* samples, int length)
+{
+    assert(length > 0);
+    float sumSquares = 0.0f;
+    for(int i=0; i<length; i++)
+    {
+        sumSquares += samples[i]*samples[i];
+    }
+    float energyDb = decibels(sumSquares/length);
+
+    if(!ctx.HasNoiseFloor)
+    {
+        ctx.HasNoiseFloor = true;
+        ctx.NoiseFloorDb = energyDb;
+    }
+    float snrDb = energyDb - ctx.NoiseFloorDb;
+
+    bool isSpeech = false;
+    if((energyDb >= VAD_MIN_SPEECH_DB) && (snrDb >= VAD_SPEECH_SNR_DB))
+    {
+        // NOTE: The harmonicity is by far the most expensive part, so we only check it if we need to
+        isSpeech = (snrDb >= VAD_LOUD_SNR_DB) ||
+                   (harmonicity(ctx.SampleRate, samples, length) >= VAD_MIN_HARMONICITY);
+    }
+
+    if(energyDb < ctx.NoiseFloorDb)
+    {
+        ctx.NoiseFloorDb += (energyDb - ctx.NoiseFloorDb)*VAD_NOISE_FLOOR_FALL_RATE;
+    }
+    else
+    {
+        float maxRiseDb = VAD_NOISE_FLOOR_RISE_DB_PER_SECOND*length/ctx.SampleRate;
+        ctx.NoiseFloorDb += minf(energyDb - ctx.NoiseFloorDb, maxRiseDb);
+    }
+
+    if(isSpeech)
+    {
+        ctx.HangoverRemaining = (VAD_HANGOVER_MS*ctx.SampleRate)/1000;
+        return true;
+    }
+    else if(ctx.HangoverRemaining > 0)
+    {
+        ctx.HangoverRemaining = max(0, ctx.HangoverRemaining - length);
+        return true;
+    }
+    return false;
+}
+
+void comfortNoiseInit(ComfortNoiseContext& ctx, int sampleRate)
+{
+    ctx.SampleRate = sampleRate;
+    ctx.Level = 0.0f;
+    ctx.Correlation = 0.0f;
+    ctx.FilterState = 0.0f;
+    ctx.Seed = 0x12345678;
+}
+
+void comfortNoiseAnalyse(ComfortNoiseContext& ctx, const float* samples, int length)
+{
+    assert(length > 1);
+    float sumSquares = 0.0f;
+    float sumProducts = 0.0f;
+    for(int i=0; i<length; i++)
+    {
+        sumSquares += samples[i]*samples[i];
+    }
+    for(int i=1; i<length; i++)
+    {
+        sumProducts += samples[i]*samples[i-1];
+    }
+    float rms = sqrtf(sumSquares/length);
+
+    // NOTE: Like the noise floor in the VAD, the level follows the quietest audio that we receive
+    if((ctx.Level == 0.0f) || (rms < ctx.Level))
+    {
+        bool hasLevel = (ctx.Level > 0.0f);
+        ctx.Level = hasLevel ? ctx.Level + (rms - ctx.Level)*COMFORT_NOISE_FALL_RATE : rms;
+    }
+    else
+    {
+        float riseDb = COMFORT_NOISE_RISE_DB_PER_SECOND*length/ctx.SampleRate;
+        ctx.Level = minf(rms, ctx.Level*powf(10.0f, riseDb/20.0f));
+    }
+    ctx.Level = minf(ctx.Level, COMFORT_NOISE_MAX_LEVEL);
+
+    // NOTE: Only the spectrum of the background noise matters, not that of any speech
+    if((sumSquares > 0.0f) && (rms <= 2.0f*ctx.Level))
+    {
+        float correlation = clampf(sumProducts/sumSquares, 0.0f, COMFORT_NOISE_MAX_CORRELATION);
+        ctx.Correlation += (correlation - ctx.Correlation)*COMFORT_NOISE_CORRELATION_RATE;
+    }
+}
+
+void comfortNoiseGenerate(ComfortNoiseContext& ctx, float* output, int length)
+{
+    // NOTE: We filter white noise with a one-pole low-pass filter, which gives noise with the
+    //       same correlation between neighbouring samples as the filter coefficient.
+    //       The input is scaled so that the output has unit variance (uniform noise in [-1,1]
+    //       has a variance of 1/3).
+    float coefficient = ctx.Correlation;
+    float inputScale = sqrtf(3.0f*(1.0f - coefficient*coefficient));
+    float state = ctx.FilterState;
+    uint32_t seed = ctx.Seed;
+    for(int i=0; i<length; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        float white = (int32_t)seed*(1.0f/2147483648.0f);
+
+        state = coefficient*state + inputScale*white;
+        output[i] = ctx.Level*state;
+    }
+    ctx.FilterState = state;
+    ctx.Seed = seed;
+}
+
+void silenceReceiveInit(SilenceReceiveContext& ctx)
+{
+    ctx.ReceivingSilence = true;
+    ctx.MissingFrameCount = 0;
+}
+
+bool silenceReceiveFrame(SilenceReceiveContext& ctx, int frameLength, int nextFrameLength)
+{
+    if(frameLength > 0)
+    {
+        ctx.ReceivingSilence = (frameLength <= AUDIO_SILENCE_FRAME_BYTES);
+        ctx.MissingFrameCount = 0;
+        return ctx.ReceivingSilence;
+    }
+
+    if(ctx.ReceivingSilence)
+    {
+        return true;
+    }
+
+    // NOTE: If the first marker was lost then one of the markers sent after it might have arrived
+    ctx.MissingFrameCount++;
+    bool nextIsSilence = (nextFrameLength > 0) && (nextFrameLength <= AUDIO_SILENCE_FRAME_BYTES);
+    if(nextIsSilence || (ctx.MissingFrameCount >= SILENCE_MAX_MISSING_FRAMES))
+    {
+        ctx.ReceivingSilence = true;
+    }
+    return ctx.ReceivingSilence;
+}
@@ -0,0 +1,77 @@
+#ifndef _AUDIO_DTX_H
+#define _AUDIO_DTX_H
+
+#include <stdint.h>
+
+// Discontinuous transmission: deciding when there is no speech worth sending, and what to play
+// in place of the packets that the other users aren't sending us while they're quiet.
+
+// NOTE: Frames this short contain no audio. Opus produces them in DTX mode for frames that don't
+//       need to be sent, and senders send a few of them at the start of each silence (as markers)
+//       to tell receivers about it.
+const int AUDIO_SILENCE_FRAME_BYTES = 2;
+
+// A voice activity detector that compares each buffer's energy against an adaptive estimate of
+// the background noise level, and checks that its spectrum looks like speech rather than noise.
+// Voiced speech is harmonic (its spectrum is a series of peaks at multiples of the pitch, so the
+// waveform repeats itself every pitch period) while background noise (fans, hiss, traffic) is not.
+// Buffers that are well above the noise floor are treated as speech regardless of their spectrum,
+// since unvoiced sounds (e.g "s" or "f") aren't harmonic either.
+// Once speech is detected, the detector stays active for a short hangover so that quiet syllables
+// and the tails of words aren't cut off.
+struct VoiceActivityContext
+{
+    int SampleRate;
+    bool HasNoiseFloor;
+    float NoiseFloorDb; // The estimated background level, in dB relative to full scale
+    int HangoverRemaining; // In samples
+};
+
+/// Initialize the context for a stream at the given sample rate.
+void vadInit(VoiceActivityContext& ctx, int sampleRate);
+
+/// Returns true if the given buffer (the next in the stream) contains speech, or follows closely
+/// after a buffer that did.
+/// NOTE: This is intended to be called with buffers of roughly 10-30ms each.
+bool vadProcess(VoiceActivityContext& ctx, const float* samples, int length);
+
+// Generates noise to play during the silences in a received stream, so that the background noise
+// doesn't cut out entirely when the sender stops transmitting (which sounds like the call dropped).
+// The level and spectral tilt of the noise are estimated from the quietest audio recently received.
+struct ComfortNoiseContext
+{
+    int SampleRate;
+    float Level; // RMS amplitude
+    float Correlation; // Between neighbouring samples, which determines how low-pitched the noise is
+    float FilterState;
+    uint32_t Seed;
+};
+
+/// Initialize the context for a stream at the given sample rate, with no estimate of the noise
+/// (so it will generate silence until it has analysed some audio).
+void comfortNoiseInit(ComfortNoiseContext& ctx, int sampleRate);
+
+/// Update the estimate of the background noise from the given buffer of received audio.
+void comfortNoiseAnalyse(ComfortNoiseContext& ctx, const float* samples, int length);
+
+/// Fill the given buffer with noise that matches the recently received background noise.
+void comfortNoiseGenerate(ComfortNoiseContext& ctx, float* output, int length);
+
+// Tracks whether a received stream is in a silence, during which the sender isn't sending anything
+// and the frames missing from the stream shouldn't be counted as lost (or concealed as such).
+// A silence starts when we receive a silence marker. The markers are sent unreliably though, so if
+// they were all lost then we also treat a long enough run of consecutive missing frames as silence.
+struct SilenceReceiveContext
+{
+    bool ReceivingSilence;
+    int MissingFrameCount; // The number of consecutive frames missing since we last received one
+};
+
+/// Initialize the context for a stream that hasn't started yet (which counts as silence).
+void silenceReceiveInit(SilenceReceiveContext& ctx);
+
+/// Returns true if the next frame of the stream is silence, given its length (0 if it is missing)
+/// and the length of the frame after it (0 if that hasn't been received yet either).
+bool silenceReceiveFrame(SilenceReceiveContext& ctx, int frameLength, int nextFrameLength);
+
+#endif // _AUDIO_DTX_H
@@ -0,0 +1,113 @@
+#include <math.h>
+
+#include "audio_level.h"
+#include "math_utils.h"
+
+static const uint8_t AUDIO_LEVEL_VOICE_FLAG = 0x80;
+
+static const float SPEAKER_MIN_LEVEL_DB = -(float)AUDIO_LEVEL_SILENT;
+static const float SPEAKER_LEVEL_DECAY_DB_PER_SECOND = 20.0f;
+static const float SPEAKER_SELECTED_ADVANTAGE_DB = 6.0f;
+
+uint8_t audioLevelEncode(float rms, bool voiceActive)
+{
+    float levelDb = 20.0f*log10f(rms + 1e-9f);
+    int level = (int)(-levelDb + 0.5f);
+    level = clamp(level, 0, (int)AUDIO_LEVEL_SILENT);
+
+    uint8_t result = (uint8_t)level;
+    if(voiceActive)
+    {
+        result |= AUDIO_LEVEL_VOICE_FLAG;
+    }
+    return result;
+}
+
+float audioLevelDecibels(uint8_t level)
+{
+    return -(float)(level & ~AUDIO_LEVEL_VOICE_FLAG);
+}
+
+bool audioLevelVoiceActive(uint8_t level)
+{
+    return (level & AUDIO_LEVEL_VOICE_FLAG) != 0;
+}
+
+void speakerActivityInit(SpeakerActivity& activity)
+{
+    activity.LevelDb = SPEAKER_MIN_LEVEL_DB;
+    activity.LastUpdateTime = 0.0;
+    activity.Selected = false;
+}
+
+float speakerActivityLevel(const SpeakerActivity& activity, double currentTime)
+{
+    float elapsed = maxf(0.0f, (float)(currentTime - activity.LastUpdateTime));
+    return maxf(SPEAKER_MIN_LEVEL_DB, activity.LevelDb - elapsed*SPEAKER_LEVEL_DECAY_DB_PER_SECOND);
+}
+
+void speakerActivityUpdate(SpeakerActivity& activity, uint8_t level, double currentTime)
+{
+    float decayedDb = speakerActivityLevel(activity, currentTime);
+    if(audioLevelVoiceActive(level))
+    {
+        activity.LevelDb = maxf(decayedDb, audioLevelDecibels(level));
+    }
+    else
+    {
+        activity.LevelDb = decayedDb;
+    }
+    activity.LastUpdateTime = fmax(activity.LastUpdateTime, currentTime);
+}
+
+static float selectionScore(const SpeakerActivity& activity, double currentTime)
+{
+    float result = speakerActivityLevel(activity, currentTime);
+    if(activity.Selected)
+    {
+        result += SPEAKER_SELECTED_ADVANTAGE_DB;
+    }
+    return result;
+}
+
+void selectActiveSpeakers(SpeakerActivity** speakers, int speakerCount, int maxSelected, double currentTime)
+{
+    if(speakerCount <= maxSelected)
+    {
+        for(int i=0; i<speakerCount; i++)
+        {
+            speakers[i]->Selected = true;
+        }
+        return;
+    }
+
+    // NOTE: There are only ever a handful of users in a room, so we just count how many speakers
+    //       are louder than each one (breaking ties by their order) rather than sorting them.
+    //       The scores depend on the current selection, so we compute them all before changing it.
+    const int MAX_SCORED_SPEAKERS = 64;
+    float scores[MAX_SCORED_SPEAKERS];
+    int scoredCount = min(speakerCount, MAX_SCORED_SPEAKERS);
+    for(int i=0; i<scoredCount; i++)
+    {
+        scores[i] = selectionScore(*speakers[i], currentTime);
+    }
+
+    for(int i=0; i<speakerCount; i++)
+    {
+        if(i >= scoredCount)
+        {
+            speakers[i]->Selected = false;
+            continue;
+        }
+
+        int louderCount = 0;
+        for(int j=0; j<scoredCount; j++)
+        {
+            if((scores[j] > scores[i]) || ((scores[j] == scores[i]) && (j < i)))
+            {
+                louderCount++;
+            }
+        }
+        speakers[i]->Selected = (louderCount < maxSelected);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef _AUDIO_LEVEL_H
+#define _AUDIO_LEVEL_H
+
+#include <stdint.h>
+
+// Each audio packet carries a single byte that describes how loud it is, so that receivers (and
+// the relay server) can tell who is speaking without decoding anything. As in RFC 6464, the low
+// 7 bits are the level in -dBov (so 0 is the loudest and 127 is silent) and the top bit is set
+// if the sender thinks that the packet contains speech.
+const uint8_t AUDIO_LEVEL_SILENT = 127;
+
+// NOTE: Only this many users are heard at once, the others are neither decoded nor mixed
+//       (and not even forwarded if the server is relaying media). Very few conversations have
+//       more than a couple of people talking at the same time.
+const int MAX_ACTIVE_SPEAKERS = 3;
+
+/// Returns the level byte for audio with the given RMS amplitude (relative to full scale).
+uint8_t audioLevelEncode(float rms, bool voiceActive);
+
+/// Returns the level of the audio described by the given level byte, in dB relative to full scale.
+float audioLevelDecibels(uint8_t level);
+
+bool audioLevelVoiceActive(uint8_t level);
+
+// Tracks how loudly one user has been speaking recently. The level rises immediately whenever
+// they speak more loudly but decays gradually afterwards, so that speakers aren't dropped during
+// the short pauses between words (and so that it falls even when no packets are arriving at all).
+struct SpeakerActivity
+{
+    float LevelDb;
+    double LastUpdateTime; // In seconds
+    bool Selected; // Whether this user is currently one of the speakers that we want to hear
+};
+
+void speakerActivityInit(SpeakerActivity& activity);
+
+/// Update the activity with the level byte of a packet received at the given time.
+/// NOTE: Only packets that contain speech raise the level.
+void speakerActivityUpdate(SpeakerActivity& activity, uint8_t level, double currentTime);
+
+/// Returns the recent level of the user at the given time, in dB relative to full scale.
+float speakerActivityLevel(const SpeakerActivity& activity, double currentTime);
+
+/// Mark the (at most) maxSelected loudest of the given speakers as selected, and the rest as not.
+/// Speakers that are already selected are given a small advantage, so that the selection doesn't
+/// flip back and forth between speakers of a similar volume.
+void selectActiveSpeakers(SpeakerActivity** speakers, int speakerCount, int maxSelected, double currentTime);
+
+#endif // _AUDIO_LEVEL_H
@@ -0,0 +1,212 @@
+#include <assert.h>
+#include <math.h>
+
+#include "audio_mix.h"
+#include "math_utils.h"
+#include "platform.h"
+
+#ifdef PLATFORM_X86
+#include <immintrin.h>
+#endif
+
+// NOTE: Limiting to just under full scale leaves a little headroom for the gain of the limiter
+//       to not quite have reached its target by the time a peak arrives (in which case we clip).
+static const float LIMITER_THRESHOLD = 0.89f; // -1dBFS
+static const int LIMITER_LOOKAHEAD_MS = 2;
+// NOTE: How quickly the gain recovers once the peaks have passed. Too fast and the gain follows
+//       individual waveforms (which distorts), too slow and loud speakers mute quiet ones for longer.
+static const float LIMITER_RELEASE_MS = 80.0f;
+
+typedef void MixAddFunction(float* mix, const float* source, int length);
+
+static void mixAddScalar(float* mix, const float* source, int length)
+{
+    for(int i=0; i<length; i++)
+    {
+        mix[i] += source[i];
+    }
+}
+
+#ifdef PLATFORM_X86
+PLATFORM_TARGET_SSE2
+static void mixAddSSE(float* mix, const float* source, int length)
+{
+    int i = 0;
+    for(; i+4<=length; i+=4)
+    {
+        _mm_storeu_ps(mix+i, _mm_add_ps(_mm_loadu_ps(mix+i), _mm_loadu_ps(source+i)));
+    }
+    for(; i<length; i++)
+    {
+        mix[i] += source[i];
+    }
+}
+
+PLATFORM_TARGET_AVX
+static void mixAddAVX(float* mix, const float* source, int length)
+{
+    int i = 0;
+    for(; i+8<=length; i+=8)
+    {
+        _mm256_storeu_ps(mix+i, _mm256_add_ps(_mm256_loadu_ps(mix+i), _mm256_loadu_ps(source+i)));
+    }
+    for(; i<length; i++)
+    {
+        mix[i] += source[i];
+    }
+}
+
+PLATFORM_TARGET_SSE2
+static void interleaveStereoSSE(const float* block, int length, float* output)
+{
+    int i = 0;
+    for(; i+4<=length; i+=4)
+    {
+        __m128 samples = _mm_loadu_ps(block+i);
+        _mm_storeu_ps(output + 2*i, _mm_unpacklo_ps(samples, samples));
+        _mm_storeu_ps(output + 2*i + 4, _mm_unpackhi_ps(samples, samples));
+    }
+    for(; i<length; i++)
+    {
+        output[2*i] = block[i];
+        output[2*i + 1] = block[i];
+    }
+}
+#endif
+
+static MixAddFunction* selectMixAddFunction()
+{
+#ifdef PLATFORM_X86
+    Platform::CPUFeatures cpu = Platform::GetCPUFeatures();
+    if(cpu.AVX)
+    {
+        return mixAddAVX;
+    }
+    if(cpu.SSE2)
+    {
+        return mixAddSSE;
+    }
+#endif
+    return mixAddScalar;
+}
+
+void mixAddBlock(float* mix, const float* source, int length)
+{
+    static MixAddFunction* mixAdd = selectMixAddFunction();
+    mixAdd(mix, source, length);
+}
+
+void mixInterleave(const float* block, int length, int channelCount, float* output)
+{
+    if(channelCount == 1)
+    {
+        for(int i=0; i<length; i++)
+        {
+            output[i] = block[i];
+        }
+        return;
+    }
+
+#ifdef PLATFORM_X86
+    static bool hasSSE2 = Platform::GetCPUFeatures().SSE2;
+    if((channelCount == 2) && hasSSE2)
+    {
+        interleaveStereoSSE(block, length, output);
+        return;
+    }
+#endif
+
+    for(int i=0; i<length; i++)
+    {
+        float sample = block[i];
+        for(int channel=0; channel<channelCount; channel++)
+        {
+            *output++ = sample;
+        }
+    }
+}
+
+void mixLimiterInit(MixLimiterContext& ctx, int sampleRate)
+{
+    assert(sampleRate > 0);
+    ctx.SampleRate = sampleRate;
+    ctx.Threshold = LIMITER_THRESHOLD;
+    ctx.Gain = 1.0f;
+
+    ctx.LookaheadLength = clamp((sampleRate*LIMITER_LOOKAHEAD_MS)/1000, 1, MIX_LIMITER_MAX_LOOKAHEAD);
+    ctx.ReleaseCoefficient = 1.0f - expf(-1000.0f/(LIMITER_RELEASE_MS*sampleRate));
+    ctx.Envelope = 1.0f;
+
+    for(int i=0; i<ctx.LookaheadLength; i++)
+    {
+        ctx.Delay[i] = 0.0f;
+        ctx.EnvelopeHistory[i] = 1.0f;
+    }
+    ctx.EnvelopeSum = ctx.LookaheadLength;
+    ctx.DelayIndex = 0;
+    ctx.PeakStart = 0;
+    ctx.PeakCount = 0;
+    ctx.CurrentTime = 0;
+}
+
+void mixLimiterApply(MixLimiterContext& ctx, float* block, int length)
+{
+    const int peakCapacity = MIX_LIMITER_MAX_LOOKAHEAD+1;
+    for(int i=0; i<length; i++)
+    {
+        float input = block[i];
+        float magnitude = fabsf(input);
+
+        // Add this sample to the window, removing any earlier peaks that it is larger than (since
+        // they will leave the window before it does, they can never be the largest again)
+        while(ctx.PeakCount > 0)
+        {
+            int lastIndex = (ctx.PeakStart + ctx.PeakCount - 1) % peakCapacity;
+            if(ctx.PeakValues[lastIndex] > magnitude)
+                break;
+            ctx.PeakCount--;
+        }
+        int newIndex = (ctx.PeakStart + ctx.PeakCount) % peakCapacity;
+        ctx.PeakValues[newIndex] = magnitude;
+        ctx.PeakTimes[newIndex] = ctx.CurrentTime;
+        ctx.PeakCount++;
+
+        // Remove the peak that has left the window, if there is one
+        if(ctx.CurrentTime - ctx.PeakTimes[ctx.PeakStart] > (uint32_t)ctx.LookaheadLength)
+        {
+            ctx.PeakStart = (ctx.PeakStart + 1) % peakCapacity;
+            ctx.PeakCount--;
+        }
+        float peak = ctx.PeakValues[ctx.PeakStart];
+
+        // NOTE: The envelope drops immediately to the gain needed for the largest peak in the window
+        //       (so it is low enough for the entire time that the peak is in the window) and then
+        //       rises slowly once the peak has left. Averaging the envelope over the window smooths
+        //       out the drop without ever letting the gain rise above what the peak needs, since
+        //       every envelope value in the window at the time that the peak is output was computed
+        //       while the peak was in the window.
+        float targetGain = (peak > ctx.Threshold) ? (ctx.Threshold/peak) : 1.0f;
+        if(targetGain < ctx.Envelope)
+        {
+            ctx.Envelope = targetGain;
+        }
+        else
+        {
+            ctx.Envelope += (targetGain - ctx.Envelope)*ctx.ReleaseCoefficient;
+        }
+        ctx.EnvelopeSum += ctx.Envelope - ctx.EnvelopeHistory[ctx.DelayIndex];
+        ctx.EnvelopeHistory[ctx.DelayIndex] = ctx.Envelope;
+        ctx.Gain = (float)(ctx.EnvelopeSum/ctx.LookaheadLength);
+
+        float delayed = ctx.Delay[ctx.DelayIndex];
+        ctx.Delay[ctx.DelayIndex] = input;
+        ctx.DelayIndex++;
+        if(ctx.DelayIndex == ctx.LookaheadLength)
+        {
+            ctx.DelayIndex = 0;
+        }
+
+        block[i] = clampf(delayed*ctx.Gain, -1.0f, 1.0f);
+        ctx.CurrentTime++;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef _AUDIO_MIX_H
+#define _AUDIO_MIX_H
+
+#include <stdint.h>
+
+// The longest look-ahead that the limiter supports, in samples (~2.7ms at 192KHz)
+#define MIX_LIMITER_MAX_LOOKAHEAD 512
+
+// A look-ahead peak limiter, which keeps the mixed output below full scale by smoothly reducing
+// the gain just before loud peaks, rather than clipping them.
+// The output is delayed by LookaheadLength samples, so that the gain reduction for each peak can
+// begin before the peak itself reaches the output.
+struct MixLimiterContext
+{
+    int SampleRate;
+    float Threshold; // The peak level that we limit to
+    float ReleaseCoefficient;
+    float Envelope;
+    float Gain; // The gain that was applied to the most recent output sample
+
+    int LookaheadLength;
+    float Delay[MIX_LIMITER_MAX_LOOKAHEAD];
+    float EnvelopeHistory[MIX_LIMITER_MAX_LOOKAHEAD];
+    double EnvelopeSum; // The sum of EnvelopeHistory
+    int DelayIndex; // The index of the oldest entry in both Delay and EnvelopeHistory
+
+    // NOTE: A queue of the (decreasing) peaks in the look-ahead window, so that we can find the
+    //       largest peak in the window without searching through the entire window every sample.
+    float PeakValues[MIX_LIMITER_MAX_LOOKAHEAD+1];
+    uint32_t PeakTimes[MIX_LIMITER_MAX_LOOKAHEAD+1];
+    int PeakStart;
+    int PeakCount;
+    uint32_t CurrentTime;
+};
+
+/// Add length samples from source to the samples in mix.
+void mixAddBlock(float* mix, const float* source, int length);
+
+/// Reset the limiter, for a stream at the given sample rate.
+void mixLimiterInit(MixLimiterContext& ctx, int sampleRate);
+
+/// Apply the limiter to length samples in block, in place.
+void mixLimiterApply(MixLimiterContext& ctx, float* block, int length);
+
+/// Write each of the length (mono) samples in block to every one of channelCount channels of output,
+/// which must have space for length*channelCount interleaved samples.
+void mixInterleave(const float* block, int length, int channelCount, float* output);
+
+#endif // _AUDIO_MIX_H
@@ -1,17 +1,346 @@
 #include <assert.h>
+#include <math.h>
+#include <string.h>
 
 #include "audio.h"
 #include "audio_resample.h"
 #include "logging.h"
 #include "math_utils.h"
+#include "platform.h"
 
-// TODO: Improve resample speed/quality.
-//       E.g Opus FAQ (https://wiki.xiph.org/OpusFAQ) lists one from opus-tools:
+#ifdef PLATFORM_X86
+#include <immintrin.h>
+#endif
+
+// NOTE: The windowed-sinc resampler is a polyphase implementation of the approach described at
+//       https://ccrma.stanford.edu/~jos/resample/ (with a Kaiser window).
+//       The Opus FAQ (https://wiki.xiph.org/OpusFAQ) also lists one from opus-tools:
 //       https://github.com/xiph/opus-tools/blob/master/src/resample.c
-//       https://ccrma.stanford.edu/~jos/resample/
 
-static int resampleStream(ResampleStreamContext& ctx,
-                          float inputSample, float* outputSamples, int maxOutputSamples)
+// NOTE: Samples are moved in and out of ring buffers in blocks of this size, so that we only
+//       need to synchronize with the other thread using the ring once per block.
+static const int RESAMPLE_RING_BLOCK_SIZE = 256;
+
+// NOTE: If the ratio between the sample rates requires more distinct filter phases than this,
+//       we round the position of each output sample down to the nearest available phase.
+static const int MAX_FILTER_BANK_PHASES = 1024;
+static const int MAX_FILTER_BANKS = 32;
+
+struct ResampleFilterBank
+{
+    int InputSampleRate;
+    int OutputSampleRate;
+    ResampleQuality Quality;
+
+    int InputStep; // InputSampleRate/gcd
+    int PhaseCount; // OutputSampleRate/gcd
+    int BankPhaseCount; // The number of phases that we actually store coefficients for
+    int TapCount; // Always a multiple of 8, so that the SIMD dot product needs no special-casing
+
+    float* Coefficients; // BankPhaseCount rows of TapCount coefficients each
+};
+
+typedef float DotProductFunction(const float* x, const float* y, int length);
+
+static ResampleFilterBank filterBanks[MAX_FILTER_BANKS];
+static int filterBankCount = 0;
+static DotProductFunction* dotProduct = nullptr;
+
+static float dotProductScalar(const float* x, const float* y, int length)
+{
+    float result = 0.0f;
+    for(int i=0; i<length; i++)
+    {
+        result += x[i]*y[i];
+    }
+    return result;
+}
+
+#ifdef PLATFORM_X86
+PLATFORM_TARGET_SSE2
+static float dotProductSSE(const float* x, const float* y, int length)
+{
+    assert((length % 8) == 0);
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for(int i=0; i<length; i+=8)
+    {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(x+i), _mm_loadu_ps(y+i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(x+i+4), _mm_loadu_ps(y+i+4)));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(sum0, sum1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+PLATFORM_TARGET_AVX
+static float dotProductAVX(const float* x, const float* y, int length)
+{
+    assert((length % 8) == 0);
+    __m256 sum = _mm256_setzero_ps();
+    for(int i=0; i<length; i+=8)
+    {
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(x+i), _mm256_loadu_ps(y+i)));
+    }
+
+    __m128 halfSum = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, halfSum);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+#endif
+
+static DotProductFunction* selectDotProductFunction()
+{
+#ifdef PLATFORM_X86
+    Platform::CPUFeatures cpu = Platform::GetCPUFeatures();
+    if(cpu.AVX)
+    {
+        return dotProductAVX;
+    }
+    if(cpu.SSE2)
+    {
+        return dotProductSSE;
+    }
+#endif
+    return dotProductScalar;
+}
+
+static int greatestCommonDivisor(int a, int b)
+{
+    while(b != 0)
+    {
+        int remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind, used to compute the Kaiser window
+static double besselI0(double x)
+{
+    double result = 1.0;
+    double term = 1.0;
+    for(int k=1; k<32; k++)
+    {
+        double factor = x/(2.0*k);
+        term *= factor*factor;
+        result += term;
+        if(term < result*1e-12)
+            break;
+    }
+    return result;
+}
+
+static void createFilterBank(ResampleFilterBank& bank,
+                             int inputSampleRate, int outputSampleRate, ResampleQuality quality)
+{
+    int baseTapCount;
+    double cutoffScale;
+    double kaiserBeta;
+    switch(quality)
+    {
+        case ResampleQuality::Low:    baseTapCount = 16; cutoffScale = 0.85; kaiserBeta = 6.0;  break;
+        case ResampleQuality::Medium: baseTapCount = 32; cutoffScale = 0.90; kaiserBeta = 8.0;  break;
+        default:                      baseTapCount = 64; cutoffScale = 0.94; kaiserBeta = 10.0; break;
+    }
+
+    int gcd = greatestCommonDivisor(inputSampleRate, outputSampleRate);
+    bank.InputSampleRate = inputSampleRate;
+    bank.OutputSampleRate = outputSampleRate;
+    bank.Quality = quality;
+    bank.InputStep = inputSampleRate/gcd;
+    bank.PhaseCount = outputSampleRate/gcd;
+    bank.BankPhaseCount = min(bank.PhaseCount, MAX_FILTER_BANK_PHASES);
+
+    // NOTE: When downsampling, the cutoff frequency needs to drop to the output nyquist frequency,
+    //       which widens the filter (in input samples) by the same ratio.
+    double downsampleRatio = (double)outputSampleRate/(double)inputSampleRate;
+    if(downsampleRatio > 1.0)
+    {
+        downsampleRatio = 1.0;
+    }
+    double cutoff = cutoffScale*downsampleRatio;
+    int tapCount = (int)ceil(baseTapCount/downsampleRatio);
+    tapCount = ((tapCount + 7)/8)*8;
+    if(tapCount > RESAMPLE_CONTEXT_MAX_TAPS)
+    {
+        tapCount = RESAMPLE_CONTEXT_MAX_TAPS;
+    }
+    bank.TapCount = tapCount;
+    bank.Coefficients = new float[bank.BankPhaseCount*tapCount];
+
+    const double pi = 3.14159265358979323846;
+    double halfWidth = tapCount/2.0;
+    double windowScale = 1.0/besselI0(kaiserBeta);
+    for(int phase=0; phase<bank.BankPhaseCount; phase++)
+    {
+        // NOTE: Tap i is applied to the input sample at distance (halfWidth - 1 - i + frac) before
+        //       the output sample, where frac is the output sample's position between inputs.
+        double frac = (double)phase/(double)bank.BankPhaseCount;
+        float* row = bank.Coefficients + phase*tapCount;
+        double rowSum = 0.0;
+        for(int tap=0; tap<tapCount; tap++)
+        {
+            double distance = (halfWidth - 1.0 - tap) + frac;
+            double sincInput = pi*cutoff*distance;
+            double sinc = (fabs(sincInput) < 1e-9) ? 1.0 : sin(sincInput)/sincInput;
+
+            double windowPosition = distance/halfWidth;
+            double window = 0.0;
+            if(fabs(windowPosition) < 1.0)
+            {
+                window = besselI0(kaiserBeta*sqrt(1.0 - windowPosition*windowPosition))*windowScale;
+            }
+
+            double coefficient = cutoff*sinc*window;
+            row[tap] = (float)coefficient;
+            rowSum += coefficient;
+        }
+
+        // NOTE: We normalize each phase to unity gain at DC so that a constant input produces a
+        //       constant output, rather than one modulated by the slightly different phase gains.
+        for(int tap=0; tap<tapCount; tap++)
+        {
+            row[tap] = (float)(row[tap]/rowSum);
+        }
+    }
+}
+
+// NOTE: This is not thread-safe, we expect that all resampling is done on the same thread.
+static const ResampleFilterBank* findFilterBank(int inputSampleRate, int outputSampleRate,
+                                                ResampleQuality quality)
+{
+    for(int i=0; i<filterBankCount; i++)
+    {
+        ResampleFilterBank& bank = filterBanks[i];
+        if((bank.InputSampleRate == inputSampleRate) &&
+           (bank.OutputSampleRate == outputSampleRate) &&
+           (bank.Quality == quality))
+        {
+            return &bank;
+        }
+    }
+
+    if(filterBankCount >= MAX_FILTER_BANKS)
+    {
+        logWarn("Unable to create a resample filter for %d->%dHz, too many filters already exist\n",
+                inputSampleRate, outputSampleRate);
+        return nullptr;
+    }
+    if(outputSampleRate > RESAMPLE_CONTEXT_MAX_OUTPUT_SAMPLES*inputSampleRate)
+    {
+        logWarn("Unable to create a resample filter for %d->%dHz, the ratio is too large\n",
+                inputSampleRate, outputSampleRate);
+        return nullptr;
+    }
+
+    if(dotProduct == nullptr)
+    {
+        dotProduct = selectDotProductFunction();
+    }
+
+    ResampleFilterBank& result = filterBanks[filterBankCount++];
+    createFilterBank(result, inputSampleRate, outputSampleRate, quality);
+    logInfo("Created %d-tap resample filter with %d phases for %d->%dHz\n",
+            result.TapCount, result.BankPhaseCount, inputSampleRate, outputSampleRate);
+    return &result;
+}
+
+void resamplePrecomputeFilters(int inputSampleRate, int outputSampleRate, ResampleQuality quality)
+{
+    if((quality != ResampleQuality::Linear) && (inputSampleRate != outputSampleRate))
+    {
+        findFilterBank(inputSampleRate, outputSampleRate, quality);
+    }
+}
+
+static void pushHistorySample(ResampleStreamContext& ctx, int tapCount, float sample)
+{
+    ctx.History[ctx.HistoryIndex] = sample;
+    ctx.History[ctx.HistoryIndex + tapCount] = sample;
+    ctx.HistoryIndex++;
+    if(ctx.HistoryIndex >= tapCount)
+    {
+        ctx.HistoryIndex = 0;
+    }
+}
+
+static int historyTapCount(ResampleStreamContext& ctx)
+{
+    if(ctx.Filter == nullptr)
+    {
+        return RESAMPLE_CONTEXT_MAX_TAPS;
+    }
+    return ctx.Filter->TapCount;
+}
+
+// Make sure that ctx has the correct filter for its current sample rates and quality
+static void updateStreamFilter(ResampleStreamContext& ctx)
+{
+    if(ctx.Quality == ResampleQuality::Linear)
+    {
+        return;
+    }
+
+    const ResampleFilterBank* oldFilter = ctx.Filter;
+    if((oldFilter != nullptr) &&
+       (oldFilter->InputSampleRate == ctx.InputSampleRate) &&
+       (oldFilter->OutputSampleRate == ctx.OutputSampleRate) &&
+       (oldFilter->Quality == ctx.Quality))
+    {
+        return;
+    }
+
+    const ResampleFilterBank* newFilter = nullptr;
+    if(ctx.InputSampleRate != ctx.OutputSampleRate)
+    {
+        newFilter = findFilterBank(ctx.InputSampleRate, ctx.OutputSampleRate, ctx.Quality);
+        if(newFilter == nullptr)
+        {
+            ctx.Quality = ResampleQuality::Linear;
+            return;
+        }
+    }
+    else if(oldFilter == nullptr)
+    {
+        // NOTE: We don't need a filter to pass samples straight through, but we do still need to
+        //       keep track of the history in case the sample rates change later.
+        return;
+    }
+
+    // Copy the most recent samples into the layout expected by the new filter
+    int oldTapCount = historyTapCount(ctx);
+    int newTapCount = (newFilter != nullptr) ? newFilter->TapCount : RESAMPLE_CONTEXT_MAX_TAPS;
+    float recentSamples[RESAMPLE_CONTEXT_MAX_TAPS];
+    memcpy(recentSamples, &ctx.History[ctx.HistoryIndex], oldTapCount*sizeof(float));
+
+    memset(ctx.History, 0, sizeof(ctx.History));
+    ctx.HistoryIndex = 0;
+    int copyCount = min(oldTapCount, newTapCount);
+    for(int i=oldTapCount-copyCount; i<oldTapCount; i++)
+    {
+        pushHistorySample(ctx, newTapCount, recentSamples[i]);
+    }
+
+    if(oldFilter == nullptr)
+    {
+        // NOTE: The first output sample should line up with the first input sample, which is
+        //       only the case once that sample has reached the center of the filter.
+        ctx.InputsUntilOutput = newTapCount/2 + 1;
+    }
+    else
+    {
+        ctx.InputsUntilOutput = 1;
+    }
+    ctx.FilterPhase = 0;
+    ctx.Filter = newFilter;
+}
+
+static int resampleStreamLinear(ResampleStreamContext& ctx,
+                                float inputSample, float* outputSamples, int maxOutputSamples)
 {
     // TODO: Apparently its a good idea to lowpass filter the output here
     //       We can achieve that with a simple averaging
@@ -48,81 +377,160 @@ static int resampleStream(ResampleStreamContext& ctx,
     return outputSampleIndex;
 }
 
-static bool resampleStreamRequiresInput(ResampleStreamContext& ctx)
+// Returns an upper bound on the number of output samples that a single input sample can produce
+static int maxOutputsPerInput(ResampleStreamContext& ctx)
 {
-    return ctx.PreviousOutputSampleIndex >= ctx.PreviousOutputSampleCount;
+    return (ctx.OutputSampleRate/ctx.InputSampleRate) + 2;
 }
 
-static void resampleStreamInput(ResampleStreamContext& ctx, float inputSample)
+// Resample input samples from the given block into output for as long as there is at least
+// reservedOutputLength space left in output.
+// Returns the number of output samples produced, *inputUsed is set to the number of input
+// samples that were consumed.
+static int resampleBlock(ResampleStreamContext& ctx,
+                         const float* input, int inputLength, int* inputUsed,
+                         float* output, int maxOutputLength, int reservedOutputLength)
 {
-    int outCount = resampleStream(ctx, inputSample, &ctx.PreviousOutputSamples[0],
-                                  RESAMPLE_CONTEXT_MAX_OUTPUT_SAMPLES);
-    ctx.PreviousOutputSampleIndex = 0;
-    ctx.PreviousOutputSampleCount = outCount;
-}
+    int inputIndex = 0;
+    int outputLength = 0;
+    const ResampleFilterBank* filter = ctx.Filter;
 
-static float resampleStreamOutput(ResampleStreamContext& ctx)
-{
-    assert(ctx.PreviousOutputSampleIndex < ctx.PreviousOutputSampleCount);
+    if(ctx.Quality == ResampleQuality::Linear)
+    {
+        for(; inputIndex<inputLength; inputIndex++)
+        {
+            if(maxOutputLength - outputLength < reservedOutputLength)
+                break;
+            outputLength += resampleStreamLinear(ctx, input[inputIndex],
+                                                 output + outputLength,
+                                                 maxOutputLength - outputLength);
+        }
+    }
+    else if(filter == nullptr)
+    {
+        // NOTE: The sample rates are equal so we can just copy the samples through directly
+        int tapCount = RESAMPLE_CONTEXT_MAX_TAPS;
+        for(; inputIndex<inputLength; inputIndex++)
+        {
+            if(maxOutputLength - outputLength < reservedOutputLength)
+                break;
+            pushHistorySample(ctx, tapCount, input[inputIndex]);
+            output[outputLength++] = input[inputIndex];
+        }
+    }
+    else
+    {
+        int tapCount = filter->TapCount;
+        int phaseCount = filter->PhaseCount;
+        for(; inputIndex<inputLength; inputIndex++)
+        {
+            if(maxOutputLength - outputLength < reservedOutputLength)
+                break;
 
-    float result = ctx.PreviousOutputSamples[ctx.PreviousOutputSampleIndex];
-    ctx.PreviousOutputSampleIndex++;
-    return result;
+            pushHistorySample(ctx, tapCount, input[inputIndex]);
+            ctx.InputsUntilOutput--;
+            while(ctx.InputsUntilOutput == 0)
+            {
+                int bankPhase = ctx.FilterPhase;
+                if(filter->BankPhaseCount != phaseCount)
+                {
+                    bankPhase = (int)(((int64)ctx.FilterPhase*filter->BankPhaseCount)/phaseCount);
+                }
+
+                if(outputLength < maxOutputLength)
+                {
+                    const float* coefficients = filter->Coefficients + bankPhase*tapCount;
+                    output[outputLength++] = dotProduct(&ctx.History[ctx.HistoryIndex],
+                                                        coefficients, tapCount);
+                }
+                else
+                {
+                    logWarn("Unable to fit all resample output samples into the given buffer of size %d\n", maxOutputLength);
+                }
+
+                ctx.FilterPhase += filter->InputStep;
+                ctx.InputsUntilOutput = ctx.FilterPhase/phaseCount;
+                ctx.FilterPhase %= phaseCount;
+            }
+        }
+    }
+
+    *inputUsed = inputIndex;
+    return outputLength;
 }
 
 void resampleBuffer2Buffer(ResampleStreamContext& ctx,
                            const Audio::AudioBuffer& input,
                            Audio::AudioBuffer& output)
 {
-    // TODO: Check that we have enough space for the output, and that we don't overflow.
     ctx.InputSampleRate = input.SampleRate;
     ctx.OutputSampleRate = output.SampleRate;
+    updateStreamFilter(ctx);
 
-    output.Length = 0;
-    for(int i=0; i<input.Length; i++)
+    int inputUsed;
+    output.Length = resampleBlock(ctx, input.Data, input.Length, &inputUsed,
+                                  output.Data, output.Capacity, 1);
+    if(inputUsed < input.Length)
     {
-        resampleStreamInput(ctx, input.Data[i]);
-        while(!resampleStreamRequiresInput(ctx))
-        {
-            float sample = resampleStreamOutput(ctx);
-            output.Data[output.Length++] = sample;
-        }
+        logWarn("Resample output buffer was too small, dropped %d input samples\n",
+                input.Length - inputUsed);
     }
 }
 
+template<typename OutputRing>
 void resampleBuffer2Ring(ResampleStreamContext& ctx,
                          const Audio::AudioBuffer& input,
-                         RingBuffer& output)
+                         OutputRing& output)
 {
     ctx.InputSampleRate = input.SampleRate;
     ctx.OutputSampleRate = output.sampleRate;
+    updateStreamFilter(ctx);
 
-    for(int i=0; i<input.Length; i++)
+    float outputBlock[RESAMPLE_RING_BLOCK_SIZE];
+    int reservedOutputLength = maxOutputsPerInput(ctx);
+    int inputIndex = 0;
+    while(inputIndex < input.Length)
     {
-        resampleStreamInput(ctx, input.Data[i]);
-        while(!resampleStreamRequiresInput(ctx))
-        {
-            float sample = resampleStreamOutput(ctx);
-            output.write(sample);
-        }
+        int inputUsed;
+        int outputBlockLength = resampleBlock(ctx, input.Data + inputIndex, input.Length - inputIndex,
+                                              &inputUsed, outputBlock, RESAMPLE_RING_BLOCK_SIZE,
+                                              reservedOutputLength);
+        output.write(outputBlock, outputBlockLength);
+        inputIndex += inputUsed;
     }
 }
+template void resampleBuffer2Ring(ResampleStreamContext& ctx, const Audio::AudioBuffer& input, RingBuffer& output);
+template void resampleBuffer2Ring(ResampleStreamContext& ctx, const Audio::AudioBuffer& input, SPSCRingBuffer& output);
 
+template<typename InputRing, typename OutputRing>
 void resampleRing2Ring(ResampleStreamContext& ctx,
-                       RingBuffer& input,
-                       RingBuffer& output)
+                       InputRing& input,
+                       OutputRing& output)
 {
     ctx.InputSampleRate = input.sampleRate;
     ctx.OutputSampleRate = output.sampleRate;
+    updateStreamFilter(ctx);
 
-    float inputSample;
-    while(input.read(&inputSample) > 0)
+    float inputBlock[RESAMPLE_RING_BLOCK_SIZE];
+    float outputBlock[RESAMPLE_RING_BLOCK_SIZE];
+    int reservedOutputLength = maxOutputsPerInput(ctx);
+    int inputBlockLength;
+    while((inputBlockLength = input.read(inputBlock, RESAMPLE_RING_BLOCK_SIZE)) > 0)
     {
-        resampleStreamInput(ctx, inputSample);
-        while(!resampleStreamRequiresInput(ctx))
+        int inputIndex = 0;
+        while(inputIndex < inputBlockLength)
         {
-            float sample = resampleStreamOutput(ctx);
-            output.write(sample);
+            int inputUsed;
+            int outputBlockLength = resampleBlock(ctx, inputBlock + inputIndex,
+                                                  inputBlockLength - inputIndex, &inputUsed,
+                                                  outputBlock, RESAMPLE_RING_BLOCK_SIZE,
+                                                  reservedOutputLength);
+            output.write(outputBlock, outputBlockLength);
+            inputIndex += inputUsed;
         }
     }
 }
+template void resampleRing2Ring(ResampleStreamContext& ctx, RingBuffer& input, RingBuffer& output);
+template void resampleRing2Ring(ResampleStreamContext& ctx, SPSCRingBuffer& input, RingBuffer& output);
+template void resampleRing2Ring(ResampleStreamContext& ctx, RingBuffer& input, SPSCRingBuffer& output);
+template void resampleRing2Ring(ResampleStreamContext& ctx, SPSCRingBuffer& input, SPSCRingBuffer& output);
@@ -4,35 +4,73 @@
 #include "audio.h"
 #include "ringbuffer.h"
 
+// The maximum number of output samples that can be produced from a single input sample.
+// IE the maximum supported ratio of output to input sample rate.
 #define RESAMPLE_CONTEXT_MAX_OUTPUT_SAMPLES 8
 
+// The maximum number of input samples that a single output sample can be computed from.
+#define RESAMPLE_CONTEXT_MAX_TAPS 256
+
+enum class ResampleQuality
+{
+    // Linear interpolation between neighbouring samples. Has no latency but no lowpass filtering
+    // either, so it aliases badly (particularly when downsampling).
+    Linear = 0,
+
+    // Windowed-sinc filters with increasing numbers of taps (and therefore latency and CPU cost).
+    // When upsampling from 48KHz the latency is roughly 0.2ms, 0.3ms and 0.7ms respectively,
+    // when downsampling it increases proportionally to the ratio of the sample rates.
+    Low,
+    Medium,
+    High
+};
+
+struct ResampleFilterBank;
+
 struct ResampleStreamContext
 {
     int InputSampleRate;
     int OutputSampleRate;
+    ResampleQuality Quality;
 
+    // Linear interpolation state
     float InterSampleTime;
 
     bool HasPreviousSample;
     float PreviousInputSample;
 
-    float PreviousOutputSamples[RESAMPLE_CONTEXT_MAX_OUTPUT_SAMPLES];
-    int PreviousOutputSampleCount;
-    int PreviousOutputSampleIndex;
+    // Windowed-sinc state
+    // NOTE: This is all stored inline (rather than being allocated) so that contexts can be copied.
+    const ResampleFilterBank* Filter;
+    int FilterPhase; // Position of the next output between input samples, in [0, OutputSampleRate/gcd)
+    int InputsUntilOutput;
+
+    // NOTE: Each input sample is stored twice, TapCount apart, so that the most recent TapCount
+    //       samples are always available contiguously starting at History[HistoryIndex].
+    float History[2*RESAMPLE_CONTEXT_MAX_TAPS];
+    int HistoryIndex;
 };
 
+/// Compute (ahead of time) the filters required to resample between the given rates, so that
+/// resampling streams between those rates will not need to compute them on first use.
+void resamplePrecomputeFilters(int inputSampleRate, int outputSampleRate, ResampleQuality quality);
+
 /// Resample the full contents of input into output, overwriting any of output's previous contents.
 void resampleBuffer2Buffer(ResampleStreamContext& ctx,
                            const Audio::AudioBuffer& input,
                            Audio::AudioBuffer& output);
 
 /// Resample the full contents of input into output.
+/// Instantiated for both RingBuffer and SPSCRingBuffer outputs.
+template<typename OutputRing>
 void resampleBuffer2Ring(ResampleStreamContext& ctx,
                          const Audio::AudioBuffer& input,
-                         RingBuffer& output);
+                         OutputRing& output);
 
 /// Resample the full contents of input into output.
+/// Instantiated for both RingBuffer and SPSCRingBuffer inputs and outputs.
+template<typename InputRing, typename OutputRing>
 void resampleRing2Ring(ResampleStreamContext& ctx,
-                       RingBuffer& input,
-                       RingBuffer& output);
+                       InputRing& input,
+                       OutputRing& output);
 #endif // _AUDIO_RESAMPLE_H
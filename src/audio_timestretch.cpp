@@ -0,0 +1,187 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "audio.h"
+#include "audio_timestretch.h"
+#include "math_utils.h"
+
+// NOTE: Human speech has a fundamental frequency of roughly 80-400Hz. We don't go all the way down
+//       to 80Hz because two of the longest periods must fit into a single 20ms packet.
+static const int TIMESTRETCH_MIN_PERIOD_HZ = 400;
+static const int TIMESTRETCH_MAX_PERIOD_HZ = 100;
+
+// NOTE: The number of samples that we compare when matching a period against the next one.
+static const int TIMESTRETCH_CORRELATION_MS = 5;
+
+// NOTE: When searching for the best period we first check every COARSE_STEP periods, and then
+//       check the periods around the best of those.
+static const int TIMESTRETCH_COARSE_STEP = 4;
+
+// NOTE: We only change the duration if the signal matches itself this well one period later,
+//       unless it is quiet enough that any artefacts of doing so will be inaudible.
+static const float TIMESTRETCH_MIN_CORRELATION = 0.6f;
+static const float TIMESTRETCH_SILENCE_RMS = 0.003f;
+
+// NOTE: We don't let pending changes build up beyond this many periods, so that we don't keep
+//       stretching for a long time after the caller stops asking us to.
+static const int TIMESTRETCH_MAX_PENDING_PERIODS = 2;
+
+void timeStretchInit(TimeStretchStreamContext& ctx, int sampleRate)
+{
+    ctx.MinPeriod = sampleRate/TIMESTRETCH_MIN_PERIOD_HZ;
+    ctx.MaxPeriod = sampleRate/TIMESTRETCH_MAX_PERIOD_HZ;
+    ctx.PendingSamples = 0.0f;
+}
+
+int timeStretchMaxOutputLength(const TimeStretchStreamContext& ctx, int inputLength)
+{
+    return inputLength + ctx.MaxPeriod;
+}
+
+static float dotProduct(const float* x, const float* y, int length)
+{
+    float result = 0.0f;
+    for(int i=0; i<length; i++)
+    {
+        result += x[i]*y[i];
+    }
+    return result;
+}
+
+// Returns the normalized correlation between the signal starting at data and the signal starting
+// one period later, over the given length.
+static float periodCorrelation(const float* data, int period, int length)
+{
+    float crossEnergy = dotProduct(data, data+period, length);
+    float startEnergy = dotProduct(data, data, length);
+    float periodEnergy = dotProduct(data+period, data+period, length);
+    float normalization = sqrtf(startEnergy*periodEnergy);
+    if(normalization <= 0.0f)
+    {
+        return 0.0f;
+    }
+    return crossEnergy/normalization;
+}
+
+// Find the period (in [minPeriod, maxPeriod]) at which the start of data best matches itself.
+static int findBestPeriod(const float* data, int minPeriod, int maxPeriod, int correlationLength,
+                          float* bestCorrelation)
+{
+    int bestPeriod = minPeriod;
+    float bestValue = -1.0f;
+    for(int period=minPeriod; period<=maxPeriod; period+=TIMESTRETCH_COARSE_STEP)
+    {
+        float correlation = periodCorrelation(data, period, correlationLength);
+        if(correlation > bestValue)
+        {
+            bestValue = correlation;
+            bestPeriod = period;
+        }
+    }
+
+    int refineStart = max(minPeriod, bestPeriod - TIMESTRETCH_COARSE_STEP + 1);
+    int refineEnd = min(maxPeriod, bestPeriod + TIMESTRETCH_COARSE_STEP - 1);
+    for(int period=refineStart; period<=refineEnd; period++)
+    {
+        float correlation = periodCorrelation(data, period, correlationLength);
+        if(correlation > bestValue)
+        {
+            bestValue = correlation;
+            bestPeriod = period;
+        }
+    }
+
+    *bestCorrelation = bestValue;
+    return bestPeriod;
+}
+
+// Write a linear cross-fade from fadeOut to fadeIn (each of the given length) into output
+static void crossFade(const float* fadeOut, const float* fadeIn, int length, float* output)
+{
+    float step = 1.0f/length;
+    for(int i=0; i<length; i++)
+    {
+        float fadeInWeight = i*step;
+        output[i] = (1.0f - fadeInWeight)*fadeOut[i] + fadeInWeight*fadeIn[i];
+    }
+}
+
+void timeStretchBuffer2Buffer(TimeStretchStreamContext& ctx,
+                              const Audio::AudioBuffer& input,
+                              Audio::AudioBuffer& output,
+                              float speedChange)
+{
+    assert(ctx.MaxPeriod > ctx.MinPeriod);
+    assert(output.Capacity >= timeStretchMaxOutputLength(ctx, input.Length));
+    output.SampleRate = input.SampleRate;
+
+    // NOTE: Changes that we couldn't make in one direction are discarded as soon as the caller
+    //       asks for a change in the other direction.
+    float requestedSamples = speedChange*input.Length;
+    if(((requestedSamples > 0.0f) && (ctx.PendingSamples < 0.0f)) ||
+       ((requestedSamples < 0.0f) && (ctx.PendingSamples > 0.0f)) ||
+       (requestedSamples == 0.0f))
+    {
+        ctx.PendingSamples = 0.0f;
+    }
+    float maxPendingSamples = (float)(TIMESTRETCH_MAX_PENDING_PERIODS*ctx.MaxPeriod);
+    ctx.PendingSamples = clampf(ctx.PendingSamples + requestedSamples, -maxPendingSamples, maxPendingSamples);
+
+    int maxPeriod = min(ctx.MaxPeriod, input.Length/2);
+    int correlationLength = min(input.SampleRate*TIMESTRETCH_CORRELATION_MS/1000, input.Length - maxPeriod);
+    float pendingMagnitude = fabsf(ctx.PendingSamples);
+    bool canStretch = (pendingMagnitude >= ctx.MinPeriod) && (maxPeriod > ctx.MinPeriod) &&
+                      (correlationLength > 0);
+    if(!canStretch)
+    {
+        memcpy(output.Data, input.Data, input.Length*sizeof(float));
+        output.Length = input.Length;
+        return;
+    }
+
+    // NOTE: We don't stretch by more than has been asked for (so that small changes are made
+    //       evenly over several buffers instead of all at once).
+    maxPeriod = min(maxPeriod, (int)pendingMagnitude);
+
+    int period;
+    float energy = dotProduct(input.Data, input.Data, 2*maxPeriod);
+    float rms = sqrtf(energy/(2*maxPeriod));
+    if(rms <= TIMESTRETCH_SILENCE_RMS)
+    {
+        // NOTE: There's nothing to match in silence, so we just make the largest change we can
+        period = maxPeriod;
+    }
+    else
+    {
+        float correlation;
+        period = findBestPeriod(input.Data, ctx.MinPeriod, maxPeriod, correlationLength, &correlation);
+        if(correlation < TIMESTRETCH_MIN_CORRELATION)
+        {
+            memcpy(output.Data, input.Data, input.Length*sizeof(float));
+            output.Length = input.Length;
+            return;
+        }
+    }
+
+    const float* in = input.Data;
+    float* out = output.Data;
+    if(ctx.PendingSamples > 0.0f)
+    {
+        // Remove a period: [ fade(in[0,P) -> in[P,2P)) | in[2P,N) ]
+        crossFade(in, in+period, period, out);
+        memcpy(out+period, in+2*period, (input.Length - 2*period)*sizeof(float));
+        output.Length = input.Length - period;
+        ctx.PendingSamples -= period;
+    }
+    else
+    {
+        // Repeat a period: [ in[0,P) | fade(in[P,2P) -> in[0,P)) | in[P,N) ]
+        // The inserted period starts off continuing on from in[0,P) and ends up leading back into in[P,2P)
+        memcpy(out, in, period*sizeof(float));
+        crossFade(in+period, in, period, out+period);
+        memcpy(out+2*period, in+period, (input.Length - period)*sizeof(float));
+        output.Length = input.Length + period;
+        ctx.PendingSamples += period;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef _AUDIO_TIMESTRETCH_H
+#define _AUDIO_TIMESTRETCH_H
+
+#include "audio.h"
+
+// Changes the duration of a stream of audio without changing its pitch, by removing or repeating
+// whole pitch periods (a simple form of WSOLA, waveform-similarity overlap-add). We use this to
+// drain or refill the jitter buffers without the audible pitch shift of resampling.
+//
+// Each buffer is handled on its own: we look for the period (within the range of human speech)
+// over which the start of the buffer best matches itself, and then either cross-fade the first
+// period into the second (removing a period) or the second period back into the first (repeating
+// a period). The first sample of the output is always the first sample of the input, so the
+// stream stays continuous across buffers without needing to keep any audio history.
+
+struct TimeStretchStreamContext
+{
+    int MinPeriod; // In samples
+    int MaxPeriod;
+
+    // The number of samples that we've been asked to remove (if positive) or add (if negative)
+    // but have not yet done so, because we can only change the duration a whole period at a time.
+    float PendingSamples;
+};
+
+/// Initialize the context for a stream at the given sample rate.
+void timeStretchInit(TimeStretchStreamContext& ctx, int sampleRate);
+
+/// The longest output that a single call to timeStretchBuffer2Buffer() can produce,
+/// for input of the given length.
+int timeStretchMaxOutputLength(const TimeStretchStreamContext& ctx, int inputLength);
+
+/// Time-stretch the full contents of input into output, overwriting any of output's previous contents.
+/// speedChange is the fraction of the input's duration that we would like to remove, so positive
+/// values speed playback up and negative values slow it down (e.g 0.1 plays 10% faster).
+/// Any change that can't be made on this buffer is carried over to the following buffers, while the
+/// direction of the change stays the same.
+void timeStretchBuffer2Buffer(TimeStretchStreamContext& ctx,
+                              const Audio::AudioBuffer& input,
+                              Audio::AudioBuffer& output,
+                              float speedChange);
+
+#endif // _AUDIO_TIMESTRETCH_H
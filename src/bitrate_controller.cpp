@@ -0,0 +1,160 @@
+#include <math.h>
+
+#include "audio.h"
+#include "bitrate_controller.h"
+#include "math_utils.h"
+
+static const float INITIAL_LEVEL = 0.6f;
+static const float MIN_LEVEL = 0.0f;
+static const float MAX_LEVEL = 1.0f;
+
+// NOTE: We consider the network congested if we're losing this many packets, or if round trips
+//       are taking this much longer than usual (which means that queues are building up).
+static const float CONGESTED_LOSS = 0.08f;
+static const float CONGESTED_QUEUEING_DELAY_MS = 150.0f;
+static const float CONGESTED_RTT_VARIANCE_MS = 100.0f;
+
+// NOTE: We only increase the level once the network is well below the congestion thresholds
+static const float CLEAR_LOSS = 0.02f;
+static const float CLEAR_QUEUEING_DELAY_MS = 50.0f;
+
+static const float DECREASE_FACTOR = 0.7f;
+static const double DECREASE_HOLD_SECONDS = 1.0; // Give the last decrease time to take effect
+static const double INCREASE_DELAY_SECONDS = 3.0; // Don't increase again too soon after a decrease
+static const float INCREASE_PER_SECOND = 0.05f;
+
+static const double LOSS_SMOOTHING_SECONDS = 1.0;
+// NOTE: The baseline round-trip time drops immediately but only rises slowly, so that queueing
+//       delay shows up as an increase above the baseline, while route changes are followed eventually.
+static const double BASELINE_RTT_RISE_SECONDS = 30.0;
+
+static const int AUDIO_MIN_BITRATE = 12000;
+static const int AUDIO_MAX_BITRATE = 32000;
+static const float AUDIO_FULL_BITRATE_LEVEL = 0.5f;
+static const int AUDIO_FEC_MARGIN_PERCENT = 2;
+static const int AUDIO_FEC_MAX_PERCENT = 30;
+
+// NOTE: Each extra audio frame in a packet adds 20ms of latency, but saves the ~50 bytes of UDP/IP and
+//       ENet headers that would otherwise be sent with it (which is more than the frame itself).
+//       We pack more frames into each packet once the baseline round-trip time reaches each of these
+//       thresholds (entry i is where we go from i to i+1 frames) and unpack again once it is back
+//       below the threshold by more than the hysteresis, so that we don't flip back and forth.
+static const float AUDIO_FRAME_PACKING_RTT_MS[Audio::AUDIO_MAX_FRAMES_PER_PACKET] = { 0.0f, 120.0f, 250.0f };
+static const float AUDIO_FRAME_PACKING_HYSTERESIS_MS = 30.0f;
+
+static const int VIDEO_MIN_QUALITY = 8;
+static const int VIDEO_MAX_QUALITY = 48;
+
+BitrateController::BitrateController()
+{
+    hasStarted = false;
+    lastUpdateTime = 0.0;
+    lastDecreaseTime = 0.0;
+    level = INITIAL_LEVEL;
+    smoothedLoss = 0.0f;
+    baselineRoundTripTimeMs = 0.0f;
+    audioFramesPerPacket = 1;
+    settings = SettingsForLevel(level, smoothedLoss);
+}
+
+MediaEncoderSettings BitrateController::Settings()
+{
+    return settings;
+}
+
+float BitrateController::Level()
+{
+    return level;
+}
+
+void BitrateController::UpdateAudioFramesPerPacket()
+{
+    while((audioFramesPerPacket < Audio::AUDIO_MAX_FRAMES_PER_PACKET) &&
+          (baselineRoundTripTimeMs >= AUDIO_FRAME_PACKING_RTT_MS[audioFramesPerPacket]))
+    {
+        audioFramesPerPacket++;
+    }
+    while((audioFramesPerPacket > 1) &&
+          (baselineRoundTripTimeMs < AUDIO_FRAME_PACKING_RTT_MS[audioFramesPerPacket-1] - AUDIO_FRAME_PACKING_HYSTERESIS_MS))
+    {
+        audioFramesPerPacket--;
+    }
+}
+
+MediaEncoderSettings BitrateController::SettingsForLevel(float qualityLevel, float loss)
+{
+    MediaEncoderSettings result = {};
+
+    float audioLevel = minf(1.0f, qualityLevel/AUDIO_FULL_BITRATE_LEVEL);
+    result.audioBitrate = AUDIO_MIN_BITRATE + (int)(audioLevel*(AUDIO_MAX_BITRATE - AUDIO_MIN_BITRATE));
+    int lossPercent = (int)ceilf(loss*100.0f);
+    result.audioExpectedPacketLossPercent = clamp(lossPercent + AUDIO_FEC_MARGIN_PERCENT,
+                                                  AUDIO_FEC_MARGIN_PERCENT, AUDIO_FEC_MAX_PERCENT);
+    result.audioFramesPerPacket = audioFramesPerPacket;
+
+    result.videoQuality = VIDEO_MIN_QUALITY + (int)(qualityLevel*(VIDEO_MAX_QUALITY - VIDEO_MIN_QUALITY));
+    if(qualityLevel >= 0.5f)
+        result.videoFrameInterval = 3;
+    else if(qualityLevel >= 0.25f)
+        result.videoFrameInterval = 4;
+    else
+        result.videoFrameInterval = 6;
+
+    return result;
+}
+
+bool BitrateController::Update(const NetworkConditions& conditions, double currentTime)
+{
+    if(!hasStarted)
+    {
+        hasStarted = true;
+        lastUpdateTime = currentTime;
+        lastDecreaseTime = currentTime;
+        baselineRoundTripTimeMs = conditions.roundTripTimeMs;
+    }
+    float deltaTime = (float)(currentTime - lastUpdateTime);
+    lastUpdateTime = currentTime;
+
+    float loss = maxf(conditions.packetLoss, conditions.receivedPacketLoss);
+    smoothedLoss += (loss - smoothedLoss)*minf(1.0f, deltaTime/(float)LOSS_SMOOTHING_SECONDS);
+
+    if(conditions.roundTripTimeMs < baselineRoundTripTimeMs)
+    {
+        baselineRoundTripTimeMs = conditions.roundTripTimeMs;
+    }
+    else
+    {
+        float baselineRise = conditions.roundTripTimeMs - baselineRoundTripTimeMs;
+        baselineRoundTripTimeMs += baselineRise*minf(1.0f, deltaTime/(float)BASELINE_RTT_RISE_SECONDS);
+    }
+    float queueingDelayMs = conditions.roundTripTimeMs - baselineRoundTripTimeMs;
+
+    bool congested = (smoothedLoss >= CONGESTED_LOSS) ||
+                     (queueingDelayMs >= CONGESTED_QUEUEING_DELAY_MS) ||
+                     (conditions.roundTripTimeVarianceMs >= CONGESTED_RTT_VARIANCE_MS);
+    bool clear = (smoothedLoss < CLEAR_LOSS) && (queueingDelayMs < CLEAR_QUEUEING_DELAY_MS);
+    double timeSinceDecrease = currentTime - lastDecreaseTime;
+    if(congested)
+    {
+        if(timeSinceDecrease >= DECREASE_HOLD_SECONDS)
+        {
+            level *= DECREASE_FACTOR;
+            lastDecreaseTime = currentTime;
+        }
+    }
+    else if(clear && (timeSinceDecrease >= INCREASE_DELAY_SECONDS))
+    {
+        level += INCREASE_PER_SECOND*deltaTime;
+    }
+    level = maxf(MIN_LEVEL, minf(MAX_LEVEL, level));
+
+    UpdateAudioFramesPerPacket();
+    MediaEncoderSettings newSettings = SettingsForLevel(level, smoothedLoss);
+    bool changed = (newSettings.audioBitrate != settings.audioBitrate) ||
+                   (newSettings.audioExpectedPacketLossPercent != settings.audioExpectedPacketLossPercent) ||
+                   (newSettings.audioFramesPerPacket != settings.audioFramesPerPacket) ||
+                   (newSettings.videoQuality != settings.videoQuality) ||
+                   (newSettings.videoFrameInterval != settings.videoFrameInterval);
+    settings = newSettings;
+    return changed;
+}
@@ -0,0 +1,61 @@
+#ifndef _BITRATE_CONTROLLER_H
+#define _BITRATE_CONTROLLER_H
+
+// The state of the network path(s) that we're sending media over
+struct NetworkConditions
+{
+    float roundTripTimeMs;
+    float roundTripTimeVarianceMs;
+    float packetLoss; // The fraction of (reliable) packets that we sent but that didn't arrive
+    float receivedPacketLoss; // The fraction of media packets that we expected to receive but didn't
+};
+
+struct MediaEncoderSettings
+{
+    int audioBitrate; // Bits per second
+    int audioExpectedPacketLossPercent; // How much loss Opus should protect against with in-band FEC
+    int audioFramesPerPacket; // The number of (20ms) Opus frames to send in each network packet
+    int videoQuality; // Theora quality index, from 0 (worst) to 63 (best)
+    int videoFrameInterval; // The number of main loop ticks between each video frame
+};
+
+// A simple congestion controller that adjusts the media encoder settings to the network conditions.
+// It tracks a single quality level in [0,1] which it decreases multiplicatively when it sees
+// signs of congestion (loss or round-trip times rising above the baseline) and increases
+// additively (and slowly) once the network has been clear for a while.
+// Audio is always kept at its maximum bitrate for as long as possible, reducing the video quality
+// and frame rate first.
+// Separately, audio frames are packed together into fewer network packets when the round-trip time
+// of the link is long, where the extra latency matters less than the per-packet overhead.
+class BitrateController
+{
+public:
+    BitrateController();
+
+    // Update our estimate of the network conditions, and the encoder settings to match.
+    // NOTE: This is intended to be called regularly (e.g every tick), currentTime is in seconds.
+    // Returns true if the encoder settings changed.
+    bool Update(const NetworkConditions& conditions, double currentTime);
+
+    MediaEncoderSettings Settings();
+
+    // Returns the current quality level, from 0 (worst) to 1 (best)
+    float Level();
+
+private:
+    bool hasStarted;
+    double lastUpdateTime;
+    double lastDecreaseTime;
+
+    float level;
+    float smoothedLoss;
+    float baselineRoundTripTimeMs;
+    int audioFramesPerPacket;
+
+    MediaEncoderSettings settings;
+
+    MediaEncoderSettings SettingsForLevel(float qualityLevel, float loss);
+    void UpdateAudioFramesPerPacket();
+};
+
+#endif // _BITRATE_CONTROLLER_H
@@ -96,16 +96,22 @@ void renderGame(InterfaceState* game, float deltaTime)
         for(auto userIter=remoteUsers.begin(); userIter!=remoteUsers.end(); userIter++)
         {
             ClientUserData* user = *userIter;
+            bool textureNeedsUpdate = user->videoImage->UpdateReadBuffer();
             if(user->videoTexture == 0)
             {
                 // TODO: These textures never get cleaned up because that'd need to happen from the UI thread
                 user->videoTexture = Render::createTexture();
+                textureNeedsUpdate = true;
+            }
+            // NOTE: We only upload the image when the decoder has published a new one
+            if(textureNeedsUpdate)
+            {
+                glBindTexture(GL_TEXTURE_2D, user->videoTexture);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
+                             cameraWidth, cameraHeight, 0,
+                             GL_RGB, GL_UNSIGNED_BYTE, user->videoImage->ReadBuffer());
+                glBindTexture(GL_TEXTURE_2D, 0);
             }
-            glBindTexture(GL_TEXTURE_2D, user->videoTexture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-                         cameraWidth, cameraHeight, 0,
-                         GL_RGB, GL_UNSIGNED_BYTE, user->videoImage);
-            glBindTexture(GL_TEXTURE_2D, 0);
 
             ImGui::BeginGroup();
             ImGui::Text(user->name);
@@ -213,6 +219,12 @@ void renderGame(InterfaceState* game, float deltaTime)
             Audio::ListenToInput(listening);
         }
 
+        bool framePacking = Audio::IsFramePackingEnabled();
+        if(ImGui::Checkbox("Pack Audio Frames", &framePacking))
+        {
+            Audio::EnableFramePacking(framePacking);
+        }
+
         int selectedPlaybackDevice = Audio::GetAudioOutputDevice();
         bool speakerChanged = ImGui::Combo("Playback Device",
                                            &selectedPlaybackDevice,
@@ -268,6 +280,8 @@ void renderGame(InterfaceState* game, float deltaTime)
             float netTotalIn = Network::TotalIncomingBytes()/1024.0f;
             float netTotalOut = Network::TotalOutgoingBytes()/1024.0f;
             ImGui::Text("Audio packet loss: %.2f%", Audio::GetPacketLoss()*100.0f);
+            ImGui::Text("Audio jitter: %.1fms (buffering %.0fms)",
+                        Audio::GetJitterMs(), Audio::GetPlayoutDelayMs());
             ImGui::Text("Total Incoming: %.1fKB", netTotalIn);
             ImGui::Text("Total Outgoing: %.1fKB", netTotalOut);
             if(ImGui::Button("Disconnect", ImVec2(80,20)))
@@ -1,189 +1,295 @@
 #include <assert.h>
+#include <math.h>
 #include <string.h>
 
 #include "jitterbuffer.h"
 #include "logging.h"
 
-static const int MAX_DATA_LENGTH = 1024*1024;
+static const int DEFAULT_CAPACITY = 6;
+static const int DEFAULT_MAX_DATA_LENGTH = 1500; // Enough for any single (unfragmented) UDP packet
 
-JitterItem::JitterItem()
-{
-    packetIndex = 0;
-    dataLength = 0;
-    data = new uint8_t[MAX_DATA_LENGTH];
-    next = nullptr;
-    prev = nullptr;
-}
+// NOTE: How long we remember extreme transit times for. Delay spikes (e.g on Wi-Fi) tend to recur
+//       so we keep the buffer deep for a while after each one, but not forever.
+static const double DELAY_WINDOW_SECONDS = 8.0;
+// NOTE: The target delay covers this many times the mean deviation in transit time, as well as
+//       the largest delay that we've seen recently.
+static const double JITTER_DELAY_MULTIPLE = 3.0;
+// NOTE: The filter gain for the jitter estimate, as per RFC 3550
+static const double JITTER_GAIN = 1.0/16.0;
+static const int MIN_TARGET_ITEM_COUNT = 1;
 
-JitterItem::~JitterItem()
+JitterBuffer::JitterBuffer()
+    : JitterBuffer(DEFAULT_CAPACITY, DEFAULT_MAX_DATA_LENGTH, 0.0)
 {
-    delete[] data;
 }
 
-JitterBuffer::JitterBuffer()
+JitterBuffer::JitterBuffer(int capacity, int maxDataLength, double packetDurationSeconds)
 {
-    capacity = 6;
-    allItems = new JitterItem[capacity];
-    unusedItems = allItems;
-    unusedItemCount = capacity;
-    first = nullptr;
-    last = nullptr;
+    assert(capacity > 2);
+    assert(maxDataLength > 0);
+    this->capacity = capacity;
+    this->maxDataLength = maxDataLength;
+
+    // NOTE: Packet indices wrap around at 2^16 so the slot count must divide that exactly,
+    //       otherwise the packets either side of the wrap would map to the same slot.
+    slotCount = 1;
+    while(slotCount < capacity)
+    {
+        slotCount *= 2;
+    }
+    slots = new JitterSlot[slotCount];
+    slotData = new uint8_t[slotCount*maxDataLength];
+    for(int i=0; i<slotCount; i++)
+    {
+        slots[i].occupied = false;
+        slots[i].packetIndex = 0;
+        slots[i].dataLength = 0;
+    }
+    itemCount = 0;
     nextOutputPacketIndex = 1;
 
-    for(int i=0; i<capacity-1; i++)
+    packetDuration = packetDurationSeconds;
+    hasArrivalTimes = false;
+    lastArrivalIndex = 0;
+    lastArrivalExtendedIndex = 0;
+    lastTransitTime = 0.0;
+    jitter = 0.0;
+    windowStartTime = 0.0;
+    for(int i=0; i<2; i++)
     {
-        allItems[i].next = &allItems[i+1];
+        minTransitTime[i] = 0.0;
+        maxDelay[i] = 0.0;
     }
+    targetItemCount = capacity/2;
+    latePacketCount = 0;
+    overflowPacketCount = 0;
 }
 
 JitterBuffer::~JitterBuffer()
 {
-    delete[] allItems;
+    delete[] slotData;
+    delete[] slots;
 }
 
 int JitterBuffer::ItemCount()
 {
-    return capacity - unusedItemCount;
+    return itemCount;
 }
+
 int JitterBuffer::DesiredItemCount()
 {
-    return capacity/2;
+    return targetItemCount;
+}
+
+int JitterBuffer::SlotIndex(uint16_t packetIndex)
+{
+    return packetIndex % slotCount;
+}
+
+uint8_t* JitterBuffer::SlotData(int slotIndex)
+{
+    return slotData + slotIndex*maxDataLength;
+}
+
+void JitterBuffer::Clear()
+{
+    for(int i=0; i<slotCount; i++)
+    {
+        slots[i].occupied = false;
+    }
+    itemCount = 0;
 }
 
-JitterItem* JitterBuffer::GetFreeItem()
+JitterBufferStats JitterBuffer::Stats()
 {
-    assert(unusedItemCount > 0);
-    JitterItem* result = unusedItems;
-    unusedItems = unusedItems->next;
-    unusedItemCount--;
+    JitterBufferStats result = {};
+    result.itemCount = ItemCount();
+    result.targetItemCount = targetItemCount;
+    result.jitterMs = (float)(jitter*1000.0);
+    result.peakDelayMs = hasArrivalTimes ? (float)(fmax(maxDelay[0], maxDelay[1])*1000.0) : 0.0f;
+    result.latePacketCount = latePacketCount;
+    result.overflowPacketCount = overflowPacketCount;
     return result;
 }
 
-void JitterBuffer::Add(uint16_t packetIndex, uint16_t dataLength, uint8_t* data)
+void JitterBuffer::UpdateDelayEstimate(uint16_t packetIndex, double arrivalTime)
 {
-    assert(dataLength <= MAX_DATA_LENGTH);
-    if(unusedItems == nullptr)
+    if(packetDuration <= 0.0)
     {
-        logWarn("Dropped packet %d when adding to a full jitterbuffer\n", packetIndex);
         return;
     }
 
-    // NOTE: If the packet we're inserting is older than the oldest packet in the buffer, and there
-    //       are no empty spaces in the buffer, then we've received it too late and we may as well
-    //       ignore it.
-    if((unusedItems == nullptr) && (packetIndex+1 <= first->packetIndex))
+    // NOTE: The transit time is relative to an unknown offset between the sender's clock and ours,
+    //       but that offset cancels out of the differences that we're interested in.
+    int64_t extendedIndex;
+    if(hasArrivalTimes)
     {
-        // Ignore it, its too late
-        return;
+        extendedIndex = lastArrivalExtendedIndex + (int16_t)(packetIndex - lastArrivalIndex);
+    }
+    else
+    {
+        extendedIndex = packetIndex;
     }
+    double transitTime = arrivalTime - extendedIndex*packetDuration;
 
-    // NOTE: If the packet we're inserting is older than the packet that we expect to return next,
-    //       then we've received it too late and we should simply drop it.
-    // NOTE: The extra check to see if the difference is small is so that index overflow is handled
-    //       correctly. Without it we'd drop the last <capacity> packets before overflow and we
-    //       don't need to drop any packets the first time when the output index is small anyways.
-    if((packetIndex < nextOutputPacketIndex) && (nextOutputPacketIndex - packetIndex <= (1u << 15)))
+    if(!hasArrivalTimes)
     {
-        return;
+        hasArrivalTimes = true;
+        lastTransitTime = transitTime;
+        windowStartTime = arrivalTime;
+        minTransitTime[0] = transitTime;
+        minTransitTime[1] = transitTime;
+        maxDelay[0] = 0.0;
+        maxDelay[1] = 0.0;
     }
 
-    JitterItem* currentItem = last;
-    while(currentItem != nullptr)
+    double transitDifference = fabs(transitTime - lastTransitTime);
+    jitter += (transitDifference - jitter)*JITTER_GAIN;
+
+    if(arrivalTime - windowStartTime >= DELAY_WINDOW_SECONDS)
     {
-        if(packetIndex == currentItem->packetIndex)
-        {
-            // We have a duplicate packet, so just return.
-            return;
-        }
+        windowStartTime = arrivalTime;
+        minTransitTime[1] = minTransitTime[0];
+        maxDelay[1] = maxDelay[0];
+        minTransitTime[0] = transitTime;
+        maxDelay[0] = 0.0;
+    }
+    minTransitTime[0] = fmin(minTransitTime[0], transitTime);
+    double delay = transitTime - fmin(minTransitTime[0], minTransitTime[1]);
+    maxDelay[0] = fmax(maxDelay[0], delay);
 
-        if(packetIndex >= (uint16_t)(currentItem->packetIndex+1))
-        {
-            // Insert the new packet after currentItem
-            JitterItem* newItem = GetFreeItem();
-            newItem->next = currentItem->next;
-            newItem->prev = currentItem;
-            if(currentItem->next != nullptr)
-            {
-                currentItem->next->prev = newItem;
-            }
-            else
-            {
-                last = newItem;
-            }
-            currentItem->next = newItem;
+    if(extendedIndex > lastArrivalExtendedIndex)
+    {
+        lastArrivalIndex = packetIndex;
+        lastArrivalExtendedIndex = extendedIndex;
+    }
+    lastTransitTime = transitTime;
 
-            memcpy(newItem->data, data, dataLength);
-            newItem->dataLength = dataLength;
-            newItem->packetIndex = packetIndex;
-            break;
-        }
+    // NOTE: We need one item in the buffer for the packet that we're about to play, plus however
+    //       many packets we expect to arrive late (during which time we're playing what we have).
+    double targetDelay = fmax(fmax(maxDelay[0], maxDelay[1]), JITTER_DELAY_MULTIPLE*jitter);
+    int newTarget = 1 + (int)ceil(targetDelay/packetDuration - 0.001);
+    if(newTarget < MIN_TARGET_ITEM_COUNT)
+        newTarget = MIN_TARGET_ITEM_COUNT;
+    if(newTarget > capacity-2)
+        newTarget = capacity-2;
+    targetItemCount = newTarget;
+}
 
-        currentItem = currentItem->prev;
+void JitterBuffer::Add(uint16_t packetIndex, uint16_t dataLength, uint8_t* data, double arrivalTime)
+{
+    // NOTE: Packets that arrive too late (or to a full buffer) still tell us about the delay
+    UpdateDelayEstimate(packetIndex, arrivalTime);
+    Add(packetIndex, dataLength, data);
+}
+
+void JitterBuffer::Add(uint16_t packetIndex, uint16_t dataLength, uint8_t* data)
+{
+    if(dataLength > maxDataLength)
+    {
+        logWarn("Dropped packet %d of %d bytes, which is too large for the jitterbuffer\n",
+                packetIndex, dataLength);
+        return;
     }
 
-    if(currentItem == nullptr)
+    // NOTE: We can only hold the <capacity> packets starting from the one that we expect to
+    //       return next, since each of those has its own slot. The distance is computed with
+    //       wrapping arithmetic so that index overflow is handled correctly.
+    int distance = (int16_t)(packetIndex - nextOutputPacketIndex);
+    if((distance < 0) || (distance >= capacity))
     {
-        // The item we're adding goes at the beginning of the buffer (and there are items after it)
-        JitterItem* newItem = GetFreeItem();
-        newItem->prev = nullptr;
-        newItem->next = first;
-        if(first == nullptr)
+        // NOTE: If the buffer is empty and the packet is nowhere near where we expected it to be
+        //       then the stream has moved on without us (e.g the sender stopped sending for a while
+        //       or we started receiving partway through), so we restart the stream from this packet.
+        if((itemCount == 0) && ((distance <= -capacity) || (distance >= capacity)))
         {
-            last = newItem;
+            logInfo("Jitterbuffer skipped from packet %d to %d\n", nextOutputPacketIndex, packetIndex);
+            nextOutputPacketIndex = packetIndex;
+            distance = 0;
+        }
+        else if(distance < 0)
+        {
+            // We've received it after we needed it, so we may as well ignore it.
+            latePacketCount++;
+            return;
         }
         else
         {
-            first->prev = newItem;
+            logWarn("Dropped packet %d when adding to a full jitterbuffer\n", packetIndex);
+            overflowPacketCount++;
+            return;
         }
-        first = newItem;
+    }
 
-        memcpy(newItem->data, data, dataLength);
-        newItem->dataLength = dataLength;
-        newItem->packetIndex = packetIndex;
+    int slotIndex = SlotIndex(packetIndex);
+    JitterSlot& slot = slots[slotIndex];
+    if(slot.occupied)
+    {
+        // NOTE: Every packet in the window maps to a different slot, so this must be a duplicate
+        assert(slot.packetIndex == packetIndex);
+        return;
     }
+
+    memcpy(SlotData(slotIndex), data, dataLength);
+    slot.occupied = true;
+    slot.packetIndex = packetIndex;
+    slot.dataLength = dataLength;
+    itemCount++;
 }
 
 uint16_t JitterBuffer::Get(uint16_t packetToGet, uint8_t** data)
 {
+    // NOTE: Any packets before the one that was asked for will never be returned
+    int skippedCount = (int16_t)(packetToGet - nextOutputPacketIndex);
+    if((skippedCount < 0) || (skippedCount >= capacity))
+    {
+        Clear();
+    }
+    else
+    {
+        for(int i=0; i<skippedCount; i++)
+        {
+            JitterSlot& slot = slots[SlotIndex((uint16_t)(nextOutputPacketIndex + i))];
+            if(slot.occupied)
+            {
+                slot.occupied = false;
+                itemCount--;
+            }
+        }
+    }
+
     nextOutputPacketIndex = packetToGet;
     return Get(data);
 }
 
-uint16_t JitterBuffer::Get(uint8_t** data)
+uint16_t JitterBuffer::Peek(uint8_t** data)
 {
-    JitterItem* itemToGet = first;
-    uint16_t expectedPacketIndex = nextOutputPacketIndex;
-    nextOutputPacketIndex++;
-
-    if(itemToGet == nullptr)
+    int slotIndex = SlotIndex(nextOutputPacketIndex);
+    JitterSlot& slot = slots[slotIndex];
+    if(!slot.occupied)
     {
         return 0;
     }
 
-    if(itemToGet->packetIndex != expectedPacketIndex)
-    {
-        logFile("Incorrect expected outpacket index: Expected %d, got %d\n",
-                expectedPacketIndex, itemToGet->packetIndex);
-        return 0;
-    }
+    assert(slot.packetIndex == nextOutputPacketIndex);
+    *data = SlotData(slotIndex);
+    return slot.dataLength;
+}
 
-    uint16_t result = itemToGet->dataLength;
-    *data = itemToGet->data;
+uint16_t JitterBuffer::Get(uint8_t** data)
+{
+    int slotIndex = SlotIndex(nextOutputPacketIndex);
+    JitterSlot& slot = slots[slotIndex];
+    nextOutputPacketIndex++;
 
-    if(first == last)
-    {
-        first = nullptr;
-        last = nullptr;
-    }
-    else
+    if(!slot.occupied)
     {
-        first = first->next;
+        return 0;
     }
 
-    itemToGet->next = unusedItems;
-    unusedItems = itemToGet;
-    unusedItemCount++;
-    assert(unusedItemCount <= capacity);
-
-    return result;
+    // NOTE: The slot's data stays where it is until a later packet is added to the same slot
+    slot.occupied = false;
+    itemCount--;
+    *data = SlotData(slotIndex);
+    return slot.dataLength;
 }
@@ -3,54 +3,97 @@
 
 #include <stdint.h>
 
-struct JitterItem
+struct JitterBufferStats
 {
-    uint16_t packetIndex;
-    uint16_t dataLength;
-    uint8_t* data;
-
-    JitterItem* prev;
-    JitterItem* next;
-
-    JitterItem();
-    ~JitterItem();
+    int itemCount;
+    int targetItemCount;
+    float jitterMs; // The mean deviation in packet transit times (as per RFC 3550)
+    float peakDelayMs; // The largest recent delay of a packet, relative to the fastest recent packet
+    uint32_t latePacketCount; // Packets that arrived after they were needed
+    uint32_t overflowPacketCount; // Packets that arrived when the buffer was full
 };
 
+// A buffer that holds packets from the network until they're needed, reordering them as necessary.
+// Packets are stored in a fixed array of slots indexed by packet index (with room for each of the
+// <capacity> packets after the one that we expect to return next), with enough space
+// preallocated in each slot for the largest packet in the stream.
 class JitterBuffer
 {
 public:
+    // NOTE: A buffer created without a packet duration has no way to estimate the delay of the
+    //       stream from packet arrival times, so it always aims to be half full.
     JitterBuffer();
+    JitterBuffer(int capacity, int maxDataLength, double packetDurationSeconds);
     ~JitterBuffer();
 
     // Add to the buffer, a packet with the given length, data and index within the stream.
     // NOTE: The first packet's index should be 1, not 0.
+    // NOTE: Packets larger than the maximum data length given on construction are dropped.
     void Add(uint16_t packetIndex, uint16_t dataLength, uint8_t* data);
 
+    // As above, but also update the estimate of the network delay using the time (in seconds)
+    // at which the packet was received.
+    void Add(uint16_t packetIndex, uint16_t dataLength, uint8_t* data, double arrivalTime);
+
     // Returns the length of the output buffer
     // NOTE: Please don't modify or delete the contents of data in the calling function.
     //       You must finish using the contents of the data pointer before calling any methods
-    //       on this jitterbuffer again, any call change the contents of the returned pointer.
+    //       on this jitterbuffer again, any call may change the contents of the returned pointer.
     uint16_t Get(uint8_t** data);
     uint16_t Get(uint16_t packetToGet, uint8_t** data);
 
+    // Returns the length of the packet that the next call to Get() would return, without removing
+    // it from the buffer, or 0 if it has not been received.
+    // NOTE: The same restrictions apply to the returned data pointer as for Get().
+    uint16_t Peek(uint8_t** data);
+
     // Return the number of items currently available within the buffer.
     int ItemCount();
 
     // Return the preferred number of items that should be maintained in the buffer.
+    // This adapts to the variation in packet arrival times, so that we keep enough packets
+    // buffered to play through the delays that we've seen recently, but no more.
     int DesiredItemCount();
 
+    JitterBufferStats Stats();
+
 private:
-    int capacity;
-    int unusedItemCount;
+    struct JitterSlot
+    {
+        bool occupied;
+        uint16_t packetIndex;
+        uint16_t dataLength;
+    };
 
-    JitterItem* allItems;
-    JitterItem* unusedItems; // Singly-linked list of items, only item->next is valid.
-    JitterItem* first;
-    JitterItem* last;
+    int capacity;
+    int maxDataLength;
+    int itemCount;
+    int slotCount; // At least capacity, rounded up to a power of two
+    JitterSlot* slots;
+    uint8_t* slotData; // The data for each slot, each with maxDataLength bytes
 
     uint16_t nextOutputPacketIndex;
 
-    JitterItem* GetFreeItem();
+    double packetDuration;
+    bool hasArrivalTimes;
+    uint16_t lastArrivalIndex;
+    int64_t lastArrivalExtendedIndex; // The index of the last packet, without wrapping
+    double lastTransitTime;
+    double jitter;
+    // NOTE: The minimum transit time and maximum delay are each tracked over two consecutive
+    //       windows, so that old extremes are forgotten after one to two windows.
+    double windowStartTime;
+    double minTransitTime[2];
+    double maxDelay[2];
+    int targetItemCount;
+
+    uint32_t latePacketCount;
+    uint32_t overflowPacketCount;
+
+    int SlotIndex(uint16_t packetIndex);
+    uint8_t* SlotData(int slotIndex);
+    void Clear();
+    void UpdateDelayEstimate(uint16_t packetIndex, double arrivalTime);
 };
 
 
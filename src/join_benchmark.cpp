@@ -0,0 +1,143 @@
+// A loopback benchmark for the server's join latency.
+// Repeatedly connects to a running server, creates a new room and waits for the room's
+// initialization data, reporting how long the connection and the join round-trip took.
+//
+// Usage: join_benchmark [hostname] [iterations]
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "enet/enet.h"
+
+#include "common.h"
+#include "logging.h"
+#include "network.h"
+#include "platform.h"
+#include "user.h"
+
+const uint32 BENCHMARK_TIMEOUT_MILLISECONDS = 2000;
+
+// Wait for an event of the given type, returns false if none arrives before the timeout.
+static bool waitForEvent(ENetHost* host, ENetEventType eventType, ENetEvent& netEvent)
+{
+    double timeoutTime = Platform::SecondsSinceStartup() + BENCHMARK_TIMEOUT_MILLISECONDS/1000.0;
+    while(Platform::SecondsSinceStartup() < timeoutTime)
+    {
+        if(enet_host_service(host, &netEvent, 1) <= 0)
+            continue;
+
+        if(netEvent.type == eventType)
+            return true;
+        if(netEvent.type == ENET_EVENT_TYPE_RECEIVE)
+            enet_packet_destroy(netEvent.packet);
+    }
+    return false;
+}
+
+static void logTimings(const char* name, std::vector<double>& timings)
+{
+    if(timings.empty())
+        return;
+
+    std::sort(timings.begin(), timings.end());
+    double total = 0.0;
+    for(double time : timings)
+        total += time;
+
+    logInfo("%s: min=%.3fms median=%.3fms mean=%.3fms p99=%.3fms max=%.3fms\n", name,
+            timings.front(), timings[timings.size()/2], total/timings.size(),
+            timings[(timings.size()*99)/100], timings.back());
+}
+
+int main(int argc, char** argv)
+{
+    const char* serverHostname = (argc > 1) ? argv[1] : "127.0.0.1";
+    int iterations = (argc > 2) ? atoi(argv[2]) : 100;
+
+    if(!initLogging("output-join-benchmark.log"))
+    {
+        return 1;
+    }
+    if(!Platform::Setup())
+    {
+        logFail("Unable to initialize platform subsystem\n");
+        return 1;
+    }
+    if(enet_initialize() != 0)
+    {
+        logFail("Unable to initialize enet!\n");
+        Platform::Shutdown();
+        return 1;
+    }
+
+    ENetAddress serverAddr = {};
+    enet_address_set_host(&serverAddr, serverHostname);
+    serverAddr.port = NET_PORT;
+
+    std::vector<double> connectTimes;
+    std::vector<double> joinTimes;
+    for(int i=0; i<iterations; i++)
+    {
+        ENetHost* host = enet_host_create(nullptr, 1, 2, 0,0);
+        if(!host)
+        {
+            logFail("Unable to create client host\n");
+            break;
+        }
+
+        ENetEvent netEvent;
+        double startTime = Platform::SecondsSinceStartup();
+        ENetPeer* peer = enet_host_connect(host, &serverAddr, 2, 0);
+        if(!peer || !waitForEvent(host, ENET_EVENT_TYPE_CONNECT, netEvent))
+        {
+            logWarn("Timed out connecting to %s\n", serverHostname);
+            enet_host_destroy(host);
+            continue;
+        }
+        double connectTime = Platform::SecondsSinceStartup();
+
+        NetworkUserSetupPacket setupPacket = {};
+        setupPacket.userID = (UserIdentifier)(1 + (i % 0xFFFE));
+        strcpy(setupPacket.name, "benchmark");
+        setupPacket.nameLength = (uint8)strlen(setupPacket.name);
+        setupPacket.createRoom = true;
+        NetworkOutPacket outPacket = createNetworkOutPacket(NET_MSGTYPE_USER_SETUP);
+        setupPacket.serialize(outPacket);
+        outPacket.send(peer, 0, true);
+        enet_host_flush(host);
+
+        bool joined = false;
+        while(!joined && waitForEvent(host, ENET_EVENT_TYPE_RECEIVE, netEvent))
+        {
+            joined = (netEvent.packet->dataLength > 0) &&
+                     (netEvent.packet->data[0] == NET_MSGTYPE_USER_INIT);
+            enet_packet_destroy(netEvent.packet);
+        }
+        double joinTime = Platform::SecondsSinceStartup();
+
+        if(joined)
+        {
+            connectTimes.push_back((connectTime - startTime)*1000.0);
+            joinTimes.push_back((joinTime - connectTime)*1000.0);
+        }
+        else
+        {
+            logWarn("Timed out waiting to join a room on %s\n", serverHostname);
+        }
+
+        enet_peer_disconnect(peer, 0);
+        waitForEvent(host, ENET_EVENT_TYPE_DISCONNECT, netEvent);
+        enet_host_destroy(host);
+    }
+
+    logInfo("Completed %d of %d joins\n", (int)joinTimes.size(), iterations);
+    logTimings("Connect", connectTimes);
+    logTimings("Join round-trip", joinTimes);
+
+    enet_deinitialize();
+    Platform::Shutdown();
+    return joinTimes.empty() ? 1 : 0;
+}
@@ -1,4 +1,5 @@
 #include "audio.h"
+#include "bitrate_controller.h"
 #include "globals.h"
 #include "interface.h"
 #include "logging.h"
@@ -10,6 +11,31 @@
 #define BUILD_VERSION "Unknown"
 #endif
 
+static void updateEncoderSettings(BitrateController& bitrateController, double currentTime)
+{
+    Network::NetworkPeerStats peerStats;
+    if(!Network::GetPeerStats(peerStats))
+    {
+        return;
+    }
+
+    NetworkConditions conditions = {};
+    conditions.roundTripTimeMs = peerStats.roundTripTimeMs;
+    conditions.roundTripTimeVarianceMs = peerStats.roundTripTimeVarianceMs;
+    conditions.packetLoss = peerStats.packetLoss;
+    conditions.receivedPacketLoss = Audio::GetPacketLoss();
+    if(bitrateController.Update(conditions, currentTime))
+    {
+        MediaEncoderSettings settings = bitrateController.Settings();
+        Audio::SetEncoderSettings(settings.audioBitrate, settings.audioExpectedPacketLossPercent,
+                                  settings.audioFramesPerPacket);
+        Video::SetEncoderSettings(settings.videoQuality, settings.videoFrameInterval);
+        logDbug("Encoder settings changed: Audio %dbps (%d%% loss, %d frames per packet), Video quality %d every %d ticks\n",
+                settings.audioBitrate, settings.audioExpectedPacketLossPercent, settings.audioFramesPerPacket,
+                settings.videoQuality, settings.videoFrameInterval);
+    }
+}
+
 int main()
 {
     if(!initLogging("output.log"))
@@ -55,6 +81,8 @@ int main()
     double tickDuration = 1.0/tickRate;
     double nextTickTime = Platform::SecondsSinceStartup();
 
+    BitrateController bitrateController;
+
     GlobalState* globals = new GlobalState();
     globals->isRunning = true;
 
@@ -64,6 +92,7 @@ int main()
     while(globals->isRunning)
     {
         Network::UpdateReceive();
+        updateEncoderSettings(bitrateController, Platform::SecondsSinceStartup());
         Audio::Update();
         Video::Update();
         Network::UpdateSend();
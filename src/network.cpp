@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "enet/enet.h"
 
@@ -37,31 +38,72 @@ SERIALIZE_NATIVE_TYPE_INPUT(float);
 bool NetworkInPacket::serializestring(char* value, uint16 bufferLen)
 {
     uint16 strLen;
-    serializeuint16(strLen);
-    if(strLen >= bufferLen)
+    if(!serializeuint16(strLen))
         return false;
-    for(uint16 i=0; i<strLen; i++)
-    {
-        serializeuint8((uint8&)value[i]);
-    }
+    if((strLen >= bufferLen) || (currentPosition + strLen > length))
+        return false;
+
+    memcpy(value, contents + currentPosition, strLen);
     value[strLen] = 0;
+    currentPosition += strLen;
     return true;
 }
 
 bool NetworkInPacket::serializebytes(uint8_t* data, uint16_t dataLength)
 {
-    serializeuint16(dataLength);
-    for(uint16_t i=0; i<dataLength; i++)
+    // NOTE: dataLength is the size of the buffer we're reading into, the actual number of bytes
+    //       to read is given by the length prefix in the packet.
+    uint16_t bytesLength;
+    if(!serializeuint16(bytesLength))
+        return false;
+    if((bytesLength > dataLength) || (currentPosition + bytesLength > length))
+        return false;
+
+    memcpy(data, contents + currentPosition, bytesLength);
+    currentPosition += bytesLength;
+    return true;
+}
+
+bool NetworkInPacket::serializebytesview(uint8*& data, uint16& dataLength)
+{
+    if(!serializeuint16(dataLength))
+        return false;
+    if(currentPosition + dataLength > length)
+        return false;
+
+    data = contents + currentPosition;
+    currentPosition += dataLength;
+    return true;
+}
+
+bool NetworkOutPacket::reserve(size_t byteCount)
+{
+    assert(!isShared);
+    if(currentPosition + byteCount <= length)
+        return true;
+
+    // NOTE: Most packets are created with the exact size that they need, this is just so that we
+    //       don't fail if the size was underestimated.
+    size_t newLength = 2*length;
+    if(newLength < currentPosition + byteCount)
     {
-        serializeuint8(data[i]);
+        newLength = currentPosition + byteCount;
     }
+    if(enet_packet_resize(enetPacket, newLength) != 0)
+    {
+        logWarn("Failed to resize network packet from %zu to %zu bytes\n", length, newLength);
+        return false;
+    }
+
+    contents = enetPacket->data;
+    length = enetPacket->dataLength;
     return true;
 }
 
 #define SERIALIZE_NATIVE_TYPE_OUTPUT(TYPE);             \
     bool NetworkOutPacket::serialize##TYPE(TYPE& value) \
     {                                                   \
-        if(currentPosition + sizeof(TYPE) > length)     \
+        if(!reserve(sizeof(TYPE)))                      \
             return false;                               \
         *((TYPE*)(contents + currentPosition)) = value; \
         currentPosition += sizeof(TYPE);                \
@@ -88,41 +130,57 @@ bool NetworkOutPacket::serializestring(char* value, uint16 bufferLen)
 
 bool NetworkOutPacket::serializebytes(uint8_t* data, uint16_t dataLength)
 {
-    serializeuint16(dataLength);
-    for(uint16_t i=0; i<dataLength; i++)
-    {
-        serializeuint8(data[i]);
-    }
+    if(!reserve(sizeof(dataLength) + dataLength))
+        return false;
+
+    *((uint16_t*)(contents + currentPosition)) = dataLength;
+    currentPosition += sizeof(dataLength);
+    memcpy(contents + currentPosition, data, dataLength);
+    currentPosition += dataLength;
     return true;
 }
 
+bool NetworkOutPacket::serializebytesview(uint8*& data, uint16& dataLength)
+{
+    return serializebytes(data, dataLength);
+}
+
 void NetworkOutPacket::send(ENetPeer* peer, uint8 channelID, bool isReliable)
 {
-    if(isReliable)
+    uint32 flags = isReliable ? ENET_PACKET_FLAG_RELIABLE
+                              : (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
+    if(!isShared)
     {
-        enetPacket->flags |= ENET_PACKET_FLAG_RELIABLE;
-    }
-    else
-    {
-        enetPacket->flags |= ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT;
+        enetPacket->flags |= flags;
+        enetPacket->dataLength = currentPosition;
+        isShared = true;
     }
+    assert((enetPacket->flags & flags) == flags);
 
-    enetPacket->dataLength = currentPosition;
     // TODO: Does it matter if reliable and unreliable packets get sent on the same channel?
     enet_peer_send(peer, channelID, enetPacket);
 }
 
-NetworkOutPacket createNetworkOutPacket(NetworkMessageType msgType)
+void NetworkOutPacket::destroyIfUnsent()
+{
+    // NOTE: Each peer that a packet is queued for holds a reference to it until it is sent
+    if(enetPacket->referenceCount == 0)
+    {
+        enet_packet_destroy(enetPacket);
+    }
+    enetPacket = nullptr;
+    contents = nullptr;
+}
+
+NetworkOutPacket createNetworkOutPacket(NetworkMessageType msgType, size_t payloadBytes)
 {
     // TODO: Constructors?
     NetworkOutPacket result = {};
 
-    // TODO: This used to be 1200 so that all packets were guaranteed to fit into one internet MTU.
-    //       It was increased so that video keyframes would fit into a single packet easily.
-    //       This should absolutely be changed to either set the size dynamically or to split out
-    //       packets into smaller segments.
-    int maxPacketBytes = 8*1024;
-    ENetPacket* enetPacket = enet_packet_create(NULL, maxPacketBytes, 0);
+    // NOTE: Packets larger than an internet MTU (~1200 bytes) get fragmented by ENet, so large
+    //       messages should be split up before sending them. See video_fragment.h.
+    size_t packetBytes = sizeof(msgType) + payloadBytes;
+    ENetPacket* enetPacket = enet_packet_create(NULL, packetBytes, 0);
     result.enetPacket = enetPacket;
     result.contents = enetPacket->data;
     result.length = enetPacket->dataLength;
@@ -26,6 +26,10 @@ enum NetworkMessageType : uint8
     NET_MSGTYPE_USER_SETUP,
     NET_MSGTYPE_USER_INIT,
     NET_MSGTYPE_USER_CONNECT,
+    NET_MSGTYPE_USER_DISCONNECT,
+    NET_MSGTYPE_USER_REDIRECT,
+    NET_MSGTYPE_VIDEO_HEADER,
+    NET_MSGTYPE_VIDEO_KEYFRAME_REQUEST,
 };
 
 struct NetworkInPacket
@@ -44,6 +48,11 @@ struct NetworkInPacket
 
     bool serializestring(char* value, uint16 bufferLen);
     bool serializebytes(uint8_t* data, uint16_t length);
+
+    // Read a length-prefixed block of bytes without copying it out of the packet.
+    // NOTE: data is set to point into the packet contents, so it is only valid until the
+    //       underlying ENet packet is destroyed.
+    bool serializebytesview(uint8*& data, uint16& dataLength);
 };
 
 struct NetworkOutPacket
@@ -52,6 +61,7 @@ struct NetworkOutPacket
     uint8* contents;
     size_t length;
     size_t currentPosition;
+    bool isShared; // True once the packet has been sent, after which its contents cannot change
 
     bool serializebool(bool& value);
     bool serializeuint8(uint8& value);
@@ -64,9 +74,31 @@ struct NetworkOutPacket
     bool serializestring(char* value, uint16 bufferLen);
     bool serializebytes(uint8_t* data, uint16_t dataLength);
 
+    // The output counterpart of NetworkInPacket::serializebytesview, so that the same packet
+    // serialization code can be used in both directions. The data is copied into the packet.
+    bool serializebytesview(uint8*& data, uint16& dataLength);
+
+    // Send the packet to the given peer.
+    // NOTE: A packet can be sent to any number of peers, they all share (and reference-count)
+    //       the same data so it is only serialized and allocated once. The packet must not be
+    //       serialized into again after the first call to send.
     void send(ENetPeer* peer, uint8 channelID, bool isReliable); // TODO: Do we even need channels? If so then we should probably pick some channel constants
+
+    // Free the packet if it hasn't been (successfully) sent to any peers, since ENet only frees
+    // the packets that it was given. The packet must not be used again after this.
+    void destroyIfUnsent();
+
+private:
+    bool reserve(size_t byteCount);
 };
 
-NetworkOutPacket createNetworkOutPacket(NetworkMessageType msgType);
+// The capacity of packets created without a payload size, they grow if more space is needed.
+const size_t NET_DEFAULT_PAYLOAD_BYTES = 128;
+
+// Create a packet with (initially) enough space for the message type and payloadBytes of data.
+// NOTE: ENet frees the packet once it has been sent to every peer that it was sent to, so every
+//       packet that gets created must be sent to at least one peer (or destroyed, see destroyIfUnsent).
+NetworkOutPacket createNetworkOutPacket(NetworkMessageType msgType,
+                                        size_t payloadBytes = NET_DEFAULT_PAYLOAD_BYTES);
 
 #endif
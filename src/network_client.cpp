@@ -3,9 +3,11 @@
 
 #include "audio.h"
 #include "logging.h"
+#include "math_utils.h"
 #include "network.h"
 #include "network_client.h"
 #include "user_client.h"
+#include "video.h"
 
 struct NetworkData
 {
@@ -17,6 +19,7 @@ struct NetworkData
     RoomIdentifier roomToJoinOnConnect;
 
     RoomIdentifier currentRoomId;
+    bool relayMedia;
 
     uint8 lastSentAudioPacket;
     uint8 lastSentVideoPacket;
@@ -29,6 +32,32 @@ struct NetworkData
 
 static NetworkData networkState = {};
 
+static ClientUserData* findRemoteUser(UserIdentifier userId)
+{
+    for(ClientUserData* user : remoteUsers)
+    {
+        if(user->ID == userId)
+        {
+            return user;
+        }
+    }
+    return nullptr;
+}
+
+static void removeRemoteUser(int userIndex)
+{
+    ClientUserData* sourceUser = remoteUsers[userIndex];
+    remoteUsers.erase(remoteUsers.begin()+userIndex);
+    Audio::RemoveAudioUser(sourceUser->ID);
+    logInfo("%s disconnected\n", sourceUser->name);
+
+    if(sourceUser->netPeer)
+    {
+        enet_peer_disconnect_now(sourceUser->netPeer, 0);
+    }
+    delete sourceUser;
+}
+
 void handleNetworkPacketReceive(NetworkInPacket& incomingPacket)
 {
     uint8 dataType;
@@ -53,6 +82,11 @@ void handleNetworkPacketReceive(NetworkInPacket& incomingPacket)
 
             logInfo("Initialization data received: In room %s with %d other users\n",
                     initPacket.roomId.name, initPacket.userCount);
+            networkState.relayMedia = initPacket.relayMedia;
+            if(networkState.relayMedia)
+            {
+                logInfo("Media is being relayed through the server\n");
+            }
             for(int i=0; i<initPacket.userCount; i++)
             {
                 NetworkUserConnectPacket& userPacket = initPacket.existingUsers[i];
@@ -62,6 +96,11 @@ void handleNetworkPacketReceive(NetworkInPacket& incomingPacket)
 
                 logInfo("%s was already connected\n", userPacket.name);
             }
+            // NOTE: When connecting directly, we send our video headers once the connection is up
+            if(networkState.relayMedia && (initPacket.userCount > 0))
+            {
+                Video::SendHeaders(nullptr);
+            }
             networkState.currentRoomId = initPacket.roomId;
             networkState.connState = NET_CONNSTATE_CONNECTED;
         } break;
@@ -71,12 +110,49 @@ void handleNetworkPacketReceive(NetworkInPacket& incomingPacket)
             if(!connPacket.serialize(incomingPacket))
                 break;
 
-            ClientUserData* newUser = new ClientUserData(connPacket);
-            // TODO: Move this into constructor (I don't really want to have to pass in a host)
-            newUser->netPeer = enet_host_connect(networkState.netHost, &connPacket.address, 1, 0);
+            ClientUserData* newUser = Network::ConnectToPeer(connPacket);
             remoteUsers.push_back(newUser);
             Audio::AddAudioUser(newUser->ID);
             logInfo("%s connected\n", connPacket.name);
+            if(networkState.relayMedia)
+            {
+                Video::SendHeaders(nullptr);
+            }
+        } break;
+        case NET_MSGTYPE_USER_REDIRECT:
+        {
+            NetworkUserRedirectPacket redirectPacket;
+            if(!redirectPacket.serialize(incomingPacket) || (networkState.netPeer == nullptr))
+                break;
+
+            // NOTE: The room we asked for is on a different shard of the server, so we reconnect to
+            //       that shard instead. The SETUP packet gets sent again once we've connected.
+            ENetAddress shardAddr = networkState.netPeer->address;
+            shardAddr.port = redirectPacket.port;
+            logInfo("Redirected to server port %d\n", shardAddr.port);
+
+            enet_peer_disconnect_now(networkState.netPeer, 0);
+            networkState.netPeer = enet_host_connect(networkState.netHost, &shardAddr, 2, 0);
+            if(!networkState.netPeer)
+            {
+                logWarn("Unable to connect to server port %d\n", shardAddr.port);
+                networkState.connState = NET_CONNSTATE_DISCONNECTED;
+            }
+        } break;
+        case NET_MSGTYPE_USER_DISCONNECT:
+        {
+            NetworkUserDisconnectPacket disconnectPacket;
+            if(!disconnectPacket.serialize(incomingPacket))
+                break;
+
+            for(int i=0; i<remoteUsers.size(); i++)
+            {
+                if(remoteUsers[i]->ID == disconnectPacket.userID)
+                {
+                    removeRemoteUser(i);
+                    break;
+                }
+            }
         } break;
 
         case NET_MSGTYPE_AUDIO:
@@ -97,27 +173,47 @@ void handleNetworkPacketReceive(NetworkInPacket& incomingPacket)
             if(!videoInPacket.serialize(incomingPacket))
                 break;
 
-            ClientUserData* sourceUser = nullptr;
-            for(auto userIter=remoteUsers.begin();
-                     userIter!=remoteUsers.end();
-                     userIter++)
+            // NOTE: Video is sent unreliably, so when the server relays it we can receive a user's
+            //       video before we're told that they've connected or after they've disconnected.
+            ClientUserData* sourceUser = findRemoteUser(videoInPacket.srcUser);
+            if(sourceUser == nullptr)
             {
-                if(videoInPacket.srcUser == (*userIter)->ID)
-                {
-                    sourceUser = *userIter;
-                    break;
-                }
+                logDbug("Received a video packet from unknown user ID %d\n", videoInPacket.srcUser);
+                break;
             }
-            // TODO: Do something safer/more elegant here, else we can crash from malicious packets
-            //       In fact we probably want to have a serialize function for Users specifically,
-            //       not just UserIDs, since then we can quit if that fails and it will take into
-            //       account the situation in which the ID doesn't correspond to any users that we
-            //       know of
-            assert(sourceUser != nullptr);
 
             sourceUser->processIncomingVideoPacket(videoInPacket);
         } break;
 
+        case NET_MSGTYPE_VIDEO_HEADER:
+        {
+            Video::NetworkVideoHeaderPacket headerPacket;
+            if(!headerPacket.serialize(incomingPacket))
+                break;
+
+            ClientUserData* sourceUser = findRemoteUser(headerPacket.srcUser);
+            if(sourceUser == nullptr)
+                break;
+
+            if(!Video::SetDecoderHeaders(sourceUser->videoDecoder, headerPacket))
+            {
+                logWarn("Received invalid video headers from user %d\n", headerPacket.srcUser);
+            }
+        } break;
+
+        case NET_MSGTYPE_VIDEO_KEYFRAME_REQUEST:
+        {
+            Video::NetworkVideoKeyframeRequestPacket requestPacket;
+            if(!requestPacket.serialize(incomingPacket))
+                break;
+
+            ClientUserData* sourceUser = findRemoteUser(requestPacket.srcUser);
+            if(sourceUser == nullptr)
+                break;
+
+            Video::ProcessKeyframeRequest(requestPacket, sourceUser->netPeer);
+        } break;
+
         default:
         {
             logWarn("Received data of unknown type: %u\n", dataType);
@@ -155,6 +251,17 @@ void Network::UpdateReceive()
                 setupPkt.serialize(outPacket);
                 outPacket.send(networkState.netPeer, 0, true);
             }
+            else
+            {
+                for(ClientUserData* user : remoteUsers)
+                {
+                    if(user->netPeer == netEvent.peer)
+                    {
+                        Video::SendHeaders(netEvent.peer);
+                        break;
+                    }
+                }
+            }
         } break;
 
         case ENET_EVENT_TYPE_RECEIVE:
@@ -188,6 +295,9 @@ void Network::UpdateReceive()
             int userIndex = -1;
             for(int i=0; i<remoteUsers.size(); i++)
             {
+                if(remoteUsers[i]->netPeer == nullptr)
+                    continue;
+
                 ENetAddress userAddr = remoteUsers[i]->netPeer->address;
                 if((userAddr.host == oldAddr.host) && (userAddr.port == oldAddr.port))
                 {
@@ -198,12 +308,9 @@ void Network::UpdateReceive()
             if(userIndex == -1)
                 break;
 
-            ClientUserData* sourceUser = remoteUsers[userIndex];
-            remoteUsers.erase(remoteUsers.begin()+userIndex);
-            Audio::RemoveAudioUser(sourceUser->ID);
-            logInfo("%s (%x:%u) disconnected\n", sourceUser->name, oldAddr.host, oldAddr.port);
-
-            delete sourceUser;
+            // NOTE: The peer has already disconnected, so we don't need to disconnect it again
+            remoteUsers[userIndex]->netPeer = nullptr;
+            removeRemoteUser(userIndex);
         } break;
         }
     }
@@ -262,7 +369,10 @@ void Network::Shutdown()
 
     for(ClientUserData* peer : remoteUsers)
     {
-        enet_peer_disconnect_now(peer->netPeer, 0);
+        if(peer->netPeer)
+        {
+            enet_peer_disconnect_now(peer->netPeer, 0);
+        }
     }
 
     enet_deinitialize();
@@ -291,6 +401,13 @@ void Network::ConnectToMasterServer(const char* serverHostname,
 ClientUserData* Network::ConnectToPeer(NetworkUserConnectPacket& userPacket)
 {
     ClientUserData* newUser = new ClientUserData(userPacket);
+    if(networkState.relayMedia)
+    {
+        // NOTE: Everything we send to and receive from this user goes through the server
+        newUser->netPeer = nullptr;
+        return newUser;
+    }
+
     // TODO: Move this into constructor (I don't really want to have to pass in a host)
     newUser->netPeer = enet_host_connect(networkState.netHost, &userPacket.address, 1, 0);
     if(!newUser->netPeer)
@@ -304,10 +421,14 @@ void Network::DisconnectFromAllPeers()
 {
     for(ClientUserData* peer : remoteUsers)
     {
-        enet_peer_disconnect_now(peer->netPeer, 0);
+        if(peer->netPeer)
+        {
+            enet_peer_disconnect_now(peer->netPeer, 0);
+        }
         delete peer;
     }
     remoteUsers.clear();
+    networkState.relayMedia = false;
 
     enet_peer_disconnect(networkState.netPeer, 0);
     networkState.netPeer = nullptr;
@@ -315,6 +436,78 @@ void Network::DisconnectFromAllPeers()
     networkState.connState = NET_CONNSTATE_DISCONNECTED;
 }
 
+// NOTE: Users that we haven't connected to directly yet (or that we've lost our connection to)
+//       have no peer, so the packet might not be sent to anybody at all.
+void Network::SendToRoom(NetworkOutPacket& packet, uint8 channelID, bool isReliable)
+{
+    if(networkState.relayMedia)
+    {
+        if(networkState.netPeer)
+        {
+            packet.send(networkState.netPeer, channelID, isReliable);
+        }
+    }
+    else
+    {
+        for(int i=0; i<remoteUsers.size(); i++)
+        {
+            if(remoteUsers[i]->netPeer)
+            {
+                packet.send(remoteUsers[i]->netPeer, channelID, isReliable);
+            }
+        }
+    }
+    packet.destroyIfUnsent();
+}
+
+void Network::SendToUser(NetworkOutPacket& packet, ENetPeer* userPeer, uint8 channelID, bool isReliable)
+{
+    ENetPeer* peer = networkState.relayMedia ? networkState.netPeer : userPeer;
+    if(peer)
+    {
+        packet.send(peer, channelID, isReliable);
+    }
+    packet.destroyIfUnsent();
+}
+
+static void accumulatePeerStats(Network::NetworkPeerStats& stats, ENetPeer* peer)
+{
+    float packetLoss = peer->packetLoss * 1.0f/ENET_PEER_PACKET_LOSS_SCALE;
+    stats.roundTripTimeMs = maxf(stats.roundTripTimeMs, (float)peer->roundTripTime);
+    stats.roundTripTimeVarianceMs = maxf(stats.roundTripTimeVarianceMs, (float)peer->roundTripTimeVariance);
+    stats.packetLoss = maxf(stats.packetLoss, packetLoss);
+}
+
+bool Network::GetPeerStats(NetworkPeerStats& stats)
+{
+    stats = {};
+    if(remoteUsers.empty())
+    {
+        return false;
+    }
+
+    if(networkState.relayMedia)
+    {
+        if(networkState.netPeer == nullptr)
+        {
+            return false;
+        }
+        accumulatePeerStats(stats, networkState.netPeer);
+        return true;
+    }
+
+    bool foundPeer = false;
+    for(ClientUserData* user : remoteUsers)
+    {
+        if(user->netPeer && (user->netPeer->state == ENET_PEER_STATE_CONNECTED))
+        {
+            accumulatePeerStats(stats, user->netPeer);
+            foundPeer = true;
+        }
+    }
+    return foundPeer;
+}
+
 uint64_t Network::TotalIncomingBytes()
 {
     return networkState.totalBytesReceived;
@@ -7,6 +7,14 @@
 
 namespace Network
 {
+    // The link statistics that ENet keeps for the peers that we send media to
+    struct NetworkPeerStats
+    {
+        float roundTripTimeMs;
+        float roundTripTimeVarianceMs;
+        float packetLoss; // The fraction of reliable packets that we had to resend
+    };
+
     NetConnectionState CurrentConnectionState();
     bool IsConnectedToMasterServer();
     RoomIdentifier CurrentRoom();
@@ -20,6 +28,22 @@ namespace Network
     ClientUserData* ConnectToPeer(NetworkUserConnectPacket& userPacket);
     void DisconnectFromAllPeers();
 
+    // Send the packet to every other user in the current room, either directly or by way of the
+    // server (if it is relaying media).
+    // NOTE: The packet is not sent at all if there are no other users in the room (or we have no
+    //       connection to any of them), in which case it is destroyed instead.
+    void SendToRoom(NetworkOutPacket& packet, uint8 channelID, bool isReliable);
+
+    // Send the packet to a single other user in the current room, given the peer for that user.
+    // NOTE: If the server is relaying media then we have no direct connection to the user, so
+    //       the packet goes to the whole room and the other users must ignore it.
+    //       If we have no connection to the user then the packet is destroyed instead.
+    void SendToUser(NetworkOutPacket& packet, ENetPeer* userPeer, uint8 channelID, bool isReliable);
+
+    // Get the statistics for the worst of the connections that we send media over.
+    // Returns false if we aren't currently sending media to anybody.
+    bool GetPeerStats(NetworkPeerStats& stats);
+
     uint64_t TotalIncomingBytes();
     uint64_t TotalOutgoingBytes();
 }
@@ -6,6 +6,25 @@
 
 // TODO: Docs, what do these functions return?
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PLATFORM_X86 1
+#endif
+
+// NOTE: GCC and Clang only allow SIMD intrinsics to be used in functions that are compiled for a
+//       instruction set that includes them, so functions containing intrinsics for instruction
+//       sets that are newer than what we compile for need to be marked with these, and should
+//       only be called after checking Platform::GetCPUFeatures() at runtime.
+//       MSVC allows intrinsics to be used anywhere, so they expand to nothing there.
+#if defined(__GNUC__) || defined(__clang__)
+#define PLATFORM_TARGET_SSE2 __attribute__((target("sse2")))
+#define PLATFORM_TARGET_AVX __attribute__((target("avx")))
+#define PLATFORM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PLATFORM_TARGET_SSE2
+#define PLATFORM_TARGET_AVX
+#define PLATFORM_TARGET_AVX2
+#endif
+
 namespace Platform
 {
     struct DateTime
@@ -19,6 +38,13 @@ namespace Platform
         uint16_t Millisecond;
     };
 
+    struct CPUFeatures
+    {
+        bool SSE2;
+        bool AVX;
+        bool AVX2;
+    };
+
     struct Thread;
     typedef int ThreadStartFunction(void*);
 
@@ -34,6 +60,16 @@ namespace Platform
     void LockMutex(Mutex* mutex);
     void UnlockMutex(Mutex* mutex);
 
+    // An auto-resetting event, that wakes (at most) one thread that is waiting on it each time it
+    // is signalled. If no thread is waiting when it is signalled then the next wait returns immediately.
+    // NOTE: Signalling an event never blocks, so it is safe to do from a realtime (e.g audio) callback.
+    struct Event;
+    Event* CreateEvent();
+    void DestroyEvent(Event* event);
+    void SignalEvent(Event* event);
+    // Returns true if the event was signalled, or false if we timed out waiting for it.
+    bool WaitForEvent(Event* event, uint32_t timeoutMilliseconds);
+
     void SleepForMilliseconds(uint32_t milliseconds);
 
     double SecondsSinceStartup();
@@ -43,6 +79,13 @@ namespace Platform
     bool IsPushToTalkKeyPushed();
 
     DateTime GetLocalDateTime();
+
+    // Returns the SIMD instruction sets supported by the CPU (and OS) that we're running on.
+    // All values are false on non-x86 platforms.
+    CPUFeatures GetCPUFeatures();
+
+    // Returns the number of logical processors that are available to us (always at least 1)
+    int GetProcessorCount();
 }
 
 #endif
@@ -1,8 +1,12 @@
+#include <errno.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #include "common.h"
 #include "platform.h"
 
@@ -42,6 +46,65 @@ void Platform::UnlockMutex(Mutex* mutex)
     pthread_mutex_unlock(&mutex->mutex);
 }
 
+// NOTE: Events are signalled from realtime audio callbacks, so signalling must never take a lock.
+//       Posting a semaphore doesn't, and the flag makes sure that it is only posted once for any
+//       number of signals between waits (so that the event resets after each wait).
+struct Platform::Event
+{
+    sem_t semaphore;
+    std::atomic<bool> signalled;
+};
+
+Platform::Event* Platform::CreateEvent()
+{
+    Event* result = new Event();
+    sem_init(&result->semaphore, 0, 0);
+    result->signalled = false;
+    return result;
+}
+
+void Platform::DestroyEvent(Event* event)
+{
+    sem_destroy(&event->semaphore);
+    delete event;
+}
+
+void Platform::SignalEvent(Event* event)
+{
+    if(!event->signalled.exchange(true))
+    {
+        sem_post(&event->semaphore);
+    }
+}
+
+bool Platform::WaitForEvent(Event* event, uint32 timeoutMilliseconds)
+{
+    // NOTE: sem_timedwait takes an absolute time on the realtime clock
+    timespec timeout;
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_sec += timeoutMilliseconds/1000;
+    timeout.tv_nsec += (timeoutMilliseconds%1000)*1000000;
+    if(timeout.tv_nsec >= 1000000000)
+    {
+        timeout.tv_sec += 1;
+        timeout.tv_nsec -= 1000000000;
+    }
+
+    int error;
+    do
+    {
+        error = sem_timedwait(&event->semaphore, &timeout);
+    } while((error != 0) && (errno == EINTR));
+    if(error != 0)
+    {
+        return false;
+    }
+
+    // NOTE: Anything that signals us after this posts the semaphore again, so we can't miss it
+    event->signalled = false;
+    return true;
+}
+
 Platform::Thread* Platform::CreateThread(Platform::ThreadStartFunction* entryPoint, void* data)
 {
     Thread* result = new Thread();
@@ -108,6 +171,27 @@ Platform::DateTime Platform::GetLocalDateTime()
     return result;
 }
 
+Platform::CPUFeatures Platform::GetCPUFeatures()
+{
+    CPUFeatures result = {};
+#ifdef PLATFORM_X86
+    result.SSE2 = __builtin_cpu_supports("sse2");
+    result.AVX = __builtin_cpu_supports("avx");
+    result.AVX2 = __builtin_cpu_supports("avx2");
+#endif
+    return result;
+}
+
+int Platform::GetProcessorCount()
+{
+    long result = sysconf(_SC_NPROCESSORS_ONLN);
+    if(result < 1)
+    {
+        return 1;
+    }
+    return (int)result;
+}
+
 bool Platform::Setup()
 {
     timespec startupTs;
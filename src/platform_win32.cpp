@@ -6,7 +6,11 @@
 #ifdef CreateMutex
 #undef CreateMutex
 #endif
+#ifdef CreateEvent
+#undef CreateEvent
+#endif
 
+#include <intrin.h>
 #include <stdlib.h>
 
 #include "platform.h"
@@ -49,6 +53,35 @@ void Platform::UnlockMutex(Platform::Mutex* mutex)
     LeaveCriticalSection(&mutex->critSec);
 }
 
+struct Platform::Event
+{
+    HANDLE handle;
+};
+
+Platform::Event* Platform::CreateEvent()
+{
+    Event* result = (Event*)malloc(sizeof(Event));
+    result->handle = ::CreateEventA(nullptr, FALSE, FALSE, nullptr); // Auto-reset, initially unsignalled
+    return result;
+}
+
+void Platform::DestroyEvent(Platform::Event* event)
+{
+    CloseHandle(event->handle);
+    free(event);
+}
+
+void Platform::SignalEvent(Platform::Event* event)
+{
+    SetEvent(event->handle);
+}
+
+bool Platform::WaitForEvent(Platform::Event* event, uint32_t timeoutMilliseconds)
+{
+    DWORD waitResult = WaitForSingleObject(event->handle, timeoutMilliseconds);
+    return (waitResult == WAIT_OBJECT_0);
+}
+
 Platform::Thread* Platform::CreateThread(Platform::ThreadStartFunction* entryPoint, void* data)
 {
     HANDLE threadHandle = ::CreateThread(nullptr, 0,
@@ -112,6 +145,43 @@ Platform::DateTime Platform::GetLocalDateTime()
     return result;
 }
 
+Platform::CPUFeatures Platform::GetCPUFeatures()
+{
+    CPUFeatures result = {};
+    int cpuInfo[4];
+    __cpuid(cpuInfo, 0);
+    int maxFunctionId = cpuInfo[0];
+
+    __cpuid(cpuInfo, 1);
+    result.SSE2 = (cpuInfo[3] & (1 << 26)) != 0;
+
+    // NOTE: AVX also requires that the OS saves the YMM registers on a context switch
+    bool osSavesYMM = false;
+    if((cpuInfo[2] & (1 << 27)) != 0) // OSXSAVE
+    {
+        osSavesYMM = ((_xgetbv(0) & 0x6) == 0x6);
+    }
+    result.AVX = osSavesYMM && ((cpuInfo[2] & (1 << 28)) != 0);
+
+    if(maxFunctionId >= 7)
+    {
+        __cpuidex(cpuInfo, 7, 0);
+        result.AVX2 = result.AVX && ((cpuInfo[1] & (1 << 5)) != 0);
+    }
+    return result;
+}
+
+int Platform::GetProcessorCount()
+{
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    if(systemInfo.dwNumberOfProcessors < 1)
+    {
+        return 1;
+    }
+    return (int)systemInfo.dwNumberOfProcessors;
+}
+
 bool Platform::Setup()
 {
     LARGE_INTEGER clockFrequency;
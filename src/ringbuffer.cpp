@@ -3,6 +3,7 @@
 
 #include "platform.h"
 #include "logging.h"
+#include "math_utils.h"
 #include "ringbuffer.h"
 
 RingBuffer::RingBuffer(int startingSampleRate, int size)
@@ -48,6 +49,41 @@ void RingBuffer::write(float value)
     Platform::UnlockMutex(lock);
 }
 
+void RingBuffer::write(const float* values, int valueCount)
+{
+    if(valueCount <= 0)
+    {
+        return;
+    }
+    if(valueCount > capacity-1)
+    {
+        values += valueCount - (capacity-1);
+        valueCount = capacity-1;
+    }
+
+    Platform::LockMutex(lock);
+    int overwrittenCount = valueCount - freeInternal();
+    if(overwrittenCount > 0)
+    {
+        readIndex += overwrittenCount;
+        if(readIndex >= capacity)
+        {
+            readIndex -= capacity;
+        }
+    }
+
+    RingBufferRegion region = getRegion(writeIndex, valueCount);
+    memcpy(region.first, values, region.firstLength*sizeof(float));
+    memcpy(region.second, values+region.firstLength, region.secondLength*sizeof(float));
+
+    writeIndex += valueCount;
+    if(writeIndex >= capacity)
+    {
+        writeIndex -= capacity;
+    }
+    Platform::UnlockMutex(lock);
+}
+
 int RingBuffer::read(float* value)
 {
     Platform::LockMutex(lock);
@@ -69,17 +105,78 @@ int RingBuffer::read(float* value)
     return 1;
 }
 
+int RingBuffer::read(float* values, int maxValueCount)
+{
+    RingBufferRegion region = peekRead(maxValueCount);
+    memcpy(values, region.first, region.firstLength*sizeof(float));
+    memcpy(values+region.firstLength, region.second, region.secondLength*sizeof(float));
+
+    int result = region.firstLength + region.secondLength;
+    commitRead(result);
+    return result;
+}
+
+RingBufferRegion RingBuffer::peekRead(int maxValueCount)
+{
+    Platform::LockMutex(lock);
+    int length = min(countInternal(), maxValueCount);
+    return getRegion(readIndex, length);
+}
+
+void RingBuffer::commitRead(int valueCount)
+{
+    assert((valueCount >= 0) && (valueCount <= countInternal()));
+    readIndex += valueCount;
+    if(readIndex >= capacity)
+    {
+        readIndex -= capacity;
+    }
+    Platform::UnlockMutex(lock);
+}
+
+RingBufferRegion RingBuffer::peekWrite(int maxValueCount)
+{
+    Platform::LockMutex(lock);
+    int length = min(freeInternal(), maxValueCount);
+    return getRegion(writeIndex, length);
+}
+
+void RingBuffer::commitWrite(int valueCount)
+{
+    assert((valueCount >= 0) && (valueCount <= freeInternal()));
+    writeIndex += valueCount;
+    if(writeIndex >= capacity)
+    {
+        writeIndex -= capacity;
+    }
+    Platform::UnlockMutex(lock);
+}
+
+RingBufferRegion RingBuffer::getRegion(int startIndex, int length)
+{
+    RingBufferRegion result = {};
+    result.first = buffer + startIndex;
+    result.firstLength = min(length, capacity - startIndex);
+    result.second = buffer;
+    result.secondLength = length - result.firstLength;
+    return result;
+}
+
 int RingBuffer::count()
 {
     Platform::LockMutex(lock);
-    int localWriteIndex = writeIndex;
-    int localReadIndex = readIndex;
+    int result = countInternal();
     Platform::UnlockMutex(lock);
 
-    if(localWriteIndex < localReadIndex)
-        return (capacity - localReadIndex) + localWriteIndex;
+    return result;
+}
+
+int RingBuffer::countInternal()
+{
+    if(writeIndex < readIndex)
+        return (capacity - readIndex) + writeIndex;
     else
-        return localWriteIndex - localReadIndex;
+        return writeIndex - readIndex;
 }
 
 int RingBuffer::free()
@@ -113,3 +210,139 @@ void RingBuffer::clear()
     readIndex = 0;
     Platform::UnlockMutex(lock);
 }
+
+SPSCRingBuffer::SPSCRingBuffer(int startingSampleRate, int size)
+    : sampleRate(startingSampleRate), capacity(size),
+      writeIndex(0), writeClaimIndex(0), writeSlot(0), readIndex(0), readSlot(0)
+{
+    assert(size > 1);
+    buffer = new std::atomic<float>[size];
+    for(int i=0; i<size; i++)
+    {
+        buffer[i].store(0.0f, std::memory_order_relaxed);
+    }
+}
+
+SPSCRingBuffer::~SPSCRingBuffer()
+{
+    delete[] buffer;
+}
+
+void SPSCRingBuffer::write(float value)
+{
+    write(&value, 1);
+}
+
+void SPSCRingBuffer::write(const float* values, int valueCount)
+{
+    if(valueCount <= 0)
+    {
+        return;
+    }
+    if(valueCount > capacity-1)
+    {
+        values += valueCount - (capacity-1);
+        valueCount = capacity-1;
+    }
+    uint64_t newWriteIndex = writeIndex.load(std::memory_order_relaxed) + valueCount;
+
+    // NOTE: We announce which slots we're about to write to before writing them, so that if the
+    //       reader sees any of the new values (having wrapped around onto a slot it was busy
+    //       reading), it is also guaranteed to see the claim, and can tell that it was overwritten.
+    writeClaimIndex.store(newWriteIndex, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for(int i=0; i<valueCount; i++)
+    {
+        buffer[writeSlot].store(values[i], std::memory_order_relaxed);
+        writeSlot++;
+        if(writeSlot >= capacity)
+        {
+            writeSlot -= capacity;
+        }
+    }
+
+    writeIndex.store(newWriteIndex, std::memory_order_release);
+}
+
+int SPSCRingBuffer::read(float* value)
+{
+    return read(value, 1);
+}
+
+int SPSCRingBuffer::read(float* values, int maxValueCount)
+{
+    uint64_t maxUnread = (uint64_t)(capacity - 1);
+
+    while(true)
+    {
+        uint64_t localReadIndex = readIndex.load(std::memory_order_relaxed);
+        int slot = readSlot;
+
+        uint64_t localWriteIndex = writeIndex.load(std::memory_order_acquire);
+        uint64_t localClaimIndex = writeClaimIndex.load(std::memory_order_relaxed);
+        if(localClaimIndex - localReadIndex > maxUnread)
+        {
+            // The writer has overwritten (or is busy overwriting) values we hadn't read yet,
+            // so skip to the oldest value that is still intact.
+            localReadIndex = localClaimIndex - maxUnread;
+            slot = (int)(localReadIndex % (uint64_t)capacity);
+        }
+
+        if(localWriteIndex <= localReadIndex)
+        {
+            return 0;
+        }
+        int result = min((int)(localWriteIndex - localReadIndex), maxValueCount);
+
+        for(int i=0; i<result; i++)
+        {
+            values[i] = buffer[slot].load(std::memory_order_relaxed);
+            slot++;
+            if(slot >= capacity)
+            {
+                slot -= capacity;
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // NOTE: If the writer started writing over the oldest slot we read while we were reading
+        //       it, then our values may be newer than the ones we wanted, so we try again.
+        localClaimIndex = writeClaimIndex.load(std::memory_order_relaxed);
+        if(localClaimIndex - localReadIndex > maxUnread)
+        {
+            continue;
+        }
+
+        readSlot = slot;
+        readIndex.store(localReadIndex+result, std::memory_order_release);
+        return result;
+    }
+}
+
+int SPSCRingBuffer::count()
+{
+    uint64_t localReadIndex = readIndex.load(std::memory_order_acquire);
+    uint64_t localWriteIndex = writeIndex.load(std::memory_order_acquire);
+
+    // NOTE: We load readIndex first so that localWriteIndex >= localReadIndex, even if either
+    //       index is changed by the other thread between the two loads.
+    uint64_t result = localWriteIndex - localReadIndex;
+    if(result > (uint64_t)(capacity - 1))
+    {
+        result = capacity - 1;
+    }
+    return (int)result;
+}
+
+int SPSCRingBuffer::free()
+{
+    return (capacity - 1) - count();
+}
+
+void SPSCRingBuffer::clear()
+{
+    uint64_t localWriteIndex = writeIndex.load(std::memory_order_acquire);
+    readSlot = (int)(localWriteIndex % (uint64_t)capacity);
+    readIndex.store(localWriteIndex, std::memory_order_release);
+}
@@ -1,10 +1,22 @@
 #ifndef _RING_BUFFER_H
 #define _RING_BUFFER_H
 
+#include <atomic>
+#include <stdint.h>
+
 #include "platform.h"
 
-// TODO: We might only ever read/write values one at a time, in which case we can greatly simplify
-//       the read and write methods that currently handle the potential wrapping logic.
+// A view of a (possibly wrapped) range of a ring buffer, as a pair of contiguous arrays.
+// The range consists of the firstLength values at first, followed by the secondLength values at
+// second. If the range does not wrap around the end of the buffer then secondLength is 0.
+struct RingBufferRegion
+{
+    float* first;
+    int firstLength;
+    float* second;
+    int secondLength;
+};
+
 class RingBuffer
 {
 public:
@@ -15,13 +27,38 @@ public:
     // NOTE: If the buffer is full, the oldest value will be removed to make space for the new one.
     void write(float value);
 
-    // Read an array of values out of the buffer, writing them into the given vals array
+    // Write valueCount values from the given array into the buffer
+    // NOTE: If there is not enough space, the oldest values will be removed to make space for the
+    //       new ones. If valueCount is larger than the buffer can hold, only the last values are kept.
+    void write(const float* values, int valueCount);
+
+    // Read a single value out of the buffer
     //
     // Returns the number of values that were written.
     // If there is a value available, then 1 will be returned and *value will be the resulting value.
     // Otherwise, 0 will be returned and the contents of value will not be modified.
     int read(float* value);
 
+    // Read up to maxValueCount values out of the buffer, writing them into the given values array
+    //
+    // Returns the number of values that were written, which is less than maxValueCount only if
+    // there were fewer values available. Elements of values after those written are not modified.
+    int read(float* values, int maxValueCount);
+
+    // Get direct access to (up to maxValueCount of) the values available for reading.
+    // The buffer remains locked until commitRead() is called, which must be done before any other
+    // method is called on this buffer, and must be passed the number of values actually consumed
+    // (which may be less than the length of the returned region).
+    RingBufferRegion peekRead(int maxValueCount);
+    void commitRead(int valueCount);
+
+    // Get direct access to (up to maxValueCount of) the free space in the buffer.
+    // The buffer remains locked until commitWrite() is called, which must be done before any other
+    // method is called on this buffer, and must be passed the number of values actually written
+    // (which may be less than the length of the returned region).
+    RingBufferRegion peekWrite(int maxValueCount);
+    void commitWrite(int valueCount);
+
     // Returns the number of items that are available for reading in the buffer
     int count();
 
@@ -45,7 +82,73 @@ private:
     Platform::Mutex* lock;
 
     // NOTE: These functions are not thread-safe
+    int countInternal();
     int freeInternal();
+    RingBufferRegion getRegion(int startIndex, int length);
+};
+
+// A lock-free variant of RingBuffer for use when there is exactly one thread writing to the
+// buffer and exactly one (possibly different) thread reading from it, such as when passing
+// samples to or from the realtime audio callbacks.
+// It has the same semantics as RingBuffer (including overwriting the oldest values when full)
+// but write() never blocks, which avoids priority inversion on the audio threads.
+class SPSCRingBuffer
+{
+public:
+    SPSCRingBuffer(int sampleRate, int size);
+    ~SPSCRingBuffer();
+
+    // Write a value into the buffer. Must only be called from the producer thread.
+    // NOTE: If the buffer is full, the oldest value will be removed to make space for the new one.
+    void write(float value);
+
+    // Write valueCount values into the buffer. Must only be called from the producer thread.
+    // The values only become visible to the consumer once they have all been written.
+    // NOTE: As with RingBuffer, the oldest values are removed if there is not enough space.
+    void write(const float* values, int valueCount);
+
+    // Read a single value out of the buffer. Must only be called from the consumer thread.
+    //
+    // If there is a value available, then 1 will be returned and *value will be the resulting value.
+    // Otherwise, 0 will be returned and the contents of value will not be modified.
+    int read(float* value);
+
+    // Read up to maxValueCount values out of the buffer. Must only be called from the consumer thread.
+    //
+    // Returns the number of values that were written into the values array.
+    int read(float* values, int maxValueCount);
+
+    // Returns the number of items that are available for reading in the buffer
+    int count();
+
+    // Returns the number of items that can be written without overwriting unread values.
+    int free();
+
+    // Empty the ringbuffer. Must only be called from the consumer thread.
+    void clear();
+
+
+    int sampleRate;
+private:
+    static const int CACHE_LINE_SIZE = 64;
+
+    int capacity;
+    std::atomic<float>* buffer;
+
+    // NOTE: The indices below count every value ever written/read and are only reduced modulo
+    //       capacity when accessing the buffer. This lets the reader detect that the writer has
+    //       lapped it, without the writer ever needing to modify readIndex.
+    //       Each index is given its own cache line so that the two threads don't contend on it.
+    //       writeIndex is the index up to which values are available for reading, while
+    //       writeClaimIndex is the index up to which the writer may have started overwriting slots.
+    char padding0[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> writeIndex;
+    std::atomic<uint64_t> writeClaimIndex;
+    int writeSlot; // Only accessed by the producer, equal to writeIndex % capacity
+    char padding1[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> readIndex;
+    int readSlot; // Only accessed by the consumer, equal to readIndex % capacity
+    char padding2[CACHE_LINE_SIZE];
 };
 
 #endif
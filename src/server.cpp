@@ -1,25 +1,37 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include <unordered_map>
 #include <random>
 
 #include "enet/enet.h"
 
+#include "audio_level.h"
 #include "common.h"
 #include "user.h"
 #include "network.h"
 #include "logging.h"
 #include "platform.h"
+#include "timerwheel.h"
 
 #include "wordlist_adjectives.cpp"
 #include "wordlist_nouns.cpp"
 
 using namespace std;
 
-RoomIdentifier GetRandomRoomId()
+// The longest time that we'll wait for network events before checking for due timers.
+const uint32 MAX_SERVICE_WAIT_MILLISECONDS = 1000;
+const uint32 STATUS_LOG_INTERVAL_MILLISECONDS = 60*1000;
+
+// The maximum number of clients that can be connected to a single shard at once.
+// NOTE: ENet supports at most 4095 peers per host.
+const int MAX_PEERS_PER_SHARD = 1024;
+const int MAX_SHARDS = 64;
+
+RoomIdentifier GetRandomRoomId(default_random_engine& rng)
 {
-    static random_device randDevice;
-    static default_random_engine rng(randDevice());
-    static uniform_int_distribution<int> nounDistrib(0, nounCount);
-    static uniform_int_distribution<int> adjectiveDistrib(0, adjectiveCount);
+    uniform_int_distribution<int> nounDistrib(0, nounCount-1);
+    uniform_int_distribution<int> adjectiveDistrib(0, adjectiveCount-1);
 
     const char* adj1 = allAdjectives[adjectiveDistrib(rng)];
     const char* adj2 = allAdjectives[adjectiveDistrib(rng)];
@@ -31,41 +43,141 @@ RoomIdentifier GetRandomRoomId()
     return result;
 }
 
-int main()
+struct RoomIdentifierHash
 {
-    if(!initLogging("output-server.log"))
+    size_t operator()(const RoomIdentifier& roomId) const { return roomId.hash(); }
+};
+struct RoomIdentifierEquals
+{
+    bool operator()(const RoomIdentifier& lhs, const RoomIdentifier& rhs) const { return lhs.equals(rhs); }
+};
+typedef unordered_map<RoomIdentifier, ServerRoom*, RoomIdentifierHash, RoomIdentifierEquals> RoomRegistry;
+
+ServerRoom* GetOrCreateRoom(RoomRegistry& rooms, RoomIdentifier roomId)
+{
+    auto roomIter = rooms.find(roomId);
+    if(roomIter != rooms.end())
     {
-        return 1;
+        return roomIter->second;
     }
-    if(!Platform::Setup())
+
+    ServerRoom* newRoom = new ServerRoom();
+    newRoom->id = roomId;
+    rooms[roomId] = newRoom;
+    logInfo("Room %s opened, there are now %d rooms\n", roomId.name, (int)rooms.size());
+    return newRoom;
+}
+
+void RemoveUserFromRoom(RoomRegistry& rooms, ServerUserData* user)
+{
+    ServerRoom* room = user->room;
+    if(room == nullptr)
+        return;
+
+    user->room = nullptr;
+    for(size_t i=0; i<room->users.size(); i++)
     {
-        logFail("Unable to initialize platform subsystem\n");
-        return 1;
+        if(room->users[i] == user)
+        {
+            room->users[i] = room->users.back();
+            room->users.pop_back();
+            break;
+        }
     }
-    if(enet_initialize() != 0)
+
+    if(room->users.empty())
     {
-        logFail("Unable to initialize enet!\n");
-        Platform::Shutdown();
-        return 1;
+        rooms.erase(room->id);
+        logInfo("Room %s closed, there are now %d rooms\n", room->id.name, (int)rooms.size());
+        delete room;
     }
+}
+
+uint64 MillisecondsSinceStartup()
+{
+    return (uint64)(Platform::SecondsSinceStartup()*1000.0);
+}
+
+// NOTE: Each shard is a separate ENet host (on its own port) that runs on its own thread and
+//       handles a subset of the rooms, based on the hash of the room's ID. Shards share nothing,
+//       so clients that request a room on a different shard are redirected to that shard's port.
+struct ServerShard
+{
+    int index;
+    int shardCount;
+    bool relayMedia;
+
+    ENetHost* netHost;
+    Platform::Thread* thread;
+    default_random_engine rng;
+
     unordered_map<UserIdentifier, ServerUserData*> remoteUsers;
+    RoomRegistry rooms;
+};
 
-    ENetAddress addr = {};
-    addr.host = ENET_HOST_ANY;
-    addr.port = NET_PORT;
-    ENetHost* netHost = enet_host_create(&addr, MAX_USERS, 2, 0,0);
-    logInfo("Server started on port %d\n", netHost->address.port);
+// Returns true if the given user is speaking loudly enough (relative to the rest of their room)
+// that their audio should be forwarded to the other users.
+// NOTE: Each receiver only decodes the loudest MAX_ACTIVE_SPEAKERS of the *other* users in the room,
+//       which might include the next-loudest user if the receiver is one of the loudest themselves,
+//       so we forward one more speaker than that.
+bool IsForwardedSpeaker(ServerUserData* sender, double currentTime)
+{
+    SpeakerActivity* speakers[MAX_USERS];
+    int speakerCount = 0;
+    for(ServerUserData* userData : sender->room->users)
+    {
+        if(speakerCount < MAX_USERS)
+        {
+            speakers[speakerCount++] = &userData->audioActivity;
+        }
+    }
+    selectActiveSpeakers(speakers, speakerCount, MAX_ACTIVE_SPEAKERS+1, currentTime);
+    return sender->audioActivity.Selected;
+}
 
-    double tickDuration = 1/30.0;
-    double nextTickTime = Platform::SecondsSinceStartup();
+int ShardForRoom(const RoomIdentifier& roomId, int shardCount)
+{
+    return (int)(roomId.hash() % (uint32)shardCount);
+}
+
+void LogShardStatus(void* data)
+{
+    ServerShard* shard = (ServerShard*)data;
+    logInfo("Shard %d: %d users in %d rooms, sent %u bytes and received %u bytes since the last update\n",
+            shard->index, (int)shard->remoteUsers.size(), (int)shard->rooms.size(),
+            shard->netHost->totalSentData, shard->netHost->totalReceivedData);
+    shard->netHost->totalSentData = 0;
+    shard->netHost->totalReceivedData = 0;
+}
+
+int RunShard(void* data)
+{
+    ServerShard* shard = (ServerShard*)data;
+    ENetHost* netHost = shard->netHost;
+    bool relayMedia = shard->relayMedia;
+    unordered_map<UserIdentifier, ServerUserData*>& remoteUsers = shard->remoteUsers;
+    RoomRegistry& rooms = shard->rooms;
+
+    // NOTE: All periodic work is scheduled on the timer wheel, so that we can sleep in
+    //       enet_host_service right up until the next piece of work needs doing.
+    TimerWheel timers(10, 256, 32);
+    timers.Schedule(MillisecondsSinceStartup(), STATUS_LOG_INTERVAL_MILLISECONDS,
+                    STATUS_LOG_INTERVAL_MILLISECONDS, LogShardStatus, shard);
 
     bool running = true;
     while(running)
     {
+        uint64 currentTime = MillisecondsSinceStartup();
+        uint32 serviceTimeout = timers.MillisecondsUntilNextTimer(currentTime, MAX_SERVICE_WAIT_MILLISECONDS);
+
+        // NOTE: We block until either something arrives over the network or the next timer is
+        //       due, and then handle everything that has arrived before going back to sleep.
+        //       This way messages are handled as soon as they arrive, and we use no CPU while idle.
         ENetEvent netEvent;
         int serviceResult = 0;
-        while(netHost && ((serviceResult = enet_host_service(netHost, &netEvent, 0)) > 0))
+        while((serviceResult = enet_host_service(netHost, &netEvent, serviceTimeout)) > 0)
         {
+            serviceTimeout = 0;
             switch(netEvent.type)
             {
             case ENET_EVENT_TYPE_CONNECT:
@@ -80,7 +192,7 @@ int main()
                 incomingPacket.length = netEvent.packet->dataLength;
                 incomingPacket.contents = netEvent.packet->data;
                 incomingPacket.currentPosition = 0;
-                logTerm("Received %llu bytes from %x:%u\n",
+                logDbug("Received %llu bytes from %x:%u\n",
                         incomingPacket.length,
                         netEvent.peer->address.host,
                         netEvent.peer->address.port);
@@ -106,15 +218,16 @@ int main()
                             break;
                         }
 
-                        // Create the new ServerUserData
-                        ServerUserData* newUser = new ServerUserData(setupPacket);
-                        newUser->netPeer = netEvent.peer;
-                        netEvent.peer->data = (void*)newUser->ID;
-
                         RoomIdentifier roomToJoin;
                         if(setupPacket.createRoom)
                         {
-                            roomToJoin = GetRandomRoomId();
+                            // NOTE: We only create rooms that belong on this shard, so that
+                            //       nobody needs to be redirected to a new room.
+                            do
+                            {
+                                roomToJoin = GetRandomRoomId(shard->rng);
+                            } while((ShardForRoom(roomToJoin, shard->shardCount) != shard->index) ||
+                                    (rooms.find(roomToJoin) != rooms.end()));
                             logTerm("Create room %s\n", roomToJoin.name);
                         }
                         else
@@ -122,48 +235,143 @@ int main()
                             roomToJoin = setupPacket.roomId;
                             // TODO: Verify that the room has existing users? Maybe we create it if not?
                         }
-                        newUser->room = roomToJoin;
+
+                        int roomShard = ShardForRoom(roomToJoin, shard->shardCount);
+                        if(roomShard != shard->index)
+                        {
+                            NetworkUserRedirectPacket redirectPacket = {};
+                            redirectPacket.port = (uint16)(NET_PORT + roomShard);
+                            logTerm("Redirect client with ID %d to port %d for room %s\n",
+                                    setupPacket.userID, redirectPacket.port, roomToJoin.name);
+
+                            NetworkOutPacket redirectOutPacket = createNetworkOutPacket(NET_MSGTYPE_USER_REDIRECT,
+                                                                                        sizeof(redirectPacket.port));
+                            redirectPacket.serialize(redirectOutPacket);
+                            redirectOutPacket.send(netEvent.peer, 0, true);
+                            enet_peer_disconnect_later(netEvent.peer, 0);
+                            break;
+                        }
+
+                        auto roomIter = rooms.find(roomToJoin);
+                        if((roomIter != rooms.end()) && (roomIter->second->users.size() >= MAX_USERS))
+                        {
+                            logWarn("Cannot add client with ID %d to room %s because it is full\n",
+                                    setupPacket.userID, roomToJoin.name);
+                            enet_peer_disconnect_later(netEvent.peer, 0);
+                            break;
+                        }
+
+                        // Create the new ServerUserData
+                        ServerUserData* newUser = new ServerUserData(setupPacket);
+                        newUser->netPeer = netEvent.peer;
+                        netEvent.peer->data = (void*)newUser->ID;
+                        ServerRoom* room = GetOrCreateRoom(rooms, roomToJoin);
 
                         // Tell the new user about all the existing users
                         NetworkUserInitPacket newUserInit = {};
-                        uint8_t remoteUserCount = 0;
-                        int existingUserIndex = 0;
-                        for(auto iter : remoteUsers)
+                        uint8_t remoteUserCount = (uint8_t)room->users.size();
+                        for(int i=0; i<remoteUserCount; i++)
                         {
-                            ServerUserData* userData = iter.second;
-                            if(!userData->room.equals(roomToJoin))
-                                continue;
-
-                            remoteUserCount++;
-                            newUserInit.existingUsers[existingUserIndex++].populate(*userData);
+                            newUserInit.existingUsers[i].populate(*room->users[i]);
                         }
                         newUserInit.userCount = remoteUserCount;
                         newUserInit.roomId = roomToJoin;
+                        newUserInit.relayMedia = relayMedia;
 
                         NetworkOutPacket initOutPacket = createNetworkOutPacket(NET_MSGTYPE_USER_INIT);
                         newUserInit.serialize(initOutPacket);
                         initOutPacket.send(newUser->netPeer, 0, true);
 
                         // Tell all the existing users about the new user
-                        NetworkUserConnectPacket newUserConnect = {};
-                        newUserConnect.populate(*newUser);
-                        for(auto iter : remoteUsers)
+                        // NOTE: The packet is only serialized once and shared between all the sends
+                        if(remoteUserCount > 0)
                         {
-                            ServerUserData* userData = iter.second;
-                            if(!userData->room.equals(roomToJoin))
-                                continue;
-
+                            NetworkUserConnectPacket newUserConnect = {};
+                            newUserConnect.populate(*newUser);
                             NetworkOutPacket connOutPacket = createNetworkOutPacket(NET_MSGTYPE_USER_CONNECT);
                             newUserConnect.serialize(connOutPacket);
-                            connOutPacket.send(userData->netPeer, 0, true);
+                            for(ServerUserData* userData : room->users)
+                            {
+                                connOutPacket.send(userData->netPeer, 0, true);
+                            }
                         }
 
+                        newUser->room = room;
+                        room->users.push_back(newUser);
                         remoteUsers[newUser->ID] = newUser;
                         logInfo("Initialization received for %s in room %s\n",
-                                newUser->name, newUser->room.name);
+                                newUser->name, room->id.name);
+                    } break;
+
+                    case NET_MSGTYPE_AUDIO:
+                    case NET_MSGTYPE_VIDEO:
+                    case NET_MSGTYPE_VIDEO_HEADER:
+                    case NET_MSGTYPE_VIDEO_KEYFRAME_REQUEST:
+                    {
+                        if(!relayMedia)
+                            break;
+
+                        UserIdentifier senderId = (UserIdentifier)(((intptr_t)netEvent.peer->data) & 0xFFFF);
+                        auto senderIter = remoteUsers.find(senderId);
+                        if(senderIter == remoteUsers.end())
+                            break;
+
+                        // NOTE: All media packets start with the ID of the user that sent them, we
+                        //       don't want to let anybody send media on behalf of somebody else.
+                        UserIdentifier srcUser;
+                        if(!incomingPacket.serializeuint16(srcUser) || (srcUser != senderId))
+                        {
+                            logWarn("Received media from user %d claiming to be from user %d\n",
+                                    senderId, srcUser);
+                            break;
+                        }
+
+                        ServerUserData* sender = senderIter->second;
+                        if(msgType == NET_MSGTYPE_AUDIO)
+                        {
+                            // NOTE: There's no point sending audio that nobody is going to listen to
+                            uint16 packetIndex;
+                            uint8 audioLevel;
+                            if(!incomingPacket.serializeuint16(packetIndex) ||
+                               !incomingPacket.serializeuint8(audioLevel))
+                            {
+                                break;
+                            }
+
+                            double currentTime = Platform::SecondsSinceStartup();
+                            speakerActivityUpdate(sender->audioActivity, audioLevel, currentTime);
+                            if(!IsForwardedSpeaker(sender, currentTime))
+                            {
+                                break;
+                            }
+                        }
+
+                        // NOTE: We forward the packet that we received, unchanged. ENet reference-counts
+                        //       it so that it only gets freed once it has been sent to every peer.
+                        // NOTE: Audio/video data is sent unreliably, but without the video headers
+                        //       (or a keyframe) the receivers can't decode any of the video at all.
+                        if((msgType == NET_MSGTYPE_VIDEO_HEADER) || (msgType == NET_MSGTYPE_VIDEO_KEYFRAME_REQUEST))
+                        {
+                            netEvent.packet->flags = ENET_PACKET_FLAG_RELIABLE;
+                        }
+                        else
+                        {
+                            netEvent.packet->flags = ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT;
+                        }
+                        for(ServerUserData* userData : sender->room->users)
+                        {
+                            if(userData == sender)
+                                continue;
+
+                            enet_peer_send(userData->netPeer, 0, netEvent.packet);
+                        }
                     } break;
                 }
-                enet_packet_destroy(netEvent.packet);
+
+                if(netEvent.packet->referenceCount == 0)
+                {
+                    enet_packet_destroy(netEvent.packet);
+                }
             } break;
 
             case ENET_EVENT_TYPE_DISCONNECT:
@@ -189,6 +397,29 @@ int main()
                     logWarn("An unknown client disconnected\n");
                 }
                 remoteUsers.erase(userIter);
+                if(oldUser == nullptr)
+                    break;
+
+                // NOTE: When relaying, the other users in the room aren't connected to the user
+                //       that disconnected, so they have no other way of knowing about it.
+                ServerRoom* oldRoom = oldUser->room;
+                if(relayMedia && (oldRoom != nullptr) && (oldRoom->users.size() > 1))
+                {
+                    NetworkUserDisconnectPacket disconnectPacket = {};
+                    disconnectPacket.userID = oldUserId;
+                    NetworkOutPacket outPacket = createNetworkOutPacket(NET_MSGTYPE_USER_DISCONNECT,
+                                                                        sizeof(disconnectPacket.userID));
+                    disconnectPacket.serialize(outPacket);
+                    for(ServerUserData* userData : oldRoom->users)
+                    {
+                        if(userData == oldUser)
+                            continue;
+
+                        outPacket.send(userData->netPeer, 0, true);
+                    }
+                }
+
+                RemoveUserFromRoom(rooms, oldUser);
                 delete oldUser;
             } break;
             }
@@ -198,13 +429,106 @@ int main()
             logWarn("ENET service error\n");
         }
 
-        nextTickTime += tickDuration;
-        double currentTime = Platform::SecondsSinceStartup();
-        double sleepSeconds = nextTickTime - currentTime;
-        if(sleepSeconds > 0.0)
+        // NOTE: Send anything that we queued while handling events now, rather than waiting
+        //       until the next time that something arrives.
+        enet_host_flush(netHost);
+
+        timers.Advance(MillisecondsSinceStartup());
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if(!initLogging("output-server.log"))
+    {
+        return 1;
+    }
+
+    // NOTE: When relaying media, clients send their audio/video to the server just once and we
+    //       forward it on to everybody else in their room, rather than each client connecting to
+    //       (and sending their media to) every other client directly.
+    bool relayMedia = false;
+    int shardCount = 1;
+    for(int argIndex=1; argIndex<argc; argIndex++)
+    {
+        if(strcmp(argv[argIndex], "--relay") == 0)
+        {
+            relayMedia = true;
+        }
+        else if((strcmp(argv[argIndex], "--shards") == 0) && (argIndex+1 < argc))
+        {
+            argIndex++;
+            shardCount = atoi(argv[argIndex]);
+            if((shardCount < 1) || (shardCount > MAX_SHARDS))
+            {
+                logFail("The number of shards must be between 1 and %d\n", MAX_SHARDS);
+                return 1;
+            }
+        }
+        else
+        {
+            logWarn("Unrecognised command-line argument: %s\n", argv[argIndex]);
+        }
+    }
+
+    if(!Platform::Setup())
+    {
+        logFail("Unable to initialize platform subsystem\n");
+        return 1;
+    }
+    if(enet_initialize() != 0)
+    {
+        logFail("Unable to initialize enet!\n");
+        Platform::Shutdown();
+        return 1;
+    }
+
+    random_device randDevice;
+    ServerShard* shards = new ServerShard[shardCount];
+    for(int i=0; i<shardCount; i++)
+    {
+        ServerShard& shard = shards[i];
+        shard.index = i;
+        shard.shardCount = shardCount;
+        shard.relayMedia = relayMedia;
+        shard.rng.seed(randDevice());
+
+        ENetAddress addr = {};
+        addr.host = ENET_HOST_ANY;
+        addr.port = (uint16)(NET_PORT + i);
+        shard.netHost = enet_host_create(&addr, MAX_PEERS_PER_SHARD, 2, 0,0);
+        if(!shard.netHost)
+        {
+            logFail("Unable to create server host on port %d\n", addr.port);
+            enet_deinitialize();
+            Platform::Shutdown();
+            return 1;
+        }
+        logInfo("Server shard %d started on port %d\n", i, shard.netHost->address.port);
+    }
+    if(relayMedia)
+    {
+        logInfo("Relaying media between users\n");
+    }
+
+    for(int i=0; i<shardCount; i++)
+    {
+        shards[i].thread = Platform::CreateThread(RunShard, &shards[i]);
+        if(shards[i].thread == nullptr)
         {
-            Platform::SleepForMilliseconds((uint32)(sleepSeconds*1000.0));
+            logFail("Unable to create a thread for shard %d\n", i);
+            return 1;
         }
     }
+    for(int i=0; i<shardCount; i++)
+    {
+        Platform::JoinThread(shards[i].thread);
+        enet_host_destroy(shards[i].netHost);
+    }
+    delete[] shards;
+
     enet_deinitialize();
+    Platform::Shutdown();
+    return 0;
 }
@@ -0,0 +1,102 @@
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+
+// A fixed-capacity, lock-free queue for passing items from exactly one producer thread to exactly
+// one (possibly different) consumer thread, such as handing packets between the network and
+// audio threads.
+// Items are filled in and read in-place, so that large items (e.g encoded packets) don't need to
+// be copied into and out of the queue: The producer fills in the slot returned by BeginPush() and
+// then publishes it with CommitPush(), while the consumer reads the slot returned by Peek() and
+// then releases it with Pop().
+// NOTE: Unlike SPSCRingBuffer, this never overwrites items that have not yet been read.
+//       If the queue is full then BeginPush() fails and it is up to the producer to decide what
+//       to do with the item instead.
+template<typename T>
+class SPSCQueue
+{
+public:
+    explicit SPSCQueue(int capacity)
+        : capacity(capacity), items(new T[capacity]()), pushIndex(0), popIndex(0)
+    {
+        assert(capacity > 0);
+    }
+
+    ~SPSCQueue()
+    {
+        delete[] items;
+    }
+
+    // Returns the slot that the next item should be written into, or nullptr if the queue is full.
+    // Must only be called from the producer thread.
+    T* BeginPush()
+    {
+        uint64_t localPushIndex = pushIndex.load(std::memory_order_relaxed);
+        uint64_t localPopIndex = popIndex.load(std::memory_order_acquire);
+        if(localPushIndex - localPopIndex >= (uint64_t)capacity)
+        {
+            return nullptr;
+        }
+        return &items[localPushIndex % (uint64_t)capacity];
+    }
+
+    // Make the item returned by the previous call to BeginPush() available to the consumer.
+    // Must only be called from the producer thread.
+    void CommitPush()
+    {
+        uint64_t localPushIndex = pushIndex.load(std::memory_order_relaxed);
+        pushIndex.store(localPushIndex+1, std::memory_order_release);
+    }
+
+    // Returns the oldest item in the queue, or nullptr if the queue is empty.
+    // The item remains in the queue (and valid) until Pop() is called.
+    // Must only be called from the consumer thread.
+    T* Peek()
+    {
+        uint64_t localPopIndex = popIndex.load(std::memory_order_relaxed);
+        uint64_t localPushIndex = pushIndex.load(std::memory_order_acquire);
+        if(localPopIndex == localPushIndex)
+        {
+            return nullptr;
+        }
+        return &items[localPopIndex % (uint64_t)capacity];
+    }
+
+    // Remove the oldest item from the queue, returning its slot to the producer.
+    // Must only be called from the consumer thread, after Peek() has returned an item.
+    void Pop()
+    {
+        uint64_t localPopIndex = popIndex.load(std::memory_order_relaxed);
+        assert(localPopIndex != pushIndex.load(std::memory_order_acquire));
+        popIndex.store(localPopIndex+1, std::memory_order_release);
+    }
+
+    // Returns the number of items that are currently in the queue
+    int Count()
+    {
+        uint64_t localPopIndex = popIndex.load(std::memory_order_acquire);
+        uint64_t localPushIndex = pushIndex.load(std::memory_order_acquire);
+        return (int)(localPushIndex - localPopIndex);
+    }
+
+private:
+    static const int CACHE_LINE_SIZE = 64;
+
+    int capacity;
+    T* items;
+
+    // NOTE: As with SPSCRingBuffer, the indices count every item ever pushed/popped and are only
+    //       reduced modulo capacity when accessing the items. Each is given its own cache line so
+    //       that the two threads don't contend on them.
+    char padding0[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> pushIndex;
+    char padding1[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> popIndex;
+    char padding2[CACHE_LINE_SIZE];
+};
+
+#endif // _SPSC_QUEUE_H
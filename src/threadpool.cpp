@@ -0,0 +1,151 @@
+#include <assert.h>
+
+#include "logging.h"
+#include "threadpool.h"
+
+// NOTE: Idle workers wake up this often even if nothing signals them, as a safety net
+static const uint32_t THREAD_POOL_MAX_WAIT_MS = 1000;
+
+ThreadPool::ThreadPool(int threadCount, int maxQueuedTaskCount)
+{
+    assert(threadCount > 0);
+    assert(maxQueuedTaskCount > 0);
+
+    lock = Platform::CreateMutex();
+    taskAvailableEvent = Platform::CreateEvent();
+    idleEvent = Platform::CreateEvent();
+
+    tasks = new ThreadPoolTaskEntry[maxQueuedTaskCount];
+    taskCapacity = maxQueuedTaskCount;
+    firstTaskIndex = 0;
+    queuedTaskCount = 0;
+    runningTaskCount = 0;
+    stopping = false;
+
+    this->threadCount = 0;
+    threads = new Platform::Thread*[threadCount];
+    for(int i=0; i<threadCount; i++)
+    {
+        Platform::Thread* thread = Platform::CreateThread(WorkerEntryPoint, this);
+        if(thread == nullptr)
+        {
+            logWarn("Unable to create thread pool worker %d of %d\n", i+1, threadCount);
+            break;
+        }
+        threads[this->threadCount++] = thread;
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    WaitForIdle();
+
+    Platform::LockMutex(lock);
+    stopping = true;
+    Platform::UnlockMutex(lock);
+    Platform::SignalEvent(taskAvailableEvent);
+
+    for(int i=0; i<threadCount; i++)
+    {
+        Platform::JoinThread(threads[i]);
+    }
+    delete[] threads;
+    delete[] tasks;
+
+    Platform::DestroyEvent(idleEvent);
+    Platform::DestroyEvent(taskAvailableEvent);
+    Platform::DestroyMutex(lock);
+}
+
+int ThreadPool::ThreadCount()
+{
+    return threadCount;
+}
+
+bool ThreadPool::Submit(ThreadPoolTask* task, void* data)
+{
+    Platform::LockMutex(lock);
+    if(queuedTaskCount >= taskCapacity)
+    {
+        Platform::UnlockMutex(lock);
+        return false;
+    }
+
+    int taskIndex = (firstTaskIndex + queuedTaskCount) % taskCapacity;
+    tasks[taskIndex].task = task;
+    tasks[taskIndex].data = data;
+    queuedTaskCount++;
+    Platform::UnlockMutex(lock);
+
+    Platform::SignalEvent(taskAvailableEvent);
+    return true;
+}
+
+void ThreadPool::WaitForIdle()
+{
+    while(true)
+    {
+        Platform::LockMutex(lock);
+        bool idle = (queuedTaskCount == 0) && (runningTaskCount == 0);
+        Platform::UnlockMutex(lock);
+        if(idle || (threadCount == 0))
+        {
+            return;
+        }
+
+        Platform::WaitForEvent(idleEvent, THREAD_POOL_MAX_WAIT_MS);
+    }
+}
+
+int ThreadPool::WorkerEntryPoint(void* data)
+{
+    ThreadPool* pool = (ThreadPool*)data;
+    pool->RunWorker();
+    return 0;
+}
+
+void ThreadPool::RunWorker()
+{
+    while(true)
+    {
+        Platform::LockMutex(lock);
+        if(queuedTaskCount == 0)
+        {
+            bool shouldStop = stopping;
+            Platform::UnlockMutex(lock);
+            if(shouldStop)
+            {
+                // NOTE: The event only wakes a single thread, so pass it on to the next one
+                Platform::SignalEvent(taskAvailableEvent);
+                break;
+            }
+
+            Platform::WaitForEvent(taskAvailableEvent, THREAD_POOL_MAX_WAIT_MS);
+            continue;
+        }
+
+        ThreadPoolTaskEntry entry = tasks[firstTaskIndex];
+        firstTaskIndex = (firstTaskIndex + 1) % taskCapacity;
+        queuedTaskCount--;
+        runningTaskCount++;
+        bool moreTasksQueued = (queuedTaskCount > 0);
+        Platform::UnlockMutex(lock);
+
+        // NOTE: Submitting several tasks in quick succession may only wake a single worker
+        if(moreTasksQueued)
+        {
+            Platform::SignalEvent(taskAvailableEvent);
+        }
+
+        entry.task(entry.data);
+
+        Platform::LockMutex(lock);
+        runningTaskCount--;
+        bool idle = (queuedTaskCount == 0) && (runningTaskCount == 0);
+        Platform::UnlockMutex(lock);
+        if(idle)
+        {
+            Platform::SignalEvent(idleEvent);
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include "platform.h"
+
+typedef void ThreadPoolTask(void* data);
+
+struct ThreadPoolTaskEntry
+{
+    ThreadPoolTask* task;
+    void* data;
+};
+
+// A fixed set of worker threads that run tasks from a shared (bounded) queue.
+// Tasks are started in the order that they were submitted, but may run concurrently with each
+// other and so can finish in any order. Any ordering between tasks must be handled by the tasks.
+class ThreadPool
+{
+public:
+    ThreadPool(int threadCount, int maxQueuedTaskCount);
+
+    // NOTE: This waits for all queued tasks to finish before stopping the worker threads
+    ~ThreadPool();
+
+    // Queue the task to be run with the given data on one of the worker threads.
+    // Returns false (and does not run the task) if the queue is already full.
+    bool Submit(ThreadPoolTask* task, void* data);
+
+    // Block until there are no tasks queued or running.
+    // NOTE: This only makes sense if nothing else is submitting tasks while we wait.
+    void WaitForIdle();
+
+    int ThreadCount();
+
+private:
+    int threadCount;
+    Platform::Thread** threads;
+
+    Platform::Mutex* lock;
+    Platform::Event* taskAvailableEvent;
+    Platform::Event* idleEvent;
+
+    // NOTE: The members below are protected by lock
+    ThreadPoolTaskEntry* tasks;
+    int taskCapacity;
+    int firstTaskIndex;
+    int queuedTaskCount;
+    int runningTaskCount;
+    bool stopping;
+
+    static int WorkerEntryPoint(void* data);
+    void RunWorker();
+};
+
+#endif // _THREAD_POOL_H
@@ -0,0 +1,241 @@
+#include <assert.h>
+#include <string.h>
+
+#include "timerwheel.h"
+
+TimerWheel::TimerWheel(uint32_t tickMilliseconds, int slotCount, int maxTimerCount)
+{
+    assert(tickMilliseconds > 0);
+    assert(slotCount > 0);
+    assert(maxTimerCount > 0);
+
+    this->tickDuration = tickMilliseconds;
+    this->slotCount = slotCount;
+    this->timerCapacity = maxTimerCount;
+    this->activeTimerCount = 0;
+    this->currentTick = 0;
+    this->hasStarted = false;
+
+    slots = new TimerWheelEntry*[slotCount];
+    memset(slots, 0, slotCount*sizeof(TimerWheelEntry*));
+
+    allTimers = new TimerWheelEntry[maxTimerCount];
+    memset(allTimers, 0, maxTimerCount*sizeof(TimerWheelEntry));
+    unusedTimers = allTimers;
+    for(int i=0; i<maxTimerCount-1; i++)
+    {
+        allTimers[i].next = &allTimers[i+1];
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    delete[] allTimers;
+    delete[] slots;
+}
+
+int TimerWheel::TimerCount()
+{
+    return activeTimerCount;
+}
+
+uint64_t TimerWheel::TickForTime(uint64_t time)
+{
+    return time / tickDuration;
+}
+
+void TimerWheel::Insert(TimerWheelEntry* timer)
+{
+    TimerWheelEntry** slot = &slots[timer->expiryTick % slotCount];
+    timer->prev = nullptr;
+    timer->next = *slot;
+    if(*slot != nullptr)
+    {
+        (*slot)->prev = timer;
+    }
+    *slot = timer;
+}
+
+void TimerWheel::Unlink(TimerWheelEntry* timer)
+{
+    if(timer->prev != nullptr)
+    {
+        timer->prev->next = timer->next;
+    }
+    else
+    {
+        slots[timer->expiryTick % slotCount] = timer->next;
+    }
+
+    if(timer->next != nullptr)
+    {
+        timer->next->prev = timer->prev;
+    }
+    timer->prev = nullptr;
+    timer->next = nullptr;
+}
+
+int TimerWheel::Schedule(uint64_t currentTime, uint32_t delayMilliseconds, uint32_t intervalMilliseconds,
+                         TimerCallback* callback, void* data)
+{
+    if(unusedTimers == nullptr)
+    {
+        return -1;
+    }
+    if(!hasStarted)
+    {
+        currentTick = TickForTime(currentTime);
+        hasStarted = true;
+    }
+
+    TimerWheelEntry* timer = unusedTimers;
+    unusedTimers = unusedTimers->next;
+    activeTimerCount++;
+
+    // NOTE: We round the expiry time up to the next tick so that timers never fire early,
+    //       and we can't schedule anything for a tick that we've already processed.
+    uint64_t expiryTime = currentTime + delayMilliseconds;
+    uint64_t expiryTick = (expiryTime + tickDuration - 1) / tickDuration;
+    if(expiryTick <= currentTick)
+    {
+        expiryTick = currentTick + 1;
+    }
+
+    uint64_t intervalTicks = (intervalMilliseconds + tickDuration - 1) / tickDuration;
+    if((intervalMilliseconds > 0) && (intervalTicks == 0))
+    {
+        intervalTicks = 1;
+    }
+
+    timer->callback = callback;
+    timer->data = data;
+    timer->expiryTick = expiryTick;
+    timer->intervalTicks = intervalTicks;
+    timer->active = true;
+    Insert(timer);
+
+    return (int)(timer - allTimers);
+}
+
+void TimerWheel::Cancel(int timerID)
+{
+    if((timerID < 0) || (timerID >= timerCapacity))
+    {
+        return;
+    }
+
+    TimerWheelEntry* timer = &allTimers[timerID];
+    if(!timer->active)
+    {
+        return;
+    }
+
+    Unlink(timer);
+    timer->active = false;
+    timer->next = unusedTimers;
+    unusedTimers = timer;
+    activeTimerCount--;
+}
+
+void TimerWheel::Advance(uint64_t currentTime)
+{
+    uint64_t targetTick = TickForTime(currentTime);
+    if(!hasStarted)
+    {
+        currentTick = targetTick;
+        hasStarted = true;
+        return;
+    }
+
+    // NOTE: Every slot gets visited in a single rotation of the wheel, so if we've fallen further
+    //       behind than that we only need to visit each slot once to fire all the overdue timers.
+    if(targetTick - currentTick > (uint64_t)slotCount)
+    {
+        currentTick = targetTick - slotCount;
+    }
+
+    while(currentTick < targetTick)
+    {
+        currentTick++;
+        TimerWheelEntry** slot = &slots[currentTick % slotCount];
+
+        // NOTE: We start from the beginning of the slot after firing each timer because the
+        //       callback is free to schedule or cancel any timers (including those in this slot).
+        bool firedTimer = true;
+        while(firedTimer)
+        {
+            firedTimer = false;
+            for(TimerWheelEntry* timer = *slot; timer != nullptr; timer = timer->next)
+            {
+                if(timer->expiryTick > currentTick)
+                    continue;
+
+                TimerCallback* callback = timer->callback;
+                void* data = timer->data;
+                if(timer->intervalTicks > 0)
+                {
+                    Unlink(timer);
+                    timer->expiryTick = currentTick + timer->intervalTicks;
+                    Insert(timer);
+                }
+                else
+                {
+                    Cancel((int)(timer - allTimers));
+                }
+
+                callback(data);
+                firedTimer = true;
+                break;
+            }
+        }
+    }
+}
+
+uint32_t TimerWheel::MillisecondsUntilNextTimer(uint64_t currentTime, uint32_t maxMilliseconds)
+{
+    if(activeTimerCount == 0)
+    {
+        return maxMilliseconds;
+    }
+
+    uint64_t nextTick = 0;
+    bool foundTimer = false;
+    for(uint64_t tick=currentTick+1; (tick<=currentTick+slotCount) && !foundTimer; tick++)
+    {
+        for(TimerWheelEntry* timer = slots[tick % slotCount]; timer != nullptr; timer = timer->next)
+        {
+            if(timer->expiryTick <= tick)
+            {
+                nextTick = tick;
+                foundTimer = true;
+                break;
+            }
+        }
+    }
+
+    if(!foundTimer)
+    {
+        // NOTE: Every timer is more than a full rotation of the wheel away, so just find the soonest
+        for(int i=0; i<timerCapacity; i++)
+        {
+            if(allTimers[i].active && (!foundTimer || (allTimers[i].expiryTick < nextTick)))
+            {
+                nextTick = allTimers[i].expiryTick;
+                foundTimer = true;
+            }
+        }
+    }
+    assert(foundTimer);
+
+    uint64_t nextTime = nextTick * tickDuration;
+    if(nextTime <= currentTime)
+    {
+        return 0;
+    }
+    uint64_t result = nextTime - currentTime;
+    if(result > maxMilliseconds)
+    {
+        return maxMilliseconds;
+    }
+    return (uint32_t)result;
+}
@@ -0,0 +1,69 @@
+#ifndef _TIMER_WHEEL_H
+#define _TIMER_WHEEL_H
+
+#include <stdint.h>
+
+typedef void TimerCallback(void* data);
+
+struct TimerWheelEntry
+{
+    TimerCallback* callback;
+    void* data;
+    uint64_t expiryTick;
+    uint64_t intervalTicks; // Zero for timers that only fire once
+
+    TimerWheelEntry* prev;
+    TimerWheelEntry* next;
+    bool active;
+};
+
+// A hashed timing wheel for scheduling (periodic) work at a granularity of tickMilliseconds.
+// Timers are stored in the slot for their expiry tick (modulo the number of slots), so scheduling,
+// cancelling and firing timers are all constant time, regardless of how many timers there are.
+// NOTE: All times are in milliseconds, relative to some arbitrary (but consistent) point in time.
+class TimerWheel
+{
+public:
+    TimerWheel(uint32_t tickMilliseconds, int slotCount, int maxTimerCount);
+    ~TimerWheel();
+
+    // Schedule the callback to be called delayMilliseconds after currentTime, and then again every
+    // intervalMilliseconds after that (or never again, if intervalMilliseconds is 0).
+    // Returns an identifier for the timer that can be passed to Cancel(), or -1 if all the timers
+    // are already in use.
+    int Schedule(uint64_t currentTime, uint32_t delayMilliseconds, uint32_t intervalMilliseconds,
+                 TimerCallback* callback, void* data);
+
+    // Stop the given timer from firing again.
+    void Cancel(int timerID);
+
+    // Fire every timer that is due at or before currentTime.
+    void Advance(uint64_t currentTime);
+
+    // Returns the number of milliseconds from currentTime until the next timer is due to fire,
+    // which is 0 if a timer is already due and maxMilliseconds if there are no timers that are
+    // due within that time.
+    uint32_t MillisecondsUntilNextTimer(uint64_t currentTime, uint32_t maxMilliseconds);
+
+    // Returns the number of timers that are currently scheduled
+    int TimerCount();
+
+private:
+    uint32_t tickDuration;
+    int slotCount;
+    int timerCapacity;
+    int activeTimerCount;
+
+    uint64_t currentTick; // The last tick for which timers have been fired
+    bool hasStarted;
+
+    TimerWheelEntry** slots;
+    TimerWheelEntry* allTimers;
+    TimerWheelEntry* unusedTimers; // Singly-linked list of timers, only timer->next is valid.
+
+    uint64_t TickForTime(uint64_t time);
+    void Insert(TimerWheelEntry* timer);
+    void Unlink(TimerWheelEntry* timer);
+};
+
+#endif // _TIMER_WHEEL_H
@@ -0,0 +1,59 @@
+#include <assert.h>
+#include <string.h>
+
+#include "triplebuffer.h"
+
+TripleBuffer::TripleBuffer(int bufferSize)
+    : bufferSize(bufferSize), writeIndex(0), readIndex(1), middleState(2)
+{
+    assert(bufferSize > 0);
+    for(int i=0; i<3; i++)
+    {
+        buffers[i] = new uint8_t[bufferSize];
+        memset(buffers[i], 0, bufferSize);
+    }
+}
+
+TripleBuffer::~TripleBuffer()
+{
+    for(int i=0; i<3; i++)
+    {
+        delete[] buffers[i];
+    }
+}
+
+int TripleBuffer::BufferSize()
+{
+    return bufferSize;
+}
+
+uint8_t* TripleBuffer::WriteBuffer()
+{
+    return buffers[writeIndex];
+}
+
+void TripleBuffer::PublishWriteBuffer()
+{
+    // NOTE: The release makes our writes to the buffer visible to the consumer once it takes the
+    //       buffer, while the acquire makes its reads of the old middle buffer finish before we
+    //       start writing to it.
+    int oldMiddleState = middleState.exchange(writeIndex | NEW_DATA_FLAG, std::memory_order_acq_rel);
+    writeIndex = oldMiddleState & BUFFER_INDEX_MASK;
+}
+
+bool TripleBuffer::UpdateReadBuffer()
+{
+    if((middleState.load(std::memory_order_relaxed) & NEW_DATA_FLAG) == 0)
+    {
+        return false;
+    }
+
+    int oldMiddleState = middleState.exchange(readIndex, std::memory_order_acq_rel);
+    readIndex = oldMiddleState & BUFFER_INDEX_MASK;
+    return true;
+}
+
+uint8_t* TripleBuffer::ReadBuffer()
+{
+    return buffers[readIndex];
+}
@@ -0,0 +1,52 @@
+#ifndef _TRIPLE_BUFFER_H
+#define _TRIPLE_BUFFER_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+// A lock-free triple buffer, for handing the latest version of some data (such as a decoded video
+// frame) from one producer thread to one consumer thread.
+// The producer always has a buffer to write into and the consumer always has a complete buffer
+// to read from, so neither of them ever waits for the other. If the producer publishes several
+// buffers between reads then the consumer skips straight to the latest one.
+class TripleBuffer
+{
+public:
+    explicit TripleBuffer(int bufferSize);
+    ~TripleBuffer();
+
+    int BufferSize();
+
+    // Returns the buffer that the producer should write the next version of the data into.
+    // Must only be called from the producer thread.
+    uint8_t* WriteBuffer();
+
+    // Make the current write buffer available to the consumer, and give the producer a new
+    // buffer to write into. Must only be called from the producer thread.
+    void PublishWriteBuffer();
+
+    // Switch the read buffer to the most recently published buffer, if there is one that we
+    // haven't read yet. Must only be called from the consumer thread.
+    // Returns true if the read buffer changed.
+    bool UpdateReadBuffer();
+
+    // Returns the buffer that the consumer should read from.
+    // Must only be called from the consumer thread.
+    uint8_t* ReadBuffer();
+
+private:
+    // NOTE: middleState holds the index of the buffer that is neither being read nor written,
+    //       with this flag set if it was published after the consumer last updated.
+    static const int NEW_DATA_FLAG = 4;
+    static const int BUFFER_INDEX_MASK = 3;
+
+    int bufferSize;
+    uint8_t* buffers[3];
+
+    int writeIndex; // Only accessed by the producer
+    int readIndex; // Only accessed by the consumer
+    std::atomic<int> middleState;
+};
+
+#endif // _TRIPLE_BUFFER_H
@@ -7,11 +7,23 @@
 #include "user.h"
 #include "video.h"
 
-bool RoomIdentifier::equals(RoomIdentifier& other)
+bool RoomIdentifier::equals(const RoomIdentifier& other) const
 {
     return strncmp(name, other.name, MAX_ROOM_ID_LENGTH) == 0;
 }
 
+uint32 RoomIdentifier::hash() const
+{
+    // NOTE: This is 32-bit FNV-1a, over the same characters that are compared by equals()
+    uint32 result = 2166136261u;
+    for(int i=0; (i<MAX_ROOM_ID_LENGTH) && (name[i] != 0); i++)
+    {
+        result ^= (uint8)name[i];
+        result *= 16777619u;
+    }
+    return result;
+}
+
 template<typename Packet>
 bool NetworkUserSetupPacket::serialize(Packet& packet)
 {
@@ -53,6 +65,7 @@ template<typename Packet>
 bool NetworkUserInitPacket::serialize(Packet& packet)
 {
     packet.serializestring(this->roomId.name, MAX_ROOM_ID_LENGTH);
+    packet.serializebool(this->relayMedia);
     packet.serializeuint8(this->userCount);
 
     for(int i=0; i<this->userCount; i++)
@@ -65,10 +78,28 @@ bool NetworkUserInitPacket::serialize(Packet& packet)
 template bool NetworkUserInitPacket::serialize(NetworkInPacket& packet);
 template bool NetworkUserInitPacket::serialize(NetworkOutPacket& packet);
 
+template<typename Packet>
+bool NetworkUserDisconnectPacket::serialize(Packet& packet)
+{
+    return packet.serializeuint16(this->userID);
+}
+template bool NetworkUserDisconnectPacket::serialize(NetworkInPacket& packet);
+template bool NetworkUserDisconnectPacket::serialize(NetworkOutPacket& packet);
+
+template<typename Packet>
+bool NetworkUserRedirectPacket::serialize(Packet& packet)
+{
+    return packet.serializeuint16(this->port);
+}
+template bool NetworkUserRedirectPacket::serialize(NetworkInPacket& packet);
+template bool NetworkUserRedirectPacket::serialize(NetworkOutPacket& packet);
+
 ServerUserData::ServerUserData(NetworkUserSetupPacket& setupPacket)
 {
     this->ID = setupPacket.userID;
     this->nameLength = setupPacket.nameLength;
     memcpy(this->name, setupPacket.name, setupPacket.nameLength);
     this->name[setupPacket.nameLength] = 0;
+    this->room = nullptr;
+    speakerActivityInit(this->audioActivity);
 }
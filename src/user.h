@@ -1,7 +1,10 @@
 #ifndef _USER_H
 #define _USER_H
 
+#include <vector>
+
 #include "enet/enet.h"
+#include "audio_level.h"
 #include "common.h"
 
 // TODO: Con/Destructors
@@ -15,7 +18,8 @@ struct RoomIdentifier
 {
     char name[MAX_ROOM_ID_LENGTH];
 
-    bool equals(RoomIdentifier& other);
+    bool equals(const RoomIdentifier& other) const;
+    uint32 hash() const;
 };
 
 // Client -> Server
@@ -56,12 +60,33 @@ struct NetworkUserConnectPacket
 struct NetworkUserInitPacket
 {
     RoomIdentifier roomId;
+    bool relayMedia; // If true, audio/video must be sent to the server, which forwards it to the room
     uint8 userCount;
     NetworkUserConnectPacket existingUsers[MAX_USERS];
 
     template<typename Packet> bool serialize(Packet& packet);
 };
 
+// Server -> Client
+// Sent to the other users in the room when a user disconnects from a server that is relaying media
+// Tells the client that it will no longer receive anything from that user
+struct NetworkUserDisconnectPacket
+{
+    UserIdentifier userID;
+
+    template<typename Packet> bool serialize(Packet& packet);
+};
+
+// Server -> Client
+// Sent in response to the SETUP packet if the requested room is handled by a different shard
+// Tells the client to reconnect to the same server on the given port, and send SETUP again
+struct NetworkUserRedirectPacket
+{
+    uint16 port;
+
+    template<typename Packet> bool serialize(Packet& packet);
+};
+
 struct UserData
 {
     UserIdentifier ID;
@@ -71,11 +96,20 @@ struct UserData
     ENetPeer* netPeer;
 };
 
+struct ServerRoom;
+
 struct ServerUserData : UserData
 {
-    RoomIdentifier room;
+    ServerRoom* room;
+    SpeakerActivity audioActivity;
 
     explicit ServerUserData(NetworkUserSetupPacket& setupPacket);
 };
 
+struct ServerRoom
+{
+    RoomIdentifier id;
+    std::vector<ServerUserData*> users;
+};
+
 #endif // _user_H
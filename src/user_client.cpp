@@ -4,6 +4,7 @@
 #include "common.h"
 #include "logging.h"
 #include "network.h"
+#include "platform.h"
 #include "render.h"
 #include "user.h"
 #include "user_client.h"
@@ -14,8 +15,14 @@ std::vector<ClientUserData*> remoteUsers;
 ClientUserData::ClientUserData()
 {
     // TODO: Be a bit more flexible with the supported image sizes
-    this->videoImage = new uint8_t[cameraWidth*cameraHeight*3];
+    this->videoImage = new TripleBuffer(cameraWidth*cameraHeight*3);
+    this->videoAssembler = new VideoFrameAssembler();
+    this->videoDecoder = nullptr;
     this->videoTexture = 0;
+    this->lastSentAudioPacket = 0;
+    this->lastSentVideoPacket = 0;
+    this->lastReceivedAudioPacket = 0;
+    this->lastReceivedVideoPacket = 0;
 }
 
 ClientUserData::ClientUserData(NetworkUserConnectPacket& connectionPacket)
@@ -24,7 +31,9 @@ ClientUserData::ClientUserData(NetworkUserConnectPacket& connectionPacket)
     this->nameLength = connectionPacket.nameLength;
     memcpy(this->name, connectionPacket.name, connectionPacket.nameLength);
     this->name[connectionPacket.nameLength] = 0;
-    this->videoImage = new uint8_t[cameraWidth*cameraHeight*3];
+    this->videoImage = new TripleBuffer(cameraWidth*cameraHeight*3);
+    this->videoAssembler = new VideoFrameAssembler();
+    this->videoDecoder = Video::CreateDecoder(this->videoImage);
     this->videoTexture = 0;
     this->lastSentAudioPacket = 0;
     this->lastSentVideoPacket = 0;
@@ -35,29 +44,40 @@ ClientUserData::ClientUserData(NetworkUserConnectPacket& connectionPacket)
 
 ClientUserData::~ClientUserData()
 {
-    delete[] videoImage;
+    // NOTE: The decoder must go first, it writes to videoImage until it is destroyed
+    Video::DestroyDecoder(videoDecoder);
+    delete videoAssembler;
+    delete videoImage;
 }
 
 void ClientUserData::processIncomingVideoPacket(Video::NetworkVideoPacket& packet)
 {
-    if(((packet.index < 20) && (this->lastReceivedVideoPacket > 235)) ||
-            (this->lastReceivedVideoPacket < packet.index))
+    bool frameCompleted = videoAssembler->Add(packet.index, packet.fragmentIndex, packet.fragmentCount,
+                                              packet.encodedDataLength, packet.encodedData,
+                                              Platform::SecondsSinceStartup());
+    if(!frameCompleted)
+    {
+        return;
+    }
+
+    uint8_t* frameData;
+    int frameLength = videoAssembler->GetFrame(&frameData);
+
+    // NOTE: The assembler only completes frames in order, so any gap means frames were lost
+    if((uint8)(this->lastReceivedVideoPacket + 1) != packet.index)
     {
-        if(this->lastReceivedVideoPacket + 1 != packet.index)
-        {
-            logWarn("Dropped video packets %d to %d (inclusive)\n",
-                    this->lastReceivedVideoPacket+1, packet.index-1);
-        }
-        this->lastReceivedVideoPacket = packet.index;
-
-        assert(packet.imageWidth == cameraWidth);
-        assert(packet.imageHeight == cameraHeight);
-        int outputImageBytes = packet.imageWidth * packet.imageHeight * 3;
-        Video::decodeRGBImage(packet.encodedDataLength, packet.encodedData,
-                              outputImageBytes, this->videoImage);
+        logWarn("Dropped video frames %d to %d (inclusive)\n",
+                (uint8)(this->lastReceivedVideoPacket+1), (uint8)(packet.index-1));
+        Video::MarkDecoderStateLost(this->videoDecoder);
     }
-    else
+    this->lastReceivedVideoPacket = packet.index;
+
+    assert(packet.imageWidth == cameraWidth);
+    assert(packet.imageHeight == cameraHeight);
+    Video::DecodeFrameAsync(this->videoDecoder, frameLength, frameData);
+
+    if(Video::ShouldRequestKeyframe(this->videoDecoder, Platform::SecondsSinceStartup()))
     {
-        logWarn("Video packet %d received out of order\n", packet.index);
+        Video::RequestKeyframe(this->ID, this->netPeer);
     }
 }
@@ -6,14 +6,18 @@
 #include "opus/opus.h"
 #include "enet/enet.h"
 
+#include "triplebuffer.h"
 #include "user.h"
 #include "video.h"
+#include "video_fragment.h"
 
 struct ClientUserData : UserData
 {
     // Video
     uint32_t videoTexture;
-    uint8_t* videoImage;
+    TripleBuffer* videoImage; // Written by the video decode threads, read by the UI thread
+    VideoFrameAssembler* videoAssembler;
+    Video::VideoDecoder* videoDecoder; // Only created for remote users
 
     // Network
     uint16 lastSentAudioPacket;
@@ -1,9 +1,17 @@
+#include <atomic>
+#include <vector>
+
 #include "theora/theoraenc.h"
 #include "theora/theoradec.h"
 
 #include "network.h"
 #include "network_client.h"
+#include "platform.h"
+#include "spscqueue.h"
+#include "threadpool.h"
 #include "video.h"
+#include "video_convert.h"
+#include "video_fragment.h"
 
 // https://www.reddit.com/r/programming/comments/4rljty/got_fed_up_with_skype_wrote_my_own_toy_video_chat?st=iql0rqn9&sh=7602e95d
 // https://github.com/rygorous/kkapture
@@ -31,11 +39,56 @@ static int cameraDevice = -1;
 int cameraDeviceCount;
 char** cameraDeviceNames;
 
+// NOTE: Each decoder only ever has a single decode task queued or running at a time (so that its
+//       frames are decoded in order), so this only needs to be as large as the number of users.
+static const int VIDEO_DECODE_MAX_QUEUED_TASKS = 64;
+static const int VIDEO_DECODE_MAX_THREADS = 8;
+
+// NOTE: The number of encoded frames that can be waiting to be decoded for a single user.
+//       Frames that arrive while the queue is full are dropped.
+static const int VIDEO_DECODE_QUEUE_CAPACITY = 4;
+
+struct EncodedVideoFrame
+{
+    std::vector<uint8> data; // Only resized by the producer, so we only allocate as frames grow
+    int length;
+};
+
+// NOTE: Decoders wait for a keyframe whenever they lose track of the stream (e.g because a frame
+//       was lost), so we only need to send keyframes this often as a fallback.
+static const int VIDEO_KEYFRAME_INTERVAL = 240;
+static const int VIDEO_KEYFRAME_GRANULE_SHIFT = 8; // Must allow for VIDEO_KEYFRAME_INTERVAL
+static const double VIDEO_KEYFRAME_REQUEST_INTERVAL_SECONDS = 0.5;
+
+struct Video::VideoDecoder
+{
+    th_dec_ctx* context; // Null until we've received the sender's headers
+    th_ycbcr_buffer decodingImage;
+    std::vector<uint8> headers; // The headers that context was created from, for comparison
+
+    SPSCQueue<EncodedVideoFrame>* frames; // Written by the network thread, read by the decode task
+    std::atomic<bool> decodeScheduled;
+    std::atomic<bool> decodeFailed; // Set by the decode task, cleared by the network thread
+    TripleBuffer* outputImage;
+
+    // NOTE: These are only accessed by the network thread
+    bool awaitingKeyframe;
+    double lastKeyframeRequestTime;
+};
+
 static th_enc_ctx* encoderContext;
-static th_dec_ctx* decoderContext;
+static ogg_uint32_t encoderKeyframeInterval;
+static bool forceNextKeyframe;
+static int encoderQuality;
+static int encoderFrameInterval; // The number of Video::Update calls between each frame we send
+
+// NOTE: The headers for our own encoder, which are sent to each user so that they can create a
+//       decoder for our video.
+static ogg_packet headerPackets[Video::VIDEO_HEADER_PACKET_COUNT];
 
 static th_ycbcr_buffer encodingImage;
-static th_ycbcr_buffer decodingImage;
+
+static ThreadPool* decodePool;
 
 #ifdef DEBUG_VIDEO_VIDEO_OUTPUT
 static FILE* ogvOutputFile;
@@ -49,20 +102,8 @@ static ogg_stream_state ogvOutputStream;
 #include "video_unix.cpp"
 #endif
 
-static float clamp(float x)
+int Video::encodeCapturedImage(int outputLength, uint8* outputBuffer)
 {
-    if(x < 0.0f)
-        return 0.0f;
-    else if(x > 255.0f)
-        return 255.0f;
-    return x;
-}
-
-int Video::encodeRGBImage(int inputLength, uint8* inputBuffer, int outputLength, uint8* outputBuffer)
-{
-    // TODO: Support other/variable image sizes
-    assert(inputLength == 320*240*3);
-
 #ifdef DEBUG_VIDEO_IMAGE_OUTPUT
     char outpngName[64];
     static int pngIndex = 0;
@@ -74,39 +115,27 @@ int Video::encodeRGBImage(int inputLength, uint8* inputBuffer, int outputLength,
     }
 #endif
 
-    // Convert RGB image to Y'CbCr
-    for(int y=0; y<encodingImage[0].height; y++)
-    {
-        for(int x=0; x<encodingImage[0].width; x++)
-        {
-            // TODO: We're assuming here that each image plane has the same size
-            int pixelIndex = y*encodingImage[0].width + x;
-            uint8 r = inputBuffer[3*pixelIndex + 0];
-            uint8 g = inputBuffer[3*pixelIndex + 1];
-            uint8 b = inputBuffer[3*pixelIndex + 2];
-
-            // TODO: Read http://www.equasys.de/colorconversion.html
-#if 0
-            uint8 YPrime = (uint8)(0.299f*r + 0.587f*g + 0.114f*b);
-            uint8 Cb = (uint8)((0.436f*255.0f - 0.14713f*r - 0.28886f*g + 0.436f*b)/0.872f);
-            uint8 Cr = (uint8)((0.615f*255.0f + 0.615f*r - 0.51499f*g - 0.10001f*b)/1.230f);
-#else
-            uint8 YPrime = (uint8)(16 + 0.257f*r + 0.504f*g + 0.098f*b);
-            uint8 Cb = (uint8)(128 - 0.148f*r - 0.291f*g + 0.439f*b);
-            uint8 Cr = (uint8)(128 + 0.439f*r - 0.368f*g - 0.071f*b);
-#endif
-            *(encodingImage[0].data + y*encodingImage[0].stride + x) = YPrime;
-            *(encodingImage[1].data + y*encodingImage[1].stride + x) = Cb;
-            *(encodingImage[2].data + y*encodingImage[2].stride + x) = Cr;
-        }
-    }
-
-    // Encode image
+    // NOTE: The platform layer writes each captured frame straight into encodingImage
     int bytesWritten = 0;
     uint8* bufferPtr = outputBuffer;
 
     ogg_packet packet;
+    if(forceNextKeyframe)
+    {
+        // NOTE: Theora has no way to directly request a keyframe, but a keyframe interval of 1
+        //       forces the next frame to be one.
+        ogg_uint32_t keyframeInterval = 1;
+        th_encode_ctl(encoderContext, TH_ENCCTL_SET_KEYFRAME_FREQUENCY_FORCE,
+                      &keyframeInterval, sizeof(keyframeInterval));
+    }
     int result = th_encode_ycbcr_in(encoderContext, encodingImage);
+    if(forceNextKeyframe)
+    {
+        ogg_uint32_t keyframeInterval = encoderKeyframeInterval;
+        th_encode_ctl(encoderContext, TH_ENCCTL_SET_KEYFRAME_FREQUENCY_FORCE,
+                      &keyframeInterval, sizeof(keyframeInterval));
+        forceNextKeyframe = false;
+    }
     if(result < 0)
     {
         logWarn("ERROR: Image encoding failed with code %d\n", result);
@@ -147,22 +176,30 @@ int Video::encodeRGBImage(int inputLength, uint8* inputBuffer, int outputLength,
     return bytesWritten;
 }
 
-int Video::decodeRGBImage(int inputLength, uint8* inputBuffer, int outputLength, uint8* outputBuffer)
+int Video::decodeRGBImage(VideoDecoder* decoder, int inputLength, uint8* inputBuffer,
+                          int outputLength, uint8* outputBuffer)
 {
-    // TODO: Support other image sizes
-    assert(outputLength == 320*240*3);
-
     int inBytesRemaining = inputLength;
+    uint8* inputPtr = inputBuffer;
+    int outputBytes = 0;
     ogg_packet packet;
 
-    while(inBytesRemaining > 0)
+    while(inBytesRemaining > (int)sizeof(int32))
     {
         // NOTE: decode_packetin does not appear to use any members of packet other than
         //       packet.bytes and packet.packet
-        packet.bytes = *((int32*)inputBuffer);
-        packet.packet = inputBuffer + sizeof(int32);
+        packet.bytes = *((int32*)inputPtr);
+        packet.packet = inputPtr + sizeof(int32);
+        if((packet.bytes < 0) || (packet.bytes > inBytesRemaining - (int)sizeof(int32)))
+        {
+            logWarn("ERROR: Video packet of %d bytes does not fit in the %d remaining bytes of the frame\n",
+                    (int)packet.bytes, inBytesRemaining);
+            return 0;
+        }
+        inputPtr += sizeof(int32) + packet.bytes;
+        inBytesRemaining -= sizeof(int32) + packet.bytes;
 
-        int result = th_decode_packetin(decoderContext, &packet, 0);
+        int result = th_decode_packetin(decoder->context, &packet, 0);
         if(result < 0)
         {
             logWarn("ERROR: Video packet decode failed with code: %d\n", result);
@@ -170,7 +207,8 @@ int Video::decodeRGBImage(int inputLength, uint8* inputBuffer, int outputLength,
         }
 
         // TODO: Can we ever get more than one image out here?
-        result = th_decode_ycbcr_out(decoderContext, decodingImage);
+        th_ycbcr_buffer& decodingImage = decoder->decodingImage;
+        result = th_decode_ycbcr_out(decoder->context, decodingImage);
         if(result < 0)
         {
             logWarn("ERROR: Video frame extraction failed with code: %d\n", result);
@@ -179,29 +217,283 @@ int Video::decodeRGBImage(int inputLength, uint8* inputBuffer, int outputLength,
 
         int imageWidth = decodingImage[0].width;
         int imageHeight = decodingImage[0].height;
-        for(int y=0; y<imageHeight; y++)
+        if(imageWidth*imageHeight*3 > outputLength)
+        {
+            logWarn("ERROR: Decoded a %dx%d video frame, which is too large for the output image\n",
+                    imageWidth, imageHeight);
+            return 0;
+        }
+
+        VideoPlane yPlane = {decodingImage[0].data, decodingImage[0].stride};
+        VideoPlane cbPlane = {decodingImage[1].data, decodingImage[1].stride};
+        VideoPlane crPlane = {decodingImage[2].data, decodingImage[2].stride};
+        if(decodingImage[1].width == imageWidth)
+        {
+            convertYCbCr444ToRGB(imageWidth, imageHeight, yPlane, cbPlane, crPlane,
+                                 outputBuffer, 3*imageWidth);
+        }
+        else
         {
-            for(int x=0; x<imageWidth; x++)
+            convertYCbCr420ToRGB(imageWidth, imageHeight, yPlane, cbPlane, crPlane,
+                                 outputBuffer, 3*imageWidth);
+        }
+        outputBytes = imageWidth*imageHeight*3;
+    }
+    return outputBytes;
+}
+
+// Runs on the decode threads, decoding every frame that is queued for the given decoder.
+static void decodeQueuedFrames(void* data)
+{
+    Video::VideoDecoder* decoder = (Video::VideoDecoder*)data;
+    while(true)
+    {
+        EncodedVideoFrame* frame;
+        while((frame = decoder->frames->Peek()) != nullptr)
+        {
+            TripleBuffer* outputImage = decoder->outputImage;
+            int imageBytes = Video::decodeRGBImage(decoder, frame->length, frame->data.data(),
+                                                   outputImage->BufferSize(), outputImage->WriteBuffer());
+            if(imageBytes > 0)
+            {
+                outputImage->PublishWriteBuffer();
+            }
+            else
             {
-                int pixelIndex = y*imageWidth+ x;
-                uint8 Y = *(decodingImage[0].data + y*decodingImage[0].stride + x);
-                uint8 Cb= *(decodingImage[1].data + y*decodingImage[1].stride + x);
-                uint8 Cr= *(decodingImage[2].data + y*decodingImage[2].stride + x);
-                float YNew = (float)Y - 16.0f;
-                float CbNew= (float)Cb - 128.0f;
-                float CrNew= (float)Cr - 128.0f;
-                uint8 r = (uint8)clamp(1.164f*YNew + 0.000f*CbNew + 1.596f*CrNew);
-                uint8 g = (uint8)clamp(1.164f*YNew - 0.392f*CbNew - 0.813f*CrNew);
-                uint8 b = (uint8)clamp(1.164f*YNew + 2.017f*CbNew + 0.000f*CrNew);
-
-                outputBuffer[3*pixelIndex + 0] = r;
-                outputBuffer[3*pixelIndex + 1] = g;
-                outputBuffer[3*pixelIndex + 2] = b;
+                decoder->decodeFailed = true;
             }
+            decoder->frames->Pop();
+        }
+
+        decoder->decodeScheduled = false;
+
+        // NOTE: A frame may have been queued after we last checked the queue but before we cleared
+        //       decodeScheduled, in which case no new task was submitted for it and it is up to us.
+        if((decoder->frames->Peek() == nullptr) || decoder->decodeScheduled.exchange(true))
+        {
+            break;
+        }
+    }
+}
+
+Video::VideoDecoder* Video::CreateDecoder(TripleBuffer* outputImage)
+{
+    VideoDecoder* result = new VideoDecoder();
+    result->context = nullptr;
+    result->frames = new SPSCQueue<EncodedVideoFrame>(VIDEO_DECODE_QUEUE_CAPACITY);
+    result->decodeScheduled = false;
+    result->decodeFailed = false;
+    result->outputImage = outputImage;
+    result->awaitingKeyframe = true;
+    result->lastKeyframeRequestTime = -VIDEO_KEYFRAME_REQUEST_INTERVAL_SECONDS;
+    return result;
+}
+
+bool Video::SetDecoderHeaders(VideoDecoder* decoder, NetworkVideoHeaderPacket& packet)
+{
+    std::vector<uint8> headers;
+    for(int i=0; i<VIDEO_HEADER_PACKET_COUNT; i++)
+    {
+        headers.push_back((uint8)(packet.headerLengths[i] & 0xFF));
+        headers.push_back((uint8)(packet.headerLengths[i] >> 8));
+        headers.insert(headers.end(), packet.headerData[i], packet.headerData[i] + packet.headerLengths[i]);
+    }
+
+    // NOTE: Headers are re-sent along with keyframes, in case we missed the first ones
+    if((decoder->context != nullptr) && (headers == decoder->headers))
+    {
+        return true;
+    }
+
+    th_info decoderInfo;
+    th_info_init(&decoderInfo);
+    th_comment comment;
+    th_comment_init(&comment);
+    th_setup_info* setupInfo = NULL;
+    bool headersValid = true;
+    for(int i=0; i<VIDEO_HEADER_PACKET_COUNT; i++)
+    {
+        ogg_packet headerPacket = {};
+        headerPacket.packet = packet.headerData[i];
+        headerPacket.bytes = packet.headerLengths[i];
+        headerPacket.b_o_s = (i == 0);
+        headerPacket.packetno = i;
+
+        int result = th_decode_headerin(&decoderInfo, &comment, &setupInfo, &headerPacket);
+        if(result <= 0)
+        {
+            logWarn("ERROR: Video header decode failed with code: %d\n", result);
+            headersValid = false;
+            break;
+        }
+    }
+    th_comment_clear(&comment);
+
+    th_dec_ctx* newContext = nullptr;
+    if(headersValid && (setupInfo != nullptr))
+    {
+        newContext = th_decode_alloc(&decoderInfo, setupInfo);
+    }
+    th_setup_free(setupInfo);
+    th_info_clear(&decoderInfo);
+    if(newContext == nullptr)
+    {
+        return false;
+    }
+
+    // NOTE: The only thread that submits decode tasks is the one calling this, so once the pool
+    //       is idle nothing else can be using the old context (and there are no frames queued for it).
+    decodePool->WaitForIdle();
+    if(decoder->context)
+    {
+        th_decode_free(decoder->context);
+    }
+    decoder->context = newContext;
+    decoder->headers.swap(headers);
+    decoder->awaitingKeyframe = true;
+    return true;
+}
+
+void Video::DestroyDecoder(VideoDecoder* decoder)
+{
+    if(decoder == nullptr)
+        return;
+
+    // NOTE: The only thread that submits decode tasks is the one calling this, so once the pool
+    //       is idle nothing else can be using the decoder.
+    decodePool->WaitForIdle();
+
+    if(decoder->context)
+    {
+        th_decode_free(decoder->context);
+    }
+    delete decoder->frames;
+    delete decoder;
+}
+
+static bool frameStartsWithKeyframe(int inputLength, uint8* inputBuffer)
+{
+    if(inputLength <= (int)sizeof(int32))
+        return false;
+
+    ogg_packet packet = {};
+    packet.bytes = *((int32*)inputBuffer);
+    packet.packet = inputBuffer + sizeof(int32);
+    if((packet.bytes <= 0) || (packet.bytes > inputLength - (int)sizeof(int32)))
+        return false;
+
+    return (th_packet_iskeyframe(&packet) == 1);
+}
+
+bool Video::DecodeFrameAsync(VideoDecoder* decoder, int inputLength, uint8* inputBuffer)
+{
+    if(decoder->decodeFailed.exchange(false))
+    {
+        decoder->awaitingKeyframe = true;
+    }
+    if(decoder->context == nullptr)
+    {
+        // NOTE: We can't decode anything until we've received the sender's headers
+        return false;
+    }
+    if(decoder->awaitingKeyframe)
+    {
+        // NOTE: Every other frame is predicted from the previous ones, which we don't have (or
+        //       can't trust), so there is no point decoding them.
+        if(!frameStartsWithKeyframe(inputLength, inputBuffer))
+        {
+            return false;
         }
-        inBytesRemaining -= imageWidth*imageHeight*3;
+        decoder->awaitingKeyframe = false;
+    }
+
+    EncodedVideoFrame* frame = decoder->frames->BeginPush();
+    if(frame == nullptr)
+    {
+        logWarn("Video decoding is not keeping up, dropping frames until the next keyframe\n");
+        decoder->awaitingKeyframe = true;
+        return false;
+    }
+    if((int)frame->data.size() < inputLength)
+    {
+        frame->data.resize(inputLength);
+    }
+    memcpy(frame->data.data(), inputBuffer, inputLength);
+    frame->length = inputLength;
+    decoder->frames->CommitPush();
+
+    if(!decoder->decodeScheduled.exchange(true))
+    {
+        if(!decodePool->Submit(decodeQueuedFrames, decoder))
+        {
+            // NOTE: The frame stays queued and will be decoded when the next frame is submitted
+            logWarn("Unable to submit video decode task, the decode queue is full\n");
+            decoder->decodeScheduled = false;
+        }
+    }
+    return true;
+}
+
+void Video::MarkDecoderStateLost(VideoDecoder* decoder)
+{
+    decoder->awaitingKeyframe = true;
+}
+
+bool Video::ShouldRequestKeyframe(VideoDecoder* decoder, double currentTime)
+{
+    if(!decoder->awaitingKeyframe && (decoder->context != nullptr))
+    {
+        return false;
+    }
+    if(currentTime - decoder->lastKeyframeRequestTime < VIDEO_KEYFRAME_REQUEST_INTERVAL_SECONDS)
+    {
+        return false;
+    }
+
+    decoder->lastKeyframeRequestTime = currentTime;
+    return true;
+}
+
+void Video::SendHeaders(ENetPeer* userPeer)
+{
+    NetworkVideoHeaderPacket headerPacket = {};
+    headerPacket.srcUser = localUser->ID;
+    size_t payloadBytes = sizeof(headerPacket.srcUser);
+    for(int i=0; i<VIDEO_HEADER_PACKET_COUNT; i++)
+    {
+        headerPacket.headerLengths[i] = (uint16)headerPackets[i].bytes;
+        headerPacket.headerData[i] = headerPackets[i].packet;
+        payloadBytes += sizeof(headerPacket.headerLengths[i]) + headerPacket.headerLengths[i];
+    }
+
+    NetworkOutPacket outPacket = createNetworkOutPacket(NET_MSGTYPE_VIDEO_HEADER, payloadBytes);
+    headerPacket.serialize(outPacket);
+    Network::SendToUser(outPacket, userPeer, 0, true);
+}
+
+void Video::RequestKeyframe(UserIdentifier targetUser, ENetPeer* userPeer)
+{
+    logInfo("Requesting a video keyframe from user %d\n", targetUser);
+    NetworkVideoKeyframeRequestPacket requestPacket = {};
+    requestPacket.srcUser = localUser->ID;
+    requestPacket.targetUser = targetUser;
+
+    NetworkOutPacket outPacket = createNetworkOutPacket(NET_MSGTYPE_VIDEO_KEYFRAME_REQUEST,
+                                                        sizeof(requestPacket.srcUser) + sizeof(requestPacket.targetUser));
+    requestPacket.serialize(outPacket);
+    Network::SendToUser(outPacket, userPeer, 0, true);
+}
+
+void Video::ProcessKeyframeRequest(NetworkVideoKeyframeRequestPacket& packet, ENetPeer* requesterPeer)
+{
+    if(packet.targetUser != localUser->ID)
+    {
+        return;
     }
-    return 0;
+
+    // NOTE: The requester may have lost (or never received) our headers too
+    SendHeaders(requesterPeer);
+    forceNextKeyframe = true;
 }
 
 static void copyTheoraPacket(ogg_packet& out, ogg_packet& in)
@@ -226,23 +518,29 @@ bool Video::Setup()
     encoderInfo.pic_height = 240;
     encoderInfo.frame_width = 320; // Must be a multiple of 16
     encoderInfo.frame_height = 240;// Must be a multiple of 16
-    encoderInfo.pixel_fmt = TH_PF_444;
+    encoderInfo.pixel_fmt = TH_PF_420;
     encoderInfo.colorspace = TH_CS_UNSPECIFIED;
-    encoderInfo.quality = 32;
+    encoderInfo.quality = VIDEO_DEFAULT_QUALITY;
     encoderInfo.target_bitrate=  -1;
     encoderInfo.fps_numerator = 24;
     encoderInfo.fps_denominator = 1;
     encoderInfo.aspect_numerator = 0;
     encoderInfo.aspect_denominator = 0;
-    //encoderInfo.keyframe_granule_shift=...; // TODO
+    encoderInfo.keyframe_granule_shift = VIDEO_KEYFRAME_GRANULE_SHIFT;
 
     encoderContext = th_encode_alloc(&encoderInfo);
     th_info_clear(&encoderInfo);
 
+    encoderKeyframeInterval = VIDEO_KEYFRAME_INTERVAL;
+    th_encode_ctl(encoderContext, TH_ENCCTL_SET_KEYFRAME_FREQUENCY_FORCE,
+                  &encoderKeyframeInterval, sizeof(encoderKeyframeInterval));
+    forceNextKeyframe = false;
+    encoderQuality = VIDEO_DEFAULT_QUALITY;
+    encoderFrameInterval = VIDEO_DEFAULT_FRAME_INTERVAL;
+
     th_comment comment;
     th_comment_init(&comment);
     ogg_packet tempPacket;
-    ogg_packet headerPackets[3];
     int headerPacketCount = 0;
     // NOTE: We need to copy each packet as we get to if we want to store it for later because
     //       the packet data is stored in a buffer that is owned by daala and gets re-used each
@@ -254,34 +552,28 @@ bool Video::Setup()
         headerPacketCount++;
         logInfo("Output theora header packet\n");
     }
-    assert(headerPacketCount == 3);
+    assert(headerPacketCount == VIDEO_HEADER_PACKET_COUNT);
 
     // TODO: Support other image sizes
+    // NOTE: We encode 4:2:0, so the chroma planes are half the size of the luma plane in each dimension
     for(int i=0; i<3; i++)
     {
-        encodingImage[i].width = 320;
-        encodingImage[i].height = 240;
+        int planeScale = (i == 0) ? 1 : 2;
+        encodingImage[i].width = cameraWidth/planeScale;
+        encodingImage[i].height = cameraHeight/planeScale;
         encodingImage[i].stride = encodingImage[i].width;
         encodingImage[i].data = new uint8[encodingImage[i].width*encodingImage[i].height];
     }
 
-    // Initialize theora decoder
-    th_info decoderInfo;
-    th_info_init(&decoderInfo);
-    //th_comment comment;
-    th_comment_init(&comment);
-    th_setup_info* setupInfo = NULL;
-    for(int i=0; i<3; i++)
-    {
-        int headersRemaining = th_decode_headerin(&decoderInfo, &comment,
-                                                  &setupInfo, &headerPackets[i]);
-        logInfo("Headers left to decode: %d\n", headersRemaining);
-        if(headersRemaining < 0)
-            break;
-    }
-    th_comment_clear(&comment);
-    decoderContext = th_decode_alloc(&decoderInfo, setupInfo);
-    th_setup_free(setupInfo);
+    // NOTE: Decoding is stateful so each user's frames must be decoded in order, but different
+    //       users' frames can be decoded in parallel.
+    int decodeThreadCount = Platform::GetProcessorCount() - 1;
+    if(decodeThreadCount < 1)
+        decodeThreadCount = 1;
+    if(decodeThreadCount > VIDEO_DECODE_MAX_THREADS)
+        decodeThreadCount = VIDEO_DECODE_MAX_THREADS;
+    decodePool = new ThreadPool(decodeThreadCount, VIDEO_DECODE_MAX_QUEUED_TASKS);
+    logInfo("Decoding video on %d threads\n", decodePool->ThreadCount());
 
 #ifdef DEBUG_VIDEO_VIDEO_OUTPUT
     ogvOutputFile = fopen("debug_videoinput.ogv", "wb");
@@ -324,12 +616,31 @@ bool Video::Setup()
     return true;
 }
 
+void Video::SetEncoderSettings(int quality, int frameInterval)
+{
+    assert((quality >= 0) && (quality <= 63));
+    assert(frameInterval > 0);
+    encoderFrameInterval = frameInterval;
+    if(quality != encoderQuality)
+    {
+        int result = th_encode_ctl(encoderContext, TH_ENCCTL_SET_QUALITY, &quality, sizeof(quality));
+        if(result == 0)
+        {
+            encoderQuality = quality;
+        }
+        else
+        {
+            logWarn("Unable to set video encoder quality to %d: Error %d\n", quality, result);
+        }
+    }
+}
+
 void Video::Update()
 {
     // TODO: This is just a quick hack to check for and send video updates at less than 50Hz
     static int executionCounter = 0;
     executionCounter++;
-    if(executionCounter == 3)
+    if(executionCounter >= encoderFrameInterval)
     {
         executionCounter = 0;
 
@@ -338,29 +649,47 @@ void Video::Update()
 
         if(checkForNewVideoFrame())
         {
-            uint8* currentPixelValues = currentVideoFrame();
             if(Network::IsConnectedToMasterServer())
             {
                 static uint8* encodedPixels = new uint8[320*240*3];
-                int videoBytes = encodeRGBImage(320*240*3, currentPixelValues,
-                                                320*240*3, encodedPixels);
+                int videoBytes = encodeCapturedImage(320*240*3, encodedPixels);
                 //logTerm("Encoded %d video bytes\n", videoBytes);
                 //delete[] encodedPixels;
-                NetworkVideoPacket videoPacket = {};
-                videoPacket.imageWidth = 320;
-                videoPacket.imageHeight = 240;
-                videoPacket.encodedDataLength = videoBytes;
-                memcpy(videoPacket.encodedData, encodedPixels, videoBytes);
-
-                for(int i=0; i<remoteUsers.size(); i++)
+                // NOTE: Nothing is encoded if encoding failed, and an empty frame would only make
+                //       the receivers think that they'd lost track of our video.
+                if((remoteUsers.size() > 0) && (videoBytes > 0) && (videoBytes <= VIDEO_FRAME_MAX_BYTES))
                 {
-                    ClientUserData* destinationUser = remoteUsers[i];
+                    static NetworkVideoPacket videoPacket = {};
                     videoPacket.srcUser = localUser->ID;
-                    videoPacket.index = destinationUser->lastSentVideoPacket++;
-
-                    NetworkOutPacket outPacket = createNetworkOutPacket(NET_MSGTYPE_VIDEO);
-                    videoPacket.serialize(outPacket);
-                    outPacket.send(destinationUser->netPeer, 0, false);
+                    videoPacket.index = (uint8)localUser->lastSentVideoPacket++;
+                    videoPacket.fragmentCount = (uint8)videoFragmentCount(videoBytes);
+                    videoPacket.imageWidth = 320;
+                    videoPacket.imageHeight = 240;
+
+                    // NOTE: We send the same packets to every user, so that they only get
+                    //       serialized once and ENet can share them between all of the sends.
+                    for(int fragment=0; fragment<videoPacket.fragmentCount; fragment++)
+                    {
+                        int fragmentOffset = fragment*VIDEO_FRAGMENT_PAYLOAD_BYTES;
+                        int fragmentBytes = videoBytes - fragmentOffset;
+                        if(fragmentBytes > VIDEO_FRAGMENT_PAYLOAD_BYTES)
+                            fragmentBytes = VIDEO_FRAGMENT_PAYLOAD_BYTES;
+                        videoPacket.fragmentIndex = (uint8)fragment;
+                        videoPacket.encodedDataLength = (uint16)fragmentBytes;
+                        videoPacket.encodedData = encodedPixels + fragmentOffset;
+
+                        size_t payloadBytes = sizeof(videoPacket.srcUser) + sizeof(videoPacket.index) +
+                                              sizeof(videoPacket.fragmentIndex) + sizeof(videoPacket.fragmentCount) +
+                                              sizeof(videoPacket.imageWidth) + sizeof(videoPacket.imageHeight) +
+                                              sizeof(videoPacket.encodedDataLength) + fragmentBytes;
+                        NetworkOutPacket outPacket = createNetworkOutPacket(NET_MSGTYPE_VIDEO, payloadBytes);
+                        videoPacket.serialize(outPacket);
+                        Network::SendToRoom(outPacket, 0, false);
+                    }
+                }
+                else if(videoBytes > VIDEO_FRAME_MAX_BYTES)
+                {
+                    logWarn("Encoded video frame is too large to send: %d bytes\n", videoBytes);
                 }
             }
         }
@@ -379,7 +708,11 @@ void Video::Shutdown()
         delete[] encodingImage[i].data;
     }
     th_encode_free(encoderContext);
-    th_decode_free(decoderContext);
+    delete decodePool;
+    for(int i=0; i<VIDEO_HEADER_PACKET_COUNT; i++)
+    {
+        delete[] headerPackets[i].packet;
+    }
 
 #ifdef DEBUG_VIDEO_VIDEO_OUTPUT
     ogg_page outputPage;
@@ -403,12 +736,34 @@ bool Video::NetworkVideoPacket::serialize(Packet& packet)
 {
     packet.serializeuint16(this->srcUser);
     packet.serializeuint8(this->index);
+    packet.serializeuint8(this->fragmentIndex);
+    packet.serializeuint8(this->fragmentCount);
     packet.serializeuint16(this->imageWidth);
     packet.serializeuint16(this->imageHeight);
-    packet.serializeuint16(this->encodedDataLength);
-    packet.serializebytes(this->encodedData, this->encodedDataLength);
-
-    return true;
+    return packet.serializebytesview(this->encodedData, this->encodedDataLength);
 }
 template bool Video::NetworkVideoPacket::serialize(NetworkInPacket& packet);
 template bool Video::NetworkVideoPacket::serialize(NetworkOutPacket& packet);
+
+template<typename Packet>
+bool Video::NetworkVideoHeaderPacket::serialize(Packet& packet)
+{
+    packet.serializeuint16(this->srcUser);
+    for(int i=0; i<VIDEO_HEADER_PACKET_COUNT; i++)
+    {
+        if(!packet.serializebytesview(this->headerData[i], this->headerLengths[i]))
+            return false;
+    }
+    return true;
+}
+template bool Video::NetworkVideoHeaderPacket::serialize(NetworkInPacket& packet);
+template bool Video::NetworkVideoHeaderPacket::serialize(NetworkOutPacket& packet);
+
+template<typename Packet>
+bool Video::NetworkVideoKeyframeRequestPacket::serialize(Packet& packet)
+{
+    packet.serializeuint16(this->srcUser);
+    return packet.serializeuint16(this->targetUser);
+}
+template bool Video::NetworkVideoKeyframeRequestPacket::serialize(NetworkInPacket& packet);
+template bool Video::NetworkVideoKeyframeRequestPacket::serialize(NetworkOutPacket& packet);
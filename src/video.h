@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #include "common.h"
+#include "triplebuffer.h"
 #include "user.h"
 
 const int cameraWidth = 320;
@@ -11,14 +12,46 @@ const int cameraHeight = 240;
 
 namespace Video
 {
+    // NOTE: Encoded frames are split into (MTU-sized) fragments for sending, so each packet
+    //       contains only a single fragment of a frame. See video_fragment.h.
     struct NetworkVideoPacket
     {
         UserIdentifier srcUser;
         uint8 index;
+        uint8 fragmentIndex;
+        uint8 fragmentCount;
         uint16 imageWidth;
         uint16 imageHeight;
         uint16 encodedDataLength;
-        uint8 encodedData[cameraWidth*cameraHeight*3]; // TODO: Sizing
+        uint8* encodedData; // Points into the network packet when receiving, not owned by the packet
+
+        template<typename Packet> bool serialize(Packet& packet);
+    };
+
+    // NOTE: The encoder settings that we use until the bitrate controller tells us otherwise
+    const int VIDEO_DEFAULT_QUALITY = 32;
+    const int VIDEO_DEFAULT_FRAME_INTERVAL = 3; // The number of Update() calls between each frame
+
+    // NOTE: Theora streams start with 3 header packets, which are needed to decode the rest
+    const int VIDEO_HEADER_PACKET_COUNT = 3;
+
+    // Sent reliably by each client to every other user in the room, and again whenever one of
+    // them asks for a keyframe. Contains the headers needed to decode the sender's video.
+    struct NetworkVideoHeaderPacket
+    {
+        UserIdentifier srcUser;
+        uint16 headerLengths[VIDEO_HEADER_PACKET_COUNT];
+        uint8* headerData[VIDEO_HEADER_PACKET_COUNT]; // Points into the network packet when receiving
+
+        template<typename Packet> bool serialize(Packet& packet);
+    };
+
+    // Sent reliably to a user whose video we can no longer decode (e.g because we lost a frame),
+    // asking them to re-send their headers and make their next frame a keyframe.
+    struct NetworkVideoKeyframeRequestPacket
+    {
+        UserIdentifier srcUser;
+        UserIdentifier targetUser;
 
         template<typename Packet> bool serialize(Packet& packet);
     };
@@ -32,11 +65,86 @@ namespace Video
      * and equal to the previous state of the device if the function failed
      */
     bool enableCamera(int deviceID);
+
+    /**
+     * Check for a new frame from the camera. If there is one, it is converted straight to the
+     * format that we encode (4:2:0 Y'CbCr) and published for currentVideoFrame().
+     * \return True if a new frame was received
+     */
     bool checkForNewVideoFrame();
+
+    /**
+     * \return The most recent frame from the camera as an RGB image, for the local preview.
+     * NOTE: This may need to convert the frame, so it should only be called when the preview is
+     * drawn, and always from the same (interface) thread.
+     */
     uint8_t* currentVideoFrame();
 
-    int encodeRGBImage(int inputLength, uint8* inputBuffer, int outputLength, uint8* outputBuffer);
-    int decodeRGBImage(int inputLength, uint8* inputBuffer, int outputLength, uint8* outputBuffer);
+    /**
+     * Encode the most recent frame received by checkForNewVideoFrame().
+     * \return The number of bytes written to outputBuffer
+     */
+    int encodeCapturedImage(int outputLength, uint8* outputBuffer);
+
+    /**
+     * Change the quality (from 0 to 63) of the video that we send, and how often we send it.
+     * The frame interval is the number of calls to Update() between each frame that we send.
+     */
+    void SetEncoderSettings(int quality, int frameInterval);
+
+    // The decoding state for a single remote user's video stream.
+    // Frames are decoded (and converted to RGB) in order on a shared pool of decoding threads,
+    // and each decoded image is published to the decoder's output buffer.
+    // NOTE: A decoder can't decode anything until it has been given the sender's headers, and
+    //       after that it skips every frame until it receives a keyframe (both initially and
+    //       whenever it loses track of the stream).
+    struct VideoDecoder;
+
+    /**
+     * \param outputImage The buffer that decoded RGB images are published to. It must outlive
+     * the decoder and should only be read from a single (consumer) thread.
+     */
+    VideoDecoder* CreateDecoder(TripleBuffer* outputImage);
+
+    // NOTE: This waits for any in-progress decoding to finish, so the decoder's output buffer
+    //       can be destroyed as soon as it returns.
+    void DestroyDecoder(VideoDecoder* decoder);
+
+    /**
+     * (Re-)initialize the decoder from the headers sent by the user whose video it decodes.
+     * Headers that are identical to the current ones are ignored.
+     * \return False if the headers were invalid, in which case the decoder is unchanged
+     */
+    bool SetDecoderHeaders(VideoDecoder* decoder, NetworkVideoHeaderPacket& packet);
+
+    /**
+     * Queue an encoded frame for decoding on the decoding threads. The frame data is copied.
+     * Must always be called from the same thread.
+     * \return False if the frame was dropped, either because the decoder is waiting for headers
+     * or a keyframe, or because it is not keeping up
+     */
+    bool DecodeFrameAsync(VideoDecoder* decoder, int inputLength, uint8* inputBuffer);
+
+    // Tell the decoder that frames were lost, so it needs to wait for the next keyframe
+    void MarkDecoderStateLost(VideoDecoder* decoder);
+
+    // Returns true if the decoder is waiting for headers or a keyframe and it has been long enough
+    // since the last time that this returned true that we should (re-)request them.
+    bool ShouldRequestKeyframe(VideoDecoder* decoder, double currentTime);
+
+    // Send our headers to the given user (see Network::SendToUser)
+    void SendHeaders(ENetPeer* userPeer);
+
+    // Ask the given user to re-send their headers and make their next frame a keyframe
+    void RequestKeyframe(UserIdentifier targetUser, ENetPeer* userPeer);
+    void ProcessKeyframeRequest(NetworkVideoKeyframeRequestPacket& packet, ENetPeer* requesterPeer);
+
+    /**
+     * Decode an encoded frame to an RGB image immediately, on the calling thread.
+     * \return The number of bytes written to outputBuffer, or 0 if decoding failed
+     */
+    int decodeRGBImage(VideoDecoder* decoder, int inputLength, uint8* inputBuffer,
+                       int outputLength, uint8* outputBuffer);
 }
 
 #endif
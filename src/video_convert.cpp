@@ -0,0 +1,593 @@
+#include <assert.h>
+
+#include "logging.h"
+#include "platform.h"
+#include "video_convert.h"
+
+#ifdef PLATFORM_X86
+#include <immintrin.h>
+#endif
+
+// NOTE: Each kernel converts a single row of pixels at a time.
+//       The SIMD kernels read (and write) slightly past the end of each block of pixels that they
+//       process, so they fall back to the scalar code for the last few pixels in each row.
+typedef void RGBToYCbCrRowFunction(int width, const uint8* rgb, uint8* y, uint8* cb, uint8* cr);
+typedef void YCbCrToRGBRowFunction(int width, const uint8* y, const uint8* cb, const uint8* cr,
+                                   uint8* rgb);
+
+// BT.601 studio-range coefficients in 8.8 fixed-point
+// See http://www.equasys.de/colorconversion.html
+static const int Y_FROM_R = 66;
+static const int Y_FROM_G = 129;
+static const int Y_FROM_B = 25;
+static const int CB_FROM_R = -38;
+static const int CB_FROM_G = -74;
+static const int CB_FROM_B = 112;
+static const int CR_FROM_R = 112;
+static const int CR_FROM_G = -94;
+static const int CR_FROM_B = -18;
+
+static const int RGB_FROM_Y = 298;
+static const int R_FROM_CR = 409;
+static const int G_FROM_CB = -100;
+static const int G_FROM_CR = -208;
+static const int B_FROM_CB = 516;
+
+static const int FIXED_POINT_ROUNDING = 128;
+static const int Y_OFFSET = 16;
+static const int CHROMA_OFFSET = 128;
+
+static bool kernelSelected = false; // Whether videoConvertSetKernel() has been called
+static RGBToYCbCrRowFunction* rgbToYCbCrRow = nullptr;
+static YCbCrToRGBRowFunction* yCbCrToRGBRow = nullptr;
+
+static inline uint8 clampToByte(int x)
+{
+    if(x < 0)
+        return 0;
+    else if(x > 255)
+        return 255;
+    return (uint8)x;
+}
+
+static inline void rgbToYCbCrPixel(const uint8* rgb, uint8* y, uint8* cb, uint8* cr)
+{
+    int r = rgb[0];
+    int g = rgb[1];
+    int b = rgb[2];
+    *y  = (uint8)(((Y_FROM_R*r  + Y_FROM_G*g  + Y_FROM_B*b  + FIXED_POINT_ROUNDING) >> 8) + Y_OFFSET);
+    *cb = (uint8)(((CB_FROM_R*r + CB_FROM_G*g + CB_FROM_B*b + FIXED_POINT_ROUNDING) >> 8) + CHROMA_OFFSET);
+    *cr = (uint8)(((CR_FROM_R*r + CR_FROM_G*g + CR_FROM_B*b + FIXED_POINT_ROUNDING) >> 8) + CHROMA_OFFSET);
+}
+
+static inline void yCbCrToRGBPixel(uint8 y, uint8 cb, uint8 cr, uint8* rgb)
+{
+    int c = (int)y - Y_OFFSET;
+    int d = (int)cb - CHROMA_OFFSET;
+    int e = (int)cr - CHROMA_OFFSET;
+    rgb[0] = clampToByte((RGB_FROM_Y*c                 + R_FROM_CR*e + FIXED_POINT_ROUNDING) >> 8);
+    rgb[1] = clampToByte((RGB_FROM_Y*c + G_FROM_CB*d + G_FROM_CR*e + FIXED_POINT_ROUNDING) >> 8);
+    rgb[2] = clampToByte((RGB_FROM_Y*c + B_FROM_CB*d               + FIXED_POINT_ROUNDING) >> 8);
+}
+
+static void rgbToYCbCrRowScalar(int width, const uint8* rgb, uint8* y, uint8* cb, uint8* cr)
+{
+    for(int x=0; x<width; x++)
+    {
+        rgbToYCbCrPixel(rgb + 3*x, y + x, cb + x, cr + x);
+    }
+}
+
+static void yCbCrToRGBRowScalar(int width, const uint8* y, const uint8* cb, const uint8* cr,
+                                uint8* rgb)
+{
+    for(int x=0; x<width; x++)
+    {
+        yCbCrToRGBPixel(y[x], cb[x], cr[x], rgb + 3*x);
+    }
+}
+
+#ifdef PLATFORM_X86
+// Pack two 16-bit coefficients into each 32-bit lane, for use with madd
+static inline int coefficientPair(int low, int high)
+{
+    return (int)(((uint32)high << 16) | ((uint32)low & 0xFFFF));
+}
+
+// Load 4 packed RGB pixels into the low 3 bytes of each 32-bit lane.
+// Reads 14 bytes from rgb.
+PLATFORM_TARGET_SSE2
+static inline __m128i loadRGBx4SSE2(const uint8* rgb)
+{
+    __m128i first = _mm_loadl_epi64((const __m128i*)rgb);
+    __m128i second = _mm_loadl_epi64((const __m128i*)(rgb + 6));
+    __m128i pairs = _mm_unpacklo_epi64(first, second);
+
+    __m128i evenMask = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+    __m128i oddMask = _mm_set_epi32(0x00FFFFFF, 0, 0x00FFFFFF, 0);
+    __m128i even = _mm_and_si128(pairs, evenMask);
+    __m128i odd = _mm_and_si128(_mm_slli_epi64(pairs, 8), oddMask);
+    return _mm_or_si128(even, odd);
+}
+
+// Store 4 pixels from the low 3 bytes of each 32-bit lane as packed RGB.
+// Writes 14 bytes to rgb.
+PLATFORM_TARGET_SSE2
+static inline void storeRGBx4SSE2(uint8* rgb, __m128i pixels)
+{
+    __m128i evenMask = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+    __m128i oddMask = _mm_set_epi32(0x0000FFFF, (int)0xFF000000, 0x0000FFFF, (int)0xFF000000);
+    __m128i even = _mm_and_si128(pixels, evenMask);
+    __m128i odd = _mm_and_si128(_mm_srli_epi64(pixels, 8), oddMask);
+    __m128i pairs = _mm_or_si128(even, odd);
+
+    // NOTE: Each store writes 2 bytes of garbage past the pixels it contains, which then get
+    //       overwritten by the next store.
+    _mm_storel_epi64((__m128i*)rgb, pairs);
+    _mm_storel_epi64((__m128i*)(rgb + 6), _mm_srli_si128(pairs, 8));
+}
+
+// Compute one output channel for 4 pixels, given their R|G<<16 and B|1<<16 lanes
+PLATFORM_TARGET_SSE2
+static inline __m128i rgbToChannelSSE2(__m128i rg, __m128i b1,
+                                       int fromR, int fromG, int fromB, int offset)
+{
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(rg, _mm_set1_epi32(coefficientPair(fromR, fromG))),
+                                _mm_madd_epi16(b1, _mm_set1_epi32(coefficientPair(fromB, FIXED_POINT_ROUNDING))));
+    return _mm_add_epi32(_mm_srai_epi32(sum, 8), _mm_set1_epi32(offset));
+}
+
+PLATFORM_TARGET_SSE2
+static void rgbToYCbCrRowSSE2(int width, const uint8* rgb, uint8* y, uint8* cb, uint8* cr)
+{
+    const int blockSize = 8;
+    const __m128i lowByteMask = _mm_set1_epi32(0xFF);
+    const __m128i secondByteMask = _mm_set1_epi32(0xFF00);
+    const __m128i one = _mm_set1_epi32(1 << 16);
+
+    int x = 0;
+    // NOTE: The last load in each block reads 2 bytes into the pixel after the block
+    for(; x+blockSize < width; x+=blockSize)
+    {
+        __m128i rg[2];
+        __m128i b1[2];
+        for(int half=0; half<2; half++)
+        {
+            __m128i pixels = loadRGBx4SSE2(rgb + 3*(x + 4*half));
+            rg[half] = _mm_or_si128(_mm_and_si128(pixels, lowByteMask),
+                                    _mm_slli_epi32(_mm_and_si128(pixels, secondByteMask), 8));
+            b1[half] = _mm_or_si128(_mm_srli_epi32(pixels, 16), one);
+        }
+
+        __m128i yLow = rgbToChannelSSE2(rg[0], b1[0], Y_FROM_R, Y_FROM_G, Y_FROM_B, Y_OFFSET);
+        __m128i yHigh = rgbToChannelSSE2(rg[1], b1[1], Y_FROM_R, Y_FROM_G, Y_FROM_B, Y_OFFSET);
+        __m128i cbLow = rgbToChannelSSE2(rg[0], b1[0], CB_FROM_R, CB_FROM_G, CB_FROM_B, CHROMA_OFFSET);
+        __m128i cbHigh = rgbToChannelSSE2(rg[1], b1[1], CB_FROM_R, CB_FROM_G, CB_FROM_B, CHROMA_OFFSET);
+        __m128i crLow = rgbToChannelSSE2(rg[0], b1[0], CR_FROM_R, CR_FROM_G, CR_FROM_B, CHROMA_OFFSET);
+        __m128i crHigh = rgbToChannelSSE2(rg[1], b1[1], CR_FROM_R, CR_FROM_G, CR_FROM_B, CHROMA_OFFSET);
+
+        __m128i yWords = _mm_packs_epi32(yLow, yHigh);
+        __m128i cbWords = _mm_packs_epi32(cbLow, cbHigh);
+        __m128i crWords = _mm_packs_epi32(crLow, crHigh);
+        _mm_storel_epi64((__m128i*)(y + x), _mm_packus_epi16(yWords, yWords));
+        _mm_storel_epi64((__m128i*)(cb + x), _mm_packus_epi16(cbWords, cbWords));
+        _mm_storel_epi64((__m128i*)(cr + x), _mm_packus_epi16(crWords, crWords));
+    }
+
+    rgbToYCbCrRowScalar(width - x, rgb + 3*x, y + x, cb + x, cr + x);
+}
+
+// Compute one output channel for 4 pixels, given their C|D<<16 and E|1<<16 lanes
+PLATFORM_TARGET_SSE2
+static inline __m128i yCbCrToChannelSSE2(__m128i cd, __m128i e1, int fromD, int fromE)
+{
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(cd, _mm_set1_epi32(coefficientPair(RGB_FROM_Y, fromD))),
+                                _mm_madd_epi16(e1, _mm_set1_epi32(coefficientPair(fromE, FIXED_POINT_ROUNDING))));
+    return _mm_srai_epi32(sum, 8);
+}
+
+PLATFORM_TARGET_SSE2
+static void yCbCrToRGBRowSSE2(int width, const uint8* y, const uint8* cb, const uint8* cr,
+                              uint8* rgb)
+{
+    const int blockSize = 8;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i yOffset = _mm_set1_epi16(Y_OFFSET);
+    const __m128i chromaOffset = _mm_set1_epi16(CHROMA_OFFSET);
+
+    int x = 0;
+    // NOTE: The last store in each block writes 2 bytes into the pixel after the block
+    for(; x+blockSize < width; x+=blockSize)
+    {
+        __m128i c = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(y + x)), zero), yOffset);
+        __m128i d = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(cb + x)), zero), chromaOffset);
+        __m128i e = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(cr + x)), zero), chromaOffset);
+
+        __m128i cdLow = _mm_unpacklo_epi16(c, d);
+        __m128i cdHigh = _mm_unpackhi_epi16(c, d);
+        __m128i e1Low = _mm_unpacklo_epi16(e, one);
+        __m128i e1High = _mm_unpackhi_epi16(e, one);
+
+        __m128i rWords = _mm_packs_epi32(yCbCrToChannelSSE2(cdLow, e1Low, 0, R_FROM_CR),
+                                         yCbCrToChannelSSE2(cdHigh, e1High, 0, R_FROM_CR));
+        __m128i gWords = _mm_packs_epi32(yCbCrToChannelSSE2(cdLow, e1Low, G_FROM_CB, G_FROM_CR),
+                                         yCbCrToChannelSSE2(cdHigh, e1High, G_FROM_CB, G_FROM_CR));
+        __m128i bWords = _mm_packs_epi32(yCbCrToChannelSSE2(cdLow, e1Low, B_FROM_CB, 0),
+                                         yCbCrToChannelSSE2(cdHigh, e1High, B_FROM_CB, 0));
+        __m128i r = _mm_packus_epi16(rWords, rWords);
+        __m128i g = _mm_packus_epi16(gWords, gWords);
+        __m128i b = _mm_packus_epi16(bWords, bWords);
+
+        __m128i rg = _mm_unpacklo_epi8(r, g);
+        __m128i b0 = _mm_unpacklo_epi8(b, zero);
+        storeRGBx4SSE2(rgb + 3*x, _mm_unpacklo_epi16(rg, b0));
+        storeRGBx4SSE2(rgb + 3*(x + 4), _mm_unpackhi_epi16(rg, b0));
+    }
+
+    yCbCrToRGBRowScalar(width - x, y + x, cb + x, cr + x, rgb + 3*x);
+}
+
+// Pack the low byte of each 32-bit lane (in order) into the low 8 bytes of the result
+PLATFORM_TARGET_AVX2
+static inline __m128i packLowBytesAVX2(__m256i values)
+{
+    __m256i words = _mm256_packs_epi32(values, values);
+    __m256i bytes = _mm256_packus_epi16(words, words);
+    __m256i ordered = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+    return _mm256_castsi256_si128(ordered);
+}
+
+PLATFORM_TARGET_AVX2
+static inline __m256i rgbToChannelAVX2(__m256i rg, __m256i b1,
+                                       int fromR, int fromG, int fromB, int offset)
+{
+    __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(rg, _mm256_set1_epi32(coefficientPair(fromR, fromG))),
+                                   _mm256_madd_epi16(b1, _mm256_set1_epi32(coefficientPair(fromB, FIXED_POINT_ROUNDING))));
+    return _mm256_add_epi32(_mm256_srai_epi32(sum, 8), _mm256_set1_epi32(offset));
+}
+
+PLATFORM_TARGET_AVX2
+static void rgbToYCbCrRowAVX2(int width, const uint8* rgb, uint8* y, uint8* cb, uint8* cr)
+{
+    const int blockSize = 8;
+    // Shuffle each group of 4 packed pixels out into R|G<<16 and B|1<<16 32-bit lanes
+    const __m256i rgShuffle = _mm256_setr_epi8(0,-1,1,-1, 3,-1,4,-1, 6,-1,7,-1, 9,-1,10,-1,
+                                               0,-1,1,-1, 3,-1,4,-1, 6,-1,7,-1, 9,-1,10,-1);
+    const __m256i bShuffle = _mm256_setr_epi8(2,-1,-1,-1, 5,-1,-1,-1, 8,-1,-1,-1, 11,-1,-1,-1,
+                                              2,-1,-1,-1, 5,-1,-1,-1, 8,-1,-1,-1, 11,-1,-1,-1);
+    const __m256i one = _mm256_set1_epi32(1 << 16);
+
+    int x = 0;
+    // NOTE: The load for the second half of each block reads 4 bytes past the end of the block
+    for(; x+blockSize+1 < width; x+=blockSize)
+    {
+        const uint8* blockRGB = rgb + 3*x;
+        __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)blockRGB)),
+                                                 _mm_loadu_si128((const __m128i*)(blockRGB + 12)), 1);
+        __m256i rg = _mm256_shuffle_epi8(pixels, rgShuffle);
+        __m256i b1 = _mm256_or_si256(_mm256_shuffle_epi8(pixels, bShuffle), one);
+
+        __m256i yValues = rgbToChannelAVX2(rg, b1, Y_FROM_R, Y_FROM_G, Y_FROM_B, Y_OFFSET);
+        __m256i cbValues = rgbToChannelAVX2(rg, b1, CB_FROM_R, CB_FROM_G, CB_FROM_B, CHROMA_OFFSET);
+        __m256i crValues = rgbToChannelAVX2(rg, b1, CR_FROM_R, CR_FROM_G, CR_FROM_B, CHROMA_OFFSET);
+        _mm_storel_epi64((__m128i*)(y + x), packLowBytesAVX2(yValues));
+        _mm_storel_epi64((__m128i*)(cb + x), packLowBytesAVX2(cbValues));
+        _mm_storel_epi64((__m128i*)(cr + x), packLowBytesAVX2(crValues));
+    }
+
+    rgbToYCbCrRowScalar(width - x, rgb + 3*x, y + x, cb + x, cr + x);
+}
+
+PLATFORM_TARGET_AVX2
+static inline __m256i yCbCrToChannelAVX2(__m256i cd, __m256i e1, int fromD, int fromE)
+{
+    __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(cd, _mm256_set1_epi32(coefficientPair(RGB_FROM_Y, fromD))),
+                                   _mm256_madd_epi16(e1, _mm256_set1_epi32(coefficientPair(fromE, FIXED_POINT_ROUNDING))));
+    __m256i result = _mm256_srai_epi32(sum, 8);
+    return _mm256_min_epi32(_mm256_max_epi32(result, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+
+PLATFORM_TARGET_AVX2
+static void yCbCrToRGBRowAVX2(int width, const uint8* y, const uint8* cb, const uint8* cr,
+                              uint8* rgb)
+{
+    const int blockSize = 8;
+    // Pack the low 3 bytes of each 32-bit lane into the first 12 bytes of each 128-bit lane
+    const __m256i rgbShuffle = _mm256_setr_epi8(0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1,
+                                                0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1);
+    const __m256i one = _mm256_set1_epi32(1 << 16);
+    const __m256i yOffset = _mm256_set1_epi32(Y_OFFSET);
+    const __m256i chromaOffset = _mm256_set1_epi32(CHROMA_OFFSET);
+
+    int x = 0;
+    // NOTE: The store for the second half of each block writes 4 bytes past the end of the block
+    for(; x+blockSize+1 < width; x+=blockSize)
+    {
+        __m256i c = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(y + x))), yOffset);
+        __m256i d = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(cb + x))), chromaOffset);
+        __m256i e = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(cr + x))), chromaOffset);
+
+        __m256i cd = _mm256_blend_epi16(c, _mm256_slli_epi32(d, 16), 0xAA);
+        __m256i e1 = _mm256_blend_epi16(e, one, 0xAA);
+
+        __m256i r = yCbCrToChannelAVX2(cd, e1, 0, R_FROM_CR);
+        __m256i g = yCbCrToChannelAVX2(cd, e1, G_FROM_CB, G_FROM_CR);
+        __m256i b = yCbCrToChannelAVX2(cd, e1, B_FROM_CB, 0);
+        __m256i pixels = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(g, 8),
+                                                            _mm256_slli_epi32(b, 16)));
+        __m256i packed = _mm256_shuffle_epi8(pixels, rgbShuffle);
+
+        uint8* blockRGB = rgb + 3*x;
+        _mm_storeu_si128((__m128i*)blockRGB, _mm256_castsi256_si128(packed));
+        _mm_storeu_si128((__m128i*)(blockRGB + 12), _mm256_extracti128_si256(packed, 1));
+    }
+
+    yCbCrToRGBRowScalar(width - x, y + x, cb + x, cr + x, rgb + 3*x);
+}
+#endif
+
+static bool isKernelSupported(VideoConvertKernel kernel)
+{
+#ifdef PLATFORM_X86
+    Platform::CPUFeatures cpu = Platform::GetCPUFeatures();
+#endif
+    switch(kernel)
+    {
+        case VideoConvertKernel::Scalar: return true;
+#ifdef PLATFORM_X86
+        case VideoConvertKernel::SSE2: return cpu.SSE2;
+        case VideoConvertKernel::AVX2: return cpu.AVX2;
+#endif
+        default: return false;
+    }
+}
+
+VideoConvertKernel videoConvertBestKernel()
+{
+    if(isKernelSupported(VideoConvertKernel::AVX2))
+        return VideoConvertKernel::AVX2;
+    if(isKernelSupported(VideoConvertKernel::SSE2))
+        return VideoConvertKernel::SSE2;
+    return VideoConvertKernel::Scalar;
+}
+
+bool videoConvertSetKernel(VideoConvertKernel kernel)
+{
+    if(!isKernelSupported(kernel))
+    {
+        return false;
+    }
+
+    switch(kernel)
+    {
+#ifdef PLATFORM_X86
+        case VideoConvertKernel::SSE2:
+        {
+            rgbToYCbCrRow = rgbToYCbCrRowSSE2;
+            yCbCrToRGBRow = yCbCrToRGBRowSSE2;
+        } break;
+        case VideoConvertKernel::AVX2:
+        {
+            rgbToYCbCrRow = rgbToYCbCrRowAVX2;
+            yCbCrToRGBRow = yCbCrToRGBRowAVX2;
+        } break;
+#endif
+        default:
+        {
+            rgbToYCbCrRow = rgbToYCbCrRowScalar;
+            yCbCrToRGBRow = yCbCrToRGBRowScalar;
+        } break;
+    }
+    kernelSelected = true;
+    return true;
+}
+
+static bool selectDefaultKernel()
+{
+    if(!kernelSelected)
+    {
+        VideoConvertKernel kernel = videoConvertBestKernel();
+        videoConvertSetKernel(kernel);
+        logInfo("Using video conversion kernel %d\n", (int)kernel);
+    }
+    return true;
+}
+
+// NOTE: Images are converted on the decoding threads as well as the main thread, so the default
+//       kernel is selected by a static initializer (as in audio_mix.cpp), which only ever runs once
+//       and which every other thread waits for.
+static void ensureKernelSelected()
+{
+    static bool defaultKernelSelected = selectDefaultKernel();
+    (void)defaultKernelSelected;
+}
+
+void convertRGBToYCbCr444(int width, int height, const uint8* rgb, int rgbStride,
+                          VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane)
+{
+    ensureKernelSelected();
+    for(int y=0; y<height; y++)
+    {
+        rgbToYCbCrRow(width, rgb + y*rgbStride,
+                      yPlane.data + y*yPlane.stride,
+                      cbPlane.data + y*cbPlane.stride,
+                      crPlane.data + y*crPlane.stride);
+    }
+}
+
+void convertYCbCr444ToRGB(int width, int height,
+                          VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane,
+                          uint8* rgb, int rgbStride)
+{
+    ensureKernelSelected();
+    for(int y=0; y<height; y++)
+    {
+        yCbCrToRGBRow(width,
+                      yPlane.data + y*yPlane.stride,
+                      cbPlane.data + y*cbPlane.stride,
+                      crPlane.data + y*crPlane.stride,
+                      rgb + y*rgbStride);
+    }
+}
+
+void convertRGBToYCbCr420(int width, int height, const uint8* rgb, int rgbStride,
+                          VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane)
+{
+    assert(width <= VIDEO_CONVERT_MAX_WIDTH);
+    assert(((width % 2) == 0) && ((height % 2) == 0));
+    ensureKernelSelected();
+
+    // NOTE: We convert each pair of rows at full resolution and then average the chroma of each
+    //       2x2 block of pixels, so that we get the same output regardless of which kernel is used.
+    uint8 cbRows[2][VIDEO_CONVERT_MAX_WIDTH];
+    uint8 crRows[2][VIDEO_CONVERT_MAX_WIDTH];
+    for(int y=0; y<height; y+=2)
+    {
+        for(int row=0; row<2; row++)
+        {
+            rgbToYCbCrRow(width, rgb + (y+row)*rgbStride,
+                          yPlane.data + (y+row)*yPlane.stride, cbRows[row], crRows[row]);
+        }
+
+        uint8* cbOut = cbPlane.data + (y/2)*cbPlane.stride;
+        uint8* crOut = crPlane.data + (y/2)*crPlane.stride;
+        for(int x=0; x<width; x+=2)
+        {
+            cbOut[x/2] = (uint8)((cbRows[0][x] + cbRows[0][x+1] + cbRows[1][x] + cbRows[1][x+1] + 2) >> 2);
+            crOut[x/2] = (uint8)((crRows[0][x] + crRows[0][x+1] + crRows[1][x] + crRows[1][x+1] + 2) >> 2);
+        }
+    }
+}
+
+void convertYCbCr420ToRGB(int width, int height,
+                          VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane,
+                          uint8* rgb, int rgbStride)
+{
+    assert(width <= VIDEO_CONVERT_MAX_WIDTH);
+    assert(((width % 2) == 0) && ((height % 2) == 0));
+    ensureKernelSelected();
+
+    uint8 cbRow[VIDEO_CONVERT_MAX_WIDTH];
+    uint8 crRow[VIDEO_CONVERT_MAX_WIDTH];
+    for(int y=0; y<height; y++)
+    {
+        // NOTE: Each chroma row is used for two output rows, so we only upsample it once
+        if((y % 2) == 0)
+        {
+            const uint8* cbIn = cbPlane.data + (y/2)*cbPlane.stride;
+            const uint8* crIn = crPlane.data + (y/2)*crPlane.stride;
+            for(int x=0; x<width; x+=2)
+            {
+                cbRow[x] = cbRow[x+1] = cbIn[x/2];
+                crRow[x] = crRow[x+1] = crIn[x/2];
+            }
+        }
+
+        yCbCrToRGBRow(width, yPlane.data + y*yPlane.stride, cbRow, crRow, rgb + y*rgbStride);
+    }
+}
+
+void convertYUYVToYCbCr420(int width, int height, const uint8* yuyv, int yuyvStride, int scale,
+                           VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane)
+{
+    assert(scale > 0);
+    assert(((width % (2*scale)) == 0) && ((height % (2*scale)) == 0));
+    int outWidth = width/scale;
+    int outHeight = height/scale;
+
+    int lumaSampleCount = scale*scale;
+    for(int y=0; y<outHeight; y++)
+    {
+        uint8* yOut = yPlane.data + y*yPlane.stride;
+        for(int x=0; x<outWidth; x++)
+        {
+            int sum = 0;
+            for(int blockY=0; blockY<scale; blockY++)
+            {
+                const uint8* row = yuyv + (y*scale + blockY)*yuyvStride;
+                for(int blockX=0; blockX<scale; blockX++)
+                {
+                    sum += row[2*(x*scale + blockX)];
+                }
+            }
+            yOut[x] = (uint8)((sum + lumaSampleCount/2)/lumaSampleCount);
+        }
+    }
+
+    // NOTE: Each output chroma sample covers 2*scale input pixels in each dimension, which is
+    //       scale chroma samples horizontally (since YUYV already has half-resolution chroma)
+    int chromaSampleCount = 2*scale*scale;
+    for(int y=0; y<outHeight/2; y++)
+    {
+        uint8* cbOut = cbPlane.data + y*cbPlane.stride;
+        uint8* crOut = crPlane.data + y*crPlane.stride;
+        for(int x=0; x<outWidth/2; x++)
+        {
+            int cbSum = 0;
+            int crSum = 0;
+            for(int blockY=0; blockY<2*scale; blockY++)
+            {
+                const uint8* row = yuyv + (2*y*scale + blockY)*yuyvStride;
+                for(int blockX=0; blockX<scale; blockX++)
+                {
+                    const uint8* pixelPair = row + 4*(x*scale + blockX);
+                    cbSum += pixelPair[1];
+                    crSum += pixelPair[3];
+                }
+            }
+            cbOut[x] = (uint8)((cbSum + chromaSampleCount/2)/chromaSampleCount);
+            crOut[x] = (uint8)((crSum + chromaSampleCount/2)/chromaSampleCount);
+        }
+    }
+}
+
+void convertNV12ToYCbCr420(int width, int height, VideoPlane inputY, VideoPlane inputCbCr, int scale,
+                           VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane)
+{
+    assert(scale > 0);
+    assert(((width % (2*scale)) == 0) && ((height % (2*scale)) == 0));
+    int outWidth = width/scale;
+    int outHeight = height/scale;
+
+    int sampleCount = scale*scale;
+    for(int y=0; y<outHeight; y++)
+    {
+        uint8* yOut = yPlane.data + y*yPlane.stride;
+        for(int x=0; x<outWidth; x++)
+        {
+            int sum = 0;
+            for(int blockY=0; blockY<scale; blockY++)
+            {
+                const uint8* row = inputY.data + (y*scale + blockY)*inputY.stride;
+                for(int blockX=0; blockX<scale; blockX++)
+                {
+                    sum += row[x*scale + blockX];
+                }
+            }
+            yOut[x] = (uint8)((sum + sampleCount/2)/sampleCount);
+        }
+    }
+
+    for(int y=0; y<outHeight/2; y++)
+    {
+        uint8* cbOut = cbPlane.data + y*cbPlane.stride;
+        uint8* crOut = crPlane.data + y*crPlane.stride;
+        for(int x=0; x<outWidth/2; x++)
+        {
+            int cbSum = 0;
+            int crSum = 0;
+            for(int blockY=0; blockY<scale; blockY++)
+            {
+                const uint8* row = inputCbCr.data + (y*scale + blockY)*inputCbCr.stride;
+                for(int blockX=0; blockX<scale; blockX++)
+                {
+                    cbSum += row[2*(x*scale + blockX) + 0];
+                    crSum += row[2*(x*scale + blockX) + 1];
+                }
+            }
+            cbOut[x] = (uint8)((cbSum + sampleCount/2)/sampleCount);
+            crOut[x] = (uint8)((crSum + sampleCount/2)/sampleCount);
+        }
+    }
+}
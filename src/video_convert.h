@@ -0,0 +1,68 @@
+#ifndef _VIDEO_CONVERT_H
+#define _VIDEO_CONVERT_H
+
+#include "common.h"
+
+// The maximum width of the images that can be converted to/from 4:2:0
+#define VIDEO_CONVERT_MAX_WIDTH 1920
+
+// NOTE: All conversions use the (studio-range) BT.601 coefficients in 8.8 fixed-point, so every
+//       kernel (SIMD or otherwise) produces exactly the same output for the same input.
+enum class VideoConvertKernel
+{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+struct VideoPlane
+{
+    uint8* data;
+    int stride;
+};
+
+/// Returns the fastest conversion kernel that is supported by the current CPU.
+VideoConvertKernel videoConvertBestKernel();
+
+/// Select the kernel used by all subsequent conversions.
+/// Returns false (and leaves the kernel unchanged) if the kernel is not supported by the current CPU.
+/// The fastest supported kernel is used if this is never called.
+/// NOTE: This must not be called while any other thread might be converting an image.
+bool videoConvertSetKernel(VideoConvertKernel kernel);
+
+/// Convert a packed 24-bit RGB image (with rows rgbStride bytes apart) to three full-resolution
+/// planes of Y', Cb and Cr.
+void convertRGBToYCbCr444(int width, int height, const uint8* rgb, int rgbStride,
+                          VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane);
+
+/// Convert three full-resolution planes of Y', Cb and Cr to a packed 24-bit RGB image (with rows
+/// rgbStride bytes apart).
+void convertYCbCr444ToRGB(int width, int height,
+                          VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane,
+                          uint8* rgb, int rgbStride);
+
+/// Convert a packed 24-bit RGB image to a full-resolution Y' plane and Cb/Cr planes at half the
+/// resolution in each dimension. The width and height must both be even.
+void convertRGBToYCbCr420(int width, int height, const uint8* rgb, int rgbStride,
+                          VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane);
+
+/// Convert a full-resolution Y' plane and half-resolution Cb/Cr planes to a packed 24-bit RGB
+/// image. The width and height must both be even.
+void convertYCbCr420ToRGB(int width, int height,
+                          VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane,
+                          uint8* rgb, int rgbStride);
+
+/// Convert a packed YUYV (4:2:2) image to 4:2:0 planes, averaging each scale*scale block of input
+/// pixels into a single output pixel. The output image is (width/scale)x(height/scale) pixels and
+/// the input width and height must both be multiples of 2*scale.
+void convertYUYVToYCbCr420(int width, int height, const uint8* yuyv, int yuyvStride, int scale,
+                           VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane);
+
+/// Convert an NV12 image (a Y' plane followed by a half-resolution plane of interleaved Cb/Cr)
+/// to 4:2:0 planes, averaging each scale*scale block of input pixels into a single output pixel.
+/// The output image is (width/scale)x(height/scale) pixels and the input width and height must
+/// both be multiples of 2*scale.
+void convertNV12ToYCbCr420(int width, int height, VideoPlane inputY, VideoPlane inputCbCr, int scale,
+                           VideoPlane yPlane, VideoPlane cbPlane, VideoPlane crPlane);
+
+#endif // _VIDEO_CONVERT_H
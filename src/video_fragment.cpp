@@ -0,0 +1,218 @@
+#include <assert.h>
+#include <string.h>
+
+#include <utility>
+
+#include "logging.h"
+#include "video_fragment.h"
+
+// NOTE: Frame indices wrap around, so a frame is "newer" than another if it is less than half
+//       the index range ahead of it.
+static int frameIndexDifference(uint8_t frameIndex, uint8_t otherFrameIndex)
+{
+    return (int8_t)(uint8_t)(frameIndex - otherFrameIndex);
+}
+
+int videoFragmentCount(int frameBytes)
+{
+    if(frameBytes <= 0)
+        return 1;
+    return (frameBytes + VIDEO_FRAGMENT_PAYLOAD_BYTES - 1) / VIDEO_FRAGMENT_PAYLOAD_BYTES;
+}
+
+VideoFrameAssembler::VideoFrameAssembler(double timeoutSeconds)
+{
+    timeout = timeoutSeconds;
+    memset(slots, 0, sizeof(slots));
+    memset(&completedFrame, 0, sizeof(completedFrame));
+    hasCompletedFrame = false;
+    lastCompletionTime = 0.0;
+    droppedFrames = 0;
+}
+
+VideoFrameAssembler::~VideoFrameAssembler()
+{
+    for(int i=0; i<SLOT_COUNT; i++)
+    {
+        delete[] slots[i].data;
+    }
+    delete[] completedFrame.data;
+}
+
+int VideoFrameAssembler::GetFrame(uint8_t** data)
+{
+    if(!hasCompletedFrame)
+    {
+        return 0;
+    }
+
+    *data = completedFrame.data;
+    return completedFrame.frameLength;
+}
+
+uint8_t VideoFrameAssembler::LastFrameIndex()
+{
+    return completedFrame.frameIndex;
+}
+
+int VideoFrameAssembler::DroppedFrameCount()
+{
+    return droppedFrames;
+}
+
+void VideoFrameAssembler::DropSlot(VideoReassemblySlot& slot)
+{
+    assert(slot.active);
+    logDbug("Dropped video frame %d after receiving %d of %d fragments\n",
+            slot.frameIndex, slot.receivedCount, slot.fragmentCount);
+    slot.active = false;
+    droppedFrames++;
+}
+
+bool VideoFrameAssembler::Add(uint8_t frameIndex, uint8_t fragmentIndex, uint8_t fragmentCount,
+                              uint16_t dataLength, const uint8_t* data, double currentTime)
+{
+    bool isLastFragment = (fragmentIndex+1 == fragmentCount);
+    if((fragmentCount == 0) || (fragmentIndex >= fragmentCount) ||
+       (dataLength > VIDEO_FRAGMENT_PAYLOAD_BYTES) ||
+       (!isLastFragment && (dataLength != VIDEO_FRAGMENT_PAYLOAD_BYTES)))
+    {
+        logWarn("Received an invalid fragment %d of %d (with %d bytes) for video frame %d\n",
+                fragmentIndex, fragmentCount, dataLength, frameIndex);
+        return false;
+    }
+
+    for(int i=0; i<SLOT_COUNT; i++)
+    {
+        if(slots[i].active && (currentTime - slots[i].firstArrivalTime > timeout))
+        {
+            DropSlot(slots[i]);
+        }
+    }
+
+    // NOTE: Frames are only returned in order, so once we've completed a frame, anything
+    //       before it is useless to us (unless the stream has moved on without us).
+    if(hasCompletedFrame)
+    {
+        int difference = frameIndexDifference(frameIndex, completedFrame.frameIndex);
+        bool isStalled = (currentTime - lastCompletionTime > timeout);
+        if((difference < -MAX_LATE_FRAMES) || ((difference <= 0) && isStalled))
+        {
+            logDbug("Resynchronising video frames at frame %d, after completing frame %d\n",
+                    frameIndex, completedFrame.frameIndex);
+            for(int i=0; i<SLOT_COUNT; i++)
+            {
+                if(slots[i].active)
+                {
+                    DropSlot(slots[i]);
+                }
+            }
+            hasCompletedFrame = false;
+        }
+        else if(difference <= 0)
+        {
+            return false;
+        }
+    }
+
+    VideoReassemblySlot* slot = nullptr;
+    VideoReassemblySlot* freeSlot = nullptr;
+    VideoReassemblySlot* oldestSlot = nullptr;
+    for(int i=0; i<SLOT_COUNT; i++)
+    {
+        if(!slots[i].active)
+        {
+            if(freeSlot == nullptr)
+                freeSlot = &slots[i];
+        }
+        else if(slots[i].frameIndex == frameIndex)
+        {
+            slot = &slots[i];
+            break;
+        }
+        else if((oldestSlot == nullptr) ||
+                (frameIndexDifference(slots[i].frameIndex, oldestSlot->frameIndex) < 0))
+        {
+            oldestSlot = &slots[i];
+        }
+    }
+
+    if(slot == nullptr)
+    {
+        if(freeSlot == nullptr)
+        {
+            // NOTE: There are too many frames in flight, so give up on the oldest one.
+            //       If the new frame is older than all of them, we give up on it instead.
+            assert(oldestSlot != nullptr);
+            if(frameIndexDifference(frameIndex, oldestSlot->frameIndex) < 0)
+            {
+                return false;
+            }
+            DropSlot(*oldestSlot);
+            freeSlot = oldestSlot;
+        }
+
+        slot = freeSlot;
+        slot->active = true;
+        slot->frameIndex = frameIndex;
+        slot->fragmentCount = fragmentCount;
+        slot->receivedCount = 0;
+        memset(slot->receivedMask, 0, sizeof(slot->receivedMask));
+        slot->firstArrivalTime = currentTime;
+        slot->frameLength = 0;
+
+        int requiredCapacity = fragmentCount * VIDEO_FRAGMENT_PAYLOAD_BYTES;
+        if(slot->dataCapacity < requiredCapacity)
+        {
+            delete[] slot->data;
+            slot->data = new uint8_t[requiredCapacity];
+            slot->dataCapacity = requiredCapacity;
+        }
+    }
+    else if(slot->fragmentCount != fragmentCount)
+    {
+        logWarn("Received fragment count %d for video frame %d, which previously had %d\n",
+                fragmentCount, frameIndex, slot->fragmentCount);
+        return false;
+    }
+
+    uint64_t fragmentBit = 1ull << (fragmentIndex % 64);
+    uint64_t& fragmentMask = slot->receivedMask[fragmentIndex / 64];
+    if(fragmentMask & fragmentBit)
+    {
+        // We have a duplicate fragment, so just ignore it
+        return false;
+    }
+    fragmentMask |= fragmentBit;
+    slot->receivedCount++;
+
+    int fragmentOffset = fragmentIndex * VIDEO_FRAGMENT_PAYLOAD_BYTES;
+    memcpy(slot->data + fragmentOffset, data, dataLength);
+    if(isLastFragment)
+    {
+        slot->frameLength = fragmentOffset + dataLength;
+    }
+
+    if(slot->receivedCount < slot->fragmentCount)
+    {
+        return false;
+    }
+
+    // NOTE: We swap the slots so that the completed frame's data stays valid until the next call,
+    //       while the previously-completed frame's buffer gets re-used for future frames.
+    std::swap(*slot, completedFrame);
+    slot->active = false;
+    completedFrame.active = false;
+    hasCompletedFrame = true;
+    lastCompletionTime = currentTime;
+
+    for(int i=0; i<SLOT_COUNT; i++)
+    {
+        if(slots[i].active &&
+           (frameIndexDifference(slots[i].frameIndex, completedFrame.frameIndex) < 0))
+        {
+            DropSlot(slots[i]);
+        }
+    }
+    return true;
+}
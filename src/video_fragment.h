@@ -0,0 +1,85 @@
+#ifndef _VIDEO_FRAGMENT_H
+#define _VIDEO_FRAGMENT_H
+
+#include <stdint.h>
+
+// The maximum number of bytes of encoded video sent in a single network packet. This is small
+// enough that a fragment (with our packet header and the ENet/UDP/IP headers) fits inside a typical
+// internet MTU (~1200 bytes), so video packets never get fragmented at the IP layer.
+const int VIDEO_FRAGMENT_PAYLOAD_BYTES = 1100;
+
+// The maximum number of fragments that a single video frame can be split into
+const int VIDEO_FRAGMENT_MAX_COUNT = 255;
+
+// The maximum size of a video frame that can be sent over the network
+const int VIDEO_FRAME_MAX_BYTES = VIDEO_FRAGMENT_PAYLOAD_BYTES * VIDEO_FRAGMENT_MAX_COUNT;
+
+// The time after receiving the first fragment of a frame, after which we give up on receiving
+// the rest of it
+const double VIDEO_REASSEMBLY_TIMEOUT_SECONDS = 0.5;
+
+// Returns the number of fragments that a frame of the given size is split into for sending.
+// Every fragment other than the last one contains exactly VIDEO_FRAGMENT_PAYLOAD_BYTES bytes.
+int videoFragmentCount(int frameBytes);
+
+struct VideoReassemblySlot
+{
+    bool active;
+    uint8_t frameIndex;
+    uint8_t fragmentCount;
+    uint8_t receivedCount;
+    uint64_t receivedMask[4]; // One bit for each of the (up to 255) fragments in the frame
+    double firstArrivalTime;
+
+    int frameLength;
+    int dataCapacity;
+    uint8_t* data;
+};
+
+// Reassembles video frames from their fragments, which may arrive in any order (or not at all).
+// Frames are only ever returned in order, so any frame that is still incomplete when a later
+// frame is completed (or when it times out) is dropped.
+// NOTE: Frame indices wrap around, so after a long enough gap in the stream (e.g a network outage
+//       of more than half the index range) new frames look older than the last completed frame.
+//       We start again from whichever frame arrives next if it is far older than the last
+//       completed frame, or if we haven't completed a frame for longer than the timeout.
+class VideoFrameAssembler
+{
+public:
+    explicit VideoFrameAssembler(double timeoutSeconds = VIDEO_REASSEMBLY_TIMEOUT_SECONDS);
+    ~VideoFrameAssembler();
+
+    // Add a single fragment of the frame with the given index. currentTime is in seconds.
+    // Returns true if this completed the frame, in which case it can be retrieved with GetFrame().
+    // Returns false if the fragment was invalid, a duplicate, too late or did not complete a frame.
+    bool Add(uint8_t frameIndex, uint8_t fragmentIndex, uint8_t fragmentCount,
+             uint16_t dataLength, const uint8_t* data, double currentTime);
+
+    // Returns the length of the most recently completed frame and sets data to point to it.
+    // NOTE: The contents of data are only valid until the next call to Add().
+    int GetFrame(uint8_t** data);
+
+    // Returns the index of the most recently completed frame.
+    uint8_t LastFrameIndex();
+
+    // Returns the total number of frames that were dropped before they could be completed.
+    int DroppedFrameCount();
+
+private:
+    static const int SLOT_COUNT = 4;
+    // NOTE: Frames are never delayed by this much relative to each other, so a frame that is this
+    //       far behind the last completed frame must be from after a gap in the stream instead.
+    static const int MAX_LATE_FRAMES = 32;
+
+    double timeout;
+    VideoReassemblySlot slots[SLOT_COUNT];
+    VideoReassemblySlot completedFrame;
+
+    bool hasCompletedFrame;
+    double lastCompletionTime;
+    int droppedFrames;
+
+    void DropSlot(VideoReassemblySlot& slot);
+};
+
+#endif // _VIDEO_FRAGMENT_H
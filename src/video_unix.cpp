@@ -11,7 +11,9 @@
 #include "stb_image_resize.h"
 
 #include "logging.h"
+#include "triplebuffer.h"
 #include "video.h"
+#include "video_convert.h"
 
 // https://linuxtv.org/downloads/v4l-dvb-apis-new/index.html
 // https://github.com/unicap/unicap/blob/master/libunicap/cpi/v4l2cpi/v4l2.c or https://github.com/dyne/FreeJ/tree/master/src for alternative references of libraries using v4l2
@@ -25,10 +27,28 @@ struct ImageBuffer
 static ImageBuffer* buffers;
 static int bufferCount;
 
-uint8_t* currentImage;
+// NOTE: The RGB image is only needed for the local preview, so rather than converting every frame
+//       that we capture, we publish the Y'CbCr planes that we encode to the interface thread and
+//       it converts them when it draws the preview (which is at most once for each frame).
+static TripleBuffer* previewPlanes; // Written by the main thread, read by the interface thread
+static uint8_t* currentImage; // Only used by the interface thread
+static uint8_t* resizedImage; // Only used by the main thread, when capturing in RGB
 
 static int deviceFile;
 
+// NOTE: We prefer to capture in the camera's native format, which we can convert straight to the
+//       4:2:0 Y'CbCr that we encode. RGB24 is a last resort that libv4l2 emulates in software.
+static const uint32_t preferredCaptureFormats[] = {
+    V4L2_PIX_FMT_YUYV,
+    V4L2_PIX_FMT_NV12,
+    V4L2_PIX_FMT_RGB24
+};
+static uint32_t captureFormat;
+static int captureWidth;
+static int captureHeight;
+static int captureStride;
+static int captureScale; // The factor by which we downscale captured images, for YUYV and NV12
+
 
 static int xioctl(int fileDescriptor, int request, void* data)
 {
@@ -42,9 +62,72 @@ static int xioctl(int fileDescriptor, int request, void* data)
         return result;
 }
 
+// Attempt to set the capture format of the device, returns true if the device accepted it
+static bool trySetCaptureFormat(uint32_t pixelFormat)
+{
+    // TODO: So apparently at 640x480 it lets us set RGB24, but then the bytesperline
+    //       is still 2*width (which makes no sense).
+    //       At 320x240 however, it doesn't like RGB24, it just gives YUYV.
+    v4l2_format fmt = {};
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = 640;//320;
+    fmt.fmt.pix.height = 480;//240;
+    fmt.fmt.pix.pixelformat = pixelFormat;
+    fmt.fmt.pix.field = V4L2_FIELD_INTERLACED;
+    if(xioctl(deviceFile, VIDIOC_S_FMT, &fmt) == -1)
+    {
+        logWarn("Error %d: Unable to set device format: %s\n", errno, strerror(errno));
+        return false;
+    }
+
+    if(xioctl(deviceFile, VIDIOC_G_FMT, &fmt) == -1)
+    {
+        logWarn("Error %d: Unable to get device format: %s\n", errno, strerror(errno));
+        return false;
+    }
+    logInfo("Device format: %dx%d with %d bytes/line, for a total of %d bytes\n",
+            fmt.fmt.pix.width, fmt.fmt.pix.height, fmt.fmt.pix.bytesperline, fmt.fmt.pix.sizeimage);
+    if(fmt.fmt.pix.pixelformat != pixelFormat)
+    {
+        logWarn("Format mismatch, unable to set the desired format. Got %d\n",
+                fmt.fmt.pix.pixelformat);
+        return false;
+    }
+    if(fmt.fmt.pix.field != V4L2_FIELD_INTERLACED)
+    {
+        // NOTE: We get 1 = V4L2_FIELD_NONE
+        logWarn("Field mismatch, unable to set the desired field. Got %d\n",
+                fmt.fmt.pix.field);
+    }
+
+    int width = fmt.fmt.pix.width;
+    int height = fmt.fmt.pix.height;
+    int scale = width/cameraWidth;
+    if(pixelFormat != V4L2_PIX_FMT_RGB24)
+    {
+        // NOTE: We only downscale native formats by whole numbers, anything else goes through
+        //       libv4l2's RGB conversion and then gets resized.
+        if((scale == 0) || (width != scale*cameraWidth) || (height != scale*cameraHeight))
+        {
+            logWarn("Unable to downscale %dx%d images to %dx%d\n",
+                    width, height, cameraWidth, cameraHeight);
+            return false;
+        }
+    }
+
+    captureFormat = pixelFormat;
+    captureWidth = width;
+    captureHeight = height;
+    captureStride = fmt.fmt.pix.bytesperline;
+    captureScale = scale;
+    return true;
+}
+
 bool SetupPlatform()
 {
-    currentImage = new uint8_t[320*240*3];
+    previewPlanes = new TripleBuffer(cameraWidth*cameraHeight + 2*(cameraWidth/2)*(cameraHeight/2));
+    currentImage = new uint8_t[cameraWidth*cameraHeight*3];
+    resizedImage = new uint8_t[cameraWidth*cameraHeight*3];
     cameraDeviceCount = 0;
     const char* deviceName = "/dev/video0";
 
@@ -87,7 +170,9 @@ bool SetupPlatform()
 
 void ShutdownPlatform()
 {
+    delete previewPlanes;
     delete[] currentImage;
+    delete[] resizedImage;
 
     for(int i=0; i<cameraDeviceCount; i++)
     {
@@ -173,37 +258,17 @@ bool Video::enableCamera(int deviceId)
         logWarn("Error %d: Unable to get crop capabilities: %s\n", errno, strerror(errno));
     }
 
-    // TODO: So apparently at 640x480 it lets us set RGB24, but then the bytesperline
-    //       is still 2*width (which makes no sense).
-    //       At 320x240 however, it doesn't like RGB24, it just gives YUYV.
-    v4l2_format fmt = {};
-    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmt.fmt.pix.width = 640;//320;
-    fmt.fmt.pix.height = 480;//240;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24; //V4L2_PIX_FMT_YUYV;
-    fmt.fmt.pix.field = V4L2_FIELD_INTERLACED;
-    if(xioctl(deviceFile, VIDIOC_S_FMT, &fmt) == -1)
-    {
-        logWarn("Error %d: Unable to set device format: %s\n", errno, strerror(errno));
-    }
-
-    if(xioctl(deviceFile, VIDIOC_G_FMT, &fmt) == -1)
-    {
-        logWarn("Error %d: Unable to get device format: %s\n", errno, strerror(errno));
-    }
-    logInfo("Device format: %dx%d with %d bytes/line, for a total of %d bytes\n",
-            fmt.fmt.pix.width, fmt.fmt.pix.height, fmt.fmt.pix.bytesperline, fmt.fmt.pix.sizeimage);
-    if(fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_RGB24)
+    bool formatSet = false;
+    int formatCount = sizeof(preferredCaptureFormats)/sizeof(preferredCaptureFormats[0]);
+    for(int i=0; (i<formatCount) && !formatSet; i++)
     {
-        // NOTE: We get 1448695129 = 'YUYV' = V4L2_PIX_FMT_YUYV
-        logWarn("Format mismatch, unable to set the desired format. Got %d\n",
-                fmt.fmt.pix.pixelformat);
+        formatSet = trySetCaptureFormat(preferredCaptureFormats[i]);
     }
-    if(fmt.fmt.pix.field != V4L2_FIELD_INTERLACED)
+    if(!formatSet)
     {
-        // NOTE: We get 1 = V4L2_FIELD_NONE
-        logWarn("Field mismatch, unable to set the desired field. Got %d\n",
-                fmt.fmt.pix.field);
+        logFail("Device %s does not support any of our capture formats\n", deviceName);
+        v4l2_close(deviceFile);
+        return false;
     }
 
     v4l2_requestbuffers requestBuffers = {};
@@ -314,8 +379,37 @@ bool Video::checkForNewVideoFrame()
             buffer.bytesused, buffer.sequence, buffer.index);
 
     uint8_t* rawImage = (uint8_t*)buffers[buffer.index].data;
-    stbir_resize_uint8(rawImage, 640, 480, 0,
-                       currentImage, 320, 240, 0, 3);
+    VideoPlane yPlane = {encodingImage[0].data, encodingImage[0].stride};
+    VideoPlane cbPlane = {encodingImage[1].data, encodingImage[1].stride};
+    VideoPlane crPlane = {encodingImage[2].data, encodingImage[2].stride};
+    if(captureFormat == V4L2_PIX_FMT_YUYV)
+    {
+        convertYUYVToYCbCr420(captureWidth, captureHeight, rawImage, captureStride, captureScale,
+                              yPlane, cbPlane, crPlane);
+    }
+    else if(captureFormat == V4L2_PIX_FMT_NV12)
+    {
+        VideoPlane rawY = {rawImage, captureStride};
+        VideoPlane rawCbCr = {rawImage + captureStride*captureHeight, captureStride};
+        convertNV12ToYCbCr420(captureWidth, captureHeight, rawY, rawCbCr, captureScale,
+                              yPlane, cbPlane, crPlane);
+    }
+    else
+    {
+        stbir_resize_uint8(rawImage, captureWidth, captureHeight, captureStride,
+                           resizedImage, cameraWidth, cameraHeight, 0, 3);
+        convertRGBToYCbCr420(cameraWidth, cameraHeight, resizedImage, 3*cameraWidth,
+                             yPlane, cbPlane, crPlane);
+    }
+
+    uint8_t* previewData = previewPlanes->WriteBuffer();
+    for(int i=0; i<3; i++)
+    {
+        int planeSize = encodingImage[i].stride*encodingImage[i].height;
+        memcpy(previewData, encodingImage[i].data, planeSize);
+        previewData += planeSize;
+    }
+    previewPlanes->PublishWriteBuffer();
 
 #if 0
     char outName[256];
@@ -344,5 +438,14 @@ bool Video::checkForNewVideoFrame()
 
 uint8_t* Video::currentVideoFrame()
 {
+    if(previewPlanes->UpdateReadBuffer())
+    {
+        uint8_t* planeData = previewPlanes->ReadBuffer();
+        VideoPlane yPlane = {planeData, cameraWidth};
+        VideoPlane cbPlane = {yPlane.data + cameraWidth*cameraHeight, cameraWidth/2};
+        VideoPlane crPlane = {cbPlane.data + (cameraWidth/2)*(cameraHeight/2), cameraWidth/2};
+        convertYCbCr420ToRGB(cameraWidth, cameraHeight, yPlane, cbPlane, crPlane,
+                             currentImage, 3*cameraWidth);
+    }
     return currentImage;
 }
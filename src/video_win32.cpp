@@ -19,6 +19,7 @@
 #include "common.h"
 #include "logging.h"
 #include "video.h"
+#include "video_convert.h"
 #include "videoInput.h"
 
 static int pixelBytes = 0;
@@ -103,6 +104,13 @@ bool Video::checkForNewVideoFrame()
         {
             VI.getPixels(cameraDevice, pixelValues, true, true);
         }
+
+        // NOTE: videoInput only gives us RGB, so we convert it to the format we encode here
+        VideoPlane yPlane = {encodingImage[0].data, encodingImage[0].stride};
+        VideoPlane cbPlane = {encodingImage[1].data, encodingImage[1].stride};
+        VideoPlane crPlane = {encodingImage[2].data, encodingImage[2].stride};
+        convertRGBToYCbCr420(cameraWidth, cameraHeight, pixelValues, 3*cameraWidth,
+                             yPlane, cbPlane, crPlane);
     }
     return result;
 }
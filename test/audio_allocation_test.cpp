@@ -0,0 +1,186 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+
+#include "catch.hpp"
+
+#include "audio.h"
+#include "audio_dtx.h"
+#include "audio_mix.h"
+#include "audio_resample.h"
+#include "audio_timestretch.h"
+#include "jitterbuffer.h"
+#include "ringbuffer.h"
+#include "spscqueue.h"
+
+// NOTE: We replace the global allocator for the whole test executable so that we can count
+//       allocations, but it only ever counts (everything else behaves as normal).
+static std::atomic<uint64_t> allocationCount(0);
+
+void* operator new(size_t size)
+{
+    allocationCount++;
+    void* result = malloc((size > 0) ? size : 1);
+    if(result == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return result;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+TEST_CASE("Allocation: AudioBuffers transfer ownership of their data when moved")
+{
+    Audio::AudioBuffer first(16);
+    float* data = first.Data;
+
+    Audio::AudioBuffer second(std::move(first));
+    REQUIRE(second.Data == data);
+    REQUIRE(second.Capacity == 16);
+    REQUIRE(first.Data == nullptr);
+    REQUIRE(first.Capacity == 0);
+
+    Audio::AudioBuffer third;
+    REQUIRE(third.Data == nullptr);
+    third = std::move(second);
+    REQUIRE(third.Data == data);
+    REQUIRE(second.Data == nullptr);
+}
+
+struct TestAudioPacket
+{
+    uint16_t index;
+    uint16_t length;
+    uint8_t data[1024];
+};
+
+TEST_CASE("Allocation: Steady-state audio processing does not allocate")
+{
+    const int frameSize = 960;
+    const int sampleRate = 48000;
+    const int outputSampleRate = 44100;
+
+    // NOTE: Everything is set up the same way as for each remote user in audio.cpp
+    SPSCQueue<TestAudioPacket> packetQueue(64);
+    JitterBuffer jitter(12, sizeof(TestAudioPacket::data), frameSize*1.0/sampleRate);
+    TimeStretchStreamContext timeStretcher;
+    timeStretchInit(timeStretcher, sampleRate);
+    ResampleStreamContext resampler = {};
+    resampler.Quality = ResampleQuality::Medium;
+    SPSCRingBuffer outputRing(outputSampleRate, 1 << 14);
+    MixLimiterContext limiter;
+    mixLimiterInit(limiter, outputSampleRate);
+    VoiceActivityContext vad;
+    vadInit(vad, sampleRate);
+    ComfortNoiseContext comfortNoise;
+    comfortNoiseInit(comfortNoise, sampleRate);
+
+    Audio::AudioBuffer decoded(frameSize);
+    decoded.SampleRate = sampleRate;
+    Audio::AudioBuffer stretched(timeStretchMaxOutputLength(timeStretcher, frameSize));
+    stretched.SampleRate = sampleRate;
+
+    uint16_t nextPacketIndex = 1;
+    int sampleTime = 0;
+    auto processFrame = [&](int frame)
+    {
+        // Receive (skipping the occasional packet to exercise FEC lookups and stretching)
+        if((frame % 17) != 0)
+        {
+            TestAudioPacket* packet = packetQueue.BeginPush();
+            packet->index = nextPacketIndex;
+            packet->length = 80;
+            memset(packet->data, frame & 0xFF, packet->length);
+            packetQueue.CommitPush();
+        }
+        nextPacketIndex++;
+
+        TestAudioPacket* received;
+        while((received = packetQueue.Peek()) != nullptr)
+        {
+            jitter.Add(received->index, received->length, received->data, frame*0.02 + (frame % 3)*0.005);
+            packetQueue.Pop();
+        }
+
+        // Decode
+        uint8_t* packetData;
+        if(jitter.Get(&packetData) == 0)
+        {
+            jitter.Peek(&packetData);
+        }
+        for(int i=0; i<frameSize; i++)
+        {
+            decoded.Data[i] = 0.5f*(((sampleTime + i) % 218) < 109 ? 1.0f : -1.0f);
+        }
+        decoded.Length = frameSize;
+        sampleTime += frameSize;
+        if(vadProcess(vad, decoded.Data, decoded.Length))
+        {
+            comfortNoiseAnalyse(comfortNoise, decoded.Data, decoded.Length);
+        }
+        else
+        {
+            comfortNoiseGenerate(comfortNoise, decoded.Data, decoded.Length);
+        }
+
+        float speedChange = ((frame/50) % 2 == 0) ? 0.1f : -0.1f;
+        timeStretchBuffer2Buffer(timeStretcher, decoded, stretched, speedChange);
+        resampleBuffer2Ring(resampler, stretched, outputRing);
+
+        // Mix
+        float mixBlock[256] = {};
+        float sourceBlock[256];
+        float interleaved[2*256];
+        while(outputRing.count() >= 256)
+        {
+            int sourceLength = outputRing.read(sourceBlock, 256);
+            mixAddBlock(mixBlock, sourceBlock, sourceLength);
+            mixAddBlock(mixBlock, sourceBlock, sourceLength);
+            mixLimiterApply(limiter, mixBlock, sourceLength);
+            mixInterleave(mixBlock, sourceLength, 2, interleaved);
+        }
+    };
+
+    // NOTE: Filters and the like are allowed to be computed (and allocated) on first use
+    int frame = 0;
+    for(; frame<100; frame++)
+    {
+        processFrame(frame);
+    }
+
+    uint64_t allocationsBefore = allocationCount;
+    for(; frame<1100; frame++)
+    {
+        processFrame(frame);
+    }
+    uint64_t allocationsAfter = allocationCount;
+
+    REQUIRE(allocationsAfter == allocationsBefore);
+}
@@ -0,0 +1,244 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "catch.hpp"
+
+#include "audio_dtx.h"
+
+static const int SAMPLE_RATE = 48000;
+static const int FRAME_SIZE = 960;
+static const float PI = 3.14159265358979f;
+
+struct TestSignal
+{
+    int sampleTime;
+    uint32_t seed;
+};
+
+static float nextNoise(TestSignal& signal)
+{
+    signal.seed = signal.seed*1664525 + 1013904223;
+    return (signal.seed >> 8)*(2.0f/16777216.0f) - 1.0f;
+}
+
+// Fill the frame with white noise of the given peak amplitude, plus a voiced "vowel" (the first
+// few harmonics of a 150Hz pitch) of the given amplitude.
+static void fillFrame(TestSignal& signal, float* frame, float noiseAmplitude, float voiceAmplitude)
+{
+    for(int i=0; i<FRAME_SIZE; i++)
+    {
+        float t = (float)(signal.sampleTime + i)/SAMPLE_RATE;
+        float voice = 0.0f;
+        for(int harmonic=1; harmonic<=5; harmonic++)
+        {
+            voice += sinf(2.0f*PI*150.0f*harmonic*t)/harmonic;
+        }
+        frame[i] = noiseAmplitude*nextNoise(signal) + 0.5f*voiceAmplitude*voice;
+    }
+    signal.sampleTime += FRAME_SIZE;
+}
+
+static float rms(const float* samples, int length)
+{
+    float sumSquares = 0.0f;
+    for(int i=0; i<length; i++)
+    {
+        sumSquares += samples[i]*samples[i];
+    }
+    return sqrtf(sumSquares/length);
+}
+
+TEST_CASE("VAD: Background noise is not speech")
+{
+    VoiceActivityContext vad;
+    vadInit(vad, SAMPLE_RATE);
+    TestSignal signal = {};
+    float frame[FRAME_SIZE];
+
+    int activeFrames = 0;
+    for(int i=0; i<100; i++)
+    {
+        fillFrame(signal, frame, 0.01f, 0.0f);
+        activeFrames += vadProcess(vad, frame, FRAME_SIZE) ? 1 : 0;
+    }
+    REQUIRE(activeFrames == 0);
+}
+
+TEST_CASE("VAD: Speech is detected over background noise, with a hangover")
+{
+    VoiceActivityContext vad;
+    vadInit(vad, SAMPLE_RATE);
+    TestSignal signal = {};
+    float frame[FRAME_SIZE];
+    for(int i=0; i<50; i++)
+    {
+        fillFrame(signal, frame, 0.01f, 0.0f);
+        vadProcess(vad, frame, FRAME_SIZE);
+    }
+
+    SECTION("Quiet voiced speech")
+    {
+        // NOTE: This is only ~12dB above the noise, so it's only detected because it is harmonic
+        fillFrame(signal, frame, 0.01f, 0.05f);
+        REQUIRE(vadProcess(vad, frame, FRAME_SIZE));
+    }
+
+    SECTION("Loud speech")
+    {
+        for(int i=0; i<25; i++)
+        {
+            fillFrame(signal, frame, 0.01f, 0.3f);
+            REQUIRE(vadProcess(vad, frame, FRAME_SIZE));
+        }
+
+        // NOTE: The hangover is 300ms, which is 15 frames
+        int hangoverFrames = 0;
+        for(int i=0; i<50; i++)
+        {
+            fillFrame(signal, frame, 0.01f, 0.0f);
+            if(!vadProcess(vad, frame, FRAME_SIZE))
+            {
+                break;
+            }
+            hangoverFrames++;
+        }
+        REQUIRE(hangoverFrames >= 10);
+        REQUIRE(hangoverFrames <= 20);
+    }
+}
+
+TEST_CASE("VAD: The noise floor adapts to louder background noise")
+{
+    VoiceActivityContext vad;
+    vadInit(vad, SAMPLE_RATE);
+    TestSignal signal = {};
+    float frame[FRAME_SIZE];
+    for(int i=0; i<50; i++)
+    {
+        fillFrame(signal, frame, 0.001f, 0.0f);
+        vadProcess(vad, frame, FRAME_SIZE);
+    }
+
+    // NOTE: The noise suddenly gets 30dB louder, which looks like speech to begin with
+    fillFrame(signal, frame, 0.03f, 0.0f);
+    REQUIRE(vadProcess(vad, frame, FRAME_SIZE));
+
+    bool active = true;
+    for(int i=0; i<500; i++)
+    {
+        fillFrame(signal, frame, 0.03f, 0.0f);
+        active = vadProcess(vad, frame, FRAME_SIZE);
+    }
+    REQUIRE_FALSE(active);
+}
+
+TEST_CASE("Comfort noise: Generates silence without any analysis")
+{
+    ComfortNoiseContext noise;
+    comfortNoiseInit(noise, SAMPLE_RATE);
+    float output[FRAME_SIZE];
+    comfortNoiseGenerate(noise, output, FRAME_SIZE);
+    REQUIRE(rms(output, FRAME_SIZE) == 0.0f);
+}
+
+TEST_CASE("Comfort noise: Matches the level of the background noise")
+{
+    ComfortNoiseContext noise;
+    comfortNoiseInit(noise, SAMPLE_RATE);
+    TestSignal signal = {};
+    float frame[FRAME_SIZE];
+
+    // NOTE: Speech with pauses in it, from which we should only pick up the background noise
+    for(int i=0; i<200; i++)
+    {
+        bool speaking = ((i/20) % 2) == 0;
+        fillFrame(signal, frame, 0.02f, speaking ? 0.3f : 0.0f);
+        comfortNoiseAnalyse(noise, frame, FRAME_SIZE);
+    }
+
+    float backgroundRms = 0.02f/sqrtf(3.0f);
+    float output[FRAME_SIZE];
+    float totalRms = 0.0f;
+    for(int i=0; i<10; i++)
+    {
+        comfortNoiseGenerate(noise, output, FRAME_SIZE);
+        totalRms += rms(output, FRAME_SIZE);
+    }
+    float generatedRms = totalRms/10.0f;
+    REQUIRE(generatedRms > 0.7f*backgroundRms);
+    REQUIRE(generatedRms < 1.3f*backgroundRms);
+}
+
+TEST_CASE("Comfort noise: Matches the spectral tilt of the background noise")
+{
+    ComfortNoiseContext noise;
+    comfortNoiseInit(noise, SAMPLE_RATE);
+    TestSignal signal = {};
+    float frame[FRAME_SIZE];
+
+    // NOTE: Low-pass filtered noise has strongly correlated neighbouring samples
+    float state = 0.0f;
+    for(int i=0; i<100; i++)
+    {
+        for(int j=0; j<FRAME_SIZE; j++)
+        {
+            state = 0.9f*state + 0.01f*nextNoise(signal);
+            frame[j] = state;
+        }
+        comfortNoiseAnalyse(noise, frame, FRAME_SIZE);
+    }
+
+    float output[FRAME_SIZE];
+    comfortNoiseGenerate(noise, output, FRAME_SIZE);
+    float sumSquares = 0.0f;
+    float sumProducts = 0.0f;
+    for(int i=1; i<FRAME_SIZE; i++)
+    {
+        sumSquares += output[i]*output[i];
+        sumProducts += output[i]*output[i-1];
+    }
+    REQUIRE(sumProducts/sumSquares > 0.8f);
+}
+
+TEST_CASE("Silence: Frames missing after a silence marker are not lost")
+{
+    SilenceReceiveContext silence;
+    silenceReceiveInit(silence);
+    REQUIRE(silenceReceiveFrame(silence, 0, 0));
+
+    REQUIRE_FALSE(silenceReceiveFrame(silence, 80, 0));
+    REQUIRE_FALSE(silenceReceiveFrame(silence, 0, 80));
+
+    REQUIRE(silenceReceiveFrame(silence, 1, 0));
+    for(int i=0; i<100; i++)
+    {
+        REQUIRE(silenceReceiveFrame(silence, 0, 0));
+    }
+    REQUIRE_FALSE(silenceReceiveFrame(silence, 80, 0));
+}
+
+TEST_CASE("Silence: Silence is detected even if the first marker is lost")
+{
+    SilenceReceiveContext silence;
+    silenceReceiveInit(silence);
+    REQUIRE_FALSE(silenceReceiveFrame(silence, 80, 0));
+
+    SECTION("A later marker has arrived")
+    {
+        REQUIRE(silenceReceiveFrame(silence, 0, 1));
+        REQUIRE(silenceReceiveFrame(silence, 1, 0));
+        REQUIRE(silenceReceiveFrame(silence, 0, 0));
+    }
+
+    SECTION("Every marker was lost")
+    {
+        int lostFrames = 0;
+        for(int i=0; i<100; i++)
+        {
+            lostFrames += silenceReceiveFrame(silence, 0, 0) ? 0 : 1;
+        }
+        REQUIRE(lostFrames > 0);
+        REQUIRE(lostFrames < 20);
+        REQUIRE_FALSE(silenceReceiveFrame(silence, 80, 0));
+    }
+}
@@ -0,0 +1,96 @@
+#include "catch.hpp"
+
+#include "audio_level.h"
+
+TEST_CASE("Audio level: Encoding round trips to the nearest decibel")
+{
+    REQUIRE(audioLevelDecibels(audioLevelEncode(1.0f, false)) == 0.0f);
+    REQUIRE(audioLevelDecibels(audioLevelEncode(0.1f, false)) == -20.0f);
+    REQUIRE(audioLevelDecibels(audioLevelEncode(0.01f, true)) == -40.0f);
+    REQUIRE(audioLevelDecibels(audioLevelEncode(0.0f, false)) == -127.0f);
+    REQUIRE(audioLevelDecibels(audioLevelEncode(2.0f, false)) == 0.0f);
+
+    REQUIRE(audioLevelVoiceActive(audioLevelEncode(0.01f, true)));
+    REQUIRE_FALSE(audioLevelVoiceActive(audioLevelEncode(0.01f, false)));
+}
+
+TEST_CASE("Audio level: Speaker activity rises immediately and decays gradually")
+{
+    SpeakerActivity activity;
+    speakerActivityInit(activity);
+    REQUIRE(speakerActivityLevel(activity, 0.0) == -127.0f);
+
+    speakerActivityUpdate(activity, audioLevelEncode(0.1f, true), 1.0);
+    REQUIRE(speakerActivityLevel(activity, 1.0) == -20.0f);
+
+    // NOTE: Packets without speech don't raise the level, even if they're loud
+    speakerActivityUpdate(activity, audioLevelEncode(1.0f, false), 1.02);
+    REQUIRE(speakerActivityLevel(activity, 1.02) <= -20.0f);
+
+    REQUIRE(speakerActivityLevel(activity, 1.2) < -20.0f);
+    REQUIRE(speakerActivityLevel(activity, 1.2) > -30.0f);
+    REQUIRE(speakerActivityLevel(activity, 100.0) == -127.0f);
+}
+
+TEST_CASE("Audio level: Only the loudest speakers are selected")
+{
+    const int speakerCount = 6;
+    SpeakerActivity activities[speakerCount];
+    SpeakerActivity* speakers[speakerCount];
+    for(int i=0; i<speakerCount; i++)
+    {
+        speakerActivityInit(activities[i]);
+        speakers[i] = &activities[i];
+    }
+
+    SECTION("Everybody is selected if there are few enough of them")
+    {
+        selectActiveSpeakers(speakers, 2, 3, 0.0);
+        REQUIRE(activities[0].Selected);
+        REQUIRE(activities[1].Selected);
+    }
+
+    SECTION("The loudest speakers are selected")
+    {
+        speakerActivityUpdate(activities[1], audioLevelEncode(0.1f, true), 1.0);
+        speakerActivityUpdate(activities[3], audioLevelEncode(0.2f, true), 1.0);
+        speakerActivityUpdate(activities[4], audioLevelEncode(0.05f, true), 1.0);
+        speakerActivityUpdate(activities[5], audioLevelEncode(0.01f, true), 1.0);
+        selectActiveSpeakers(speakers, speakerCount, 3, 1.0);
+
+        int selectedCount = 0;
+        for(int i=0; i<speakerCount; i++)
+        {
+            selectedCount += activities[i].Selected ? 1 : 0;
+        }
+        REQUIRE(selectedCount == 3);
+        REQUIRE(activities[1].Selected);
+        REQUIRE(activities[3].Selected);
+        REQUIRE(activities[4].Selected);
+
+        // NOTE: A slightly louder speaker doesn't replace one that is already selected...
+        speakerActivityUpdate(activities[5], audioLevelEncode(0.06f, true), 1.02);
+        selectActiveSpeakers(speakers, speakerCount, 3, 1.02);
+        REQUIRE(activities[4].Selected);
+        REQUIRE_FALSE(activities[5].Selected);
+
+        // NOTE: ...but a much louder one does
+        speakerActivityUpdate(activities[5], audioLevelEncode(0.5f, true), 1.04);
+        selectActiveSpeakers(speakers, speakerCount, 3, 1.04);
+        REQUIRE(activities[5].Selected);
+        REQUIRE_FALSE(activities[4].Selected);
+
+        // NOTE: Speakers that have stopped talking are replaced by those who are still talking
+        for(int i=0; i<100; i++)
+        {
+            double time = 1.04 + 0.02*i;
+            speakerActivityUpdate(activities[1], audioLevelEncode(0.1f, true), time);
+            speakerActivityUpdate(activities[3], audioLevelEncode(0.2f, true), time);
+            speakerActivityUpdate(activities[4], audioLevelEncode(0.05f, true), time);
+            speakerActivityUpdate(activities[5], audioLevelEncode(0.0f, false), time);
+        }
+        selectActiveSpeakers(speakers, speakerCount, 3, 3.04);
+        REQUIRE(activities[4].Selected);
+        REQUIRE_FALSE(activities[5].Selected);
+    }
+}
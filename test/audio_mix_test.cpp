@@ -0,0 +1,146 @@
+#include <math.h>
+
+#include "catch.hpp"
+
+#include "audio_mix.h"
+
+static const int SAMPLE_RATE = 48000;
+static const float PI = 3.14159265358979f;
+
+TEST_CASE("Mix: Adding blocks sums each sample, for lengths that don't fill a SIMD register")
+{
+    float mix[19];
+    float source[19];
+    for(int i=0; i<19; i++)
+    {
+        mix[i] = (float)i;
+        source[i] = 0.5f*i;
+    }
+
+    mixAddBlock(mix, source, 19);
+    for(int i=0; i<19; i++)
+    {
+        REQUIRE(mix[i] == 1.5f*i);
+    }
+}
+
+TEST_CASE("Mix: Interleaving writes each sample to every channel")
+{
+    float block[7] = {1, 2, 3, 4, 5, 6, 7};
+
+    for(int channelCount=1; channelCount<=6; channelCount++)
+    {
+        float output[7*6] = {};
+        mixInterleave(block, 7, channelCount, output);
+        for(int frame=0; frame<7; frame++)
+        {
+            for(int channel=0; channel<channelCount; channel++)
+            {
+                REQUIRE(output[frame*channelCount + channel] == block[frame]);
+            }
+        }
+    }
+}
+
+TEST_CASE("Mix: The limiter delays quiet audio without changing it")
+{
+    MixLimiterContext limiter;
+    mixLimiterInit(limiter, SAMPLE_RATE);
+    int delay = limiter.LookaheadLength;
+
+    const int length = 2048;
+    float input[length];
+    float output[length];
+    for(int i=0; i<length; i++)
+    {
+        input[i] = 0.5f*sinf(2.0f*PI*440.0f*i/SAMPLE_RATE);
+        output[i] = input[i];
+    }
+
+    mixLimiterApply(limiter, output, length);
+    for(int i=0; i<delay; i++)
+    {
+        REQUIRE(output[i] == 0.0f);
+    }
+    for(int i=delay; i<length; i++)
+    {
+        REQUIRE(output[i] == Approx(input[i-delay]));
+    }
+}
+
+TEST_CASE("Mix: The limiter keeps loud audio below full scale without hard clipping it")
+{
+    MixLimiterContext limiter;
+    mixLimiterInit(limiter, SAMPLE_RATE);
+    int delay = limiter.LookaheadLength;
+
+    // NOTE: Three people talking loudly at once
+    const int length = 4800;
+    float input[length];
+    float output[length];
+    for(int i=0; i<length; i++)
+    {
+        input[i] = 0.8f*sinf(2.0f*PI*200.0f*i/SAMPLE_RATE) +
+                   0.8f*sinf(2.0f*PI*310.0f*i/SAMPLE_RATE) +
+                   0.8f*sinf(2.0f*PI*450.0f*i/SAMPLE_RATE);
+        output[i] = input[i];
+    }
+
+    // NOTE: Process in uneven blocks, to check that the state carries over between them
+    int blockStart = 0;
+    int blockLength = 37;
+    while(blockStart < length)
+    {
+        int thisLength = (blockStart+blockLength <= length) ? blockLength : length-blockStart;
+        mixLimiterApply(limiter, output+blockStart, thisLength);
+        blockStart += thisLength;
+        blockLength = (blockLength*7) % 300 + 1;
+    }
+
+    for(int i=delay; i<length; i++)
+    {
+        REQUIRE(fabsf(output[i]) <= limiter.Threshold*1.01f);
+        // NOTE: The gain is never negative, so the limiter never flips the sign of the signal
+        REQUIRE(output[i]*input[i-delay] >= 0.0f);
+    }
+}
+
+TEST_CASE("Mix: The limiter reduces the gain before a sudden peak arrives")
+{
+    MixLimiterContext limiter;
+    mixLimiterInit(limiter, SAMPLE_RATE);
+    int delay = limiter.LookaheadLength;
+
+    const int length = 1024;
+    const int peakIndex = 500;
+    float block[length];
+    for(int i=0; i<length; i++)
+    {
+        block[i] = 0.1f;
+    }
+    block[peakIndex] = 4.0f;
+
+    mixLimiterApply(limiter, block, length);
+    REQUIRE(block[peakIndex+delay] <= limiter.Threshold*1.01f);
+    REQUIRE(block[peakIndex+delay] > 0.8f*limiter.Threshold);
+    REQUIRE(block[peakIndex+delay-1] < 0.1f);
+    REQUIRE(block[peakIndex-1] == Approx(0.1f));
+}
+
+TEST_CASE("Mix: The limiter gain recovers after a peak")
+{
+    MixLimiterContext limiter;
+    mixLimiterInit(limiter, SAMPLE_RATE);
+
+    const int length = SAMPLE_RATE;
+    static float block[length];
+    for(int i=0; i<length; i++)
+    {
+        block[i] = 0.1f;
+    }
+    block[0] = 4.0f;
+
+    mixLimiterApply(limiter, block, length);
+    REQUIRE(limiter.Gain > 0.99f);
+    REQUIRE(block[length-1] == Approx(0.1f).epsilon(0.01));
+}
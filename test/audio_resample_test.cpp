@@ -1,3 +1,5 @@
+#include <math.h>
+
 #include "catch.hpp"
 
 #include "audio.h"
@@ -5,22 +7,6 @@
 
 using namespace Audio;
 
-// TODO: Dirty hack so we don't need to compile audio.cpp (which has its own dependencies)
-Audio::AudioBuffer::AudioBuffer(int initialCapacity)
-{
-    Data = new float[initialCapacity];
-    Capacity = initialCapacity;
-    Length = 0;
-}
-
-Audio::AudioBuffer::~AudioBuffer()
-{
-    if(Data)
-    {
-        delete[] Data;
-    }
-}
-
 TEST_CASE("Upsample first input matches output")
 {
     ResampleStreamContext ctx = {};
@@ -110,3 +96,104 @@ TEST_CASE("Resampling to the current sample rate returns the input as-is")
     REQUIRE(outBuffer.Data[1] == inBuffer.Data[1]);
     REQUIRE(outBuffer.Data[2] == inBuffer.Data[2]);
 }
+
+TEST_CASE("Sinc resampling gives the correct number of output samples")
+{
+    ResampleStreamContext ctx = {};
+    ctx.Quality = ResampleQuality::Medium;
+    AudioBuffer inBuffer(4410);
+    AudioBuffer outBuffer(4800);
+
+    for(int i=0; i<inBuffer.Capacity; i++)
+    {
+        inBuffer.Data[i] = 0.0f;
+    }
+    inBuffer.Length = inBuffer.Capacity;
+    inBuffer.SampleRate = 44100;
+    outBuffer.SampleRate = 48000;
+
+    // NOTE: The filter delays the output, so the output of the first buffer will be short but
+    //       every subsequent buffer should give us exactly the number of samples we expect.
+    resampleBuffer2Buffer(ctx, inBuffer, outBuffer);
+    REQUIRE(outBuffer.Length > 0);
+    REQUIRE(outBuffer.Length < 4800);
+
+    resampleBuffer2Buffer(ctx, inBuffer, outBuffer);
+    REQUIRE(outBuffer.Length == 4800);
+}
+
+TEST_CASE("Sinc resampling a constant signal gives the same constant")
+{
+    ResampleStreamContext ctx = {};
+    ctx.Quality = ResampleQuality::High;
+    AudioBuffer inBuffer(480);
+    AudioBuffer outBuffer(480);
+
+    for(int i=0; i<inBuffer.Capacity; i++)
+    {
+        inBuffer.Data[i] = 0.5f;
+    }
+    inBuffer.Length = inBuffer.Capacity;
+    inBuffer.SampleRate = 48000;
+    outBuffer.SampleRate = 44100;
+
+    resampleBuffer2Buffer(ctx, inBuffer, outBuffer);
+    resampleBuffer2Buffer(ctx, inBuffer, outBuffer);
+
+    REQUIRE(outBuffer.Length > 0);
+    for(int i=0; i<outBuffer.Length; i++)
+    {
+        REQUIRE(outBuffer.Data[i] == Approx(0.5f).epsilon(0.0001));
+    }
+}
+
+TEST_CASE("Sinc upsampling a sine wave gives the same sine wave at the higher sample rate")
+{
+    ResampleStreamContext ctx = {};
+    ctx.Quality = ResampleQuality::Medium;
+    AudioBuffer inBuffer(1600);
+    AudioBuffer outBuffer(4800);
+
+    const float pi = 3.14159265358979f;
+    const float frequency = 1000.0f;
+    for(int i=0; i<inBuffer.Capacity; i++)
+    {
+        inBuffer.Data[i] = sinf(2.0f*pi*frequency*i/16000.0f);
+    }
+    inBuffer.Length = inBuffer.Capacity;
+    inBuffer.SampleRate = 16000;
+    outBuffer.SampleRate = 48000;
+
+    resampleBuffer2Buffer(ctx, inBuffer, outBuffer);
+    REQUIRE(outBuffer.Length > 2400);
+
+    // NOTE: The first output sample lines up with the first input sample, but we skip the first
+    //       few output samples because they are computed from the silence before the input.
+    for(int i=400; i<outBuffer.Length; i++)
+    {
+        float expected = sinf(2.0f*pi*frequency*i/48000.0f);
+        REQUIRE(fabsf(outBuffer.Data[i] - expected) < 0.01f);
+    }
+}
+
+TEST_CASE("Sinc resampling to the current sample rate returns the input as-is")
+{
+    ResampleStreamContext ctx = {};
+    ctx.Quality = ResampleQuality::High;
+    AudioBuffer inBuffer(3);
+    AudioBuffer outBuffer(3);
+
+    inBuffer.Data[0] = 1.0f;
+    inBuffer.Data[1] = 2.0f;
+    inBuffer.Data[2] = 3.0f;
+    inBuffer.Length = 3;
+    inBuffer.SampleRate = 48000;
+    outBuffer.SampleRate = 48000;
+
+    resampleBuffer2Buffer(ctx, inBuffer, outBuffer);
+
+    REQUIRE(outBuffer.Length == inBuffer.Length);
+    REQUIRE(outBuffer.Data[0] == inBuffer.Data[0]);
+    REQUIRE(outBuffer.Data[1] == inBuffer.Data[1]);
+    REQUIRE(outBuffer.Data[2] == inBuffer.Data[2]);
+}
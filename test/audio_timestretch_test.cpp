@@ -0,0 +1,154 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "catch.hpp"
+
+#include "audio.h"
+#include "audio_timestretch.h"
+
+using namespace Audio;
+
+static const int SAMPLE_RATE = 48000;
+static const int FRAME_SIZE = 960;
+static const float PI = 3.14159265358979f;
+
+static void fillSine(AudioBuffer& buffer, float frequency, int startSample, int length)
+{
+    for(int i=0; i<length; i++)
+    {
+        buffer.Data[i] = 0.5f*sinf(2.0f*PI*frequency*(startSample+i)/SAMPLE_RATE);
+    }
+    buffer.Length = length;
+    buffer.SampleRate = SAMPLE_RATE;
+}
+
+static float maxSineError(AudioBuffer& buffer, float frequency, int startSample)
+{
+    float result = 0.0f;
+    for(int i=0; i<buffer.Length; i++)
+    {
+        float expected = 0.5f*sinf(2.0f*PI*frequency*(startSample+i)/SAMPLE_RATE);
+        result = fmaxf(result, fabsf(buffer.Data[i] - expected));
+    }
+    return result;
+}
+
+TEST_CASE("TimeStretch: Audio is unchanged when no speed change is requested")
+{
+    TimeStretchStreamContext ctx;
+    timeStretchInit(ctx, SAMPLE_RATE);
+    AudioBuffer input(FRAME_SIZE);
+    AudioBuffer output(timeStretchMaxOutputLength(ctx, FRAME_SIZE));
+    fillSine(input, 200.0f, 0, FRAME_SIZE);
+
+    timeStretchBuffer2Buffer(ctx, input, output, 0.0f);
+    REQUIRE(output.Length == FRAME_SIZE);
+    REQUIRE(output.SampleRate == SAMPLE_RATE);
+    for(int i=0; i<FRAME_SIZE; i++)
+    {
+        REQUIRE(output.Data[i] == input.Data[i]);
+    }
+}
+
+TEST_CASE("TimeStretch: Speeding up removes a whole period without changing the pitch")
+{
+    TimeStretchStreamContext ctx;
+    timeStretchInit(ctx, SAMPLE_RATE);
+    AudioBuffer input(FRAME_SIZE);
+    AudioBuffer output(timeStretchMaxOutputLength(ctx, FRAME_SIZE));
+    fillSine(input, 200.0f, 0, FRAME_SIZE);
+
+    timeStretchBuffer2Buffer(ctx, input, output, 0.25f);
+    REQUIRE(output.Length == FRAME_SIZE - 240);
+    REQUIRE(maxSineError(output, 200.0f, 0) < 0.01f);
+}
+
+TEST_CASE("TimeStretch: Slowing down repeats a whole period without changing the pitch")
+{
+    TimeStretchStreamContext ctx;
+    timeStretchInit(ctx, SAMPLE_RATE);
+    AudioBuffer input(FRAME_SIZE);
+    AudioBuffer output(timeStretchMaxOutputLength(ctx, FRAME_SIZE));
+    fillSine(input, 200.0f, 0, FRAME_SIZE);
+
+    timeStretchBuffer2Buffer(ctx, input, output, -0.25f);
+    REQUIRE(output.Length == FRAME_SIZE + 240);
+    REQUIRE(maxSineError(output, 200.0f, 0) < 0.01f);
+}
+
+TEST_CASE("TimeStretch: Small speed changes build up over several buffers")
+{
+    TimeStretchStreamContext ctx;
+    timeStretchInit(ctx, SAMPLE_RATE);
+    AudioBuffer input(FRAME_SIZE);
+    AudioBuffer output(timeStretchMaxOutputLength(ctx, FRAME_SIZE));
+
+    int frameCount = 50;
+    int totalOutput = 0;
+    for(int frame=0; frame<frameCount; frame++)
+    {
+        fillSine(input, 150.0f, frame*FRAME_SIZE, FRAME_SIZE);
+        timeStretchBuffer2Buffer(ctx, input, output, 0.05f);
+        REQUIRE(output.Length <= FRAME_SIZE);
+        totalOutput += output.Length;
+    }
+
+    int requestedRemoval = (int)(0.05f*frameCount*FRAME_SIZE);
+    int actualRemoval = frameCount*FRAME_SIZE - totalOutput;
+    REQUIRE(actualRemoval <= requestedRemoval);
+    REQUIRE(actualRemoval > requestedRemoval - SAMPLE_RATE/100);
+}
+
+TEST_CASE("TimeStretch: Audio that doesn't repeat is left unchanged")
+{
+    TimeStretchStreamContext ctx;
+    timeStretchInit(ctx, SAMPLE_RATE);
+    AudioBuffer input(FRAME_SIZE);
+    AudioBuffer output(timeStretchMaxOutputLength(ctx, FRAME_SIZE));
+
+    uint32_t randomState = 12345;
+    for(int i=0; i<FRAME_SIZE; i++)
+    {
+        randomState = randomState*1664525 + 1013904223;
+        input.Data[i] = (randomState >> 8)*(1.0f/(1 << 24)) - 0.5f;
+    }
+    input.Length = FRAME_SIZE;
+    input.SampleRate = SAMPLE_RATE;
+
+    timeStretchBuffer2Buffer(ctx, input, output, 0.2f);
+    REQUIRE(output.Length == FRAME_SIZE);
+}
+
+TEST_CASE("TimeStretch: Silence is stretched by as much as was requested")
+{
+    TimeStretchStreamContext ctx;
+    timeStretchInit(ctx, SAMPLE_RATE);
+    AudioBuffer input(FRAME_SIZE);
+    AudioBuffer output(timeStretchMaxOutputLength(ctx, FRAME_SIZE));
+    for(int i=0; i<FRAME_SIZE; i++)
+    {
+        input.Data[i] = 0.0f;
+    }
+    input.Length = FRAME_SIZE;
+    input.SampleRate = SAMPLE_RATE;
+
+    timeStretchBuffer2Buffer(ctx, input, output, -0.3f);
+    REQUIRE(output.Length == FRAME_SIZE + 288);
+}
+
+TEST_CASE("TimeStretch: Pending changes are discarded when the direction changes")
+{
+    TimeStretchStreamContext ctx;
+    timeStretchInit(ctx, SAMPLE_RATE);
+    AudioBuffer input(FRAME_SIZE);
+    AudioBuffer output(timeStretchMaxOutputLength(ctx, FRAME_SIZE));
+    fillSine(input, 200.0f, 0, FRAME_SIZE);
+
+    // NOTE: Not enough to remove a single period
+    timeStretchBuffer2Buffer(ctx, input, output, 0.1f);
+    REQUIRE(output.Length == FRAME_SIZE);
+
+    timeStretchBuffer2Buffer(ctx, input, output, -0.1f);
+    REQUIRE(output.Length == FRAME_SIZE);
+    REQUIRE(ctx.PendingSamples < 0.0f);
+}
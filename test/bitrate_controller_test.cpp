@@ -0,0 +1,159 @@
+#include "catch.hpp"
+
+#include "bitrate_controller.h"
+#include "video.h"
+
+static NetworkConditions makeConditions(float roundTripTimeMs, float packetLoss)
+{
+    NetworkConditions result = {};
+    result.roundTripTimeMs = roundTripTimeMs;
+    result.roundTripTimeVarianceMs = 5.0f;
+    result.packetLoss = packetLoss;
+    result.receivedPacketLoss = 0.0f;
+    return result;
+}
+
+// Run the controller at 50Hz for the given duration, returning the time that it finished at
+static double runController(BitrateController& controller, const NetworkConditions& conditions,
+                            double startTime, double durationSeconds)
+{
+    double time = startTime;
+    while(time < startTime + durationSeconds)
+    {
+        controller.Update(conditions, time);
+        time += 0.02;
+    }
+    return time;
+}
+
+TEST_CASE("BitrateController: Starts with the video encoder's initial settings")
+{
+    // NOTE: The video encoder is set up with its defaults before the controller first updates it,
+    //       so if these differ then the video quality jumps as soon as we join a call.
+    BitrateController controller;
+    MediaEncoderSettings settings = controller.Settings();
+    REQUIRE(settings.videoQuality == Video::VIDEO_DEFAULT_QUALITY);
+    REQUIRE(settings.videoFrameInterval == Video::VIDEO_DEFAULT_FRAME_INTERVAL);
+}
+
+TEST_CASE("BitrateController: Quality increases on a clear network")
+{
+    BitrateController controller;
+    float initialLevel = controller.Level();
+    MediaEncoderSettings initialSettings = controller.Settings();
+
+    runController(controller, makeConditions(40.0f, 0.0f), 0.0, 20.0);
+
+    REQUIRE(controller.Level() > initialLevel);
+    MediaEncoderSettings settings = controller.Settings();
+    REQUIRE(settings.videoQuality > initialSettings.videoQuality);
+    REQUIRE(settings.audioBitrate >= initialSettings.audioBitrate);
+    REQUIRE(settings.videoFrameInterval <= initialSettings.videoFrameInterval);
+}
+
+TEST_CASE("BitrateController: Quality decreases when packets are lost")
+{
+    BitrateController controller;
+    float initialLevel = controller.Level();
+    MediaEncoderSettings initialSettings = controller.Settings();
+
+    runController(controller, makeConditions(40.0f, 0.2f), 0.0, 5.0);
+
+    REQUIRE(controller.Level() < initialLevel);
+    MediaEncoderSettings settings = controller.Settings();
+    REQUIRE(settings.videoQuality < initialSettings.videoQuality);
+    REQUIRE(settings.videoFrameInterval > initialSettings.videoFrameInterval);
+    REQUIRE(settings.audioExpectedPacketLossPercent > initialSettings.audioExpectedPacketLossPercent);
+}
+
+TEST_CASE("BitrateController: Received packet loss is also treated as congestion")
+{
+    BitrateController controller;
+    float initialLevel = controller.Level();
+
+    NetworkConditions conditions = makeConditions(40.0f, 0.0f);
+    conditions.receivedPacketLoss = 0.2f;
+    runController(controller, conditions, 0.0, 5.0);
+
+    REQUIRE(controller.Level() < initialLevel);
+}
+
+TEST_CASE("BitrateController: Quality decreases when the round-trip time rises above its baseline")
+{
+    BitrateController controller;
+    double time = runController(controller, makeConditions(40.0f, 0.0f), 0.0, 5.0);
+    float clearLevel = controller.Level();
+
+    runController(controller, makeConditions(400.0f, 0.0f), time, 3.0);
+    REQUIRE(controller.Level() < clearLevel);
+}
+
+TEST_CASE("BitrateController: A consistently high round-trip time is not treated as congestion")
+{
+    BitrateController controller;
+    float initialLevel = controller.Level();
+
+    runController(controller, makeConditions(400.0f, 0.0f), 0.0, 10.0);
+    REQUIRE(controller.Level() >= initialLevel);
+}
+
+TEST_CASE("BitrateController: Decreases are spaced out to give them time to take effect")
+{
+    BitrateController controller;
+    float initialLevel = controller.Level();
+
+    runController(controller, makeConditions(40.0f, 0.5f), 0.0, 1.5);
+    float level = controller.Level();
+    REQUIRE(level < initialLevel);
+    REQUIRE(level > initialLevel*0.5f);
+}
+
+TEST_CASE("BitrateController: Audio keeps its full bitrate while video is reduced")
+{
+    BitrateController controller;
+    double time = runController(controller, makeConditions(40.0f, 0.0f), 0.0, 20.0);
+    MediaEncoderSettings clearSettings = controller.Settings();
+
+    time = runController(controller, makeConditions(40.0f, 0.2f), time, 1.5);
+    MediaEncoderSettings lossySettings = controller.Settings();
+    REQUIRE(lossySettings.videoQuality < clearSettings.videoQuality);
+    REQUIRE(lossySettings.audioBitrate == clearSettings.audioBitrate);
+}
+
+TEST_CASE("BitrateController: Settings stay within their valid ranges")
+{
+    BitrateController controller;
+    runController(controller, makeConditions(40.0f, 1.0f), 0.0, 60.0);
+    MediaEncoderSettings worst = controller.Settings();
+    REQUIRE(worst.audioBitrate > 0);
+    REQUIRE(worst.audioExpectedPacketLossPercent <= 100);
+    REQUIRE(worst.videoQuality >= 0);
+    REQUIRE(worst.videoFrameInterval > 0);
+
+    runController(controller, makeConditions(40.0f, 0.0f), 60.0, 120.0);
+    MediaEncoderSettings best = controller.Settings();
+    REQUIRE(controller.Level() <= 1.0f);
+    REQUIRE(best.videoQuality <= 63);
+    REQUIRE(best.audioExpectedPacketLossPercent >= 0);
+}
+
+TEST_CASE("BitrateController: Audio frames are packed together on long round trips")
+{
+    BitrateController controller;
+    runController(controller, makeConditions(40.0f, 0.0f), 0.0, 5.0);
+    REQUIRE(controller.Settings().audioFramesPerPacket == 1);
+
+    BitrateController farController;
+    runController(farController, makeConditions(400.0f, 0.0f), 0.0, 5.0);
+    REQUIRE(farController.Settings().audioFramesPerPacket == 3);
+
+    BitrateController midController;
+    runController(midController, makeConditions(180.0f, 0.0f), 0.0, 5.0);
+    REQUIRE(midController.Settings().audioFramesPerPacket == 2);
+
+    // NOTE: The baseline round-trip time drops immediately when the round trips get faster
+    runController(midController, makeConditions(110.0f, 0.0f), 5.0, 1.0);
+    REQUIRE(midController.Settings().audioFramesPerPacket == 2);
+    runController(midController, makeConditions(80.0f, 0.0f), 6.0, 1.0);
+    REQUIRE(midController.Settings().audioFramesPerPacket == 1);
+}
@@ -413,3 +413,209 @@ TEST_CASE("When a client stops sending for some time, only the packets that arri
     CHECK(outCount == 1);
     CHECK(*outVal == 23);
 }
+
+TEST_CASE("Peek returns the next packet without removing it")
+{
+    JitterBuffer jb;
+    uint8_t inVal;
+    uint8_t* outVal;
+
+    REQUIRE(jb.Peek(&outVal) == 0);
+
+    inVal = 3;
+    jb.Add(1, 1, &inVal);
+    inVal = 4;
+    jb.Add(2, 1, &inVal);
+
+    REQUIRE(jb.Peek(&outVal) == 1);
+    REQUIRE(*outVal == 3);
+    REQUIRE(jb.ItemCount() == 2);
+
+    REQUIRE(jb.Get(&outVal) == 1);
+    REQUIRE(*outVal == 3);
+    REQUIRE(jb.Peek(&outVal) == 1);
+    REQUIRE(*outVal == 4);
+}
+
+TEST_CASE("Peek returns the packet after a dropped packet once the dropped packet is skipped")
+{
+    JitterBuffer jb;
+    uint8_t inVal;
+    uint8_t* outVal;
+
+    inVal = 3;
+    jb.Add(1, 1, &inVal);
+    inVal = 5;
+    jb.Add(3, 1, &inVal);
+
+    REQUIRE(jb.Get(&outVal) == 1);
+    REQUIRE(jb.Peek(&outVal) == 0);
+    REQUIRE(jb.Get(&outVal) == 0);
+
+    REQUIRE(jb.Peek(&outVal) == 1);
+    REQUIRE(*outVal == 5);
+    REQUIRE(jb.Get(&outVal) == 1);
+    REQUIRE(*outVal == 5);
+}
+
+TEST_CASE("The desired item count is small when packets arrive evenly spaced")
+{
+    JitterBuffer jb(12, 16, 0.02);
+    uint8_t inVal = 1;
+    uint8_t* outVal;
+    for(uint16_t i=1; i<=500; i++)
+    {
+        jb.Add(i, 1, &inVal, 10.0 + i*0.02);
+        jb.Get(&outVal);
+    }
+
+    JitterBufferStats stats = jb.Stats();
+    REQUIRE(stats.jitterMs < 1.0f);
+    REQUIRE(jb.DesiredItemCount() == 1);
+}
+
+TEST_CASE("The desired item count grows to cover packets that arrive late")
+{
+    JitterBuffer jb(12, 16, 0.02);
+    uint8_t inVal = 1;
+    uint8_t* outVal;
+    for(uint16_t i=1; i<=500; i++)
+    {
+        // NOTE: Every 10th packet is delayed by 50ms (e.g by a retransmission on Wi-Fi)
+        double delay = ((i % 10) == 0) ? 0.05 : 0.0;
+        jb.Add(i, 1, &inVal, 10.0 + i*0.02 + delay);
+        jb.Get(&outVal);
+    }
+
+    JitterBufferStats stats = jb.Stats();
+    REQUIRE(stats.jitterMs > 1.0f);
+    REQUIRE(stats.peakDelayMs == Approx(50.0f).epsilon(0.01));
+    REQUIRE(jb.DesiredItemCount() >= 4);
+    REQUIRE(jb.DesiredItemCount() <= 10);
+}
+
+TEST_CASE("The desired item count shrinks again some time after a delay spike")
+{
+    JitterBuffer jb(12, 16, 0.02);
+    uint8_t inVal = 1;
+    uint8_t* outVal;
+    uint16_t packetIndex = 1;
+    for(; packetIndex<=50; packetIndex++)
+    {
+        jb.Add(packetIndex, 1, &inVal, packetIndex*0.02);
+        jb.Get(&outVal);
+    }
+    jb.Add(packetIndex, 1, &inVal, packetIndex*0.02 + 0.15);
+    jb.Get(&outVal);
+    packetIndex++;
+    int spikeItemCount = jb.DesiredItemCount();
+    REQUIRE(spikeItemCount >= 8);
+
+    for(int i=0; i<1500; i++)
+    {
+        jb.Add(packetIndex, 1, &inVal, packetIndex*0.02);
+        jb.Get(&outVal);
+        packetIndex++;
+    }
+    REQUIRE(jb.DesiredItemCount() < spikeItemCount);
+    REQUIRE(jb.DesiredItemCount() <= 2);
+}
+
+TEST_CASE("The desired item count never exceeds the capacity of the buffer")
+{
+    JitterBuffer jb(8, 16, 0.02);
+    uint8_t inVal = 1;
+    jb.Add(1, 1, &inVal, 0.02);
+    jb.Add(2, 1, &inVal, 2.0);
+    REQUIRE(jb.DesiredItemCount() <= 6);
+}
+
+TEST_CASE("The delay estimate is unaffected by packet index overflow")
+{
+    JitterBuffer jb(12, 16, 0.02);
+    uint8_t inVal = 1;
+    uint8_t* outVal;
+    jb.Get(65000, &outVal);
+    for(int i=0; i<1000; i++)
+    {
+        uint16_t packetIndex = (uint16_t)(65001 + i);
+        jb.Add(packetIndex, 1, &inVal, 10.0 + i*0.02);
+        jb.Get(&outVal);
+    }
+    REQUIRE(jb.Stats().jitterMs < 1.0f);
+    REQUIRE(jb.DesiredItemCount() == 1);
+}
+
+TEST_CASE("Late and overflowing packets are counted")
+{
+    JitterBuffer jb;
+    uint8_t inVal = 1;
+    uint8_t* outVal;
+    jb.Get(&outVal);
+    jb.Add(1, 1, &inVal);
+    REQUIRE(jb.Stats().latePacketCount == 1);
+
+    for(uint16_t i=2; i<=9; i++)
+    {
+        jb.Add(i, 1, &inVal);
+    }
+    REQUIRE(jb.Stats().overflowPacketCount == 2);
+}
+
+TEST_CASE("Packets either side of index overflow are kept apart with a capacity that doesn't divide 2^16")
+{
+    JitterBuffer jb(6, 16, 0.0);
+    uint8_t* outVal;
+    jb.Get((uint16_t)65532, &outVal);
+
+    for(uint16_t i=0; i<6; i++)
+    {
+        AddSingleByteToJitterBuffer(jb, (uint16_t)(65533 + i), (uint8_t)i);
+    }
+    REQUIRE(jb.ItemCount() == 6);
+
+    for(uint8_t i=0; i<6; i++)
+    {
+        REQUIRE(jb.Get(&outVal) == 1);
+        REQUIRE(*outVal == i);
+    }
+}
+
+TEST_CASE("Packets that are larger than the maximum data length are dropped")
+{
+    JitterBuffer jb(6, 4, 0.0);
+    uint8_t inVal[8] = {};
+    uint8_t* outVal;
+    jb.Add(1, 8, inVal);
+    jb.Add(2, 4, inVal);
+    REQUIRE(jb.ItemCount() == 1);
+    REQUIRE(jb.Get(&outVal) == 0);
+    REQUIRE(jb.Get(&outVal) == 4);
+}
+
+TEST_CASE("An empty buffer skips to a packet that is far ahead of the expected packet")
+{
+    JitterBuffer jb;
+    uint8_t* outVal;
+    AddSingleByteToJitterBuffer(jb, 500, 50);
+    AddSingleByteToJitterBuffer(jb, 501, 51);
+
+    REQUIRE(jb.Get(&outVal) == 1);
+    REQUIRE(*outVal == 50);
+    REQUIRE(jb.Get(&outVal) == 1);
+    REQUIRE(*outVal == 51);
+}
+
+TEST_CASE("An empty buffer skips back to a packet that is far behind the expected packet")
+{
+    JitterBuffer jb;
+    uint8_t* outVal;
+    for(int i=0; i<100; i++)
+    {
+        jb.Get(&outVal);
+    }
+
+    AddSingleByteToJitterBuffer(jb, 20, 20);
+    REQUIRE(jb.Get(&outVal) == 1);
+    REQUIRE(*outVal == 20);
+}
@@ -170,3 +170,90 @@ TEST_CASE("Read advances the read pointer correctly")
     REQUIRE(xOut[2] == 3.0f);
     REQUIRE(xOut[3] == 4.0f);
 }
+
+TEST_CASE("Multiple values written at once are read back in order across the wrap")
+{
+    RingBuffer buffer = RingBuffer(1, 5);
+    float xIn[4] = {1.0f, 2.0f, 3.0f, 4.0f};
+    buffer.write(xIn, 3);
+
+    float xOut[4] = {};
+    REQUIRE(buffer.read(xOut, 2) == 2);
+    REQUIRE(xOut[0] == 1.0f);
+    REQUIRE(xOut[1] == 2.0f);
+
+    // NOTE: There is only space for 3 more values, so the unread 3.0f gets overwritten
+    buffer.write(xIn, 4);
+    REQUIRE(buffer.count() == 4);
+    REQUIRE(buffer.read(&xOut[0]) == 1);
+    REQUIRE(xOut[0] == 1.0f);
+    REQUIRE(buffer.read(xOut, 4) == 3);
+    REQUIRE(xOut[0] == 2.0f);
+    REQUIRE(xOut[1] == 3.0f);
+    REQUIRE(xOut[2] == 4.0f);
+}
+
+TEST_CASE("Writing multiple values to a full buffer keeps only the latest values")
+{
+    RingBuffer buffer = RingBuffer(1, 4);
+    float xIn[5] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+    buffer.write(xIn, 2);
+    buffer.write(xIn+2, 3);
+
+    float xOut[4] = {};
+    REQUIRE(buffer.read(xOut, 4) == 3);
+    REQUIRE(xOut[0] == 3.0f);
+    REQUIRE(xOut[1] == 4.0f);
+    REQUIRE(xOut[2] == 5.0f);
+
+    buffer.write(xIn, 5);
+    REQUIRE(buffer.read(xOut, 4) == 3);
+    REQUIRE(xOut[0] == 3.0f);
+    REQUIRE(xOut[1] == 4.0f);
+    REQUIRE(xOut[2] == 5.0f);
+}
+
+TEST_CASE("Peeking a wrapped range returns both contiguous regions")
+{
+    RingBuffer buffer = RingBuffer(1, 5);
+    float xIn[4] = {1.0f, 2.0f, 3.0f, 4.0f};
+    float xOut[3];
+    buffer.write(xIn, 3);
+    buffer.read(xOut, 3);
+    buffer.write(xIn, 4);
+
+    RingBufferRegion region = buffer.peekRead(10);
+    REQUIRE(region.firstLength == 2);
+    REQUIRE(region.secondLength == 2);
+    REQUIRE(region.first[0] == 1.0f);
+    REQUIRE(region.first[1] == 2.0f);
+    REQUIRE(region.second[0] == 3.0f);
+    REQUIRE(region.second[1] == 4.0f);
+    buffer.commitRead(3);
+
+    REQUIRE(buffer.count() == 1);
+    REQUIRE(buffer.read(xOut) == 1);
+    REQUIRE(xOut[0] == 4.0f);
+}
+
+TEST_CASE("Values written through a peeked region are read back after being committed")
+{
+    RingBuffer buffer = RingBuffer(1, 4);
+    buffer.write(0.0f);
+    buffer.write(0.0f);
+    float xOut[3];
+    buffer.read(xOut, 2);
+
+    RingBufferRegion region = buffer.peekWrite(5);
+    REQUIRE(region.firstLength + region.secondLength == 3);
+    REQUIRE(region.firstLength == 2);
+    region.first[0] = 1.0f;
+    region.first[1] = 2.0f;
+    region.second[0] = 3.0f;
+    buffer.commitWrite(3);
+
+    REQUIRE(buffer.read(xOut, 3) == 3);
+    REQUIRE(xOut[0] == 1.0f);
+    REQUIRE(xOut[1] == 2.0f);
+    REQUIRE(xOut[2] == 3.0f);
+}
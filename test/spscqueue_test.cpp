@@ -0,0 +1,101 @@
+#include "catch.hpp"
+
+#include "platform.h"
+#include "spscqueue.h"
+
+TEST_CASE("SPSCQueue: Items are popped in the order that they were pushed")
+{
+    SPSCQueue<int> queue(4);
+    for(int i=0; i<3; i++)
+    {
+        int* slot = queue.BeginPush();
+        REQUIRE(slot != nullptr);
+        *slot = i;
+        queue.CommitPush();
+    }
+    REQUIRE(queue.Count() == 3);
+
+    for(int i=0; i<3; i++)
+    {
+        int* item = queue.Peek();
+        REQUIRE(item != nullptr);
+        REQUIRE(*item == i);
+        queue.Pop();
+    }
+    REQUIRE(queue.Count() == 0);
+    REQUIRE(queue.Peek() == nullptr);
+}
+
+TEST_CASE("SPSCQueue: Items are not visible to the consumer until they are committed")
+{
+    SPSCQueue<int> queue(4);
+    int* slot = queue.BeginPush();
+    *slot = 42;
+    REQUIRE(queue.Peek() == nullptr);
+
+    queue.CommitPush();
+    REQUIRE(queue.Peek() != nullptr);
+    REQUIRE(*queue.Peek() == 42);
+}
+
+TEST_CASE("SPSCQueue: Pushing fails when the queue is full, rather than overwriting unread items")
+{
+    SPSCQueue<int> queue(2);
+    *queue.BeginPush() = 1;
+    queue.CommitPush();
+    *queue.BeginPush() = 2;
+    queue.CommitPush();
+    REQUIRE(queue.BeginPush() == nullptr);
+
+    REQUIRE(*queue.Peek() == 1);
+    queue.Pop();
+    int* slot = queue.BeginPush();
+    REQUIRE(slot != nullptr);
+    *slot = 3;
+    queue.CommitPush();
+
+    REQUIRE(*queue.Peek() == 2);
+    queue.Pop();
+    REQUIRE(*queue.Peek() == 3);
+    queue.Pop();
+}
+
+struct QueueTestData
+{
+    SPSCQueue<int>* queue;
+    int itemCount;
+};
+
+static int pushQueueItems(void* data)
+{
+    QueueTestData* testData = (QueueTestData*)data;
+    for(int i=0; i<testData->itemCount; i++)
+    {
+        int* slot = nullptr;
+        while((slot = testData->queue->BeginPush()) == nullptr) {}
+        *slot = i;
+        testData->queue->CommitPush();
+    }
+    return 0;
+}
+
+TEST_CASE("SPSCQueue: Items pushed from another thread arrive intact and in order")
+{
+    SPSCQueue<int> queue(16);
+    QueueTestData testData = {&queue, 100000};
+    Platform::Thread* producer = Platform::CreateThread(pushQueueItems, &testData);
+    REQUIRE(producer != nullptr);
+
+    bool inOrder = true;
+    for(int i=0; i<testData.itemCount; i++)
+    {
+        int* item = nullptr;
+        while((item = queue.Peek()) == nullptr) {}
+        inOrder = inOrder && (*item == i);
+        queue.Pop();
+    }
+    Platform::JoinThread(producer);
+
+    REQUIRE(inOrder);
+    REQUIRE(queue.Count() == 0);
+}
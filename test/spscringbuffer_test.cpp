@@ -0,0 +1,376 @@
+#include "catch.hpp"
+
+#include "platform.h"
+#include "ringbuffer.h"
+
+TEST_CASE("SPSC: A single value gets read after being written")
+{
+    float xIn = 3.14f;
+    SPSCRingBuffer buffer(1, 2);
+    buffer.write(xIn);
+
+    float xOut;
+    buffer.read(&xOut);
+
+    REQUIRE(xOut == xIn);
+}
+
+TEST_CASE("SPSC: Multiple values are correctly read after being written")
+{
+    float xIn[3] = {3.14f, 2.71f, -1.0f};
+    SPSCRingBuffer buffer(1, 5);
+
+    buffer.write(xIn[0]);
+    buffer.write(xIn[1]);
+    buffer.write(xIn[2]);
+
+    float xOut[3] = {};
+    buffer.read(&xOut[0]);
+    buffer.read(&xOut[1]);
+    buffer.read(&xOut[2]);
+
+    REQUIRE(xOut[0] == xIn[0]);
+    REQUIRE(xOut[1] == xIn[1]);
+    REQUIRE(xOut[2] == xIn[2]);
+}
+
+TEST_CASE("SPSC: A buffer with capacity n can store n-1 items")
+{
+    float xIn[3] = {3.14f, 2.71f, -1.0f};
+    SPSCRingBuffer buffer(1, 4);
+
+    buffer.write(xIn[0]);
+    buffer.write(xIn[1]);
+    buffer.write(xIn[2]);
+
+    float xOut[3] = {};
+    buffer.read(&xOut[0]);
+    buffer.read(&xOut[1]);
+    buffer.read(&xOut[2]);
+
+    REQUIRE(xOut[0] == xIn[0]);
+    REQUIRE(xOut[1] == xIn[1]);
+    REQUIRE(xOut[2] == xIn[2]);
+}
+
+TEST_CASE("SPSC: The latest values are read when we write more than the full capacity")
+{
+    float xIn[5] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+    SPSCRingBuffer buffer(1, 3);
+
+    buffer.write(xIn[0]);
+    buffer.write(xIn[1]);
+    buffer.write(xIn[2]);
+    buffer.write(xIn[3]);
+    buffer.write(xIn[4]);
+
+    float xOut[2] = {};
+    buffer.read(&xOut[0]);
+    buffer.read(&xOut[1]);
+
+    REQUIRE(xOut[0] == xIn[3]);
+    REQUIRE(xOut[1] == xIn[4]);
+}
+
+TEST_CASE("SPSC: Return fewer than the requested number of values when there is not enough data available (with a non-wrapping read)")
+{
+    float xIn[2] = {1.0f, 2.0f};
+    SPSCRingBuffer buffer(1, 5);
+
+    buffer.write(xIn[0]);
+    buffer.write(xIn[1]);
+
+    float xOut[3] = {};
+    int valuesRead = 0;
+    valuesRead += buffer.read(&xOut[0]);
+    valuesRead += buffer.read(&xOut[1]);
+    valuesRead += buffer.read(&xOut[2]);
+
+    REQUIRE(valuesRead == 2);
+    REQUIRE(xOut[0] == xIn[0]);
+    REQUIRE(xOut[1] == xIn[1]);
+    REQUIRE(xOut[2] == 0.0f);
+}
+
+TEST_CASE("SPSC: Return no values when there isn't any data available")
+{
+    float xIn[3] = {1.0f, 2.0f, 3.0f};
+    SPSCRingBuffer buffer(1, 4);
+
+    buffer.write(xIn[0]);
+    buffer.write(xIn[1]);
+    buffer.write(xIn[2]);
+
+    float xOut;
+    int valuesRead;
+
+    valuesRead = buffer.read(&xOut);
+    REQUIRE(valuesRead == 1);
+    REQUIRE(xOut == 1.0f);
+
+    valuesRead = buffer.read(&xOut);
+    REQUIRE(valuesRead == 1);
+    REQUIRE(xOut == 2.0f);
+
+    valuesRead = buffer.read(&xOut);
+    REQUIRE(valuesRead == 1);
+    REQUIRE(xOut == 3.0f);
+
+    valuesRead = buffer.read(&xOut);
+    REQUIRE(valuesRead == 0);
+    valuesRead = buffer.read(&xOut);
+    REQUIRE(valuesRead == 0);
+    REQUIRE(xOut == 3.0f);
+}
+
+TEST_CASE("SPSC: Read returns 0 values on a new buffer")
+{
+    SPSCRingBuffer buffer(1, 5);
+
+    float xOut;
+    int valuesRead = buffer.read(&xOut);
+
+    REQUIRE(valuesRead == 0);
+}
+
+TEST_CASE("SPSC: Read returns 0 values on an empty buffer that has been written to and read from")
+{
+    float xIn[2] = {1.0f, 2.0f};
+    SPSCRingBuffer buffer(1, 5);
+    buffer.write(xIn[0]);
+    buffer.write(xIn[1]);
+
+    float xOut;
+    buffer.read(&xOut);
+    buffer.read(&xOut);
+
+    int valuesRead = buffer.read(&xOut);
+    REQUIRE(valuesRead == 0);
+}
+
+TEST_CASE("SPSC: Read advances the read pointer correctly")
+{
+    SPSCRingBuffer buffer(1, 5);
+
+    float xIn[4] = {1.0f, 2.0f, 3.0f, 4.0f};
+    buffer.write(xIn[0]);
+    buffer.write(xIn[1]);
+    buffer.write(xIn[2]);
+    buffer.write(xIn[3]);
+
+    float xOut[4];
+    int valuesRead = 0;
+    valuesRead += buffer.read(&xOut[0]);
+    valuesRead += buffer.read(&xOut[1]);
+    valuesRead += buffer.read(&xOut[2]);
+    valuesRead += buffer.read(&xOut[3]);
+    REQUIRE(valuesRead == 4);
+    REQUIRE(xOut[0] == 1.0f);
+    REQUIRE(xOut[1] == 2.0f);
+    REQUIRE(xOut[2] == 3.0f);
+    REQUIRE(xOut[3] == 4.0f);
+}
+
+TEST_CASE("SPSC: Count and free are correct after wrapping and overwriting")
+{
+    SPSCRingBuffer buffer(1, 4);
+    REQUIRE(buffer.count() == 0);
+    REQUIRE(buffer.free() == 3);
+
+    for(int i=0; i<10; i++)
+    {
+        buffer.write((float)i);
+    }
+    REQUIRE(buffer.count() == 3);
+    REQUIRE(buffer.free() == 0);
+
+    float xOut;
+    REQUIRE(buffer.read(&xOut) == 1);
+    REQUIRE(xOut == 7.0f);
+    REQUIRE(buffer.count() == 2);
+    REQUIRE(buffer.free() == 1);
+
+    buffer.clear();
+    REQUIRE(buffer.count() == 0);
+    REQUIRE(buffer.read(&xOut) == 0);
+
+    buffer.write(42.0f);
+    REQUIRE(buffer.read(&xOut) == 1);
+    REQUIRE(xOut == 42.0f);
+}
+
+TEST_CASE("SPSC: Multiple values written at once are read back in order across the wrap")
+{
+    SPSCRingBuffer buffer(1, 5);
+    float xIn[5] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+    buffer.write(xIn, 3);
+
+    float xOut[4] = {};
+    REQUIRE(buffer.read(xOut, 2) == 2);
+    REQUIRE(xOut[0] == 1.0f);
+    REQUIRE(xOut[1] == 2.0f);
+
+    buffer.write(xIn, 4);
+    REQUIRE(buffer.count() == 4);
+    REQUIRE(buffer.read(xOut, 4) == 4);
+    REQUIRE(xOut[0] == 1.0f);
+    REQUIRE(xOut[1] == 2.0f);
+    REQUIRE(xOut[2] == 3.0f);
+    REQUIRE(xOut[3] == 4.0f);
+
+    buffer.write(xIn, 5);
+    REQUIRE(buffer.read(xOut, 4) == 4);
+    REQUIRE(xOut[0] == 2.0f);
+    REQUIRE(xOut[3] == 5.0f);
+}
+
+struct SPSCStressTestData
+{
+    SPSCRingBuffer* buffer;
+    int valueCount;
+    int blockSize;
+    bool waitForSpace;
+};
+
+static int spscStressProducer(void* data)
+{
+    SPSCStressTestData* testData = (SPSCStressTestData*)data;
+    float block[16];
+    for(int i=0; i<testData->valueCount; i+=testData->blockSize)
+    {
+        while(testData->waitForSpace && (testData->buffer->free() < testData->blockSize))
+        {
+            Platform::SleepForMilliseconds(0);
+        }
+        for(int j=0; j<testData->blockSize; j++)
+        {
+            block[j] = (float)(i+j);
+        }
+        testData->buffer->write(block, testData->blockSize);
+    }
+    return 0;
+}
+
+TEST_CASE("SPSC: Every value is read exactly once and in order while another thread is writing")
+{
+    SPSCRingBuffer buffer(1, 61);
+    SPSCStressTestData testData = {};
+    testData.buffer = &buffer;
+    testData.valueCount = 1 << 16;
+    testData.blockSize = 1;
+    testData.waitForSpace = true;
+
+    Platform::Thread* producer = Platform::CreateThread(spscStressProducer, &testData);
+    REQUIRE(producer != nullptr);
+
+    int valuesRead = 0;
+    bool allValuesCorrect = true;
+    while(valuesRead < testData.valueCount)
+    {
+        float xOut;
+        if(buffer.read(&xOut))
+        {
+            allValuesCorrect &= (xOut == (float)valuesRead);
+            valuesRead++;
+        }
+        else
+        {
+            Platform::SleepForMilliseconds(0);
+        }
+    }
+    Platform::JoinThread(producer);
+
+    REQUIRE(allValuesCorrect);
+    REQUIRE(buffer.count() == 0);
+}
+
+TEST_CASE("SPSC: Values are read in order while another thread is overwriting them")
+{
+    SPSCRingBuffer buffer(1, 7);
+    SPSCStressTestData testData = {};
+    testData.buffer = &buffer;
+    testData.valueCount = 1 << 16;
+    testData.blockSize = 1;
+    testData.waitForSpace = false;
+
+    Platform::Thread* producer = Platform::CreateThread(spscStressProducer, &testData);
+    REQUIRE(producer != nullptr);
+
+    float lastValue = -1.0f;
+    bool allValuesIncreasing = true;
+    while(lastValue < (float)(testData.valueCount-1))
+    {
+        float xOut;
+        if(buffer.read(&xOut))
+        {
+            allValuesIncreasing &= (xOut > lastValue);
+            lastValue = xOut;
+        }
+    }
+    Platform::JoinThread(producer);
+
+    REQUIRE(allValuesIncreasing);
+    REQUIRE(buffer.count() == 0);
+}
+
+TEST_CASE("SPSC: Blocks of values are read in order while another thread is writing blocks")
+{
+    SPSCRingBuffer buffer(1, 61);
+    SPSCStressTestData testData = {};
+    testData.buffer = &buffer;
+    testData.valueCount = 1 << 16;
+    testData.blockSize = 16;
+    testData.waitForSpace = true;
+
+    Platform::Thread* producer = Platform::CreateThread(spscStressProducer, &testData);
+    REQUIRE(producer != nullptr);
+
+    int valuesRead = 0;
+    bool allValuesCorrect = true;
+    while(valuesRead < testData.valueCount)
+    {
+        float xOut[7];
+        int blockLength = buffer.read(xOut, 7);
+        for(int i=0; i<blockLength; i++)
+        {
+            allValuesCorrect &= (xOut[i] == (float)valuesRead);
+            valuesRead++;
+        }
+        if(blockLength == 0)
+        {
+            Platform::SleepForMilliseconds(0);
+        }
+    }
+    Platform::JoinThread(producer);
+
+    REQUIRE(allValuesCorrect);
+}
+
+TEST_CASE("SPSC: Blocks of values are read in order while another thread is overwriting them")
+{
+    SPSCRingBuffer buffer(1, 23);
+    SPSCStressTestData testData = {};
+    testData.buffer = &buffer;
+    testData.valueCount = 1 << 16;
+    testData.blockSize = 16;
+    testData.waitForSpace = false;
+
+    Platform::Thread* producer = Platform::CreateThread(spscStressProducer, &testData);
+    REQUIRE(producer != nullptr);
+
+    float lastValue = -1.0f;
+    bool allValuesIncreasing = true;
+    while(lastValue < (float)(testData.valueCount-1))
+    {
+        float xOut[5];
+        int blockLength = buffer.read(xOut, 5);
+        for(int i=0; i<blockLength; i++)
+        {
+            allValuesIncreasing &= (xOut[i] > lastValue);
+            lastValue = xOut[i];
+        }
+    }
+    Platform::JoinThread(producer);
+
+    REQUIRE(allValuesIncreasing);
+}
@@ -0,0 +1,82 @@
+#include <atomic>
+
+#include "catch.hpp"
+
+#include "platform.h"
+#include "threadpool.h"
+
+static void incrementAtomicCounter(void* data)
+{
+    std::atomic<int>* counter = (std::atomic<int>*)data;
+    (*counter)++;
+}
+
+static void slowlyIncrementAtomicCounter(void* data)
+{
+    Platform::SleepForMilliseconds(20);
+    incrementAtomicCounter(data);
+}
+
+TEST_CASE("Every task that is submitted to a thread pool gets run")
+{
+    std::atomic<int> counter(0);
+    ThreadPool pool(4, 128);
+    REQUIRE(pool.ThreadCount() == 4);
+
+    for(int i=0; i<100; i++)
+    {
+        REQUIRE(pool.Submit(incrementAtomicCounter, &counter));
+    }
+    pool.WaitForIdle();
+
+    REQUIRE(counter == 100);
+}
+
+TEST_CASE("Waiting for a thread pool to be idle waits for running tasks to finish")
+{
+    std::atomic<int> counter(0);
+    ThreadPool pool(2, 8);
+
+    REQUIRE(pool.Submit(slowlyIncrementAtomicCounter, &counter));
+    REQUIRE(pool.Submit(slowlyIncrementAtomicCounter, &counter));
+    REQUIRE(pool.Submit(slowlyIncrementAtomicCounter, &counter));
+    pool.WaitForIdle();
+
+    REQUIRE(counter == 3);
+}
+
+TEST_CASE("Destroying a thread pool runs all of the tasks that were already queued")
+{
+    std::atomic<int> counter(0);
+    {
+        ThreadPool pool(1, 8);
+        for(int i=0; i<5; i++)
+        {
+            REQUIRE(pool.Submit(slowlyIncrementAtomicCounter, &counter));
+        }
+    }
+
+    REQUIRE(counter == 5);
+}
+
+TEST_CASE("Submitting tasks fails once the thread pool's queue is full")
+{
+    std::atomic<int> counter(0);
+    ThreadPool pool(1, 2);
+
+    // NOTE: The first task may or may not have been taken off the queue by the time we submit the
+    //       others, but the worker can't take a third while it is still running the first.
+    int submittedCount = 0;
+    for(int i=0; i<4; i++)
+    {
+        if(pool.Submit(slowlyIncrementAtomicCounter, &counter))
+        {
+            submittedCount++;
+        }
+    }
+    REQUIRE(submittedCount >= 2);
+    REQUIRE(submittedCount <= 3);
+
+    pool.WaitForIdle();
+    REQUIRE(counter == submittedCount);
+}
@@ -0,0 +1,105 @@
+#include <stdint.h>
+
+#include "catch.hpp"
+#include "timerwheel.h"
+
+static void incrementCounter(void* data)
+{
+    int* counter = (int*)data;
+    (*counter)++;
+}
+
+TEST_CASE("Timers fire once they are due, but not before")
+{
+    TimerWheel wheel(10, 8, 4);
+    int fireCount = 0;
+    wheel.Schedule(1000, 25, 0, incrementCounter, &fireCount);
+
+    wheel.Advance(1020);
+    REQUIRE(fireCount == 0);
+    wheel.Advance(1029);
+    REQUIRE(fireCount == 0);
+    wheel.Advance(1030);
+    REQUIRE(fireCount == 1);
+    wheel.Advance(2000);
+    REQUIRE(fireCount == 1);
+    REQUIRE(wheel.TimerCount() == 0);
+}
+
+TEST_CASE("Periodic timers fire repeatedly until they are cancelled")
+{
+    TimerWheel wheel(10, 8, 4);
+    int fireCount = 0;
+    int timer = wheel.Schedule(0, 50, 50, incrementCounter, &fireCount);
+
+    for(uint64_t time=0; time<=500; time+=10)
+    {
+        wheel.Advance(time);
+    }
+    REQUIRE(fireCount == 10);
+
+    wheel.Cancel(timer);
+    wheel.Advance(1000);
+    REQUIRE(fireCount == 10);
+    REQUIRE(wheel.TimerCount() == 0);
+}
+
+TEST_CASE("Timers further away than a single rotation of the wheel fire at the right time")
+{
+    TimerWheel wheel(10, 4, 4);
+    int fireCount = 0;
+    wheel.Schedule(0, 95, 0, incrementCounter, &fireCount);
+
+    for(uint64_t time=0; time<100; time+=10)
+    {
+        wheel.Advance(time);
+        REQUIRE(fireCount == 0);
+    }
+    wheel.Advance(100);
+    REQUIRE(fireCount == 1);
+}
+
+TEST_CASE("Overdue timers all fire when the wheel falls far behind")
+{
+    TimerWheel wheel(10, 4, 4);
+    int fireCount = 0;
+    wheel.Schedule(0, 10, 0, incrementCounter, &fireCount);
+    wheel.Schedule(0, 30, 0, incrementCounter, &fireCount);
+    wheel.Schedule(0, 70, 0, incrementCounter, &fireCount);
+
+    wheel.Advance(10000);
+    REQUIRE(fireCount == 3);
+}
+
+TEST_CASE("The time until the next timer is reported correctly")
+{
+    TimerWheel wheel(10, 8, 4);
+    int fireCount = 0;
+
+    REQUIRE(wheel.MillisecondsUntilNextTimer(0, 1000) == 1000);
+
+    wheel.Schedule(0, 40, 0, incrementCounter, &fireCount);
+    REQUIRE(wheel.MillisecondsUntilNextTimer(0, 1000) == 40);
+    REQUIRE(wheel.MillisecondsUntilNextTimer(15, 1000) == 25);
+    REQUIRE(wheel.MillisecondsUntilNextTimer(15, 10) == 10);
+    REQUIRE(wheel.MillisecondsUntilNextTimer(50, 1000) == 0);
+
+    wheel.Schedule(0, 500, 0, incrementCounter, &fireCount);
+    wheel.Advance(40);
+    REQUIRE(fireCount == 1);
+    REQUIRE(wheel.MillisecondsUntilNextTimer(40, 1000) == 460);
+}
+
+TEST_CASE("Scheduling fails once all timers are in use")
+{
+    TimerWheel wheel(10, 8, 2);
+    int fireCount = 0;
+
+    REQUIRE(wheel.Schedule(0, 10, 0, incrementCounter, &fireCount) >= 0);
+    int timer = wheel.Schedule(0, 10, 0, incrementCounter, &fireCount);
+    REQUIRE(timer >= 0);
+    REQUIRE(wheel.Schedule(0, 10, 0, incrementCounter, &fireCount) == -1);
+
+    wheel.Cancel(timer);
+    REQUIRE(wheel.Schedule(0, 10, 0, incrementCounter, &fireCount) >= 0);
+}
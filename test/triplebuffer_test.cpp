@@ -0,0 +1,102 @@
+#include "catch.hpp"
+
+#include "platform.h"
+#include "triplebuffer.h"
+
+TEST_CASE("TripleBuffer: Nothing new is read before anything is published")
+{
+    TripleBuffer buffer(4);
+    REQUIRE_FALSE(buffer.UpdateReadBuffer());
+    REQUIRE(buffer.ReadBuffer() != buffer.WriteBuffer());
+}
+
+TEST_CASE("TripleBuffer: Published data is read back")
+{
+    TripleBuffer buffer(4);
+    buffer.WriteBuffer()[0] = 42;
+    buffer.PublishWriteBuffer();
+
+    REQUIRE(buffer.UpdateReadBuffer());
+    REQUIRE(buffer.ReadBuffer()[0] == 42);
+    REQUIRE_FALSE(buffer.UpdateReadBuffer());
+    REQUIRE(buffer.ReadBuffer()[0] == 42);
+}
+
+TEST_CASE("TripleBuffer: Only the latest published data is read")
+{
+    TripleBuffer buffer(4);
+    for(uint8_t i=1; i<=5; i++)
+    {
+        buffer.WriteBuffer()[0] = i;
+        buffer.PublishWriteBuffer();
+    }
+
+    REQUIRE(buffer.UpdateReadBuffer());
+    REQUIRE(buffer.ReadBuffer()[0] == 5);
+}
+
+TEST_CASE("TripleBuffer: The producer never writes into the buffer that is being read")
+{
+    TripleBuffer buffer(4);
+    buffer.WriteBuffer()[0] = 1;
+    buffer.PublishWriteBuffer();
+    REQUIRE(buffer.UpdateReadBuffer());
+    uint8_t* readBuffer = buffer.ReadBuffer();
+
+    for(uint8_t i=2; i<10; i++)
+    {
+        REQUIRE(buffer.WriteBuffer() != readBuffer);
+        buffer.WriteBuffer()[0] = i;
+        buffer.PublishWriteBuffer();
+    }
+    REQUIRE(readBuffer[0] == 1);
+}
+
+struct TripleBufferTestData
+{
+    TripleBuffer* buffer;
+    int publishCount;
+};
+
+static int publishCountingBuffers(void* data)
+{
+    TripleBufferTestData* testData = (TripleBufferTestData*)data;
+    int bufferSize = testData->buffer->BufferSize();
+    for(int i=1; i<=testData->publishCount; i++)
+    {
+        uint8_t* writeBuffer = testData->buffer->WriteBuffer();
+        for(int j=0; j<bufferSize; j++)
+        {
+            writeBuffer[j] = (uint8_t)i;
+        }
+        testData->buffer->PublishWriteBuffer();
+    }
+    return 0;
+}
+
+TEST_CASE("TripleBuffer: Buffers published from another thread are always read whole and in order")
+{
+    TripleBuffer buffer(256);
+    TripleBufferTestData testData = {&buffer, 200};
+    Platform::Thread* producer = Platform::CreateThread(publishCountingBuffers, &testData);
+    REQUIRE(producer != nullptr);
+
+    bool consistent = true;
+    int lastValue = 0;
+    while(lastValue < testData.publishCount)
+    {
+        if(!buffer.UpdateReadBuffer())
+            continue;
+
+        uint8_t* readBuffer = buffer.ReadBuffer();
+        for(int j=1; j<buffer.BufferSize(); j++)
+        {
+            consistent = consistent && (readBuffer[j] == readBuffer[0]);
+        }
+        consistent = consistent && (readBuffer[0] > lastValue);
+        lastValue = readBuffer[0];
+    }
+    Platform::JoinThread(producer);
+
+    REQUIRE(consistent);
+}
@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "catch.hpp"
+
+#include "video_convert.h"
+
+// NOTE: An odd width that isn't a multiple of any SIMD block size, so that we also test the
+//       scalar handling of the end of each row.
+static const int TEST_IMAGE_WIDTH = 37;
+static const int TEST_IMAGE_HEIGHT = 5;
+static const int TEST_RGB_STRIDE = 3*TEST_IMAGE_WIDTH + 5;
+static const int TEST_PLANE_STRIDE = TEST_IMAGE_WIDTH + 3;
+
+static void fillRandom(uint8* data, int length)
+{
+    for(int i=0; i<length; i++)
+    {
+        data[i] = (uint8)(rand() & 0xFF);
+    }
+}
+
+static void convertRGBWithKernel(VideoConvertKernel kernel, const uint8* rgb, uint8* planes)
+{
+    REQUIRE(videoConvertSetKernel(kernel));
+    int planeSize = TEST_PLANE_STRIDE*TEST_IMAGE_HEIGHT;
+    VideoPlane yPlane = {planes, TEST_PLANE_STRIDE};
+    VideoPlane cbPlane = {planes + planeSize, TEST_PLANE_STRIDE};
+    VideoPlane crPlane = {planes + 2*planeSize, TEST_PLANE_STRIDE};
+    convertRGBToYCbCr444(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, rgb, TEST_RGB_STRIDE,
+                         yPlane, cbPlane, crPlane);
+}
+
+static void convertYCbCrWithKernel(VideoConvertKernel kernel, uint8* planes, uint8* rgb)
+{
+    REQUIRE(videoConvertSetKernel(kernel));
+    int planeSize = TEST_PLANE_STRIDE*TEST_IMAGE_HEIGHT;
+    VideoPlane yPlane = {planes, TEST_PLANE_STRIDE};
+    VideoPlane cbPlane = {planes + planeSize, TEST_PLANE_STRIDE};
+    VideoPlane crPlane = {planes + 2*planeSize, TEST_PLANE_STRIDE};
+    convertYCbCr444ToRGB(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, yPlane, cbPlane, crPlane,
+                         rgb, TEST_RGB_STRIDE);
+}
+
+TEST_CASE("RGB to Y'CbCr maps black and white to the ends of the studio range")
+{
+    uint8 rgb[2*3] = {0,0,0, 255,255,255};
+    uint8 y[2];
+    uint8 cb[2];
+    uint8 cr[2];
+    VideoPlane yPlane = {y, 2};
+    VideoPlane cbPlane = {cb, 2};
+    VideoPlane crPlane = {cr, 2};
+    REQUIRE(videoConvertSetKernel(VideoConvertKernel::Scalar));
+    convertRGBToYCbCr444(2, 1, rgb, 6, yPlane, cbPlane, crPlane);
+
+    REQUIRE(y[0] == 16);
+    REQUIRE(y[1] == 235);
+    REQUIRE(cb[0] == 128);
+    REQUIRE(cb[1] == 128);
+    REQUIRE(cr[0] == 128);
+    REQUIRE(cr[1] == 128);
+
+    uint8 roundTrip[2*3];
+    convertYCbCr444ToRGB(2, 1, yPlane, cbPlane, crPlane, roundTrip, 6);
+    REQUIRE(memcmp(rgb, roundTrip, sizeof(rgb)) == 0);
+}
+
+TEST_CASE("SIMD video conversion kernels match the scalar kernel exactly")
+{
+    const int rgbSize = TEST_RGB_STRIDE*TEST_IMAGE_HEIGHT;
+    const int planesSize = 3*TEST_PLANE_STRIDE*TEST_IMAGE_HEIGHT;
+    uint8* rgb = new uint8[rgbSize];
+    uint8* planes = new uint8[planesSize];
+    uint8* expected = new uint8[rgbSize > planesSize ? rgbSize : planesSize];
+    uint8* actual = new uint8[rgbSize > planesSize ? rgbSize : planesSize];
+    srand(1234);
+    fillRandom(rgb, rgbSize);
+    fillRandom(planes, planesSize);
+
+    VideoConvertKernel kernels[] = { VideoConvertKernel::SSE2, VideoConvertKernel::AVX2 };
+    for(VideoConvertKernel kernel : kernels)
+    {
+        if(!videoConvertSetKernel(kernel))
+            continue;
+
+        memset(expected, 0, planesSize);
+        memset(actual, 0, planesSize);
+        convertRGBWithKernel(VideoConvertKernel::Scalar, rgb, expected);
+        convertRGBWithKernel(kernel, rgb, actual);
+        REQUIRE(memcmp(expected, actual, planesSize) == 0);
+
+        memset(expected, 0, rgbSize);
+        memset(actual, 0, rgbSize);
+        convertYCbCrWithKernel(VideoConvertKernel::Scalar, planes, expected);
+        convertYCbCrWithKernel(kernel, planes, actual);
+        REQUIRE(memcmp(expected, actual, rgbSize) == 0);
+    }
+
+    REQUIRE(videoConvertSetKernel(videoConvertBestKernel()));
+    delete[] rgb;
+    delete[] planes;
+    delete[] expected;
+    delete[] actual;
+}
+
+TEST_CASE("RGB to Y'CbCr 4:2:0 averages the chroma of each 2x2 block of pixels")
+{
+    const int width = 20;
+    const int height = 4;
+    uint8 rgb[3*width*height];
+    srand(5678);
+    fillRandom(rgb, sizeof(rgb));
+
+    uint8 fullY[width*height];
+    uint8 fullCb[width*height];
+    uint8 fullCr[width*height];
+    VideoPlane fullYPlane = {fullY, width};
+    VideoPlane fullCbPlane = {fullCb, width};
+    VideoPlane fullCrPlane = {fullCr, width};
+    convertRGBToYCbCr444(width, height, rgb, 3*width, fullYPlane, fullCbPlane, fullCrPlane);
+
+    uint8 y[width*height];
+    uint8 cb[(width/2)*(height/2)];
+    uint8 cr[(width/2)*(height/2)];
+    VideoPlane yPlane = {y, width};
+    VideoPlane cbPlane = {cb, width/2};
+    VideoPlane crPlane = {cr, width/2};
+    convertRGBToYCbCr420(width, height, rgb, 3*width, yPlane, cbPlane, crPlane);
+
+    REQUIRE(memcmp(y, fullY, sizeof(y)) == 0);
+    for(int row=0; row<height/2; row++)
+    {
+        for(int col=0; col<width/2; col++)
+        {
+            int topLeft = 2*row*width + 2*col;
+            int expectedCb = (fullCb[topLeft] + fullCb[topLeft+1] +
+                              fullCb[topLeft+width] + fullCb[topLeft+width+1] + 2)/4;
+            int expectedCr = (fullCr[topLeft] + fullCr[topLeft+1] +
+                              fullCr[topLeft+width] + fullCr[topLeft+width+1] + 2)/4;
+            REQUIRE(cb[row*(width/2) + col] == expectedCb);
+            REQUIRE(cr[row*(width/2) + col] == expectedCr);
+        }
+    }
+}
+
+TEST_CASE("Y'CbCr 4:2:0 to RGB uses each chroma sample for a 2x2 block of pixels")
+{
+    const int width = 20;
+    const int height = 4;
+    uint8 y[width*height];
+    uint8 cb[(width/2)*(height/2)];
+    uint8 cr[(width/2)*(height/2)];
+    srand(91011);
+    fillRandom(y, sizeof(y));
+    fillRandom(cb, sizeof(cb));
+    fillRandom(cr, sizeof(cr));
+    VideoPlane yPlane = {y, width};
+    VideoPlane cbPlane = {cb, width/2};
+    VideoPlane crPlane = {cr, width/2};
+
+    uint8 fullCb[width*height];
+    uint8 fullCr[width*height];
+    for(int row=0; row<height; row++)
+    {
+        for(int col=0; col<width; col++)
+        {
+            fullCb[row*width + col] = cb[(row/2)*(width/2) + col/2];
+            fullCr[row*width + col] = cr[(row/2)*(width/2) + col/2];
+        }
+    }
+    VideoPlane fullCbPlane = {fullCb, width};
+    VideoPlane fullCrPlane = {fullCr, width};
+
+    uint8 expected[3*width*height];
+    uint8 actual[3*width*height];
+    convertYCbCr444ToRGB(width, height, yPlane, fullCbPlane, fullCrPlane, expected, 3*width);
+    convertYCbCr420ToRGB(width, height, yPlane, cbPlane, crPlane, actual, 3*width);
+    REQUIRE(memcmp(expected, actual, sizeof(expected)) == 0);
+}
+
+TEST_CASE("YUYV to Y'CbCr 4:2:0 averages blocks of pixels when downscaling")
+{
+    // A 4x4 YUYV image, which gets downscaled to 2x2 with a single chroma sample
+    const int width = 4;
+    const int height = 4;
+    uint8 yuyv[2*width*height];
+    for(int row=0; row<height; row++)
+    {
+        for(int pair=0; pair<width/2; pair++)
+        {
+            uint8* pixelPair = yuyv + row*2*width + 4*pair;
+            pixelPair[0] = (uint8)(10*row + 4*pair);
+            pixelPair[1] = (uint8)(100 + row);
+            pixelPair[2] = (uint8)(10*row + 4*pair + 2);
+            pixelPair[3] = (uint8)(200 - row);
+        }
+    }
+
+    uint8 y[4];
+    uint8 cb[1];
+    uint8 cr[1];
+    VideoPlane yPlane = {y, 2};
+    VideoPlane cbPlane = {cb, 1};
+    VideoPlane crPlane = {cr, 1};
+    convertYUYVToYCbCr420(width, height, yuyv, 2*width, 2, yPlane, cbPlane, crPlane);
+
+    // Each output Y' is the (rounded) mean of the 2x2 block: (a + (a+2) + (a+10) + (a+12))/4
+    REQUIRE(y[0] == 6);
+    REQUIRE(y[1] == 10);
+    REQUIRE(y[2] == 26);
+    REQUIRE(y[3] == 30);
+    REQUIRE(cb[0] == 102); // Mean of 100,100,101,101,102,102,103,103 rounded
+    REQUIRE(cr[0] == 199); // Mean of 200,200,199,199,198,198,197,197 rounded
+}
+
+TEST_CASE("NV12 to Y'CbCr 4:2:0 without downscaling just separates the chroma planes")
+{
+    const int width = 4;
+    const int height = 2;
+    uint8 inputY[width*height] = {1,2,3,4, 5,6,7,8};
+    uint8 inputCbCr[width] = {10,20, 30,40};
+    VideoPlane inputYPlane = {inputY, width};
+    VideoPlane inputCbCrPlane = {inputCbCr, width};
+
+    uint8 y[width*height];
+    uint8 cb[2];
+    uint8 cr[2];
+    VideoPlane yPlane = {y, width};
+    VideoPlane cbPlane = {cb, 2};
+    VideoPlane crPlane = {cr, 2};
+    convertNV12ToYCbCr420(width, height, inputYPlane, inputCbCrPlane, 1, yPlane, cbPlane, crPlane);
+
+    REQUIRE(memcmp(y, inputY, sizeof(y)) == 0);
+    REQUIRE(cb[0] == 10);
+    REQUIRE(cb[1] == 30);
+    REQUIRE(cr[0] == 20);
+    REQUIRE(cr[1] == 40);
+}
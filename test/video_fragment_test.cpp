@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "catch.hpp"
+#include "video_fragment.h"
+
+static void fillFrame(uint8_t* frame, int length, uint8_t seed)
+{
+    for(int i=0; i<length; i++)
+    {
+        frame[i] = (uint8_t)(seed + 7*i);
+    }
+}
+
+static bool addFragment(VideoFrameAssembler& assembler, uint8_t frameIndex, uint8_t fragmentIndex,
+                        const uint8_t* frame, int frameLength, double time)
+{
+    uint8_t fragmentCount = (uint8_t)videoFragmentCount(frameLength);
+    int offset = fragmentIndex * VIDEO_FRAGMENT_PAYLOAD_BYTES;
+    int length = frameLength - offset;
+    if(length > VIDEO_FRAGMENT_PAYLOAD_BYTES)
+        length = VIDEO_FRAGMENT_PAYLOAD_BYTES;
+    return assembler.Add(frameIndex, fragmentIndex, fragmentCount, (uint16_t)length, frame + offset, time);
+}
+
+TEST_CASE("Frames are split into MTU-sized fragments")
+{
+    REQUIRE(videoFragmentCount(0) == 1);
+    REQUIRE(videoFragmentCount(1) == 1);
+    REQUIRE(videoFragmentCount(VIDEO_FRAGMENT_PAYLOAD_BYTES) == 1);
+    REQUIRE(videoFragmentCount(VIDEO_FRAGMENT_PAYLOAD_BYTES+1) == 2);
+    REQUIRE(videoFragmentCount(VIDEO_FRAME_MAX_BYTES) == VIDEO_FRAGMENT_MAX_COUNT);
+}
+
+TEST_CASE("A frame is reassembled from fragments received out of order")
+{
+    const int frameLength = 3*VIDEO_FRAGMENT_PAYLOAD_BYTES + 123;
+    uint8_t frame[frameLength];
+    fillFrame(frame, frameLength, 1);
+
+    VideoFrameAssembler assembler;
+    REQUIRE_FALSE(addFragment(assembler, 5, 2, frame, frameLength, 0.0));
+    REQUIRE_FALSE(addFragment(assembler, 5, 3, frame, frameLength, 0.0));
+    REQUIRE_FALSE(addFragment(assembler, 5, 0, frame, frameLength, 0.0));
+    REQUIRE_FALSE(addFragment(assembler, 5, 0, frame, frameLength, 0.0)); // Duplicate
+    REQUIRE(addFragment(assembler, 5, 1, frame, frameLength, 0.0));
+
+    uint8_t* output = nullptr;
+    REQUIRE(assembler.GetFrame(&output) == frameLength);
+    REQUIRE(memcmp(output, frame, frameLength) == 0);
+    REQUIRE(assembler.LastFrameIndex() == 5);
+    REQUIRE(assembler.DroppedFrameCount() == 0);
+}
+
+TEST_CASE("Incomplete frames are dropped when they time out")
+{
+    const int frameLength = 2*VIDEO_FRAGMENT_PAYLOAD_BYTES;
+    uint8_t frame[frameLength];
+    fillFrame(frame, frameLength, 2);
+
+    VideoFrameAssembler assembler(0.5);
+    REQUIRE_FALSE(addFragment(assembler, 1, 0, frame, frameLength, 0.0));
+    REQUIRE_FALSE(addFragment(assembler, 1, 1, frame, frameLength, 1.0));
+    REQUIRE(assembler.DroppedFrameCount() == 1);
+
+    // The late fragment started a new attempt at the frame, which can still be completed
+    REQUIRE(addFragment(assembler, 1, 0, frame, frameLength, 1.1));
+    REQUIRE(assembler.DroppedFrameCount() == 1);
+}
+
+TEST_CASE("Incomplete frames are dropped when a later frame is completed")
+{
+    const int frameLength = 2*VIDEO_FRAGMENT_PAYLOAD_BYTES;
+    uint8_t frame[frameLength];
+    fillFrame(frame, frameLength, 3);
+
+    VideoFrameAssembler assembler;
+    REQUIRE_FALSE(addFragment(assembler, 1, 0, frame, frameLength, 0.0));
+    REQUIRE_FALSE(addFragment(assembler, 2, 0, frame, frameLength, 0.0));
+    REQUIRE(addFragment(assembler, 2, 1, frame, frameLength, 0.0));
+    REQUIRE(assembler.LastFrameIndex() == 2);
+    REQUIRE(assembler.DroppedFrameCount() == 1);
+
+    // Frame 1 can no longer be returned, since frame 2 has already been returned
+    REQUIRE_FALSE(addFragment(assembler, 1, 1, frame, frameLength, 0.0));
+}
+
+TEST_CASE("Frame indices are compared correctly across overflow")
+{
+    const int frameLength = 10;
+    uint8_t frame[frameLength];
+    fillFrame(frame, frameLength, 4);
+
+    VideoFrameAssembler assembler;
+    REQUIRE(addFragment(assembler, 254, 0, frame, frameLength, 0.0));
+    REQUIRE(addFragment(assembler, 255, 0, frame, frameLength, 0.0));
+    REQUIRE(addFragment(assembler, 0, 0, frame, frameLength, 0.0));
+    REQUIRE(addFragment(assembler, 1, 0, frame, frameLength, 0.0));
+    REQUIRE_FALSE(addFragment(assembler, 255, 0, frame, frameLength, 0.0));
+    REQUIRE(assembler.LastFrameIndex() == 1);
+}
+
+TEST_CASE("Invalid fragments are rejected")
+{
+    uint8_t data[VIDEO_FRAGMENT_PAYLOAD_BYTES+1] = {};
+    VideoFrameAssembler assembler;
+
+    REQUIRE_FALSE(assembler.Add(1, 0, 0, 10, data, 0.0));
+    REQUIRE_FALSE(assembler.Add(1, 2, 2, 10, data, 0.0));
+    REQUIRE_FALSE(assembler.Add(1, 0, 1, VIDEO_FRAGMENT_PAYLOAD_BYTES+1, data, 0.0));
+    REQUIRE_FALSE(assembler.Add(1, 0, 2, 10, data, 0.0)); // Only the last fragment can be short
+
+    REQUIRE_FALSE(assembler.Add(1, 0, 2, VIDEO_FRAGMENT_PAYLOAD_BYTES, data, 0.0));
+    REQUIRE_FALSE(assembler.Add(1, 1, 3, VIDEO_FRAGMENT_PAYLOAD_BYTES, data, 0.0)); // Inconsistent fragment count
+    REQUIRE(assembler.Add(1, 1, 2, 10, data, 0.0));
+}
+
+TEST_CASE("Frames are received again after a gap of more than half the index range")
+{
+    const int frameLength = 10;
+    uint8_t frame[frameLength];
+    fillFrame(frame, frameLength, 5);
+
+    VideoFrameAssembler assembler(0.5);
+    REQUIRE(addFragment(assembler, 10, 0, frame, frameLength, 0.0));
+    REQUIRE(addFragment(assembler, 11, 0, frame, frameLength, 0.1));
+
+    SECTION("The next frame is far behind the last completed frame")
+    {
+        // NOTE: 11 + 150 wraps around to 161, which looks like it is 106 frames behind frame 11
+        REQUIRE(addFragment(assembler, 161, 0, frame, frameLength, 0.2));
+        REQUIRE(assembler.LastFrameIndex() == 161);
+        REQUIRE(addFragment(assembler, 162, 0, frame, frameLength, 0.3));
+        REQUIRE_FALSE(addFragment(assembler, 161, 0, frame, frameLength, 0.3));
+    }
+
+    SECTION("The next frame is only a little behind, but much later")
+    {
+        // NOTE: After 250 frames, frame 5 looks like it is only 6 frames behind frame 11
+        REQUIRE(addFragment(assembler, 5, 0, frame, frameLength, 15.0));
+        REQUIRE(assembler.LastFrameIndex() == 5);
+        REQUIRE(addFragment(assembler, 6, 0, frame, frameLength, 15.1));
+    }
+
+    SECTION("A slightly late frame is still rejected")
+    {
+        REQUIRE_FALSE(addFragment(assembler, 10, 0, frame, frameLength, 0.2));
+        REQUIRE(assembler.LastFrameIndex() == 11);
+    }
+}